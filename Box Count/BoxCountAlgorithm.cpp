@@ -2,10 +2,86 @@
 
 
 #include "BoxCountAlgorithm.h"
+#include "../Terrain Core/FractalDimension.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
 #include "Logging/LogMacros.h"
 #include "GameFramework/Actor.h"
 
 
+// settings of the terrain core for the given parameters
+static TerrainCore::FractalDimensionSettings MakeFractalDimensionSettings(float cellSize, float heightScale, float boxSize, int depth)
+{
+	TerrainCore::FractalDimensionSettings settings;
+	settings.CellSize = cellSize;
+	settings.HeightScale = heightScale;
+	settings.BoxSize = boxSize;
+	settings.Depth = depth;
+	return settings;
+}
+
+// converts the measurements of the terrain core for blueprint
+static TArray<FFractalDimensionResult> ToFractalDimensionResults(const std::vector<TerrainCore::FractalDimensionResult>& measurements)
+{
+	TArray<FFractalDimensionResult> results;
+	results.Reserve(static_cast<int32>(measurements.size()));
+	for (const auto& measurement : measurements)
+	{
+		FFractalDimensionResult& result = results.AddDefaulted_GetRef();
+		result.Dimension = measurement.Fit.Dimension;
+		result.RSquared = measurement.Fit.RSquared;
+		for (const auto& point : measurement.Points)
+		{
+			result.LogSizes.Add(point.LogSize);
+			result.LogRatios.Add(point.LogRatio);
+		}
+		// the core stores the first depth last
+		for (auto collisions = measurement.Counts.Collisions.rbegin(); collisions != measurement.Counts.Collisions.rend(); ++collisions)
+			result.Collisions.Add(*collisions);
+	}
+	return results;
+}
+
+TFuture<TTerrainTaskResult<TArray<FFractalDimensionResult>>> UBoxCountAlgorithm::MeasureFractalDimensionsAsync(const TArray<UTerrainHeightfield*>& heightfields, float cellSize, float heightScale, float boxSize, int depth, TFunction<void(TTerrainTaskResult<TArray<FFractalDimensionResult>>)> onFinished, FTerrainTaskControlPtr control)
+{
+	control = RestartTerrainTask(m_AsyncMeasurement, control);
+	auto settings = MakeFractalDimensionSettings(cellSize, heightScale, boxSize, depth);
+
+	// the worker measures float copies, missing heightfields stay empty maps so the results keep their order
+	std::vector<TerrainCore::Heightfield> maps(heightfields.Num());
+	for (int32 i = 0; i < heightfields.Num(); ++i)
+	{
+		if (heightfields[i])
+			heightfields[i]->CopyHeightsTo(maps[i]);
+	}
+
+	auto work = [settings, maps = MoveTemp(maps)](TerrainCore::TaskControl& taskControl)
+	{
+		std::vector<TerrainCore::ConstHeightfieldView> views;
+		views.reserve(maps.size());
+		for (const auto& map : maps)
+			views.push_back(map.GetView());
+
+		auto startTime = FPlatformTime::Cycles();
+		auto measurements = TerrainCore::MeasureFractalDimensions(views, settings, &taskControl);
+
+		auto compTime = FPlatformTime::Cycles() - startTime;
+		UE_LOG(LogTemp, Warning, TEXT("CompTime async fractal dimension of %d heightfields: %f"), static_cast<int32>(maps.size()), FPlatformTime::ToMilliseconds(compTime));
+		return ToFractalDimensionResults(measurements);
+	};
+	return LaunchTerrainTask<TArray<FFractalDimensionResult>>(control, MoveTemp(work), MoveTemp(onFinished));
+}
+
+void UBoxCountAlgorithm::CancelAsyncMeasurement()
+{
+	if (m_AsyncMeasurement)
+		m_AsyncMeasurement->Cancel();
+}
+
+float UBoxCountAlgorithm::GetAsyncMeasurementProgress() const
+{
+	return m_AsyncMeasurement ? m_AsyncMeasurement->GetProgress() : 0.f;
+}
+
 // Sets default values for this component's properties
 UBoxCountAlgorithm::UBoxCountAlgorithm()
 {
@@ -22,46 +98,13 @@ void UBoxCountAlgorithm::BeginPlay()
 	
 }
 
-
-void UBoxCountAlgorithm::SplitCube(int depth, float boxSize, FVector position, UBoxComponent* box)
+void UBoxCountAlgorithm::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	// decreases depth
-	depth--;
-	// if depth smaller or equal to 0, escape
-	if (depth <= 0)
-		return;
-
-	// decrease boxsize
-	boxSize *= 0.5f;
-
-	// loop that splits box into 4 boxes
-	for (size_t x = 0; x < 2; x++)
-	{
-		for (size_t y = 0; y < 2; y++)
-		{
-			for (size_t z = 0; z < 2; z++)
-			{
-				// get current box position
-				auto currentBoxPosition = FVector(position.X + boxSize * x, position.Y + boxSize * y, position.Z + boxSize * z);
-
-				// change box extent and world location
-				box->SetBoxExtent(FVector(boxSize * 0.5f, boxSize * 0.5f, boxSize * 0.5f));
-				box->SetWorldLocation(FVector(currentBoxPosition.X + boxSize * 0.5f, currentBoxPosition.Y + boxSize * 0.5f, currentBoxPosition.Z + boxSize * 0.5f));
-
-				// update overlaps and check if box overlaps with terrain
-				box->UpdateOverlaps();
-				auto isoverlapping = box->IsOverlappingComponent(m_pProceduralMeshComponent);
-				if (isoverlapping)
-				{
-					// if overlaps add to the collision count within this depth, split cube again
-					m_Collisions[depth - 1] += 1;
-					SplitCube(depth, boxSize, currentBoxPosition, box);
-				}
-			}
-		}
-	}
+	CancelAsyncMeasurement();
+	Super::EndPlay(EndPlayReason);
 }
 
+
 // Called every frame
 void UBoxCountAlgorithm::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
@@ -78,71 +121,89 @@ void UBoxCountAlgorithm::SetBoxes(float boxSize, int depth)
 	box->SetupAttachment(GetOwner()->GetRootComponent());
 	box->RegisterComponent();
 
-	// reset collision list
-	m_Collisions.Empty();
-	m_Collisions.SetNum(depth);
-	for (auto collision : m_Collisions)
-		collision = 0;
+	// calculate bounds of mesh
+	auto meshBox = m_pProceduralMeshComponent->CalcBounds(m_pProceduralMeshComponent->GetComponentTransform()).GetBox();
+	TerrainCore::BoxCountBounds bounds;
+	bounds.MinX = meshBox.Min.X;
+	bounds.MinY = meshBox.Min.Y;
+	bounds.MinZ = meshBox.Min.Z;
+	bounds.MaxX = meshBox.Max.X;
+	bounds.MaxY = meshBox.Max.Y;
+	bounds.MaxZ = meshBox.Max.Z;
+
+	// moves the collision box to the requested box and checks if it overlaps with the terrain
+	auto overlapTest = [this, box](const TerrainCore::CountBox& countBox)
+	{
+		float halfSize = countBox.Size * 0.5f;
+		box->SetBoxExtent(FVector(halfSize, halfSize, halfSize));
+		box->SetWorldLocation(FVector(countBox.X + halfSize, countBox.Y + halfSize, countBox.Z + halfSize));
+		box->UpdateOverlaps();
+		return box->IsOverlappingComponent(m_pProceduralMeshComponent);
+	};
+	StoreResult(TerrainCore::CountBoxes(bounds, boxSize, depth, overlapTest));
+
+	// destroy collision box
+	box->DestroyComponent();
+}
+
+void UBoxCountAlgorithm::SetBoxesOnHeightfield(UTerrainHeightfield* heightfield, float cellSize, float heightScale, float boxSize, int depth)
+{
+	if (!heightfield)
+		return;
 
-	// calculate bounds of mesh and starting position
-	auto meshBox = m_pProceduralMeshComponent->CalcBounds(m_pProceduralMeshComponent->GetComponentTransform());
-	auto meshBounds = meshBox.GetBox().Max - meshBox.GetBox().Min;
-	auto position = meshBox.GetBox().Min;
+	// counts come from a min/max pyramid of the heights, no physics queries needed
+	auto startTime = FPlatformTime::Cycles();
+	if (heightfield->IsQuantized())
+		StoreResult(TerrainCore::CountHeightfieldBoxes(heightfield->GetQuantizedView(), cellSize, heightScale, boxSize, depth));
+	else
+		StoreResult(TerrainCore::CountHeightfieldBoxes(heightfield->GetView(), cellSize, heightScale, boxSize, depth));
 
-	int dimensionsX = FMath::CeilToInt(meshBounds.X / boxSize);
-	int dimensionsY = FMath::CeilToInt(meshBounds.Y / boxSize);
-	int dimensionsZ = FMath::CeilToInt(meshBounds.Z / boxSize);
+	// computational time gets measured and logged
+	auto compTime = FPlatformTime::Cycles() - startTime;
+	UE_LOG(LogTemp, Warning, TEXT("CompTime box count: %f"), FPlatformTime::ToMilliseconds(compTime));
+}
 
+void UBoxCountAlgorithm::StoreResult(const TerrainCore::BoxCountResult& result)
+{
+	// store collision list
+	m_Collisions = TArray<int>(result.Collisions.data(), static_cast<int32>(result.Collisions.size()));
 
-	// used to reset to initial position after loop
-	auto defaultPosition = position;
+	// itterate over all collisions and log data
+	auto points = result.GetLogPoints();
+	for (const auto& point : points)
+		UE_LOG(LogTemp, Warning, TEXT("Log(Size): %f, Log(Ratio): %f"), point.LogSize, point.LogRatio);
 
-	defaultPosition.X -= (dimensionsX * boxSize - meshBounds.X) / 2.f;
-	defaultPosition.Y -= (dimensionsY * boxSize - meshBounds.Y) / 2.f;
-	defaultPosition.Z -= (dimensionsZ * boxSize - meshBounds.Z) / 2.f;
-	auto currentPosition = defaultPosition;
+	auto fit = TerrainCore::FitFractalDimension(points);
+	UE_LOG(LogTemp, Warning, TEXT("Fractal dimension: %f, R2: %f"), fit.Dimension, fit.RSquared);
+}
 
-	// calculate total boxes on first depth
-	int totalBoxes = dimensionsX * dimensionsY * dimensionsZ;
-	for (size_t x = 0; x < dimensionsX; ++x)
+TArray<FFractalDimensionResult> UBoxCountAlgorithm::MeasureFractalDimensions(const TArray<UTerrainHeightfield*>& heightfields, float cellSize, float heightScale, float boxSize, int depth)
+{
+	// Missing heightfields are measured as empty maps so the results keep their order. A batch is measured with one
+	// storage, quantized heightfields get measured through float copies.
+	std::vector<TerrainCore::Heightfield> copies(heightfields.Num());
+	std::vector<TerrainCore::ConstHeightfieldView> maps;
+	maps.reserve(heightfields.Num());
+	for (int32 i = 0; i < heightfields.Num(); ++i)
 	{
-		for (size_t y = 0; y < dimensionsY; ++y)
+		if (heightfields[i] && heightfields[i]->IsQuantized())
 		{
-			for (size_t z = 0; z < dimensionsZ; ++z)
-			{
-				// change box extent and set world location
-				box->SetBoxExtent(FVector(boxSize * 0.5f, boxSize * 0.5f, boxSize * 0.5f));
-				box->SetWorldLocation(FVector(currentPosition.X + boxSize * 0.5f, currentPosition.Y + boxSize * 0.5f, currentPosition.Z + boxSize * 0.5f));
-
-				//update and check overlaps
-				box->UpdateOverlaps();
-				auto isoverlapping = box->IsOverlappingComponent(m_pProceduralMeshComponent);
-				if (isoverlapping)
-				{
-					// add to collision and split cube
-					m_Collisions[depth - 1] += 1;
-					SplitCube(depth, boxSize, currentPosition, box);
-				}
-
-				currentPosition.Z += boxSize;
-			}
-			currentPosition.Z = defaultPosition.Z;
-			currentPosition.Y += boxSize;
+			heightfields[i]->CopyHeightsTo(copies[i]);
+			maps.push_back(copies[i].GetView());
 		}
-		currentPosition.Y = defaultPosition.Y;
-		currentPosition.X += boxSize;
+		else
+			maps.push_back(heightfields[i] ? heightfields[i]->GetView() : TerrainCore::ConstHeightfieldView());
 	}
 
-	// itterate over all collisions and log data
-	for (int i = 1; i <= m_Collisions.Num(); ++i)
-	{
-		float ratio = (float)m_Collisions[depth - i] / (float)totalBoxes;
-		UE_LOG(LogTemp, Warning, TEXT("Log(Size): %f, Log(Ratio): %f"), FMath::Loge(1.f / boxSize), FMath::Loge(ratio));
-		totalBoxes *= 8;
-		boxSize *= 0.5;
-	}
-	// destroy collision box
-	box->DestroyComponent();
+	// Used to calculate computational time
+	auto startTime = FPlatformTime::Cycles();
+	auto measurements = TerrainCore::MeasureFractalDimensions(maps, MakeFractalDimensionSettings(cellSize, heightScale, boxSize, depth));
+
+	// computational time gets measured and logged
+	auto compTime = FPlatformTime::Cycles() - startTime;
+	UE_LOG(LogTemp, Warning, TEXT("CompTime fractal dimension of %d heightfields: %f"), heightfields.Num(), FPlatformTime::ToMilliseconds(compTime));
+
+	return ToFractalDimensionResults(measurements);
 }
 
 void UBoxCountAlgorithm::DrawBoxes()
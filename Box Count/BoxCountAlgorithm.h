@@ -6,8 +6,38 @@
 #include "Components/ActorComponent.h"
 #include "ProceduralMeshComponent.h"
 #include "Components/BoxComponent.h"
+#include "../Terrain Core/BoxCountKernel.h"
+#include "../Terrain Async/TerrainAsyncTask.h"
 #include "BoxCountAlgorithm.generated.h"
 
+//fractal dimension of one terrain, measured with box counting
+USTRUCT(BlueprintType)
+struct FFractalDimensionResult
+{
+	GENERATED_BODY()
+
+	// least squares fitted box counting dimension
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float Dimension = 0.f;
+
+	// quality of the fit, 1 means every point is on the line
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float RSquared = 0.f;
+
+	// points of the fractal dimension plot, starting at the first depth
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<float> LogSizes;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<float> LogRatios;
+
+	// collision count per depth, starting at the first depth
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<int32> Collisions;
+};
+
+class UTerrainHeightfield;
+
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class PROCEDURALTERRAIN_API UBoxCountAlgorithm : public UActorComponent
 {
@@ -20,6 +50,8 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	// cancels the async measurement that is still running
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Procedural Mesh")
 	UProceduralMeshComponent* m_pProceduralMeshComponent;
@@ -31,8 +63,11 @@ protected:
 	// list that keeps track of collision count
 	TArray<int> m_Collisions;
 
-	// helper function that splits cube into 8 cubes(recursive)
-	void SplitCube(int depth, float boxSize, FVector position, UBoxComponent* box);
+	// stores the collision counts and logs the data for fractal dimension plotting
+	void StoreResult(const TerrainCore::BoxCountResult& result);
+
+	// async measurement that is running
+	FTerrainTaskControlPtr m_AsyncMeasurement;
 public:	
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
@@ -41,6 +76,29 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "BoxCounting")
 	void SetBoxes(float boxSize, int depth);
 
+	// same as SetBoxes but measures the surface of a shared heightfield instead of the mesh, counts all depths from a
+	// min/max pyramid of the heights in milliseconds
+	UFUNCTION(BlueprintCallable, Category = "BoxCounting")
+	void SetBoxesOnHeightfield(UTerrainHeightfield* heightfield, float cellSize, float heightScale, float boxSize, int depth);
+
+	// Measures a batch of heightfields on every core, results are in the same order as the heightfields. A heightScale or
+	// boxSize of 0 scales the heights to the width of the map and uses a quarter of the width as first box size.
+	UFUNCTION(BlueprintCallable, Category = "BoxCounting")
+	static TArray<FFractalDimensionResult> MeasureFractalDimensions(const TArray<UTerrainHeightfield*>& heightfields, float cellSize = 1.f, float heightScale = 0.f, float boxSize = 0.f, int depth = 6);
+
+	// MeasureFractalDimensions on a background thread, the heights get copied first so the heightfields can change
+	// meanwhile. onFinished gets the results on the game thread, or null if the run got cancelled. Starting a new run
+	// cancels the one that is still running. SetBoxes has no async version since it needs physics queries.
+	TFuture<TTerrainTaskResult<TArray<FFractalDimensionResult>>> MeasureFractalDimensionsAsync(const TArray<UTerrainHeightfield*>& heightfields, float cellSize, float heightScale, float boxSize, int depth, TFunction<void(TTerrainTaskResult<TArray<FFractalDimensionResult>>)> onFinished = nullptr, FTerrainTaskControlPtr control = nullptr);
+
+	// cancels the running async measurement, its results get discarded
+	UFUNCTION(BlueprintCallable, Category = "BoxCounting")
+	void CancelAsyncMeasurement();
+
+	// progress of the last async measurement in the 0 1 range
+	UFUNCTION(BlueprintPure, Category = "BoxCounting")
+	float GetAsyncMeasurementProgress() const;
+
 	// helper function that draws debugboxes
 	UFUNCTION(BlueprintCallable, Category = "BoxCounting")
 	void DrawBoxes();
@@ -2,6 +2,7 @@
 
 
 #include "HydraulicErosion.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
 #include "GameFramework/Actor.h"
 
 // Sets default values for this component's properties
@@ -20,213 +21,223 @@ void UHydraulicErosion::BeginPlay()
 	
 }
 
+void UHydraulicErosion::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CancelAsyncErosion();
+	m_ProgressiveHeightfield.Reset();
+	Super::EndPlay(EndPlayReason);
+}
+
 
 // Called every frame
 void UHydraulicErosion::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (!m_ProgressiveHeightfield.IsValid())
+		return;
+
+	// the core keeps a view of the heights, it must not run on heights that moved or changed their size
+	UTerrainHeightfield* heightfield = m_ProgressiveHeightfield.Get();
+	if (heightfield->GetStorageData() != m_ProgressiveData || FIntPoint(heightfield->GetWidth(), heightfield->GetHeight()) != m_ProgressiveSize)
+	{
+		m_ProgressiveHeightfield.Reset();
+		return;
+	}
+
+	bool bFinished = m_HydraulicErosion.AdvanceProgressive(m_FrameBudget);
+	m_TimeSincePublish += DeltaTime;
+	if (bFinished || m_TimeSincePublish >= m_PublishInterval)
+		PublishProgressiveErosion();
+	if (bFinished)
+	{
+		m_ProgressiveHeightfield.Reset();
+		OnProgressiveErosionFinished.Broadcast();
+	}
 }
 
-FHeightGradient UHydraulicErosion::CalcHeightGradient(TArray<float> map, int dimensions, float posX, float posY)
+TArray<float> UHydraulicErosion::ErodeTerrain(const TArray<float>& HeightmapData)
 {
-	// Get current position in grid
-	FHeightGradient heightGradient;
-	int coordX = (int)posX;
-	int coordY = (int)posY;
-
-	// get offset within grid
-	float x = posX - coordX;
-	float y = posY - coordY;
+	// calculate width/height of map
+	int heightmapDimension = FMath::Sqrt(static_cast<float>(HeightmapData.Num()));
+	return ErodeTerrainWithSize(HeightmapData, heightmapDimension, heightmapDimension);
+}
 
-	// get north western corner index
-	int nodeindexNW = coordX + dimensions * coordY;
+TArray<float> UHydraulicErosion::ErodeTerrainWithSize(const TArray<float>& HeightmapData, int32 width, int32 height)
+{
+	if (width <= 0 || height <= 0 || static_cast<int64>(width) * height != HeightmapData.Num())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hydraulic erosion got %d heights for a %d x %d map"), HeightmapData.Num(), width, height);
+		return HeightmapData;
+	}
 
-	// get corner gray values
-	float heightNW = map[nodeindexNW];
-	float heightNE = map[nodeindexNW + 1];
-	float heightSW = map[nodeindexNW + dimensions];
-	float heightSE = map[nodeindexNW + dimensions + 1];
+	// the result is the only copy, erosion runs in place on it
+	TArray<float> erodedHeightmap = HeightmapData;
+	Erode(TerrainCore::HeightfieldView(erodedHeightmap.GetData(), width, height));
+	return erodedHeightmap;
+}
 
-	// calculate gradient vars based on offset within grid
-	heightGradient.gradientX = (heightNE - heightNW) * (1 - y) + (heightSE - heightSW) * y;
-	heightGradient.gradientY = (heightSW - heightNW) * (1 - x) + (heightSE - heightNW) * x;
-	heightGradient.height = heightNW * (1 - x) * (1 - y) + heightNE * x * (1 - y) + heightSW * (1 - x) * y + heightSE * x * y;
-	
-	return heightGradient;
+void UHydraulicErosion::ErodeHeightfield(UTerrainHeightfield* heightfield)
+{
+	if (!heightfield)
+		return;
+	if (heightfield->IsQuantized())
+		Erode(heightfield->GetQuantizedView());
+	else
+		Erode(heightfield->GetView());
+
+	heightfield->NotifyRegionsChanged(m_DirtyRegions);
 }
 
-TArray<float> UHydraulicErosion::ErodeTerrain(TArray<float> HeightmapData)
+TFuture<TTerrainTaskResult<TArray<float>>> UHydraulicErosion::ErodeTerrainAsync(TArray<float> HeightmapData, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished, FTerrainTaskControlPtr control)
 {
-	// calculate width/height of map
 	int heightmapDimension = FMath::Sqrt(static_cast<float>(HeightmapData.Num()));
+	return ErodeTerrainAsync(MoveTemp(HeightmapData), heightmapDimension, heightmapDimension, MoveTemp(onFinished), control);
+}
 
-	// Initialize the brushes
-	InitializeBrushIndices(heightmapDimension, m_Radius);
+TFuture<TTerrainTaskResult<TArray<float>>> UHydraulicErosion::ErodeTerrainAsync(TArray<float> HeightmapData, int32 width, int32 height, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished, FTerrainTaskControlPtr control)
+{
+	// a heightmap of another size comes back unchanged like in ErodeTerrainWithSize
+	if (width <= 0 || height <= 0 || static_cast<int64>(width) * height != HeightmapData.Num())
+		width = height = 0;
 
-	// Used to calculate computational time
-	auto startTime = FPlatformTime::Cycles();
-	for (int a = 0; a < m_IterateAmount; ++a)
+	control = RestartTerrainTask(m_AsyncErosion, control);
+	auto settings = MakeSettings();
+
+	// the worker owns the heights, the erosion happens in place on them
+	auto work = [settings, width, height, heights = MoveTemp(HeightmapData)](TerrainCore::TaskControl& taskControl) mutable
+	{
+		auto startTime = FPlatformTime::Cycles();
+		TerrainCore::HydraulicErosion erosion;
+		erosion.ErodeTerrain(TerrainCore::HeightfieldView(heights.GetData(), width, height), settings, &taskControl);
+
+		auto compTime = FPlatformTime::Cycles() - startTime;
+		UE_LOG(LogTemp, Warning, TEXT("CompTime async Hydraulic erosion: %f"), FPlatformTime::ToMilliseconds(compTime));
+		return MoveTemp(heights);
+	};
+	return LaunchTerrainTask<TArray<float>>(control, MoveTemp(work), MoveTemp(onFinished));
+}
+
+void UHydraulicErosion::CancelAsyncErosion()
+{
+	if (m_AsyncErosion)
+		m_AsyncErosion->Cancel();
+}
+
+float UHydraulicErosion::GetAsyncErosionProgress() const
+{
+	return m_AsyncErosion ? m_AsyncErosion->GetProgress() : 0.f;
+}
+
+FHydraulicErosionStats UHydraulicErosion::GetErosionStats() const
+{
+	const TerrainCore::HydraulicErosionStats& coreStats = m_HydraulicErosion.GetStats();
+	FHydraulicErosionStats stats;
+	stats.Drops = static_cast<int32>(coreStats.Drops);
+	stats.StalledDrops = static_cast<int32>(coreStats.StalledDrops);
+	stats.LeftMapDrops = static_cast<int32>(coreStats.LeftMapDrops);
+	stats.MaxPathDrops = static_cast<int32>(coreStats.MaxPathDrops);
+	stats.AveragePathLength = static_cast<float>(coreStats.GetAveragePathLength());
+	stats.Eroded = static_cast<float>(coreStats.Eroded);
+	stats.Deposited = static_cast<float>(coreStats.Deposited);
+	return stats;
+}
+
+void UHydraulicErosion::StartProgressiveErosion(UTerrainHeightfield* heightfield)
+{
+	StopProgressiveErosion();
+	if (!heightfield)
+		return;
+
+	auto settings = MakeSettings();
+	if (heightfield->IsQuantized())
+		m_HydraulicErosion.BeginProgressive(heightfield->GetQuantizedView(), settings);
+	else
+		m_HydraulicErosion.BeginProgressive(heightfield->GetView(), settings);
+	m_ProgressiveHeightfield = heightfield;
+	m_ProgressiveData = heightfield->GetStorageData();
+	m_ProgressiveSize = FIntPoint(heightfield->GetWidth(), heightfield->GetHeight());
+	m_TimeSincePublish = 0.f;
+}
+
+void UHydraulicErosion::StopProgressiveErosion()
+{
+	if (!m_ProgressiveHeightfield.IsValid())
+		return;
+
+	PublishProgressiveErosion();
+	m_ProgressiveHeightfield.Reset();
+}
+
+float UHydraulicErosion::GetProgressiveErosionProgress() const
+{
+	return m_HydraulicErosion.GetProgressiveProgress();
+}
+
+void UHydraulicErosion::PublishProgressiveErosion()
+{
+	m_TimeSincePublish = 0.f;
+	TArray<FHeightfieldRegion> regions = UTerrainHeightfield::MakeRegions(m_HydraulicErosion.GetDirtyTiles());
+	m_HydraulicErosion.ClearDirtyTiles();
+	if (regions.Num() > 0)
+		m_ProgressiveHeightfield->NotifyRegionsChanged(regions);
+}
+
+TerrainCore::HydraulicErosionSettings UHydraulicErosion::MakeSettings() const
+{
+	// settings get forwarded to the terrain core
+	TerrainCore::HydraulicErosionSettings settings;
+	settings.Inertia = m_Inertia;
+	settings.Capacity = m_Capacity;
+	settings.MinCapacity = m_MinCapacity;
+	settings.Deposition = m_Deposition;
+	settings.Erosion = m_Erosion;
+	settings.Evaporation = m_Evaporation;
+	settings.MaxPath = m_MaxPath;
+	settings.Gravity = m_Gravity;
+	settings.Radius = static_cast<int>(m_Radius);
+	settings.MinSlope = m_MinSlope;
+	settings.IterateAmount = m_IterateAmount;
+	settings.Seed = static_cast<uint32>(FMath::Rand());
+	switch (m_Mode)
 	{
-		// Create drop and spawn within grid
-		FRainDrop drop;
-		drop.Location.X = FMath::FRandRange(0.f, heightmapDimension - 2.f);
-		drop.Location.Y = FMath::FRandRange(0.f, heightmapDimension - 2.f);
-		drop.Direction = FVector2d(0.f, 0.f);
-
-		// loop over its max path
-		for (int i = 0; i < m_MaxPath; ++i)
-		{
-			// get current location in grid
-			int currentX = (int)drop.Location.X;
-			int currentY = (int)drop.Location.Y;
-			int mapIndex = XYToPos(FVector2D(currentX, currentY), heightmapDimension);
-
-			// calculate offset within that cell
-			float currentOffsetX = drop.Location.X - currentX;
-			float currentOffsetY = drop.Location.Y - currentY;
-
-			// get heightgradient
-			auto heightGradient = CalcHeightGradient(HeightmapData, heightmapDimension, drop.Location.X, drop.Location.Y);
-
-			// set direction based on heightgradient, current direction and inertia
-			drop.Direction.X = (drop.Direction.X * m_Inertia - heightGradient.gradientX * (1 - m_Inertia));
-			drop.Direction.Y = (drop.Direction.Y * m_Inertia - heightGradient.gradientY * (1 - m_Inertia));
-			drop.Direction.Normalize();
-
-			// Change location based on direction
-			drop.Location.X += drop.Direction.X;
-			drop.Location.Y += drop.Direction.Y;
-
-			// escape if drop left map
-			if ((drop.Direction.X == 0.f && drop.Direction.Y == 0.f) || drop.Location.X < 0.f || drop.Location.X >= heightmapDimension - 1 || drop.Location.Y < 0.f || drop.Location.Y >= heightmapDimension - 1)
-				break;
-
-			// get height in new cell
-			float newHeight = CalcHeightGradient(HeightmapData, heightmapDimension, drop.Location.X, drop.Location.Y).height;
-
-			// calculate heightdifference
-			float heightDifference = newHeight - heightGradient.height;
-
-			// calculate capacity
-			float capacity = FMath::Max(-heightDifference, m_MinSlope) * drop.Velocity * drop.Water * m_Capacity;
-
-			if (drop.Sediment > capacity || heightDifference > 0.f)
-			{
-				// calculate sediment to drop based on heightdifference
-				auto sedimentTodrop = (heightDifference > 0.f) ? FMath::Min(heightDifference, drop.Sediment) : (drop.Sediment - capacity) * m_Deposition;
-				drop.Sediment -= sedimentTodrop;
-
-				// spread sediment drop over corners of cell
-				HeightmapData[mapIndex] += sedimentTodrop * (1 - currentOffsetX) * (1 - currentOffsetY);
-				HeightmapData[mapIndex + 1] += sedimentTodrop * currentOffsetX * (1 - currentOffsetY);
-				HeightmapData[mapIndex + heightmapDimension] += sedimentTodrop * (1 - currentOffsetX) * currentOffsetY;
-				HeightmapData[mapIndex + heightmapDimension + 1] += sedimentTodrop * currentOffsetX * currentOffsetY;
-			}
-			else
-			{
-				// calculate amount to erode
-				auto erode = FMath::Min(m_Erosion * (capacity - drop.Sediment), -heightDifference);
-
-				// loop over all brushes
-				for (int brushIdx = 0; brushIdx < erosionBrushIndices[mapIndex].size(); ++brushIdx)
-				{
-					// get neighbor information
-					int nodeIdx = erosionBrushIndices[mapIndex][brushIdx];
-					float weightErode = erode * erosionBrushWeights[mapIndex][brushIdx];
-
-					// calculate sediment to take from terrain and add sediment to drop
-					auto deltaSediment = (HeightmapData[nodeIdx] < weightErode) ? HeightmapData[nodeIdx] : weightErode;
-					HeightmapData[nodeIdx] -= deltaSediment;
-					drop.Sediment += deltaSediment;
-				}
-			}
-
-			// decrease water capacity and change velocity
-			drop.Water *= (1 - m_Evaporation);
-			drop.Velocity = FMath::Sqrt(drop.Velocity * drop.Velocity + FMath::Abs(heightDifference) * m_Gravity);
-		}
+	case EHydraulicErosionMode::Parallel:
+		settings.Mode = TerrainCore::HydraulicErosionMode::Parallel;
+		break;
+	case EHydraulicErosionMode::Lockstep:
+		settings.Mode = TerrainCore::HydraulicErosionMode::Lockstep;
+		break;
+	case EHydraulicErosionMode::ShallowWater:
+		settings.Mode = TerrainCore::HydraulicErosionMode::ShallowWater;
+		break;
+	default:
+		settings.Mode = TerrainCore::HydraulicErosionMode::Sequential;
+		break;
 	}
+	settings.ThreadCount = m_ThreadCount;
+	settings.Rain = m_Rain;
+	settings.TimeStep = m_TimeStep;
+	return settings;
+}
+
+template<typename ViewType>
+void UHydraulicErosion::Erode(ViewType map)
+{
+	// the progressive erosion shares the core erosion
+	StopProgressiveErosion();
+	auto settings = MakeSettings();
+
+	// Used to calculate computational time
+	auto startTime = FPlatformTime::Cycles();
+	m_HydraulicErosion.ErodeTerrain(map, settings);
+	m_DirtyRegions = UTerrainHeightfield::MakeRegions(m_HydraulicErosion.GetDirtyTiles());
+
 	// computational time gets measured and logged
 	auto compTime = FPlatformTime::Cycles() - startTime;
 	UE_LOG(LogTemp, Warning, TEXT("CompTime Hydraulic erosion: %f"), FPlatformTime::ToMilliseconds(compTime));
-
-	return HeightmapData;
-}
-
-FVector2D UHydraulicErosion::posToXY(int position, int arraySize)
-{
-	FVector2D pos;
-	pos.X = position % arraySize;
-	pos.Y = (position - pos.X) / arraySize;
-	return pos;
-}
-
-int UHydraulicErosion::XYToPos(FVector2D position, int arraySize)
-{
-	return position.X + arraySize * position.Y;
-}
-
-void UHydraulicErosion::InitializeBrushIndices(int mapSize, int radius)
-{
-	// clears and resizes lists
-	erosionBrushIndices.clear();
-	erosionBrushWeights.clear();
-	erosionBrushIndices.resize(mapSize * mapSize);
-	erosionBrushWeights.resize(mapSize * mapSize);
-
-	// initialize lists used to store neighbor offsets and weight
-	std::vector<int> xOffsets(radius * radius * 4);
-	std::vector<int> yOffsets(radius * radius * 4);
-	std::vector<float> weights(radius * radius * 4);
-	float weightSum = 0;
-	int addIndex = 0;
-
-	for (int i = 0; i < erosionBrushIndices.size(); i++) {
-		// gets current cell index
-		int centreX = i % mapSize;
-		int centreY = i / mapSize;
-
-		// checks if current cell is within the edge of the map(reduces amount of calculations)
-		if (centreY <= radius || centreY >= mapSize - radius || centreX <= radius || centreX >= mapSize - radius) {
-			weightSum = 0;
-			addIndex = 0;
-			//Loops over the square grid the circle fits in
-			for (int y = -radius; y <= radius; y++) {
-				for (int x = -radius; x <= radius; x++) {
-					// calculates distance from center and sees if it is within the radius
-					float sqrDst = x * x + y * y;
-					if (sqrDst < radius * radius) {
-						// neighbourindex gets calculated
-						int coordX = centreX + x;
-						int coordY = centreY + y;
-
-						// checks if coordinates are within the map size
-						if (coordX >= 0 && coordX < mapSize && coordY >= 0 && coordY < mapSize) {
-							// calculates weigh and adds it to the weight list
-							float weight = 1 - FMath::Sqrt(sqrDst) / radius;
-							weightSum += weight;
-							weights[addIndex] = weight;
-
-							// adds offset to offset list
-							xOffsets[addIndex] = x;
-							yOffsets[addIndex] = y;
-							addIndex++;
-						}
-					}
-				}
-			}
-		}
-
-		// resizes list on current index to the appropriate size
-		int numEntries = addIndex;
-		erosionBrushIndices[i].resize(numEntries);
-		erosionBrushWeights[i].resize(numEntries);
-
-		// loops over the amount of entries and sets variables
-		for (int j = 0; j < numEntries; j++) {
-			erosionBrushIndices[i][j] = (yOffsets[j] + centreY) * mapSize + xOffsets[j] + centreX;
-			erosionBrushWeights[i][j] = weights[j] / weightSum;
-		}
+	if (settings.Mode != TerrainCore::HydraulicErosionMode::ShallowWater)
+	{
+		const TerrainCore::HydraulicErosionStats& stats = m_HydraulicErosion.GetStats();
+		UE_LOG(LogTemp, Warning, TEXT("Hydraulic erosion drops: %lld, stalled: %lld, left map: %lld, average path: %f"), static_cast<int64>(stats.Drops), static_cast<int64>(stats.StalledDrops), static_cast<int64>(stats.LeftMapDrops), stats.GetAveragePathLength());
 	}
 }
-
@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "../Terrain Core/HydraulicErosionKernel.h"
+#include "../Terrain Async/TerrainAsyncTask.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
 #include "HydraulicErosion.generated.h"
 
 //Structure used for raindrops
@@ -44,6 +47,54 @@ struct FHeightGradient
 	float gradientY;
 };
 
+//counters of a hydraulic erosion run, the shallow water mode leaves them at 0
+USTRUCT(BlueprintType)
+struct FHydraulicErosionStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 Drops = 0;
+
+	// drops that stopped on flat ground
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 StalledDrops = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 LeftMapDrops = 0;
+
+	// drops that ran for the max path
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 MaxPathDrops = 0;
+
+	// steps a drop moved on the map on average
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float AveragePathLength = 0.f;
+
+	// material the drops took from the map and put back
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float Eroded = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float Deposited = 0.f;
+};
+
+//how the raindrops get scheduled
+UENUM(BlueprintType)
+enum class EHydraulicErosionMode : uint8
+{
+	// one drop after the other
+	Sequential,
+	// drops run on every core, spatially separated drops are simulated at the same time
+	Parallel,
+	// batches of drops advance one step at a time with simd, heightfields with UInt16 storage use Sequential
+	Lockstep,
+	// grid of water flowing through pipes between the cells instead of drops, the iterate amount counts passes
+	ShallowWater,
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnHydraulicErosionFinished);
+
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class PROCEDURALTERRAIN_API UHydraulicErosion : public UActorComponent
 {
@@ -56,6 +107,8 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	// cancels the async erosion that is still running and drops the progressive one
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	//variables that influence hydraulic erosion
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings")
@@ -80,25 +133,104 @@ protected:
 	float m_MinSlope{ 0.01f };
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings")
 	int m_IterateAmount{ 7000 };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings")
+	EHydraulicErosionMode m_Mode{ EHydraulicErosionMode::Sequential };
+	// threads used by the parallel and shallow water mode, 0 uses every core
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings", meta = (ClampMin = "0"))
+	int m_ThreadCount{ 0 };
+	// shallow water mode only: water rained onto every cell per unit of time and the time every pass simulates
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings", meta = (ClampMin = "0"))
+	float m_Rain{ .01f };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings", meta = (ClampMin = "0"))
+	float m_TimeStep{ .2f };
+	// milliseconds every tick of a progressive erosion may spend, at least one drop or pass runs per tick
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Progressive erosion", meta = (ClampMin = "0"))
+	float m_FrameBudget{ 4.f };
+	// seconds between updates of the heightfield while a progressive erosion runs, 0 updates it every tick
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Progressive erosion", meta = (ClampMin = "0"))
+	float m_PublishInterval{ .25f };
 public:	
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
-	// function called in blueprint that returns eroded terrain heightmap
+	// function called in blueprint that returns eroded terrain heightmap, the heightmap has to be square
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	TArray<float> ErodeTerrain(const TArray<float>& HeightmapData);
+
+	// ErodeTerrain for heightmaps of width x height samples stored row by row, a heightmap of another size is returned unchanged
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	TArray<float> ErodeTerrainWithSize(const TArray<float>& HeightmapData, int32 width, int32 height);
+
+	// function called in blueprint that erodes a shared heightfield in place
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	void ErodeHeightfield(UTerrainHeightfield* heightfield);
+
+	// Regions the last ErodeTerrain or ErodeHeightfield changed, merged from tiles of 32x32 samples. ErodeHeightfield
+	// already passes them to NotifyRegionsChanged of the heightfield
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	TArray<FHeightfieldRegion> GetDirtyRegions() const { return m_DirtyRegions; }
+
+	// counters of the last ErodeTerrain or ErodeHeightfield, or of the running or last progressive erosion
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	FHydraulicErosionStats GetErosionStats() const;
+
+	// ErodeTerrain on a background thread with the settings at the time of the call. onFinished gets the eroded heights
+	// on the game thread, or null if the run got cancelled. Starting a new run cancels the one that is still running.
+	TFuture<TTerrainTaskResult<TArray<float>>> ErodeTerrainAsync(TArray<float> HeightmapData, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished = nullptr, FTerrainTaskControlPtr control = nullptr);
+	TFuture<TTerrainTaskResult<TArray<float>>> ErodeTerrainAsync(TArray<float> HeightmapData, int32 width, int32 height, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished = nullptr, FTerrainTaskControlPtr control = nullptr);
+
+	// cancels the running async erosion, its eroded heights get discarded
 	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
-	TArray<float> ErodeTerrain(TArray<float> HeightmapData);
+	void CancelAsyncErosion();
+
+	// progress of the last async erosion in the 0 1 range
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	float GetAsyncErosionProgress() const;
+
+	// Erodes the heightfield over the next ticks instead of all at once with the settings at the time of the call,
+	// every tick spends about the frame budget on it. The heightfield gets the changed regions every publish interval
+	// and at the end. A new run, ErodeTerrain, ErodeHeightfield or resizing the heightfield ends the running one
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	void StartProgressiveErosion(UTerrainHeightfield* heightfield);
+
+	// stops the progressive erosion, the heightfield keeps and gets the changes made so far
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	void StopProgressiveErosion();
+
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	bool IsProgressiveErosionRunning() const { return m_ProgressiveHeightfield.IsValid(); }
+
+	// progress of the running or last progressive erosion in the 0 1 range
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	float GetProgressiveErosionProgress() const;
+
+	// called on the game thread once a progressive erosion finished all of its work
+	UPROPERTY(BlueprintAssignable, Category = "Procedural Mesh")
+	FOnHydraulicErosionFinished OnProgressiveErosionFinished;
+
+private:
+	// snapshot of the erosion settings for the terrain core
+	TerrainCore::HydraulicErosionSettings MakeSettings() const;
+
+	// erodes a float or quantized map in place and logs the computational time
+	template<typename ViewType>
+	void Erode(ViewType map);
+
+	// engine independent erosion, keeps its brush stencil between calls
+	TerrainCore::HydraulicErosion m_HydraulicErosion;
 
-	// Helperfunctions that convert x y coordinates to list index and vise versa
-	FVector2D posToXY(int position, int arraySize);
-	int XYToPos(FVector2D position, int arraySize);
+	// async erosion that is running, async runs use their own erosion instance
+	FTerrainTaskControlPtr m_AsyncErosion;
 
-	// Helper function that gets heightgradient
-	FHeightGradient CalcHeightGradient(TArray<float> map, int dimensions, float posX, float posY);
+	// changed regions of the last synchronous erosion
+	TArray<FHeightfieldRegion> m_DirtyRegions;
 
-	// Helper variables, these are lists that contain all neighboring cells within a radius per index
-	std::vector<std::vector<int>> erosionBrushIndices;
-	std::vector<std::vector<float>> erosionBrushWeights;
+	// hands the regions the progressive erosion changed since the last time to the heightfield
+	void PublishProgressiveErosion();
 
-	// Helper function that fills these helper lists
-	void InitializeBrushIndices(int mapSize, int radius);
+	// heightfield of the running progressive erosion, its heights have to stay where they were at the start
+	TWeakObjectPtr<UTerrainHeightfield> m_ProgressiveHeightfield;
+	const void* m_ProgressiveData{ nullptr };
+	FIntPoint m_ProgressiveSize{ 0, 0 };
+	float m_TimeSincePublish{ 0.f };
 };
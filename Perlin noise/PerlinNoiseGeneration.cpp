@@ -2,6 +2,7 @@
 
 
 #include "PerlinNoiseGeneration.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
 
 #include "Logging/LogMacros.h"
 #include "Engine/Texture2D.h"
@@ -25,70 +26,125 @@ void UPerlinNoiseGeneration::BeginPlay()
 	
 }
 
+void UPerlinNoiseGeneration::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CancelAsyncGeneration();
+	Super::EndPlay(EndPlayReason);
+}
+
 TArray<float> UPerlinNoiseGeneration::GeneratePerlinNoise(int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh)
+{
+	// rows are generated in parallel directly into the returned map
+	TArray<float> noiseMap;
+	noiseMap.SetNumUninitialized(widthHeight * widthHeight);
+	TerrainCore::HeightfieldView noiseView(noiseMap.GetData(), widthHeight, widthHeight);
+	GenerateNoise(noiseView, offset, scale, octaves, persistance, lacunarity);
+
+	//Heightmap gets visualized on plane
+	UTerrainHeightfield::VisualizeHeightmap(noiseView, mesh);
+
+	return noiseMap;
+}
+
+TArray<FLinearColor> UPerlinNoiseGeneration::GeneratePerlinNoiseWithNormals(int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, float heightScale)
+{
+	// the packed samples are written straight into the returned colors
+	static_assert(sizeof(FLinearColor) == sizeof(TerrainCore::HeightNormal), "height normals have to match the color layout");
+	TArray<FLinearColor> noiseMap;
+	noiseMap.SetNumUninitialized(widthHeight * widthHeight);
+	TerrainCore::HeightNormalView noiseView(reinterpret_cast<TerrainCore::HeightNormal*>(noiseMap.GetData()), widthHeight, widthHeight);
+	TerrainCore::GenerateFractalNoiseWithNormals(noiseView, MakeSettings(offset, scale, octaves, persistance, lacunarity), heightScale);
+	return noiseMap;
+}
+
+void UPerlinNoiseGeneration::GeneratePerlinNoiseInto(UTerrainHeightfield* heightfield, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh)
+{
+	if (!heightfield)
+		return;
+
+	// noise is written in place into the shared heightfield
+	if (heightfield->IsQuantized())
+		GenerateNoise(heightfield->GetQuantizedView(), offset, scale, octaves, persistance, lacunarity);
+	else
+		GenerateNoise(heightfield->GetView(), offset, scale, octaves, persistance, lacunarity);
+	heightfield->VisualizeOnMesh(mesh);
+}
+
+template<typename ViewType>
+void UPerlinNoiseGeneration::GenerateNoise(ViewType map, FVector2D offset, float scale, int octaves, float persistance, float lacunarity)
 {
 	//Used to calculate computational time
 	float startTime = FPlatformTime::Cycles();
 
-	TArray<float> noiseMap;
-	noiseMap.Reserve(widthHeight * widthHeight);
+	// fbm noise gets generated by the terrain core
+	TerrainCore::GenerateFractalNoise(map, MakeSettings(offset, scale, octaves, persistance, lacunarity));
 
-	for (int i = 0; i < widthHeight; ++i)
-	{
-		for (int j = 0; j < widthHeight; ++j)
-		{
-			//Values used for Fractal brownian motion
-			float amplitude = 1.f;
-			float frequency = 1.f;
-			float noiseHeight = 0.f;
-
-			//FBM loop
-			for (int k = 0; k < octaves; ++k)
-			{
-				// coordinates for noise function are calculated
-				float X = offset.X + (j / (float)widthHeight) * scale * frequency;
-				float Y = offset.Y + (i / (float)widthHeight) * scale * frequency;
-
-				// NoiseHeight is increased
-				auto perlinNoise = FMath::PerlinNoise2D(FVector2D(X, Y));
-				noiseHeight += perlinNoise * amplitude * 1.2f;
-
-				// amplitude and frequency get adjusted
-				amplitude *= persistance;
-				frequency *= lacunarity;
-			}
-			//Moves noiseHeight from -1 1 to 0 1
-			noiseHeight = (noiseHeight + 1.f) / 2.f;
-			// adds final noiseHeight to noisemap
-			noiseMap.Add(FMath::Clamp(noiseHeight, 0.f, 1.f));
-		}
-		
-	}
 	// computational time gets measured and logged
 	float compTime = FPlatformTime::Cycles() - startTime;
 	UE_LOG(LogTemp, Warning, TEXT("CompTime perlin noise: %f"), FPlatformTime::ToMilliseconds(compTime));
+}
 
-	//Heightmap gets visualized on plane
-	auto CustomTexture = UTexture2D::CreateTransient(widthHeight, widthHeight);
-	auto MipMap = &CustomTexture->PlatformData->Mips[0];
-	FByteBulkData* ImageData = &MipMap->BulkData;
-	uint8* RawImageData = (uint8*)ImageData->Lock(LOCK_READ_WRITE);
-	int ArraySize = widthHeight * widthHeight * 4;
-	for (auto i = 0; i < ArraySize; i += 4)
+TFuture<TTerrainTaskResult<TArray<float>>> UPerlinNoiseGeneration::GeneratePerlinNoiseAsync(int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished, FTerrainTaskControlPtr control)
+{
+	control = RestartTerrainTask(m_AsyncGeneration, control);
+	auto settings = MakeSettings(offset, scale, octaves, persistance, lacunarity);
+
+	// the texels for the mesh get converted on the worker as well
+	TSharedPtr<FHeightTexels, ESPMode::ThreadSafe> texels;
+	if (mesh)
+		texels = MakeShared<FHeightTexels, ESPMode::ThreadSafe>();
+
+	auto work = [settings, widthHeight, texels](TerrainCore::TaskControl& taskControl)
 	{
-		RawImageData[i] = 255 * (noiseMap[i / 4]);
-		RawImageData[i + 1] = 255 * (noiseMap[i / 4]);
-		RawImageData[i + 2] = 255 * (noiseMap[i / 4]);
-		RawImageData[i + 3] = 255 * (noiseMap[i / 4]);
-	}
-	ImageData->Unlock();
-	CustomTexture->UpdateResource();
-
-	UMaterialInstanceDynamic* DynamicMaterial = mesh->CreateDynamicMaterialInstance(0, mesh->GetMaterial(0));
-	DynamicMaterial->SetTextureParameterValue("Texture", CustomTexture);
-	mesh->SetMaterial(0, DynamicMaterial);
+		auto startTime = FPlatformTime::Cycles();
+		TArray<float> noiseMap;
+		noiseMap.SetNumUninitialized(widthHeight * widthHeight);
+		TerrainCore::HeightfieldView noiseView(noiseMap.GetData(), widthHeight, widthHeight);
+		TerrainCore::GenerateFractalNoise(noiseView, settings, &taskControl);
+		if (texels && !taskControl.IsCancelled())
+			*texels = UTerrainHeightfield::ConvertHeightmap(noiseView, { 0, 0, widthHeight, widthHeight }, EHeightTextureFormat::R16);
+
+		auto compTime = FPlatformTime::Cycles() - startTime;
+		UE_LOG(LogTemp, Warning, TEXT("CompTime async perlin noise: %f"), FPlatformTime::ToMilliseconds(compTime));
+		return noiseMap;
+	};
+
+	// the mesh gets updated on the game thread before the caller sees the heights
+	TWeakObjectPtr<UPrimitiveComponent> weakMesh = mesh;
+	auto visualize = [weakMesh, texels, onFinished = MoveTemp(onFinished)](TTerrainTaskResult<TArray<float>> noiseMap)
+	{
+		if (noiseMap && texels && weakMesh.IsValid())
+			UTerrainHeightfield::VisualizeTexels(*texels, weakMesh.Get());
+		if (onFinished)
+			onFinished(noiseMap);
+	};
+	return LaunchTerrainTask<TArray<float>>(control, MoveTemp(work), MoveTemp(visualize));
+}
 
-	return noiseMap;
+void UPerlinNoiseGeneration::CancelAsyncGeneration()
+{
+	if (m_AsyncGeneration)
+		m_AsyncGeneration->Cancel();
+}
+
+float UPerlinNoiseGeneration::GetAsyncGenerationProgress() const
+{
+	return m_AsyncGeneration ? m_AsyncGeneration->GetProgress() : 0.f;
+}
+
+TerrainCore::FractalNoiseSettings UPerlinNoiseGeneration::MakeSettings(FVector2D offset, float scale, int octaves, float persistance, float lacunarity) const
+{
+	TerrainCore::FractalNoiseSettings settings;
+	settings.Basis = TerrainCore::NoiseBasis::Perlin;
+	settings.OffsetX = offset.X;
+	settings.OffsetY = offset.Y;
+	settings.Scale = scale;
+	settings.Octaves = octaves;
+	settings.Persistance = persistance;
+	settings.Lacunarity = lacunarity;
+	settings.Seed = static_cast<uint32>(m_Seed);
+	settings.SlopeDampening = m_SlopeDampening;
+	return settings;
 }
 
 
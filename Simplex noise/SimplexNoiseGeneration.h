@@ -4,10 +4,13 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
-#include "Math/UnrealMathUtility.h"
+#include "../Terrain Core/FractalNoise.h"
+#include "../Terrain Async/TerrainAsyncTask.h"
 #include "SimplexNoiseGeneration.generated.h"
 
 
+class UTerrainHeightfield;
+
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class PROCEDURALTERRAIN_API USimplexNoiseGeneration : public UActorComponent
 {
@@ -20,6 +23,8 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	// cancels the async generation that is still running
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:	
 	// Called every frame
@@ -29,9 +34,43 @@ public:
 	UFUNCTION(BlueprintCallable)
 	TArray<float> GenerateSimplexNoise(int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh);
 
+	// Same noise with the analytic surface normal of every sample, packed as (height, normal x, normal y, normal z) so it can
+	// be uploaded as one RGBA32F texture. heightScale is the height of 1 in units of the sample spacing
+	UFUNCTION(BlueprintCallable)
+	TArray<FLinearColor> GenerateSimplexNoiseWithNormals(int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, float heightScale);
+
+	//Function used in blueprint to generate noise in place into a shared heightfield
+	UFUNCTION(BlueprintCallable)
+	void GenerateSimplexNoiseInto(UTerrainHeightfield* heightfield, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh);
+
+	// GenerateSimplexNoise on a background thread. The mesh gets the heightmap and onFinished the heights on the game thread,
+	// onFinished gets null if the run got cancelled. Starting a new run cancels the one that is still running.
+	TFuture<TTerrainTaskResult<TArray<float>>> GenerateSimplexNoiseAsync(int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished = nullptr, FTerrainTaskControlPtr control = nullptr);
+
+	// cancels the running async generation, its heights get discarded
+	UFUNCTION(BlueprintCallable)
+	void CancelAsyncGeneration();
+
+	// progress of the last async generation in the 0 1 range
+	UFUNCTION(BlueprintPure)
+	float GetAsyncGenerationProgress() const;
+
+	// seed of the noise permutation, every seed gives its own terrain and 0 the classic one
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings", meta = (ClampMin = "0"))
+	int m_Seed{ 0 };
+
+	// damps the detail octaves on steep slopes by the analytic noise derivatives, 0 is plain fbm
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings", meta = (ClampMin = "0"))
+	float m_SlopeDampening{ 0.f };
+
 private:
-	float SimplexNoise2D(const FVector2D& location);
-	//Simplex constants
-	float m_F2;
-	float m_G2;
+	// settings of the terrain core for the given parameters and the seed
+	TerrainCore::FractalNoiseSettings MakeSettings(FVector2D offset, float scale, int octaves, float persistance, float lacunarity) const;
+
+	// generates fbm noise into a float or quantized map and logs the computational time
+	template<typename ViewType>
+	void GenerateNoise(ViewType map, FVector2D offset, float scale, int octaves, float persistance, float lacunarity);
+
+	// async generation that is running
+	FTerrainTaskControlPtr m_AsyncGeneration;
 };
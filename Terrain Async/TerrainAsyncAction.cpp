@@ -0,0 +1,194 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainAsyncAction.h"
+#include "../Perlin noise/PerlinNoiseGeneration.h"
+#include "../Simplex noise/SimplexNoiseGeneration.h"
+#include "../Hydraulic Erosion/HydraulicErosion.h"
+#include "../Thermal Erosion/ThermalErosion.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
+
+// control whose progress reports get forwarded to the game thread, the node may be gone by the time they arrive
+template<typename ActionType>
+static FTerrainTaskControlPtr MakeProgressControl(ActionType* action)
+{
+	TWeakObjectPtr<ActionType> weakAction = action;
+	return MakeShared<TerrainCore::TaskControl, ESPMode::ThreadSafe>([weakAction](float progress)
+	{
+		AsyncTask(ENamedThreads::GameThread, [weakAction, progress]()
+		{
+			if (weakAction.IsValid())
+				weakAction->ReportProgress(progress);
+		});
+	});
+}
+
+UTerrainAsyncAction* UTerrainAsyncAction::GeneratePerlinNoiseAsync(UPerlinNoiseGeneration* generator, int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh)
+{
+	TWeakObjectPtr<UPerlinNoiseGeneration> weakGenerator = generator;
+	TWeakObjectPtr<UPrimitiveComponent> weakMesh = mesh;
+	return Create(generator, [=](FTerrainTaskControlPtr control, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished)
+	{
+		if (!weakGenerator.IsValid())
+		{
+			onFinished(nullptr);
+			return;
+		}
+		weakGenerator->GeneratePerlinNoiseAsync(widthHeight, offset, scale, octaves, persistance, lacunarity, weakMesh.Get(), MoveTemp(onFinished), control);
+	});
+}
+
+UTerrainAsyncAction* UTerrainAsyncAction::GenerateSimplexNoiseAsync(USimplexNoiseGeneration* generator, int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh)
+{
+	TWeakObjectPtr<USimplexNoiseGeneration> weakGenerator = generator;
+	TWeakObjectPtr<UPrimitiveComponent> weakMesh = mesh;
+	return Create(generator, [=](FTerrainTaskControlPtr control, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished)
+	{
+		if (!weakGenerator.IsValid())
+		{
+			onFinished(nullptr);
+			return;
+		}
+		weakGenerator->GenerateSimplexNoiseAsync(widthHeight, offset, scale, octaves, persistance, lacunarity, weakMesh.Get(), MoveTemp(onFinished), control);
+	});
+}
+
+UTerrainAsyncAction* UTerrainAsyncAction::ErodeHydraulicAsync(UHydraulicErosion* erosion, const TArray<float>& HeightmapData)
+{
+	TWeakObjectPtr<UHydraulicErosion> weakErosion = erosion;
+	return Create(erosion, [weakErosion, HeightmapData](FTerrainTaskControlPtr control, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished)
+	{
+		if (!weakErosion.IsValid())
+		{
+			onFinished(nullptr);
+			return;
+		}
+		weakErosion->ErodeTerrainAsync(HeightmapData, MoveTemp(onFinished), control);
+	});
+}
+
+UTerrainAsyncAction* UTerrainAsyncAction::ErodeThermalAsync(UThermalErosion* erosion, const TArray<float>& HeightmapData)
+{
+	TWeakObjectPtr<UThermalErosion> weakErosion = erosion;
+	return Create(erosion, [weakErosion, HeightmapData](FTerrainTaskControlPtr control, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished)
+	{
+		if (!weakErosion.IsValid())
+		{
+			onFinished(nullptr);
+			return;
+		}
+		weakErosion->ErodeTerrainAsync(HeightmapData, MoveTemp(onFinished), control);
+	});
+}
+
+UTerrainAsyncAction* UTerrainAsyncAction::Create(UActorComponent* component, FStartFunction start)
+{
+	UTerrainAsyncAction* action = NewObject<UTerrainAsyncAction>();
+	// a missing component leaves the start empty, the node reports a cancel once activated
+	if (component)
+	{
+		action->m_Start = MoveTemp(start);
+		action->RegisterWithGameInstance(component);
+	}
+	return action;
+}
+
+void UTerrainAsyncAction::Activate()
+{
+	// no component got passed to the node
+	if (!m_Start)
+	{
+		Finish(nullptr);
+		return;
+	}
+
+	TWeakObjectPtr<UTerrainAsyncAction> weakThis = this;
+	m_Control = MakeProgressControl(this);
+	m_Start(m_Control, [weakThis](TTerrainTaskResult<TArray<float>> heights)
+	{
+		if (weakThis.IsValid())
+			weakThis->Finish(heights);
+	});
+	m_Start = nullptr;
+}
+
+void UTerrainAsyncAction::Cancel()
+{
+	if (m_Control)
+		m_Control->Cancel();
+}
+
+void UTerrainAsyncAction::ReportProgress(float progress)
+{
+	if (!m_IsFinished)
+		OnProgress.Broadcast(progress);
+}
+
+void UTerrainAsyncAction::Finish(TTerrainTaskResult<TArray<float>> heights)
+{
+	m_IsFinished = true;
+	if (heights)
+		OnCompleted.Broadcast(*heights);
+	else
+		OnCancelled.Broadcast();
+	SetReadyToDestroy();
+}
+
+UFractalDimensionAsyncAction* UFractalDimensionAsyncAction::MeasureFractalDimensionsAsync(UBoxCountAlgorithm* boxCount, const TArray<UTerrainHeightfield*>& heightfields, float cellSize, float heightScale, float boxSize, int depth)
+{
+	UFractalDimensionAsyncAction* action = NewObject<UFractalDimensionAsyncAction>();
+	action->m_BoxCount = boxCount;
+	for (UTerrainHeightfield* heightfield : heightfields)
+		action->m_Heightfields.Add(heightfield);
+	action->m_CellSize = cellSize;
+	action->m_HeightScale = heightScale;
+	action->m_BoxSize = boxSize;
+	action->m_Depth = depth;
+	if (boxCount)
+		action->RegisterWithGameInstance(boxCount);
+	return action;
+}
+
+void UFractalDimensionAsyncAction::Activate()
+{
+	if (!m_BoxCount.IsValid())
+	{
+		Finish(nullptr);
+		return;
+	}
+
+	// heightfields destroyed since the node got created are measured as empty maps
+	TArray<UTerrainHeightfield*> heightfields;
+	for (const auto& heightfield : m_Heightfields)
+		heightfields.Add(heightfield.Get());
+
+	TWeakObjectPtr<UFractalDimensionAsyncAction> weakThis = this;
+	m_Control = MakeProgressControl(this);
+	m_BoxCount->MeasureFractalDimensionsAsync(heightfields, m_CellSize, m_HeightScale, m_BoxSize, m_Depth, [weakThis](TTerrainTaskResult<TArray<FFractalDimensionResult>> results)
+	{
+		if (weakThis.IsValid())
+			weakThis->Finish(results);
+	}, m_Control);
+}
+
+void UFractalDimensionAsyncAction::Cancel()
+{
+	if (m_Control)
+		m_Control->Cancel();
+}
+
+void UFractalDimensionAsyncAction::ReportProgress(float progress)
+{
+	if (!m_IsFinished)
+		OnProgress.Broadcast(progress);
+}
+
+void UFractalDimensionAsyncAction::Finish(TTerrainTaskResult<TArray<FFractalDimensionResult>> results)
+{
+	m_IsFinished = true;
+	if (results)
+		OnCompleted.Broadcast(*results);
+	else
+		OnCancelled.Broadcast();
+	SetReadyToDestroy();
+}
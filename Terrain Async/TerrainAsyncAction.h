@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "TerrainAsyncTask.h"
+#include "../Box Count/BoxCountAlgorithm.h"
+#include "TerrainAsyncAction.generated.h"
+
+class UPerlinNoiseGeneration;
+class USimplexNoiseGeneration;
+class UHydraulicErosion;
+class UThermalErosion;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FTerrainAsyncProgress, float, Progress);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FTerrainAsyncHeights, const TArray<float>&, Heights);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FTerrainAsyncFractalDimensions, const TArray<FFractalDimensionResult>&, Results);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FTerrainAsyncCancelled);
+
+// Blueprint node that generates or erodes a heightmap on a background thread with the settings of the component. A new
+// node on the same component cancels the node that is still running, so parameter changes only keep the latest run.
+UCLASS()
+class PROCEDURALTERRAIN_API UTerrainAsyncAction : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+public:
+	// fires on the game thread every time the progress grows by a percent
+	UPROPERTY(BlueprintAssignable)
+	FTerrainAsyncProgress OnProgress;
+	UPROPERTY(BlueprintAssignable)
+	FTerrainAsyncHeights OnCompleted;
+	UPROPERTY(BlueprintAssignable)
+	FTerrainAsyncCancelled OnCancelled;
+
+	UFUNCTION(BlueprintCallable, Category = "Terrain Async", meta = (BlueprintInternalUseOnly = "true"))
+	static UTerrainAsyncAction* GeneratePerlinNoiseAsync(UPerlinNoiseGeneration* generator, int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh);
+
+	UFUNCTION(BlueprintCallable, Category = "Terrain Async", meta = (BlueprintInternalUseOnly = "true"))
+	static UTerrainAsyncAction* GenerateSimplexNoiseAsync(USimplexNoiseGeneration* generator, int widthHeight, FVector2D offset, float scale, int octaves, float persistance, float lacunarity, UPrimitiveComponent* mesh);
+
+	UFUNCTION(BlueprintCallable, Category = "Terrain Async", meta = (BlueprintInternalUseOnly = "true"))
+	static UTerrainAsyncAction* ErodeHydraulicAsync(UHydraulicErosion* erosion, const TArray<float>& HeightmapData);
+
+	UFUNCTION(BlueprintCallable, Category = "Terrain Async", meta = (BlueprintInternalUseOnly = "true"))
+	static UTerrainAsyncAction* ErodeThermalAsync(UThermalErosion* erosion, const TArray<float>& HeightmapData);
+
+	virtual void Activate() override;
+
+	// cancels the run, OnCancelled fires once the worker stopped
+	UFUNCTION(BlueprintCallable, Category = "Terrain Async")
+	void Cancel();
+
+	// broadcasts OnProgress unless the run already finished
+	void ReportProgress(float progress);
+
+private:
+	// creates the node for a component, start launches the run with the control of the node
+	using FStartFunction = TFunction<void(FTerrainTaskControlPtr, TFunction<void(TTerrainTaskResult<TArray<float>>)>)>;
+	static UTerrainAsyncAction* Create(UActorComponent* component, FStartFunction start);
+
+	void Finish(TTerrainTaskResult<TArray<float>> heights);
+
+	FStartFunction m_Start;
+	FTerrainTaskControlPtr m_Control;
+	bool m_IsFinished{ false };
+};
+
+// Blueprint node that measures the fractal dimension of a batch of heightfields on background threads
+UCLASS()
+class PROCEDURALTERRAIN_API UFractalDimensionAsyncAction : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+public:
+	// fires on the game thread every time the progress grows by a percent
+	UPROPERTY(BlueprintAssignable)
+	FTerrainAsyncProgress OnProgress;
+	UPROPERTY(BlueprintAssignable)
+	FTerrainAsyncFractalDimensions OnCompleted;
+	UPROPERTY(BlueprintAssignable)
+	FTerrainAsyncCancelled OnCancelled;
+
+	UFUNCTION(BlueprintCallable, Category = "Terrain Async", meta = (BlueprintInternalUseOnly = "true"))
+	static UFractalDimensionAsyncAction* MeasureFractalDimensionsAsync(UBoxCountAlgorithm* boxCount, const TArray<UTerrainHeightfield*>& heightfields, float cellSize = 1.f, float heightScale = 0.f, float boxSize = 0.f, int depth = 6);
+
+	virtual void Activate() override;
+
+	// cancels the run, OnCancelled fires once the worker stopped
+	UFUNCTION(BlueprintCallable, Category = "Terrain Async")
+	void Cancel();
+
+	// broadcasts OnProgress unless the run already finished
+	void ReportProgress(float progress);
+
+private:
+	void Finish(TTerrainTaskResult<TArray<FFractalDimensionResult>> results);
+
+	TWeakObjectPtr<UBoxCountAlgorithm> m_BoxCount;
+	TArray<TWeakObjectPtr<UTerrainHeightfield>> m_Heightfields;
+	float m_CellSize{ 1.f };
+	float m_HeightScale{ 0.f };
+	float m_BoxSize{ 0.f };
+	int m_Depth{ 6 };
+	FTerrainTaskControlPtr m_Control;
+	bool m_IsFinished{ false };
+};
@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Async.h"
+#include "../Terrain Core/TaskControl.h"
+
+// control of a background terrain task, shared between the worker and the game thread
+using FTerrainTaskControlPtr = TSharedPtr<TerrainCore::TaskControl, ESPMode::ThreadSafe>;
+
+// result of a background terrain task, null when the task got cancelled
+template<typename ResultType>
+using TTerrainTaskResult = TSharedPtr<ResultType, ESPMode::ThreadSafe>;
+
+// cancels the task an owner is still running and makes nextTask its running task, a new control gets created if
+// nextTask is null
+inline FTerrainTaskControlPtr RestartTerrainTask(FTerrainTaskControlPtr& runningTask, FTerrainTaskControlPtr nextTask)
+{
+	if (runningTask)
+		runningTask->Cancel();
+	runningTask = nextTask ? nextTask : MakeShared<TerrainCore::TaskControl, ESPMode::ThreadSafe>();
+	return runningTask;
+}
+
+// Runs work on the thread pool and hands the result to onFinished on the game thread. The work only gets data it owns,
+// never the calling component. The result is null when the task got cancelled before onFinished runs, the future
+// resolves to the result as soon as the worker is done.
+template<typename ResultType>
+TFuture<TTerrainTaskResult<ResultType>> LaunchTerrainTask(FTerrainTaskControlPtr control, TUniqueFunction<ResultType(TerrainCore::TaskControl&)> work, TFunction<void(TTerrainTaskResult<ResultType>)> onFinished)
+{
+	return Async(EAsyncExecution::ThreadPool, [control, work = MoveTemp(work), onFinished = MoveTemp(onFinished)]() mutable
+	{
+		TTerrainTaskResult<ResultType> result;
+		if (!control->IsCancelled())
+		{
+			ResultType value = work(*control);
+			if (!control->IsCancelled())
+				result = MakeShared<ResultType, ESPMode::ThreadSafe>(MoveTemp(value));
+		}
+
+		// a newer task can replace this one while the result waits for the game thread
+		if (onFinished)
+		{
+			AsyncTask(ENamedThreads::GameThread, [control, result, onFinished = MoveTemp(onFinished)]()
+			{
+				onFinished(control->IsCancelled() ? nullptr : result);
+			});
+		}
+		return result;
+	});
+}
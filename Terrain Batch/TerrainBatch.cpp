@@ -0,0 +1,492 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Headless command line tool that generates and erodes terrain without the engine.
+// usage: TerrainBatch [options]
+//   --size N               width/height of the map (default 512)
+//   --width N, --height N  width or height of the map on their own for maps that aren't square
+//   --noise perlin|simplex|value
+//                          noise basis (default simplex)
+//   --fractal fbm|ridged|billow
+//                          shape of the octaves (default fbm)
+//   --offset X Y           noise offset
+//   --scale S              noise scale
+//   --octaves N            fbm octaves
+//   --persistance P        fbm persistance
+//   --lacunarity L         fbm lacunarity
+//   --noise-seed N         seed of the noise permutation, 0 uses the classic permutation (default)
+//   --slope-dampening S    damps the octaves on steep slopes, 0 is plain fbm (default)
+//   --threads N            threads used for the generation and erosion, 0 uses every core (default)
+//   --seed N               seed used by the erosion
+//   --hydraulic N          amount of raindrops or water passes, 0 disables hydraulic erosion
+//   --hydraulic-mode sequential|parallel|lockstep|water
+//                          drop scheduling of the hydraulic erosion (default sequential), water runs the grid based
+//                          shallow water model and --hydraulic counts its passes
+//   --rain R               water rained per unit of time in the water mode
+//   --time-step T          time simulated per pass of the water mode
+//   --thermal N            amount of thermal iterations, 0 disables thermal erosion
+//   --thermal-mode sorted|jacobi|active
+//                          cell update order of the thermal erosion (default sorted)
+//   --thermal-tolerance T  active mode stops once an iteration moves T or less material
+//   --frame-budget MS      runs the erosions progressively in slices of MS milliseconds like a game loop would and
+//                          logs the slices, 0 runs them in one go (default)
+//   --boxcount DEPTH       logs fractal dimension data of the final map
+//   --boxcount-mode pyramid|recursive
+//                          counts boxes from a min/max pyramid (default) or tests every box on its own
+//   --boxcount-tiles N     also measures the fractal dimension of every square tile of a split of the map into N
+//                          tiles along its shorter side
+//   --out FILE             writes the map as raw texels
+//   --out-format r32|r16   32 bit floats (default) or 0 1 mapped to 16 bit unsigned integers
+//   --storage float|uint16 keeps the map as 32 bit floats (default) or quantized 16 bit heights
+//   --mesh N               builds mesh sections of N quads from the final map with a viewer in the middle
+//   --mesh-lods N          detail levels of the mesh sections (default 4)
+//   --normals FILE         writes the uneroded noise with its analytic normals as raw RGBA32F texels (height, normal)
+//   --trace FILE           records the phases of every step, files ending in .json get the chrome trace format and
+//                          the others csv
+
+#include "BoxCountKernel.h"
+#include "FractalDimension.h"
+#include "FractalNoise.h"
+#include "HeightQuantization.h"
+#include "HeightTexture.h"
+#include "HydraulicErosionKernel.h"
+#include "TerrainMesh.h"
+#include "TerrainTrace.h"
+#include "ThermalErosionKernel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	struct BatchOptions
+	{
+		int Width{ 512 };
+		int Height{ 512 };
+		TerrainCore::FractalNoiseSettings Noise;
+		TerrainCore::HydraulicErosionSettings Hydraulic;
+		TerrainCore::ThermalErosionSettings Thermal;
+		double FrameBudget{ 0. };
+		int BoxCountDepth{ 0 };
+		bool BoxCountRecursive{ false };
+		int BoxCountTiles{ 0 };
+		std::string OutputPath;
+		TerrainCore::HeightTextureFormat OutputFormat{ TerrainCore::HeightTextureFormat::R32F };
+		bool QuantizedStorage{ false };
+		std::string NormalsPath;
+		int MeshSectionSize{ 0 };
+		int MeshLodCount{ 4 };
+		std::string TracePath;
+	};
+
+	bool ParseOptions(int argc, char** argv, BatchOptions& options)
+	{
+		options.Noise.Scale = 4.f;
+		options.Noise.Octaves = 6;
+		options.Hydraulic.IterateAmount = 0;
+		options.Thermal.IterateAmount = 0;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string argument = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (argument == "--size" && hasValue)
+				options.Width = options.Height = std::atoi(argv[++i]);
+			else if (argument == "--width" && hasValue)
+				options.Width = std::atoi(argv[++i]);
+			else if (argument == "--height" && hasValue)
+				options.Height = std::atoi(argv[++i]);
+			else if (argument == "--noise" && hasValue)
+			{
+				std::string basis = argv[++i];
+				if (basis == "perlin")
+					options.Noise.Basis = TerrainCore::NoiseBasis::Perlin;
+				else if (basis == "simplex")
+					options.Noise.Basis = TerrainCore::NoiseBasis::Simplex;
+				else if (basis == "value")
+					options.Noise.Basis = TerrainCore::NoiseBasis::Value;
+				else
+					return false;
+			}
+			else if (argument == "--fractal" && hasValue)
+			{
+				std::string type = argv[++i];
+				if (type == "fbm")
+					options.Noise.Type = TerrainCore::FractalNoiseType::Fbm;
+				else if (type == "ridged")
+					options.Noise.Type = TerrainCore::FractalNoiseType::Ridged;
+				else if (type == "billow")
+					options.Noise.Type = TerrainCore::FractalNoiseType::Billow;
+				else
+					return false;
+			}
+			else if (argument == "--offset" && i + 2 < argc)
+			{
+				options.Noise.OffsetX = static_cast<float>(std::atof(argv[++i]));
+				options.Noise.OffsetY = static_cast<float>(std::atof(argv[++i]));
+			}
+			else if (argument == "--scale" && hasValue)
+				options.Noise.Scale = static_cast<float>(std::atof(argv[++i]));
+			else if (argument == "--octaves" && hasValue)
+				options.Noise.Octaves = std::atoi(argv[++i]);
+			else if (argument == "--persistance" && hasValue)
+				options.Noise.Persistance = static_cast<float>(std::atof(argv[++i]));
+			else if (argument == "--lacunarity" && hasValue)
+				options.Noise.Lacunarity = static_cast<float>(std::atof(argv[++i]));
+			else if (argument == "--noise-seed" && hasValue)
+				options.Noise.Seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+			else if (argument == "--slope-dampening" && hasValue)
+				options.Noise.SlopeDampening = static_cast<float>(std::atof(argv[++i]));
+			else if (argument == "--threads" && hasValue)
+			{
+				options.Noise.ThreadCount = std::atoi(argv[++i]);
+				options.Hydraulic.ThreadCount = options.Noise.ThreadCount;
+				options.Thermal.ThreadCount = options.Noise.ThreadCount;
+			}
+			else if (argument == "--seed" && hasValue)
+				options.Hydraulic.Seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+			else if (argument == "--hydraulic" && hasValue)
+				options.Hydraulic.IterateAmount = std::atoi(argv[++i]);
+			else if (argument == "--hydraulic-mode" && hasValue)
+			{
+				std::string mode = argv[++i];
+				if (mode == "sequential")
+					options.Hydraulic.Mode = TerrainCore::HydraulicErosionMode::Sequential;
+				else if (mode == "parallel")
+					options.Hydraulic.Mode = TerrainCore::HydraulicErosionMode::Parallel;
+				else if (mode == "lockstep")
+					options.Hydraulic.Mode = TerrainCore::HydraulicErosionMode::Lockstep;
+				else if (mode == "water")
+					options.Hydraulic.Mode = TerrainCore::HydraulicErosionMode::ShallowWater;
+				else
+					return false;
+			}
+			else if (argument == "--rain" && hasValue)
+				options.Hydraulic.Rain = static_cast<float>(std::atof(argv[++i]));
+			else if (argument == "--time-step" && hasValue)
+				options.Hydraulic.TimeStep = static_cast<float>(std::atof(argv[++i]));
+			else if (argument == "--thermal" && hasValue)
+				options.Thermal.IterateAmount = std::atoi(argv[++i]);
+			else if (argument == "--thermal-mode" && hasValue)
+			{
+				std::string mode = argv[++i];
+				if (mode == "sorted")
+					options.Thermal.Mode = TerrainCore::ThermalErosionMode::Sorted;
+				else if (mode == "jacobi")
+					options.Thermal.Mode = TerrainCore::ThermalErosionMode::Jacobi;
+				else if (mode == "active")
+					options.Thermal.Mode = TerrainCore::ThermalErosionMode::ActiveSet;
+				else
+					return false;
+			}
+			else if (argument == "--thermal-tolerance" && hasValue)
+				options.Thermal.Tolerance = static_cast<float>(std::atof(argv[++i]));
+			else if (argument == "--frame-budget" && hasValue)
+				options.FrameBudget = std::atof(argv[++i]);
+			else if (argument == "--boxcount" && hasValue)
+				options.BoxCountDepth = std::atoi(argv[++i]);
+			else if (argument == "--boxcount-mode" && hasValue)
+			{
+				std::string mode = argv[++i];
+				if (mode == "pyramid")
+					options.BoxCountRecursive = false;
+				else if (mode == "recursive")
+					options.BoxCountRecursive = true;
+				else
+					return false;
+			}
+			else if (argument == "--boxcount-tiles" && hasValue)
+				options.BoxCountTiles = std::atoi(argv[++i]);
+			else if (argument == "--out" && hasValue)
+				options.OutputPath = argv[++i];
+			else if (argument == "--out-format" && hasValue)
+			{
+				std::string format = argv[++i];
+				if (format == "r32")
+					options.OutputFormat = TerrainCore::HeightTextureFormat::R32F;
+				else if (format == "r16")
+					options.OutputFormat = TerrainCore::HeightTextureFormat::R16;
+				else
+					return false;
+			}
+			else if (argument == "--storage" && hasValue)
+			{
+				std::string storage = argv[++i];
+				if (storage == "float")
+					options.QuantizedStorage = false;
+				else if (storage == "uint16")
+					options.QuantizedStorage = true;
+				else
+					return false;
+			}
+			else if (argument == "--normals" && hasValue)
+				options.NormalsPath = argv[++i];
+			else if (argument == "--mesh" && hasValue)
+				options.MeshSectionSize = std::atoi(argv[++i]);
+			else if (argument == "--mesh-lods" && hasValue)
+				options.MeshLodCount = std::atoi(argv[++i]);
+			else if (argument == "--trace" && hasValue)
+				options.TracePath = argv[++i];
+			else
+				return false;
+		}
+		return options.Width > 1 && options.Height > 1;
+	}
+
+	// runs a step and logs its computational time
+	template<typename Step>
+	void TimeStep(const char* name, Step step)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+		step();
+		std::chrono::duration<double, std::milli> compTime = std::chrono::steady_clock::now() - startTime;
+		std::printf("CompTime %s: %f\n", name, compTime.count());
+	}
+
+	// float heights of a map, quantized maps get dequantized into scratch
+	TerrainCore::ConstHeightfieldView GetFloatHeights(const TerrainCore::Heightfield& map, TerrainCore::Heightfield&)
+	{
+		return map.GetView();
+	}
+
+	TerrainCore::ConstHeightfieldView GetFloatHeights(const TerrainCore::QuantizedHeightfield& map, TerrainCore::Heightfield& scratch)
+	{
+		scratch.Resize(map.GetWidth(), map.GetHeight());
+		TerrainCore::DequantizeHeightfield(map.GetView(), scratch.GetView());
+		return scratch.GetView();
+	}
+
+	// writes the raw bytes of count samples
+	template<typename T>
+	bool WriteRawFile(const std::string& path, const T* data, size_t count)
+	{
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			std::fprintf(stderr, "could not open %s\n", path.c_str());
+			return false;
+		}
+		std::fwrite(data, sizeof(T), count, file);
+		std::fclose(file);
+		return true;
+	}
+
+	// Runs a progressive erosion to the end one slice after the other and logs the longest slice. A slice can exceed
+	// the budget by the last drop, pass or iteration it started
+	template<typename Erosion>
+	void RunProgressive(Erosion& erosion, double budgetMilliseconds)
+	{
+		int sliceCount = 0;
+		double longestSlice = 0.;
+		bool finished = false;
+		while (!finished)
+		{
+			auto startTime = std::chrono::steady_clock::now();
+			finished = erosion.AdvanceProgressive(budgetMilliseconds);
+			std::chrono::duration<double, std::milli> sliceTime = std::chrono::steady_clock::now() - startTime;
+			longestSlice = std::max(longestSlice, sliceTime.count());
+			++sliceCount;
+		}
+		std::printf("Slices: %d of %.2f ms, longest %f ms\n", sliceCount, budgetMilliseconds, longestSlice);
+	}
+
+	// share of the map an erosion step changed, downstream updates only need the merged rectangles
+	void PrintDirtyTiles(const TerrainCore::DirtyTileMask& dirtyTiles)
+	{
+		int dirtyCount = dirtyTiles.GetDirtyTileCount();
+		std::printf("Dirty tiles: %d of %d (%.1f%%), %zu rectangles\n", dirtyCount, dirtyTiles.GetTileCount(), 100.0 * dirtyCount / std::max(dirtyTiles.GetTileCount(), 1), dirtyTiles.GetDirtyRects().size());
+	}
+
+	void PrintHydraulicStats(const TerrainCore::HydraulicErosionStats& stats)
+	{
+		std::printf("Drops: %lld, stalled: %lld, left map: %lld, max path: %lld, average path: %f\n", static_cast<long long>(stats.Drops), static_cast<long long>(stats.StalledDrops), static_cast<long long>(stats.LeftMapDrops), static_cast<long long>(stats.MaxPathDrops), stats.GetAveragePathLength());
+		std::printf("Eroded: %f, deposited: %f\n", stats.Eroded, stats.Deposited);
+	}
+
+	void PrintThermalStats(const TerrainCore::ThermalErosionStats& stats)
+	{
+		const auto& senders = stats.SendingCellsPerIteration;
+		if (!senders.empty())
+			std::printf("Sending cells: first iteration %d, last iteration %d, moved: %f\n", senders.front(), senders.back(), stats.MovedMass);
+	}
+
+	bool WriteTrace(const std::string& path, const std::vector<TerrainCore::TraceEvent>& events)
+	{
+		bool isJson = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		if (isJson ? TerrainCore::WriteTraceJson(path, events) : TerrainCore::WriteTraceCsv(path, events))
+			return true;
+		std::fprintf(stderr, "could not write %s\n", path.c_str());
+		return false;
+	}
+
+	// generates, erodes, measures and writes a map stored as MapType
+	template<typename MapType>
+	int RunBatch(const BatchOptions& options)
+	{
+		MapType map(options.Width, options.Height);
+		// heights, boxes and distances scale with the longer side of the map
+		int mapSize = std::max(options.Width, options.Height);
+		TimeStep("noise", [&]() { TerrainCore::GenerateFractalNoise(map.GetView(), options.Noise); });
+
+		if (options.Hydraulic.IterateAmount > 0)
+		{
+			TerrainCore::HydraulicErosion hydraulicErosion;
+			TimeStep("hydraulic erosion", [&]()
+			{
+				if (options.FrameBudget > 0.)
+				{
+					hydraulicErosion.BeginProgressive(map.GetView(), options.Hydraulic);
+					RunProgressive(hydraulicErosion, options.FrameBudget);
+				}
+				else
+					hydraulicErosion.ErodeTerrain(map.GetView(), options.Hydraulic);
+			});
+			PrintDirtyTiles(hydraulicErosion.GetDirtyTiles());
+			if (options.Hydraulic.Mode != TerrainCore::HydraulicErosionMode::ShallowWater)
+				PrintHydraulicStats(hydraulicErosion.GetStats());
+		}
+
+		if (options.Thermal.IterateAmount > 0)
+		{
+			TerrainCore::ThermalErosion thermalErosion;
+			TimeStep("thermal erosion", [&]()
+			{
+				if (options.FrameBudget > 0.)
+				{
+					thermalErosion.BeginProgressive(map.GetView(), options.Thermal);
+					RunProgressive(thermalErosion, options.FrameBudget);
+				}
+				else
+					thermalErosion.ErodeTerrain(map.GetView(), options.Thermal);
+			});
+			if (options.FrameBudget <= 0.)
+				std::printf("Thermal iterations: %d\n", thermalErosion.GetIterationsRun());
+			PrintDirtyTiles(thermalErosion.GetDirtyTiles());
+			PrintThermalStats(thermalErosion.GetStats());
+		}
+
+		if (options.BoxCountDepth > 0)
+		{
+			// heights are scaled to the map size so the surface is measured as a landscape instead of a flat plane
+			float heightScale = static_cast<float>(mapSize);
+			float boxSize = mapSize / 4.f;
+			TerrainCore::BoxCountResult result;
+			TimeStep("box count", [&]()
+			{
+				if (options.BoxCountRecursive)
+				{
+					TerrainCore::Heightfield scratch;
+					TerrainCore::HeightfieldBoxOverlap overlapTest(GetFloatHeights(map, scratch), 1.f, heightScale);
+					result = TerrainCore::CountBoxes(overlapTest.GetBounds(), boxSize, options.BoxCountDepth, overlapTest);
+				}
+				else
+					result = TerrainCore::CountHeightfieldBoxes(map.GetView(), 1.f, heightScale, boxSize, options.BoxCountDepth);
+			});
+			auto points = result.GetLogPoints();
+			for (const auto& point : points)
+				std::printf("Log(Size): %f, Log(Ratio): %f\n", point.LogSize, point.LogRatio);
+			auto fit = TerrainCore::FitFractalDimension(points);
+			std::printf("Fractal dimension: %f, R2: %f\n", fit.Dimension, fit.RSquared);
+		}
+
+		if (options.BoxCountDepth > 0 && options.BoxCountTiles > 0)
+		{
+			// every tile is measured on its own, scaled to its own size. The shorter side of the map gets split into N
+			// square tiles
+			int tileSize = std::min(options.Width, options.Height) / options.BoxCountTiles;
+			int tileCountX = std::max(options.Width / std::max(tileSize, 1), 1);
+			std::vector<decltype(std::as_const(map).GetView())> tiles;
+			for (int y = 0; y + tileSize <= options.Height && tileSize > 1; y += tileSize)
+			{
+				for (int x = 0; x + tileSize <= options.Width; x += tileSize)
+					tiles.push_back(std::as_const(map).GetView().SubView(x, y, tileSize, tileSize));
+			}
+
+			TerrainCore::FractalDimensionSettings settings;
+			settings.Depth = options.BoxCountDepth;
+			settings.ThreadCount = options.Noise.ThreadCount;
+			std::vector<TerrainCore::FractalDimensionResult> results;
+			TimeStep("tile box count", [&]() { results = TerrainCore::MeasureFractalDimensions(tiles, settings); });
+			for (size_t i = 0; i < results.size(); ++i)
+				std::printf("Tile %d %d: dimension %f, R2 %f\n", static_cast<int>(i) % tileCountX, static_cast<int>(i) / tileCountX, results[i].Fit.Dimension, results[i].Fit.RSquared);
+		}
+
+		if (options.MeshSectionSize > 0)
+		{
+			TerrainCore::TerrainMeshSettings settings;
+			settings.SectionSize = options.MeshSectionSize;
+			settings.LodCount = options.MeshLodCount;
+			settings.LodDistance = mapSize / 8.f;
+			settings.HeightScale = static_cast<float>(mapSize);
+			settings.ThreadCount = options.Noise.ThreadCount;
+			TerrainCore::TerrainMeshBuilder meshBuilder(settings);
+			meshBuilder.Resize(options.Width, options.Height);
+			meshBuilder.UpdateLods({ TerrainCore::MeshViewer{ options.Width / 2.f, options.Height / 2.f } });
+
+			TerrainCore::Heightfield scratch;
+			auto heights = GetFloatHeights(map, scratch);
+			TimeStep("mesh build", [&]() { meshBuilder.BuildDirtySections(heights); });
+
+			size_t vertexCount = 0;
+			size_t triangleCount = 0;
+			for (int i = 0; i < meshBuilder.GetSectionCount(); ++i)
+			{
+				vertexCount += meshBuilder.GetSection(i).Vertices.size();
+				triangleCount += meshBuilder.GetSection(i).Indices.size() / 3;
+			}
+			std::printf("Mesh sections: %d, vertices: %zu, triangles: %zu\n", meshBuilder.GetSectionCount(), vertexCount, triangleCount);
+
+			// a small change only rebuilds the sections around it
+			meshBuilder.MarkDirty(options.Width / 2, options.Height / 2, 1, 1);
+			std::vector<int> rebuilt;
+			TimeStep("mesh rebuild", [&]() { rebuilt = meshBuilder.BuildDirtySections(heights); });
+			std::printf("Mesh sections rebuilt: %zu\n", rebuilt.size());
+		}
+
+		if (!options.OutputPath.empty())
+		{
+			// the file holds the same texels the engine uploads
+			int texelSize = TerrainCore::GetHeightTexelSize(options.OutputFormat);
+			std::vector<unsigned char> texels(static_cast<size_t>(map.GetSize()) * texelSize);
+			TimeStep("texel conversion", [&]()
+			{
+				TerrainCore::HeightTextureRegion region{ 0, 0, map.GetWidth(), map.GetHeight() };
+				TerrainCore::ConvertHeightsToTexels(map.GetView(), region, options.OutputFormat, texels.data(), map.GetWidth() * texelSize);
+			});
+
+			if (!WriteRawFile(options.OutputPath, texels.data(), texels.size()))
+				return 1;
+		}
+
+		if (!options.NormalsPath.empty())
+		{
+			// heights are scaled to the map size like the box count
+			TerrainCore::HeightNormalField normals(options.Width, options.Height);
+			TimeStep("noise with normals", [&]() { TerrainCore::GenerateFractalNoiseWithNormals(normals.GetView(), options.Noise, static_cast<float>(mapSize)); });
+			if (!WriteRawFile(options.NormalsPath, normals.GetData(), static_cast<size_t>(normals.GetSize())))
+				return 1;
+		}
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BatchOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::fprintf(stderr, "usage: TerrainBatch [--size N] [--width N] [--height N] [--noise perlin|simplex|value] [--fractal fbm|ridged|billow] [--offset X Y] [--scale S] [--octaves N] [--persistance P] [--lacunarity L] [--noise-seed N] [--slope-dampening S] [--threads N] [--seed N] [--hydraulic N] [--hydraulic-mode sequential|parallel|lockstep|water] [--rain R] [--time-step T] [--thermal N] [--thermal-mode sorted|jacobi|active] [--thermal-tolerance T] [--frame-budget MS] [--boxcount DEPTH] [--boxcount-mode pyramid|recursive] [--boxcount-tiles N] [--out FILE] [--out-format r32|r16] [--storage float|uint16] [--normals FILE] [--mesh N] [--mesh-lods N] [--trace FILE]\n");
+		return 1;
+	}
+
+	if (!options.TracePath.empty())
+		TerrainCore::StartTraceRecording();
+	int result = options.QuantizedStorage ? RunBatch<TerrainCore::QuantizedHeightfield>(options) : RunBatch<TerrainCore::Heightfield>(options);
+	if (!options.TracePath.empty() && !WriteTrace(options.TracePath, TerrainCore::StopTraceRecording()))
+		return 1;
+	return result;
+}
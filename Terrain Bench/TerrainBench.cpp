@@ -0,0 +1,462 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Benchmarks every terrain kernel over map sizes and parameters and writes the results as JSON or CSV.
+// usage: TerrainBench [options]
+//   --kernels LIST         kernels to run out of noise,hydraulic,brush,thermal,boxcount (default all)
+//   --sizes LIST           width/height of the maps (default 256,1024), the bake farm sizes go up to 8192
+//   --octaves LIST         fbm octaves of the simplex and perlin generation (default 4,8)
+//   --radii LIST           brush radii of the hydraulic erosion and the brush initialization (default 3,6)
+//   --drops LIST           raindrops per hydraulic run (default 50000)
+//   --hydraulic-modes LIST sequential,parallel,lockstep,water (default all)
+//   --water-passes N       passes of the shallow water mode (default 50)
+//   --thermal-modes LIST   sorted,jacobi,active (default all)
+//   --thermal-iterations N iterations per thermal run (default 10)
+//   --boxcount-depth N     subdivisions of the box count (default 6)
+//   --repeat N             runs per case, the best and the median time are reported (default 3)
+//   --threads N            threads of the parallel kernels, 0 uses every core (default)
+//   --format json|csv      output format (default json)
+//   --out FILE             writes the results to a file instead of stdout
+//
+// Throughput is Mpixels/s for generation and box counting, drops/s for the raindrop modes, Mcells/s per pass for the
+// grid modes and brushes/s for the brush initialization. Memory is the peak resident memory of a case including its
+// map, read from VmHWM after resetting it through /proc/self/clear_refs, -1 where that isn't available.
+
+#include "BoxCountKernel.h"
+#include "CpuFeatures.h"
+#include "ErosionBrush.h"
+#include "FractalNoise.h"
+#include "HydraulicErosionKernel.h"
+#include "Parallel.h"
+#include "SimdKernels.h"
+#include "ThermalErosionKernel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct BenchOptions
+	{
+		std::vector<std::string> Kernels{ "noise", "hydraulic", "brush", "thermal", "boxcount" };
+		std::vector<int> Sizes{ 256, 1024 };
+		std::vector<int> Octaves{ 4, 8 };
+		std::vector<int> Radii{ 3, 6 };
+		std::vector<int> Drops{ 50000 };
+		std::vector<std::string> HydraulicModes{ "sequential", "parallel", "lockstep", "water" };
+		int WaterPasses{ 50 };
+		std::vector<std::string> ThermalModes{ "sorted", "jacobi", "active" };
+		int ThermalIterations{ 10 };
+		int BoxCountDepth{ 6 };
+		int Repeat{ 3 };
+		int ThreadCount{ 0 };
+		bool Csv{ false };
+		std::string OutputPath;
+	};
+
+	// one measured case, parameters that don't apply to the kernel stay 0
+	struct BenchResult
+	{
+		std::string Kernel;
+		std::string Mode;
+		int Size{ 0 };
+		int Octaves{ 0 };
+		int Radius{ 0 };
+		// drops, passes, iterations or brushes of one run
+		int Work{ 0 };
+		double BestMilliseconds{ 0. };
+		double MedianMilliseconds{ 0. };
+		double Throughput{ 0. };
+		const char* Unit{ "" };
+		long BaselineKb{ -1 };
+		long PeakKb{ -1 };
+	};
+
+	std::vector<std::string> SplitList(const char* list)
+	{
+		std::vector<std::string> items;
+		std::string item;
+		for (const char* c = list; ; ++c)
+		{
+			if (*c == ',' || *c == '\0')
+			{
+				if (!item.empty())
+					items.push_back(item);
+				item.clear();
+				if (*c == '\0')
+					break;
+			}
+			else
+				item += *c;
+		}
+		return items;
+	}
+
+	std::vector<int> SplitIntList(const char* list)
+	{
+		std::vector<int> values;
+		for (const auto& item : SplitList(list))
+			values.push_back(std::atoi(item.c_str()));
+		return values;
+	}
+
+	bool Contains(const std::vector<std::string>& items, const char* item)
+	{
+		return std::find(items.begin(), items.end(), item) != items.end();
+	}
+
+	bool ParseOptions(int argc, char** argv, BenchOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string argument = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (argument == "--kernels" && hasValue)
+				options.Kernels = SplitList(argv[++i]);
+			else if (argument == "--sizes" && hasValue)
+				options.Sizes = SplitIntList(argv[++i]);
+			else if (argument == "--octaves" && hasValue)
+				options.Octaves = SplitIntList(argv[++i]);
+			else if (argument == "--radii" && hasValue)
+				options.Radii = SplitIntList(argv[++i]);
+			else if (argument == "--drops" && hasValue)
+				options.Drops = SplitIntList(argv[++i]);
+			else if (argument == "--hydraulic-modes" && hasValue)
+				options.HydraulicModes = SplitList(argv[++i]);
+			else if (argument == "--water-passes" && hasValue)
+				options.WaterPasses = std::atoi(argv[++i]);
+			else if (argument == "--thermal-modes" && hasValue)
+				options.ThermalModes = SplitList(argv[++i]);
+			else if (argument == "--thermal-iterations" && hasValue)
+				options.ThermalIterations = std::atoi(argv[++i]);
+			else if (argument == "--boxcount-depth" && hasValue)
+				options.BoxCountDepth = std::atoi(argv[++i]);
+			else if (argument == "--repeat" && hasValue)
+				options.Repeat = std::max(std::atoi(argv[++i]), 1);
+			else if (argument == "--threads" && hasValue)
+				options.ThreadCount = std::atoi(argv[++i]);
+			else if (argument == "--format" && hasValue)
+			{
+				std::string format = argv[++i];
+				if (format == "json")
+					options.Csv = false;
+				else if (format == "csv")
+					options.Csv = true;
+				else
+					return false;
+			}
+			else if (argument == "--out" && hasValue)
+				options.OutputPath = argv[++i];
+			else
+				return false;
+		}
+		for (int size : options.Sizes)
+		{
+			if (size < 2)
+				return false;
+		}
+		return true;
+	}
+
+	// Linux keeps the peak resident memory of the process as VmHWM, writing 5 to clear_refs resets it to the current
+	// resident memory. Both fail quietly elsewhere
+	bool ResetPeakMemory()
+	{
+		FILE* file = std::fopen("/proc/self/clear_refs", "w");
+		if (!file)
+			return false;
+		bool written = std::fputs("5", file) >= 0;
+		return std::fclose(file) == 0 && written;
+	}
+
+	// a kB field of /proc/self/status, -1 if it can't be read
+	long ReadStatusKb(const char* field)
+	{
+		FILE* file = std::fopen("/proc/self/status", "r");
+		if (!file)
+			return -1;
+		long value = -1;
+		size_t fieldLength = std::strlen(field);
+		char line[256];
+		while (std::fgets(line, sizeof(line), file))
+		{
+			if (std::strncmp(line, field, fieldLength) == 0 && line[fieldLength] == ':')
+			{
+				value = std::strtol(line + fieldLength + 1, nullptr, 10);
+				break;
+			}
+		}
+		std::fclose(file);
+		return value;
+	}
+
+	// Runs a case: setup builds the inputs once, every repetition calls prepare untimed and run timed. The memory
+	// peak covers the inputs and every run
+	void MeasureCase(BenchResult& result, int repeat, const std::function<void()>& setup, const std::function<void()>& prepare, const std::function<void()>& run)
+	{
+		bool peakReset = ResetPeakMemory();
+		result.BaselineKb = peakReset ? ReadStatusKb("VmRSS") : -1;
+		setup();
+
+		std::vector<double> times;
+		for (int i = 0; i < repeat; ++i)
+		{
+			prepare();
+			auto startTime = std::chrono::steady_clock::now();
+			run();
+			std::chrono::duration<double, std::milli> runTime = std::chrono::steady_clock::now() - startTime;
+			times.push_back(runTime.count());
+		}
+		result.PeakKb = peakReset ? ReadStatusKb("VmHWM") : -1;
+
+		std::sort(times.begin(), times.end());
+		result.BestMilliseconds = times.front();
+		result.MedianMilliseconds = times[times.size() / 2];
+	}
+
+	// work per second of the best run, scaled to the unit
+	double GetThroughput(const BenchResult& result, double work, double scale)
+	{
+		return result.BestMilliseconds > 0. ? work / (result.BestMilliseconds / 1000.) / scale : 0.;
+	}
+
+	void Report(std::vector<BenchResult>& results, const BenchResult& result)
+	{
+		std::fprintf(stderr, "%-10s %-10s size %5d octaves %d radius %d work %7d: %10.3f ms, %10.3f %s, peak %ld kB\n", result.Kernel.c_str(), result.Mode.c_str(), result.Size, result.Octaves, result.Radius, result.Work, result.BestMilliseconds, result.Throughput, result.Unit, result.PeakKb);
+		results.push_back(result);
+	}
+
+	void GenerateInput(TerrainCore::Heightfield& map, int size, const BenchOptions& options)
+	{
+		TerrainCore::FractalNoiseSettings settings;
+		settings.Octaves = 6;
+		settings.ThreadCount = options.ThreadCount;
+		map.Resize(size, size);
+		TerrainCore::GenerateFractalNoise(map.GetView(), settings);
+	}
+
+	void BenchNoise(const BenchOptions& options, std::vector<BenchResult>& results)
+	{
+		const std::pair<TerrainCore::NoiseBasis, const char*> bases[] = { { TerrainCore::NoiseBasis::Simplex, "simplex" }, { TerrainCore::NoiseBasis::Perlin, "perlin" } };
+		for (int size : options.Sizes)
+		{
+			for (const auto& basis : bases)
+			{
+				for (int octaves : options.Octaves)
+				{
+					TerrainCore::Heightfield map;
+					TerrainCore::FractalNoiseSettings settings;
+					settings.Basis = basis.first;
+					settings.Octaves = octaves;
+					settings.ThreadCount = options.ThreadCount;
+
+					BenchResult result;
+					result.Kernel = "noise";
+					result.Mode = basis.second;
+					result.Size = size;
+					result.Octaves = octaves;
+					MeasureCase(result, options.Repeat, [&]() { map.Resize(size, size); }, []() {}, [&]() { TerrainCore::GenerateFractalNoise(map.GetView(), settings); });
+					result.Throughput = GetThroughput(result, static_cast<double>(size) * size, 1e6);
+					result.Unit = "Mpixels/s";
+					Report(results, result);
+				}
+			}
+		}
+	}
+
+	void BenchHydraulic(const BenchOptions& options, std::vector<BenchResult>& results)
+	{
+		for (int size : options.Sizes)
+		{
+			for (const auto& mode : options.HydraulicModes)
+			{
+				TerrainCore::HydraulicErosionSettings settings;
+				settings.ThreadCount = options.ThreadCount;
+				if (mode == "parallel")
+					settings.Mode = TerrainCore::HydraulicErosionMode::Parallel;
+				else if (mode == "lockstep")
+					settings.Mode = TerrainCore::HydraulicErosionMode::Lockstep;
+				else if (mode == "water")
+					settings.Mode = TerrainCore::HydraulicErosionMode::ShallowWater;
+				else if (mode != "sequential")
+					continue;
+
+				// the grid mode has no brush and counts passes instead of drops
+				bool isGrid = settings.Mode == TerrainCore::HydraulicErosionMode::ShallowWater;
+				std::vector<int> radii = isGrid ? std::vector<int>{ 0 } : options.Radii;
+				std::vector<int> workAmounts = isGrid ? std::vector<int>{ options.WaterPasses } : options.Drops;
+				for (int radius : radii)
+				{
+					for (int work : workAmounts)
+					{
+						settings.Radius = radius;
+						settings.IterateAmount = work;
+						TerrainCore::Heightfield input;
+						TerrainCore::Heightfield map;
+						TerrainCore::HydraulicErosion erosion;
+
+						BenchResult result;
+						result.Kernel = "hydraulic";
+						result.Mode = mode;
+						result.Size = size;
+						result.Radius = radius;
+						result.Work = work;
+						MeasureCase(result, options.Repeat, [&]() { GenerateInput(input, size, options); map = input; }, [&]() { map = input; }, [&]() { erosion.ErodeTerrain(map.GetView(), settings); });
+						result.Throughput = isGrid ? GetThroughput(result, static_cast<double>(size) * size * work, 1e6) : GetThroughput(result, work, 1.);
+						result.Unit = isGrid ? "Mcells/s per pass" : "drops/s";
+						Report(results, result);
+					}
+				}
+			}
+		}
+	}
+
+	void BenchBrush(const BenchOptions& options, std::vector<BenchResult>& results)
+	{
+		// a fresh brush every time, the erosion keeps its brush as long as the layout and radius stay the same
+		constexpr int brushCount = 1000;
+		for (int size : options.Sizes)
+		{
+			for (int radius : options.Radii)
+			{
+				BenchResult result;
+				result.Kernel = "brush";
+				result.Mode = "prepare";
+				result.Size = size;
+				result.Radius = radius;
+				result.Work = brushCount;
+				MeasureCase(result, options.Repeat, []() {}, []() {}, [&]()
+				{
+					for (int i = 0; i < brushCount; ++i)
+					{
+						TerrainCore::ErosionBrush brush;
+						brush.Prepare(size, size, size, radius);
+					}
+				});
+				result.Throughput = GetThroughput(result, brushCount, 1.);
+				result.Unit = "brushes/s";
+				Report(results, result);
+			}
+		}
+	}
+
+	void BenchThermal(const BenchOptions& options, std::vector<BenchResult>& results)
+	{
+		for (int size : options.Sizes)
+		{
+			for (const auto& mode : options.ThermalModes)
+			{
+				TerrainCore::ThermalErosionSettings settings;
+				settings.IterateAmount = options.ThermalIterations;
+				settings.ThreadCount = options.ThreadCount;
+				if (mode == "jacobi")
+					settings.Mode = TerrainCore::ThermalErosionMode::Jacobi;
+				else if (mode == "active")
+					settings.Mode = TerrainCore::ThermalErosionMode::ActiveSet;
+				else if (mode != "sorted")
+					continue;
+
+				TerrainCore::Heightfield input;
+				TerrainCore::Heightfield map;
+				TerrainCore::ThermalErosion erosion;
+
+				BenchResult result;
+				result.Kernel = "thermal";
+				result.Mode = mode;
+				result.Size = size;
+				result.Work = options.ThermalIterations;
+				MeasureCase(result, options.Repeat, [&]() { GenerateInput(input, size, options); map = input; }, [&]() { map = input; }, [&]() { erosion.ErodeTerrain(map.GetView(), settings); });
+				// the active set mode can stop early, the passes it ran count
+				result.Throughput = GetThroughput(result, static_cast<double>(size) * size * std::max(erosion.GetIterationsRun(), 1), 1e6);
+				result.Unit = "Mcells/s per pass";
+				Report(results, result);
+			}
+		}
+	}
+
+	void BenchBoxCount(const BenchOptions& options, std::vector<BenchResult>& results)
+	{
+		for (int size : options.Sizes)
+		{
+			TerrainCore::Heightfield map;
+			BenchResult result;
+			result.Kernel = "boxcount";
+			result.Mode = "pyramid";
+			result.Size = size;
+			result.Work = options.BoxCountDepth;
+			// heights are scaled to the map size like the batch tool does
+			MeasureCase(result, options.Repeat, [&]() { GenerateInput(map, size, options); }, []() {}, [&]() { TerrainCore::CountHeightfieldBoxes(map.GetView(), 1.f, static_cast<float>(size), size / 4.f, options.BoxCountDepth); });
+			result.Throughput = GetThroughput(result, static_cast<double>(size) * size, 1e6);
+			result.Unit = "Mpixels/s";
+			Report(results, result);
+		}
+	}
+
+	void WriteJson(FILE* file, const BenchOptions& options, const std::vector<BenchResult>& results)
+	{
+		std::fprintf(file, "{\n");
+		std::fprintf(file, "  \"simd\": \"%s\",\n", TerrainCore::GetSimdLevelName(TerrainCore::GetSimdKernels().Level));
+		std::fprintf(file, "  \"threads\": %d,\n", options.ThreadCount > 0 ? options.ThreadCount : TerrainCore::GetHardwareThreadCount());
+		std::fprintf(file, "  \"repeat\": %d,\n", options.Repeat);
+		std::fprintf(file, "  \"results\": [\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const BenchResult& result = results[i];
+			std::fprintf(file, "    { \"kernel\": \"%s\", \"mode\": \"%s\", \"size\": %d, \"octaves\": %d, \"radius\": %d, \"work\": %d, \"best_ms\": %.4f, \"median_ms\": %.4f, \"throughput\": %.4f, \"unit\": \"%s\", \"baseline_kb\": %ld, \"peak_kb\": %ld }%s\n",
+				result.Kernel.c_str(), result.Mode.c_str(), result.Size, result.Octaves, result.Radius, result.Work, result.BestMilliseconds, result.MedianMilliseconds, result.Throughput, result.Unit, result.BaselineKb, result.PeakKb, i + 1 < results.size() ? "," : "");
+		}
+		std::fprintf(file, "  ]\n}\n");
+	}
+
+	void WriteCsv(FILE* file, const std::vector<BenchResult>& results)
+	{
+		std::fprintf(file, "kernel,mode,size,octaves,radius,work,best_ms,median_ms,throughput,unit,baseline_kb,peak_kb\n");
+		for (const BenchResult& result : results)
+		{
+			std::fprintf(file, "%s,%s,%d,%d,%d,%d,%.4f,%.4f,%.4f,%s,%ld,%ld\n", result.Kernel.c_str(), result.Mode.c_str(), result.Size, result.Octaves, result.Radius, result.Work,
+				result.BestMilliseconds, result.MedianMilliseconds, result.Throughput, result.Unit, result.BaselineKb, result.PeakKb);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::fprintf(stderr, "usage: TerrainBench [--kernels noise,hydraulic,brush,thermal,boxcount] [--sizes LIST] [--octaves LIST] [--radii LIST] [--drops LIST] [--hydraulic-modes sequential,parallel,lockstep,water] [--water-passes N] [--thermal-modes sorted,jacobi,active] [--thermal-iterations N] [--boxcount-depth N] [--repeat N] [--threads N] [--format json|csv] [--out FILE]\n");
+		return 1;
+	}
+
+	// results go to stdout or the file, progress goes to stderr
+	std::vector<BenchResult> results;
+	if (Contains(options.Kernels, "noise"))
+		BenchNoise(options, results);
+	if (Contains(options.Kernels, "hydraulic"))
+		BenchHydraulic(options, results);
+	if (Contains(options.Kernels, "brush"))
+		BenchBrush(options, results);
+	if (Contains(options.Kernels, "thermal"))
+		BenchThermal(options, results);
+	if (Contains(options.Kernels, "boxcount"))
+		BenchBoxCount(options, results);
+
+	FILE* file = options.OutputPath.empty() ? stdout : std::fopen(options.OutputPath.c_str(), "w");
+	if (!file)
+	{
+		std::fprintf(stderr, "could not open %s\n", options.OutputPath.c_str());
+		return 1;
+	}
+	if (options.Csv)
+		WriteCsv(file, results);
+	else
+		WriteJson(file, options, results);
+	if (file != stdout)
+		std::fclose(file);
+	return 0;
+}
@@ -0,0 +1,25 @@
+# Fails when an object file of an instruction set defines a weak symbol. Inline functions that are not inlined, like
+# the std math overloads in a debug build, become weak symbols in every file that uses them and the linker keeps any
+# one copy, which can be the one compiled for a wider instruction set than the scalar and SSE4.2 kernels may use.
+# usage: cmake -DNM=<nm> -DOBJECTS=<object files> -P CheckSimdSymbols.cmake
+
+set(checkedObjects 0)
+foreach(object IN LISTS OBJECTS)
+	if(NOT object MATCHES "SimdKernels(SSE42|AVX2|AVX512)\\.cpp\\.(o|obj)$")
+		continue()
+	endif()
+	math(EXPR checkedObjects "${checkedObjects} + 1")
+
+	execute_process(COMMAND "${NM}" -C "${object}" OUTPUT_VARIABLE symbols RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${NM} failed on ${object}")
+	endif()
+
+	# defined weak, weak object and unique symbols
+	string(REGEX MATCHALL "[0-9a-fA-F]+ [WVu] [^\n]+" weakSymbols "${symbols}")
+	if(weakSymbols)
+		string(REPLACE ";" "\n  " weakSymbols "${weakSymbols}")
+		message(FATAL_ERROR "${object} defines weak symbols:\n  ${weakSymbols}")
+	endif()
+endforeach()
+message(STATUS "no weak symbols in ${checkedObjects} instruction set object files")
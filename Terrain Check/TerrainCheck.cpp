@@ -0,0 +1,688 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Checks the equivalences the kernels promise on small maps, registered with ctest.
+// usage: TerrainCheck
+// Prints one line per check and returns 1 if any of them failed.
+
+#include "BoxCountKernel.h"
+#include "CpuFeatures.h"
+#include "DirtyTiles.h"
+#include "FractalNoise.h"
+#include "HeightQuantization.h"
+#include "HeightTexture.h"
+#include "HydraulicErosionKernel.h"
+#include "NoiseFunctions.h"
+#include "SimdKernels.h"
+#include "TerrainMesh.h"
+#include "ThermalErosionKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	// width and height of the maps, not square and not a multiple of any simd width so the remainder loops run too
+	constexpr int CheckWidth = 97;
+	constexpr int CheckHeight = 75;
+	// largest difference between the sorted and the jacobi thermal mode, a few float steps of heights around 1
+	constexpr float CheckSortedTolerance = 1e-5f;
+
+	int FailedChecks = 0;
+
+	void Report(const std::string& name, bool isPassed, const char* detail = "")
+	{
+		std::printf("%s %s%s\n", isPassed ? "ok  " : "FAIL", name.c_str(), detail);
+		if (!isPassed)
+			++FailedChecks;
+	}
+
+	float GetMaxDifference(const TerrainCore::Heightfield& a, const TerrainCore::Heightfield& b)
+	{
+		float maxDifference = 0.f;
+		for (int i = 0; i < a.GetSize(); ++i)
+			maxDifference = std::max(maxDifference, std::abs(a.GetData()[i] - b.GetData()[i]));
+		return maxDifference;
+	}
+
+	bool IsEqual(const TerrainCore::Heightfield& a, const TerrainCore::Heightfield& b)
+	{
+		return a.GetWidth() == b.GetWidth() && a.GetHeight() == b.GetHeight() && std::equal(a.GetData(), a.GetData() + a.GetSize(), b.GetData());
+	}
+
+	// the derivatives of the scalar function are the ones of a batch, values are compared on their own
+	bool IsEqual(const std::vector<TerrainCore::NoiseDerivatives>& derivatives, const std::vector<float>& derivativeX, const std::vector<float>& derivativeY)
+	{
+		for (size_t i = 0; i < derivatives.size(); ++i)
+		{
+			if (derivatives[i].DerivativeX != derivativeX[i] || derivatives[i].DerivativeY != derivativeY[i])
+				return false;
+		}
+		return true;
+	}
+
+	// calls function with every instruction set the cpu and the build have, the kernels are capped to it meanwhile
+	template<typename Function>
+	void ForEachSimdLevel(Function function)
+	{
+		using namespace TerrainCore;
+		SimdLevel initialLimit = GetSimdLevelLimit();
+		for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512 })
+		{
+			// levels the cpu or the build don't have fall back to a lower one that is already checked
+			SetSimdLevelLimit(level);
+			if (GetSimdKernels().Level == level)
+				function(level);
+		}
+		SetSimdLevelLimit(initialLimit);
+	}
+
+	// scalar and batched functions of one noise basis
+	struct NoiseBasisFunctions
+	{
+		const char* Name;
+		float (*Noise)(const TerrainCore::NoisePermutation&, float, float);
+		TerrainCore::NoiseDerivatives (*Derivatives)(const TerrainCore::NoisePermutation&, float, float);
+		void (*Batch)(const TerrainCore::NoisePermutation&, const float*, const float*, float*, int);
+		void (*DerivativesBatch)(const TerrainCore::NoisePermutation&, const float*, const float*, float*, float*, float*, int);
+	};
+
+	// every lane width returns the values of the scalar noise functions, the derivative kernels return the values of the
+	// plain kernels
+	void CheckNoiseBatches()
+	{
+		using namespace TerrainCore;
+		const NoiseBasisFunctions bases[] = {
+			{ "simplex", SimplexNoise2D, SimplexNoise2DDerivatives, SimplexNoise2DBatch, SimplexNoise2DDerivativesBatch },
+			{ "perlin", PerlinNoise2D, PerlinNoise2DDerivatives, PerlinNoise2DBatch, PerlinNoise2DDerivativesBatch },
+			{ "value", ValueNoise2D, ValueNoise2DDerivatives, ValueNoise2DBatch, ValueNoise2DDerivativesBatch },
+		};
+
+		// negative, fractional and large coordinates, a count that leaves a remainder for every lane width
+		std::vector<float> x;
+		std::vector<float> y;
+		for (int i = 0; i < 1003; ++i)
+		{
+			x.push_back((i % 37) * 1.37f - 20.f + i * .001f);
+			y.push_back((i / 37) * 2.71f - 30.f - i * .013f);
+		}
+		int count = static_cast<int>(x.size());
+
+		// the classic permutation and a shuffled one
+		for (uint32_t seed : { DefaultNoiseSeed, 12345u })
+		{
+			const NoisePermutation& permutation = GetNoisePermutation(seed);
+			for (const NoiseBasisFunctions& basis : bases)
+			{
+				std::vector<float> values(x.size());
+				std::vector<NoiseDerivatives> derivatives(x.size());
+				for (int i = 0; i < count; ++i)
+				{
+					values[i] = basis.Noise(permutation, x[i], y[i]);
+					derivatives[i] = basis.Derivatives(permutation, x[i], y[i]);
+				}
+
+				std::string name = std::string(basis.Name) + " noise batch seed " + std::to_string(seed) + ", ";
+				ForEachSimdLevel([&](SimdLevel level)
+				{
+					std::vector<float> result(x.size());
+					basis.Batch(permutation, x.data(), y.data(), result.data(), count);
+					Report(name + GetSimdLevelName(level) + " matches the scalar function", result == values);
+
+					std::vector<float> derivativeX(x.size());
+					std::vector<float> derivativeY(x.size());
+					basis.DerivativesBatch(permutation, x.data(), y.data(), result.data(), derivativeX.data(), derivativeY.data(), count);
+					Report(name + GetSimdLevelName(level) + " derivatives match the scalar function", result == values && IsEqual(derivatives, derivativeX, derivativeY));
+				});
+			}
+		}
+	}
+
+	TerrainCore::FractalNoiseSettings MakeNoiseSettings(TerrainCore::NoiseBasis basis, int threadCount)
+	{
+		TerrainCore::FractalNoiseSettings settings;
+		settings.Basis = basis;
+		settings.Scale = 4.f;
+		settings.Octaves = 6;
+		settings.ThreadCount = threadCount;
+		return settings;
+	}
+
+	TerrainCore::Heightfield MakeNoiseMap(const TerrainCore::FractalNoiseSettings& settings)
+	{
+		TerrainCore::Heightfield map(CheckWidth, CheckHeight);
+		TerrainCore::GenerateFractalNoise(map.GetView(), settings);
+		return map;
+	}
+
+	TerrainCore::Heightfield MakeNoiseMap(TerrainCore::NoiseBasis basis, int threadCount)
+	{
+		return MakeNoiseMap(MakeNoiseSettings(basis, threadCount));
+	}
+
+	// the heights that come with the normals are the plain fbm heights, with and without slope dampening
+	void CheckNoiseNormals()
+	{
+		using namespace TerrainCore;
+		for (float slopeDampening : { 0.f, .5f })
+		{
+			FractalNoiseSettings settings = MakeNoiseSettings(NoiseBasis::Simplex, 2);
+			settings.SlopeDampening = slopeDampening;
+			HeightNormalField normals(CheckWidth, CheckHeight);
+			GenerateFractalNoiseWithNormals(normals.GetView(), settings, 20.f);
+			Heightfield map = MakeNoiseMap(settings);
+			bool isPassed = true;
+			for (int i = 0; i < map.GetSize(); ++i)
+				isPassed = isPassed && normals.GetData()[i].Height == map.GetData()[i];
+			Report(slopeDampening > 0.f ? "slope dampened fbm heights with normals match the plain heights" : "fbm heights with normals match the plain heights", isPassed);
+		}
+	}
+
+	// a chunk of a world is the same part of a map of the whole world, chunks that share an edge agree on it
+	void CheckNoiseChunks()
+	{
+		using namespace TerrainCore;
+		FractalNoiseSettings settings = MakeNoiseSettings(NoiseBasis::Simplex, 2);
+		settings.SamplingWidth = CheckWidth;
+		Heightfield world = MakeNoiseMap(settings);
+		constexpr int chunkX = 30;
+		constexpr int chunkY = 10;
+		Heightfield chunk(40, 30);
+		settings.OriginX = chunkX;
+		settings.OriginY = chunkY;
+		GenerateFractalNoise(chunk.GetView(), settings);
+		bool isPassed = true;
+		for (int y = 0; y < chunk.GetHeight(); ++y)
+		{
+			for (int x = 0; x < chunk.GetWidth(); ++x)
+				isPassed = isPassed && chunk.GetData()[y * chunk.GetWidth() + x] == world.GetData()[(y + chunkY) * CheckWidth + x + chunkX];
+		}
+		Report("noise chunk matches the same part of the world map", isPassed);
+	}
+
+	TerrainCore::HydraulicErosionSettings MakeHydraulicSettings(TerrainCore::HydraulicErosionMode mode, int threadCount)
+	{
+		TerrainCore::HydraulicErosionSettings settings;
+		settings.Mode = mode;
+		// short paths keep the tiles of the parallel mode small enough that the map has several of them
+		settings.MaxPath = 8;
+		settings.Radius = 2;
+		// the shallow water mode counts passes over the whole map
+		settings.IterateAmount = mode == TerrainCore::HydraulicErosionMode::ShallowWater ? 20 : 3000;
+		settings.Seed = 7;
+		settings.ThreadCount = threadCount;
+		return settings;
+	}
+
+	TerrainCore::Heightfield RunHydraulic(TerrainCore::HydraulicErosionMode mode, int threadCount)
+	{
+		TerrainCore::Heightfield map = MakeNoiseMap(TerrainCore::NoiseBasis::Simplex, 1);
+		TerrainCore::HydraulicErosion erosion;
+		erosion.ErodeTerrain(map.GetView(), MakeHydraulicSettings(mode, threadCount));
+		return map;
+	}
+
+	TerrainCore::ThermalErosionSettings MakeThermalSettings(TerrainCore::ThermalErosionMode mode, int threadCount, float maxAngle = .005f, int iterateAmount = 10)
+	{
+		TerrainCore::ThermalErosionSettings settings;
+		// the default max angle is low enough that every cell of the smooth check map sends material
+		settings.MaxAngle = maxAngle;
+		settings.IterateAmount = iterateAmount;
+		settings.Mode = mode;
+		settings.ThreadCount = threadCount;
+		return settings;
+	}
+
+	TerrainCore::Heightfield RunThermal(TerrainCore::ThermalErosionMode mode, int threadCount, float maxAngle = .005f, int iterateAmount = 10)
+	{
+		TerrainCore::Heightfield map = MakeNoiseMap(TerrainCore::NoiseBasis::Simplex, 1);
+		TerrainCore::ThermalErosion erosion;
+		erosion.ErodeTerrain(map.GetView(), MakeThermalSettings(mode, threadCount, maxAngle, iterateAmount));
+		return map;
+	}
+
+	// every run that produces a map, named for the report and called with a thread count
+	std::vector<std::pair<std::string, std::function<TerrainCore::Heightfield(int)>>> GetMapRuns()
+	{
+		using namespace TerrainCore;
+		return {
+			{ "simplex fbm", [](int threadCount) { return MakeNoiseMap(NoiseBasis::Simplex, threadCount); } },
+			{ "perlin fbm", [](int threadCount) { return MakeNoiseMap(NoiseBasis::Perlin, threadCount); } },
+			{ "value fbm", [](int threadCount) { return MakeNoiseMap(NoiseBasis::Value, threadCount); } },
+			{ "seeded simplex fbm", [](int threadCount)
+			{
+				FractalNoiseSettings settings = MakeNoiseSettings(NoiseBasis::Simplex, threadCount);
+				settings.Seed = 12345;
+				return MakeNoiseMap(settings);
+			} },
+			{ "slope dampened ridged perlin noise", [](int threadCount)
+			{
+				FractalNoiseSettings settings = MakeNoiseSettings(NoiseBasis::Perlin, threadCount);
+				settings.Type = FractalNoiseType::Ridged;
+				settings.SlopeDampening = .5f;
+				return MakeNoiseMap(settings);
+			} },
+			{ "billow value noise with 5 octaves", [](int threadCount)
+			{
+				// 5 octaves runs the loop instead of a specialized octave count
+				FractalNoiseSettings settings = MakeNoiseSettings(NoiseBasis::Value, threadCount);
+				settings.Type = FractalNoiseType::Billow;
+				settings.Octaves = 5;
+				return MakeNoiseMap(settings);
+			} },
+			{ "parallel hydraulic erosion", [](int threadCount) { return RunHydraulic(HydraulicErosionMode::Parallel, threadCount); } },
+			{ "lockstep hydraulic erosion", [](int threadCount) { return RunHydraulic(HydraulicErosionMode::Lockstep, threadCount); } },
+			{ "shallow water erosion", [](int threadCount) { return RunHydraulic(HydraulicErosionMode::ShallowWater, threadCount); } },
+			{ "jacobi thermal erosion", [](int threadCount) { return RunThermal(ThermalErosionMode::Jacobi, threadCount); } },
+			{ "active set thermal erosion", [](int threadCount) { return RunThermal(ThermalErosionMode::ActiveSet, threadCount); } },
+		};
+	}
+
+	// the maps are the same with every instruction set
+	void CheckSimdMaps()
+	{
+		for (const auto& run : GetMapRuns())
+		{
+			TerrainCore::Heightfield reference;
+			ForEachSimdLevel([&](TerrainCore::SimdLevel level)
+			{
+				TerrainCore::Heightfield map = run.second(2);
+				if (level == TerrainCore::SimdLevel::Scalar)
+					reference = std::move(map);
+				else
+					Report(run.first + ", " + TerrainCore::GetSimdLevelName(level) + " matches scalar", IsEqual(map, reference));
+			});
+		}
+	}
+
+	// the maps don't depend on the thread count
+	void CheckThreadCounts()
+	{
+		for (const auto& run : GetMapRuns())
+		{
+			TerrainCore::Heightfield reference = run.second(1);
+			bool isPassed = true;
+			for (int threadCount : { 2, 3, 8 })
+				isPassed = isPassed && IsEqual(run.second(threadCount), reference);
+			Report(run.first + " doesn't depend on the thread count", isPassed);
+		}
+	}
+
+	// the active set mode gives the jacobi heights, both while the whole map moves and once it settles
+	void CheckThermalModes()
+	{
+		using namespace TerrainCore;
+		Report("active set thermal erosion matches jacobi", IsEqual(RunThermal(ThermalErosionMode::ActiveSet, 2), RunThermal(ThermalErosionMode::Jacobi, 2)));
+		// at this angle the check map settles after a few dozen iterations, the sparse passes run before it stops
+		Report("settling active set thermal erosion matches jacobi",
+			IsEqual(RunThermal(ThermalErosionMode::ActiveSet, 2, .1f, 200), RunThermal(ThermalErosionMode::Jacobi, 2, .1f, 200)));
+
+		// The sorted mode moves the same material but adds up the transfers of a cell in another order, the results
+		// agree within float rounding. The rounding differences grow over many iterations while every cell moves
+		const std::pair<float, int> sortedRuns[] = { { .005f, 10 }, { .1f, 200 } };
+		for (const auto& run : sortedRuns)
+		{
+			float maxDifference = GetMaxDifference(RunThermal(ThermalErosionMode::Sorted, 1, run.first, run.second), RunThermal(ThermalErosionMode::Jacobi, 2, run.first, run.second));
+			char name[96];
+			std::snprintf(name, sizeof(name), "sorted thermal erosion, max angle %g and %d iterations is within float rounding of jacobi", run.first, run.second);
+			char detail[64];
+			std::snprintf(detail, sizeof(detail), " (max difference %g)", maxDifference);
+			Report(name, maxDifference <= CheckSortedTolerance, detail);
+		}
+	}
+
+	TerrainCore::QuantizedHeightfield RunQuantizedHydraulic(int threadCount)
+	{
+		TerrainCore::QuantizedHeightfield map(CheckWidth, CheckHeight);
+		TerrainCore::GenerateFractalNoise(map.GetView(), MakeNoiseSettings(TerrainCore::NoiseBasis::Simplex, 1));
+		TerrainCore::HydraulicErosion erosion;
+		erosion.ErodeTerrain(map.GetView(), MakeHydraulicSettings(TerrainCore::HydraulicErosionMode::Parallel, threadCount));
+		return map;
+	}
+
+	// quantized noise is within half a step of the float noise, a round trip keeps the quantized heights and the
+	// stochastic rounding of the erosion doesn't depend on the thread count
+	void CheckQuantizedMaps()
+	{
+		using namespace TerrainCore;
+		Heightfield map = MakeNoiseMap(NoiseBasis::Simplex, 1);
+		QuantizedHeightfield quantized(CheckWidth, CheckHeight);
+		GenerateFractalNoise(quantized.GetView(), MakeNoiseSettings(NoiseBasis::Simplex, 1));
+		float maxDifference = 0.f;
+		for (int i = 0; i < map.GetSize(); ++i)
+			maxDifference = std::max(maxDifference, std::abs(DequantizeHeight(quantized.GetData()[i]) - map.GetData()[i]));
+		char detail[64];
+		std::snprintf(detail, sizeof(detail), " (max difference %g steps)", maxDifference / QuantizedHeightStep);
+		Report("quantized noise is within half a step of the float noise", maxDifference <= QuantizedHeightStep * .5f, detail);
+
+		Heightfield dequantized(CheckWidth, CheckHeight);
+		QuantizedHeightfield roundTrip(CheckWidth, CheckHeight);
+		DequantizeHeightfield(quantized.GetView(), dequantized.GetView());
+		QuantizeHeightfield(dequantized.GetView(), roundTrip.GetView());
+		Report("quantized round trip keeps the heights", std::equal(quantized.GetData(), quantized.GetData() + quantized.GetSize(), roundTrip.GetData()));
+
+		QuantizedHeightfield reference = RunQuantizedHydraulic(1);
+		bool isPassed = true;
+		for (int threadCount : { 2, 3, 8 })
+		{
+			QuantizedHeightfield eroded = RunQuantizedHydraulic(threadCount);
+			isPassed = isPassed && std::equal(eroded.GetData(), eroded.GetData() + eroded.GetSize(), reference.GetData());
+		}
+		Report("quantized parallel hydraulic erosion doesn't depend on the thread count", isPassed);
+	}
+
+	// every instruction set converts the heights to the same r16 texels
+	void CheckHeightTexels()
+	{
+		using namespace TerrainCore;
+		Heightfield map = MakeNoiseMap(NoiseBasis::Simplex, 1);
+		// a region that starts and ends off the lane widths, heights out of the 0 1 range get clamped
+		map.GetData()[CheckWidth + 3] = -.5f;
+		map.GetData()[CheckWidth + 4] = 1.5f;
+		HeightTextureRegion region{ 3, 1, CheckWidth - 5, CheckHeight - 2 };
+		int pitch = region.Width * GetHeightTexelSize(HeightTextureFormat::R16);
+		std::vector<uint16_t> reference;
+		ForEachSimdLevel([&](SimdLevel level)
+		{
+			std::vector<uint16_t> texels(region.Width * region.Height);
+			ConvertHeightsToTexels(map.GetView(), region, HeightTextureFormat::R16, texels.data(), pitch);
+			if (level == SimdLevel::Scalar)
+				reference = std::move(texels);
+			else
+				Report(std::string("r16 texels, ") + GetSimdLevelName(level) + " matches scalar", texels == reference);
+		});
+	}
+
+	// the pyramid counts of a heightfield are the counts of testing every box, on square and non square maps. Depths
+	// with boxes smaller than a cell are left out
+	void CheckBoxCounts()
+	{
+		using namespace TerrainCore;
+		struct BoxCountCase
+		{
+			float BoxSize;
+			int Depth;
+			// depths that keep boxes at least a cell wide
+			int CountedDepth;
+		};
+		const BoxCountCase cases[] = { { 12.5f, 2, 2 }, { 7.f, 3, 3 }, { 16.f, 4, 4 }, { 30.f, 5, 5 }, { 12.5f, 8, 4 }, { 1.f, 3, 1 } };
+		const std::pair<int, int> sizes[] = { { CheckWidth, CheckHeight }, { 40, 90 }, { 64, 64 } };
+		constexpr float heightScale = 40.f;
+		for (const auto& size : sizes)
+		{
+			Heightfield map(size.first, size.second);
+			GenerateFractalNoise(map.GetView(), MakeNoiseSettings(NoiseBasis::Simplex, 1));
+			HeightfieldBoxOverlap overlapTest(map.GetView(), 1.f, heightScale);
+			for (const BoxCountCase& boxCase : cases)
+			{
+				BoxCountResult boxes = CountBoxes(overlapTest.GetBounds(), boxCase.BoxSize, boxCase.CountedDepth, overlapTest);
+				BoxCountResult pyramid = CountHeightfieldBoxes(map.GetView(), 1.f, heightScale, boxCase.BoxSize, boxCase.Depth);
+				char name[112];
+				std::snprintf(name, sizeof(name), "box counts of a %dx%d map, box size %g depth %d match the overlap test to depth %d",
+					size.first, size.second, boxCase.BoxSize, boxCase.Depth, boxCase.CountedDepth);
+				Report(name, pyramid.Collisions == boxes.Collisions && pyramid.TotalBoxes == boxes.TotalBoxes && pyramid.BoxSize == boxes.BoxSize);
+			}
+			Report("box counts of boxes smaller than a cell are empty", CountHeightfieldBoxes(map.GetView(), 1.f, heightScale, .5f, 3).Collisions.empty());
+		}
+	}
+
+	// Every changed cell lies in a dirty tile, with isExact every dirty tile also holds a changed cell. The merged
+	// rectangles cover the dirty tiles and nothing else
+	bool IsDirtyTilesMatching(const TerrainCore::Heightfield& before, const TerrainCore::Heightfield& after, const TerrainCore::DirtyTileMask& mask, bool isExact)
+	{
+		int tileShift = 0;
+		while ((1 << tileShift) < mask.GetTileSize())
+			++tileShift;
+		std::vector<uint8_t> isTileChanged(mask.GetTileCount(), 0);
+		std::vector<uint8_t> isCovered(before.GetSize(), 0);
+		for (const TerrainCore::DirtyRect& rect : mask.GetDirtyRects())
+		{
+			for (int y = rect.Y; y < rect.Y + rect.Height; ++y)
+			{
+				for (int x = rect.X; x < rect.X + rect.Width; ++x)
+					++isCovered[y * before.GetWidth() + x];
+			}
+		}
+
+		for (int y = 0; y < before.GetHeight(); ++y)
+		{
+			for (int x = 0; x < before.GetWidth(); ++x)
+			{
+				int i = y * before.GetWidth() + x;
+				bool isDirty = mask.IsTileDirty(x >> tileShift, y >> tileShift);
+				if (before.GetData()[i] != after.GetData()[i])
+				{
+					isTileChanged[(x >> tileShift) + (y >> tileShift) * mask.GetTileCountX()] = 1;
+					if (!isDirty)
+						return false;
+				}
+				// rectangles don't overlap either
+				if (isCovered[i] != (isDirty ? 1 : 0))
+					return false;
+			}
+		}
+		for (int y = 0; isExact && y < mask.GetTileCountY(); ++y)
+		{
+			for (int x = 0; x < mask.GetTileCountX(); ++x)
+			{
+				if (mask.IsTileDirty(x, y) && !isTileChanged[x + y * mask.GetTileCountX()])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// a single drop in flight takes the steps of the sequential drop, every seed spawns it somewhere else
+	void CheckLockstepDrops()
+	{
+		using namespace TerrainCore;
+		Heightfield map = MakeNoiseMap(NoiseBasis::Simplex, 1);
+		bool isPassed = true;
+		for (uint32_t seed = 1; seed <= 20; ++seed)
+		{
+			Heightfield lockstep = map;
+			Heightfield sequential = map;
+			HydraulicErosionSettings settings = MakeHydraulicSettings(HydraulicErosionMode::Lockstep, 1);
+			settings.MaxPath = 30;
+			settings.IterateAmount = 1;
+			settings.Seed = seed;
+			HydraulicErosion erosion;
+			erosion.ErodeTerrain(lockstep.GetView(), settings);
+			settings.Mode = HydraulicErosionMode::Sequential;
+			erosion.ErodeTerrain(sequential.GetView(), settings);
+			isPassed = isPassed && !IsEqual(lockstep, map) && IsEqual(lockstep, sequential);
+		}
+		Report("lockstep hydraulic erosion of single drops matches sequential", isPassed);
+	}
+
+	// Progressive runs sliced as thin as they go give the blocking results, the drops of every hydraulic mode run in
+	// spawn order like the sequential mode
+	void CheckProgressiveErosion()
+	{
+		using namespace TerrainCore;
+		struct ProgressiveRun
+		{
+			const char* Name;
+			HydraulicErosionMode Mode;
+			// blocking mode with the same result
+			HydraulicErosionMode BlockingMode;
+		};
+		const ProgressiveRun hydraulicRuns[] = {
+			{ "progressive sequential hydraulic erosion matches blocking", HydraulicErosionMode::Sequential, HydraulicErosionMode::Sequential },
+			{ "progressive parallel hydraulic erosion matches blocking sequential", HydraulicErosionMode::Parallel, HydraulicErosionMode::Sequential },
+			{ "progressive shallow water erosion matches blocking", HydraulicErosionMode::ShallowWater, HydraulicErosionMode::ShallowWater } };
+		for (const ProgressiveRun& run : hydraulicRuns)
+		{
+			Heightfield map = MakeNoiseMap(NoiseBasis::Simplex, 1);
+			HydraulicErosion erosion;
+			erosion.BeginProgressive(map.GetView(), MakeHydraulicSettings(run.Mode, 2));
+			// a budget of 0 advances by one drop or pass
+			while (!erosion.AdvanceProgressive(0.))
+			{
+			}
+			Report(run.Name, IsEqual(map, RunHydraulic(run.BlockingMode, 2)));
+		}
+
+		for (ThermalErosionMode mode : { ThermalErosionMode::Jacobi, ThermalErosionMode::ActiveSet })
+		{
+			Heightfield map = MakeNoiseMap(NoiseBasis::Simplex, 1);
+			ThermalErosion erosion;
+			erosion.BeginProgressive(map.GetView(), MakeThermalSettings(mode, 2));
+			while (!erosion.AdvanceProgressive(0.))
+			{
+			}
+			Report(mode == ThermalErosionMode::Jacobi ? "progressive jacobi thermal erosion matches blocking" : "progressive active set thermal erosion matches blocking",
+				IsEqual(map, RunThermal(mode, 2)));
+		}
+	}
+
+	bool IsEqual(const TerrainCore::HydraulicErosionStats& a, const TerrainCore::HydraulicErosionStats& b)
+	{
+		return a.Drops == b.Drops && a.StalledDrops == b.StalledDrops && a.LeftMapDrops == b.LeftMapDrops && a.MaxPathDrops == b.MaxPathDrops
+			&& a.PathSteps == b.PathSteps && a.Eroded == b.Eroded && a.Deposited == b.Deposited;
+	}
+
+	// the parallel mode adds up the counters of its tiles in order, they don't depend on the thread count
+	void CheckErosionStats()
+	{
+		using namespace TerrainCore;
+		Heightfield map = MakeNoiseMap(NoiseBasis::Simplex, 1);
+		HydraulicErosion erosion;
+		Heightfield reference = map;
+		erosion.ErodeTerrain(reference.GetView(), MakeHydraulicSettings(HydraulicErosionMode::Parallel, 1));
+		HydraulicErosionStats stats = erosion.GetStats();
+		bool isPassed = stats.Drops > 0 && stats.PathSteps > 0;
+		for (int threadCount : { 2, 3, 8 })
+		{
+			Heightfield eroded = map;
+			erosion.ErodeTerrain(eroded.GetView(), MakeHydraulicSettings(HydraulicErosionMode::Parallel, threadCount));
+			isPassed = isPassed && IsEqual(erosion.GetStats(), stats);
+		}
+		Report("parallel hydraulic erosion counters don't depend on the thread count", isPassed);
+
+		ThermalErosion thermal;
+		Heightfield jacobi = map;
+		thermal.ErodeTerrain(jacobi.GetView(), MakeThermalSettings(ThermalErosionMode::Jacobi, 1));
+		ThermalErosionStats thermalStats = thermal.GetStats();
+		isPassed = true;
+		for (int threadCount : { 2, 3, 8 })
+		{
+			Heightfield eroded = map;
+			thermal.ErodeTerrain(eroded.GetView(), MakeThermalSettings(ThermalErosionMode::Jacobi, threadCount));
+			isPassed = isPassed && thermal.GetStats().SendingCellsPerIteration == thermalStats.SendingCellsPerIteration && thermal.GetStats().MovedMass == thermalStats.MovedMass;
+		}
+		Report("jacobi thermal erosion counters don't depend on the thread count", isPassed);
+	}
+
+	// the dirty tiles of the erosion hold every cell it changed, the jacobi and active set modes mark no others
+	void CheckDirtyTiles()
+	{
+		using namespace TerrainCore;
+		for (HydraulicErosionMode mode : { HydraulicErosionMode::Sequential, HydraulicErosionMode::Parallel })
+		{
+			Heightfield before = MakeNoiseMap(NoiseBasis::Simplex, 1);
+			Heightfield after = before;
+			HydraulicErosion erosion;
+			// few short drops leave parts of the map untouched
+			HydraulicErosionSettings settings = MakeHydraulicSettings(mode, 2);
+			settings.IterateAmount = 20;
+			erosion.ErodeTerrain(after.GetView(), settings);
+			Report(mode == HydraulicErosionMode::Parallel ? "parallel hydraulic dirty tiles hold the changes" : "sequential hydraulic dirty tiles hold the changes",
+				IsDirtyTilesMatching(before, after, erosion.GetDirtyTiles(), false));
+		}
+
+		const std::pair<const char*, ThermalErosionMode> modes[] = {
+			{ "sorted", ThermalErosionMode::Sorted }, { "jacobi", ThermalErosionMode::Jacobi }, { "active set", ThermalErosionMode::ActiveSet } };
+		for (const auto& mode : modes)
+		{
+			// a spike at the corner of four tiles slides into them and leaves the rest of the flat map alone
+			Heightfield before(CheckWidth, CheckHeight);
+			before.GetData()[31 * CheckWidth + 31] = 1.f;
+			Heightfield after = before;
+			ThermalErosionSettings settings;
+			settings.Mode = mode.second;
+			settings.IterateAmount = 10;
+			settings.ThreadCount = 2;
+			ThermalErosion erosion;
+			erosion.ErodeTerrain(after.GetView(), settings);
+			bool isExact = mode.second != ThermalErosionMode::Sorted;
+			Report(std::string(mode.first) + " thermal dirty tiles " + (isExact ? "are the changes" : "hold the changes"),
+				!erosion.GetDirtyTiles().IsEmpty() && erosion.GetDirtyTiles().GetDirtyTileCount() < erosion.GetDirtyTiles().GetTileCount()
+				&& IsDirtyTilesMatching(before, after, erosion.GetDirtyTiles(), isExact));
+		}
+	}
+
+	bool IsEqual(const TerrainCore::TerrainMeshSection& a, const TerrainCore::TerrainMeshSection& b)
+	{
+		auto isVertexEqual = [](const TerrainCore::TerrainMeshVertex& a, const TerrainCore::TerrainMeshVertex& b)
+		{
+			return a.X == b.X && a.Y == b.Y && a.Z == b.Z && a.NormalX == b.NormalX && a.NormalY == b.NormalY && a.NormalZ == b.NormalZ && a.U == b.U && a.V == b.V;
+		};
+		return a.X == b.X && a.Y == b.Y && a.Lod == b.Lod && a.Indices == b.Indices && a.Vertices.size() == b.Vertices.size()
+			&& std::equal(a.Vertices.begin(), a.Vertices.end(), b.Vertices.begin(), isVertexEqual);
+	}
+
+	// rebuilding the dirty sections after a change gives the sections of a full build, whatever the thread count
+	void CheckMeshSections()
+	{
+		using namespace TerrainCore;
+		Heightfield map = MakeNoiseMap(NoiseBasis::Simplex, 1);
+		TerrainMeshSettings settings;
+		settings.SectionSize = 16;
+		settings.LodCount = 3;
+		settings.LodDistance = 20.f;
+		settings.ThreadCount = 3;
+		// sections at every detail level
+		const std::vector<MeshViewer> viewers = { { 20.f, 30.f } };
+		TerrainMeshBuilder incremental(settings);
+		incremental.UpdateLods(viewers);
+		incremental.BuildDirtySections(map.GetView());
+
+		// a change next to the corner of four sections, the sections past it only read it for their normals
+		constexpr int changeX = 47;
+		constexpr int changeY = 31;
+		for (int y = changeY; y < changeY + 3; ++y)
+		{
+			for (int x = changeX; x < changeX + 2; ++x)
+				map.GetData()[y * CheckWidth + x] += .1f;
+		}
+		incremental.MarkDirty(changeX, changeY, 2, 3);
+		incremental.BuildDirtySections(map.GetView());
+
+		settings.ThreadCount = 1;
+		TerrainMeshBuilder full(settings);
+		full.UpdateLods(viewers);
+		full.BuildDirtySections(map.GetView());
+		bool isPassed = incremental.GetSectionCount() == full.GetSectionCount();
+		for (int i = 0; isPassed && i < full.GetSectionCount(); ++i)
+			isPassed = IsEqual(incremental.GetSection(i), full.GetSection(i));
+		Report("rebuilt mesh sections match a full build", isPassed);
+	}
+}
+
+int main()
+{
+	CheckNoiseBatches();
+	CheckNoiseNormals();
+	CheckNoiseChunks();
+	CheckSimdMaps();
+	CheckThreadCounts();
+	CheckThermalModes();
+	CheckBoxCounts();
+	CheckHeightTexels();
+	CheckQuantizedMaps();
+	CheckMeshSections();
+	CheckDirtyTiles();
+	CheckLockstepDrops();
+	CheckProgressiveErosion();
+	CheckErosionStats();
+
+	if (FailedChecks > 0)
+		std::printf("%d checks failed\n", FailedChecks);
+	return FailedChecks > 0 ? 1 : 0;
+}
@@ -0,0 +1,349 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BoxCountKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace TerrainCore
+{
+	// boxes of the first depth, centered around the bounds
+	struct BoxCountGrid
+	{
+		int DimensionsX;
+		int DimensionsY;
+		int DimensionsZ;
+		float DefaultX;
+		float DefaultY;
+		float DefaultZ;
+	};
+
+	static BoxCountGrid MakeBoxCountGrid(const BoxCountBounds& bounds, float boxSize)
+	{
+		float boundsX = bounds.MaxX - bounds.MinX;
+		float boundsY = bounds.MaxY - bounds.MinY;
+		float boundsZ = bounds.MaxZ - bounds.MinZ;
+
+		BoxCountGrid grid;
+		grid.DimensionsX = static_cast<int>(std::ceil(boundsX / boxSize));
+		grid.DimensionsY = static_cast<int>(std::ceil(boundsY / boxSize));
+		grid.DimensionsZ = static_cast<int>(std::ceil(boundsZ / boxSize));
+
+		grid.DefaultX = bounds.MinX - (grid.DimensionsX * boxSize - boundsX) / 2.f;
+		grid.DefaultY = bounds.MinY - (grid.DimensionsY * boxSize - boundsY) / 2.f;
+		grid.DefaultZ = bounds.MinZ - (grid.DimensionsZ * boxSize - boundsZ) / 2.f;
+		return grid;
+	}
+
+	// helper function that splits cube into 8 cubes(recursive)
+	static void SplitCube(int depth, float boxSize, float positionX, float positionY, float positionZ, const BoxOverlapTest& overlapTest, std::vector<int>& collisions)
+	{
+		// decreases depth
+		depth--;
+		// if depth smaller or equal to 0, escape
+		if (depth <= 0)
+			return;
+
+		// decrease boxsize
+		boxSize *= 0.5f;
+
+		// loop that splits box into 8 boxes
+		for (int x = 0; x < 2; x++)
+		{
+			for (int y = 0; y < 2; y++)
+			{
+				for (int z = 0; z < 2; z++)
+				{
+					// get current box position and check if box overlaps with terrain
+					CountBox currentBox{ positionX + boxSize * x, positionY + boxSize * y, positionZ + boxSize * z, boxSize };
+					if (overlapTest(currentBox))
+					{
+						// if overlaps add to the collision count within this depth, split cube again
+						collisions[depth - 1] += 1;
+						SplitCube(depth, boxSize, currentBox.X, currentBox.Y, currentBox.Z, overlapTest, collisions);
+					}
+				}
+			}
+		}
+	}
+
+	BoxCountResult CountBoxes(const BoxCountBounds& bounds, float boxSize, int depth, const BoxOverlapTest& overlapTest)
+	{
+		BoxCountResult result;
+		result.BoxSize = boxSize;
+		if (depth <= 0 || boxSize <= 0.f)
+			return result;
+
+		// reset collision list
+		result.Collisions.assign(depth, 0);
+
+		// boxes are centered around the bounds
+		BoxCountGrid grid = MakeBoxCountGrid(bounds, boxSize);
+		int dimensionsX = grid.DimensionsX;
+		int dimensionsY = grid.DimensionsY;
+		int dimensionsZ = grid.DimensionsZ;
+		float defaultX = grid.DefaultX;
+		float defaultY = grid.DefaultY;
+		float defaultZ = grid.DefaultZ;
+
+		// calculate total boxes on first depth
+		result.TotalBoxes = dimensionsX * dimensionsY * dimensionsZ;
+		for (int x = 0; x < dimensionsX; ++x)
+		{
+			for (int y = 0; y < dimensionsY; ++y)
+			{
+				for (int z = 0; z < dimensionsZ; ++z)
+				{
+					CountBox currentBox{ defaultX + boxSize * x, defaultY + boxSize * y, defaultZ + boxSize * z, boxSize };
+					if (overlapTest(currentBox))
+					{
+						// add to collision and split cube
+						result.Collisions[depth - 1] += 1;
+						SplitCube(depth, boxSize, currentBox.X, currentBox.Y, currentBox.Z, overlapTest, result.Collisions);
+					}
+				}
+			}
+		}
+		return result;
+	}
+
+	std::vector<BoxCountPoint> BoxCountResult::GetLogPoints() const
+	{
+		std::vector<BoxCountPoint> points;
+		points.reserve(Collisions.size());
+
+		float totalBoxes = static_cast<float>(TotalBoxes);
+		float boxSize = BoxSize;
+		int depth = static_cast<int>(Collisions.size());
+		for (int i = 1; i <= depth; ++i)
+		{
+			float ratio = Collisions[depth - i] / totalBoxes;
+			points.push_back({ std::log(1.f / boxSize), std::log(ratio) });
+			totalBoxes *= 8.f;
+			boxSize *= 0.5f;
+		}
+		return points;
+	}
+
+	HeightfieldBoxOverlap::HeightfieldBoxOverlap(ConstHeightfieldView map, float cellSize, float heightScale)
+		: m_Map{ map }
+		, m_CellSize{ cellSize }
+		, m_HeightScale{ heightScale }
+	{
+	}
+
+	bool HeightfieldBoxOverlap::operator()(const CountBox& box) const
+	{
+		// sample range that covers the footprint of the box
+		int firstX = std::max(static_cast<int>(std::floor(box.X / m_CellSize)), 0);
+		int firstY = std::max(static_cast<int>(std::floor(box.Y / m_CellSize)), 0);
+		int lastX = std::min(static_cast<int>(std::ceil((box.X + box.Size) / m_CellSize)), m_Map.Width - 1);
+		int lastY = std::min(static_cast<int>(std::ceil((box.Y + box.Size) / m_CellSize)), m_Map.Height - 1);
+		if (firstX > lastX || firstY > lastY)
+			return false;
+
+		// the surface overlaps if its height range within the footprint intersects the box height range
+		float lowest = m_Map.At(firstX, firstY);
+		float highest = lowest;
+		for (int y = firstY; y <= lastY; ++y)
+		{
+			for (int x = firstX; x <= lastX; ++x)
+			{
+				float height = m_Map.At(x, y);
+				lowest = std::min(lowest, height);
+				highest = std::max(highest, height);
+			}
+		}
+		return highest * m_HeightScale >= box.Z && lowest * m_HeightScale <= box.Z + box.Size;
+	}
+
+	// bounds of the surface of a float or quantized map
+	template<typename ViewType>
+	static BoxCountBounds GetHeightfieldBounds(ViewType map, float cellSize, float heightScale)
+	{
+		auto range = GetMinMax(map);
+		return { 0.f, 0.f, range.first * heightScale, (map.Width - 1) * cellSize, (map.Height - 1) * cellSize, range.second * heightScale };
+	}
+
+	BoxCountBounds HeightfieldBoxOverlap::GetBounds() const
+	{
+		return GetHeightfieldBounds(m_Map, m_CellSize, m_HeightScale);
+	}
+
+	// height of a float or quantized sample
+	static float GetBoxCountHeight(float sample)
+	{
+		return sample;
+	}
+
+	static float GetBoxCountHeight(uint16_t sample)
+	{
+		return DequantizeHeight(sample);
+	}
+
+	// first and last sample under every box along one axis, first > last when the box misses the map
+	static void GetBoxFootprints(float defaultPosition, float boxSize, int boxCount, float cellSize, int sampleCount, std::vector<int>& first, std::vector<int>& last)
+	{
+		first.resize(boxCount);
+		last.resize(boxCount);
+		for (int i = 0; i < boxCount; ++i)
+		{
+			float position = defaultPosition + boxSize * i;
+			first[i] = std::max(static_cast<int>(std::floor(position / cellSize)), 0);
+			last[i] = std::min(static_cast<int>(std::ceil((position + boxSize) / cellSize)), sampleCount - 1);
+		}
+	}
+
+	// amount of boxes in a column of boxCount boxes that overlap the height range [lowest, highest]
+	static int CountColumnBoxes(float defaultZ, float boxSize, int boxCount, float lowest, float highest)
+	{
+		if (lowest > highest)
+			return 0;
+
+		// estimate of the first and last overlapping box, corrected with the exact test of the overlap function
+		auto boxZ = [&](int k) { return defaultZ + boxSize * k; };
+		int firstBox = std::min(std::max(static_cast<int>(std::floor((lowest - defaultZ) / boxSize)) - 1, 0), boxCount);
+		while (firstBox < boxCount && boxZ(firstBox) + boxSize < lowest)
+			++firstBox;
+		while (firstBox > 0 && boxZ(firstBox - 1) + boxSize >= lowest)
+			--firstBox;
+
+		int lastBox = std::min(std::max(static_cast<int>(std::floor((highest - defaultZ) / boxSize)) + 1, -1), boxCount - 1);
+		while (lastBox >= 0 && boxZ(lastBox) > highest)
+			--lastBox;
+		while (lastBox + 1 < boxCount && boxZ(lastBox + 1) <= highest)
+			++lastBox;
+
+		return std::max(lastBox - firstBox + 1, 0);
+	}
+
+	template<typename ViewType>
+	static BoxCountResult CountMapBoxes(ViewType map, float cellSize, float heightScale, float boxSize, int depth)
+	{
+		BoxCountResult result;
+		result.BoxSize = boxSize;
+		// boxes smaller than a cell see the same samples as a cell sized box, the column grid would only grow
+		if (depth <= 0 || boxSize < cellSize || cellSize <= 0.f || map.IsEmpty())
+			return result;
+
+		// Box columns of the deepest level, levels with boxes smaller than a cell are left out so the columns never
+		// outnumber the samples of the grid bounds
+		int deepest = 0;
+		float deepestSize = boxSize;
+		while (deepest < depth - 1 && deepestSize * 0.5f >= cellSize)
+		{
+			deepestSize *= 0.5f;
+			++deepest;
+		}
+		int levelCount = deepest + 1;
+		result.Collisions.assign(levelCount, 0);
+		BoxCountGrid grid = MakeBoxCountGrid(GetHeightfieldBounds(map, cellSize, heightScale), boxSize);
+		result.TotalBoxes = grid.DimensionsX * grid.DimensionsY * grid.DimensionsZ;
+
+		int columnsX = grid.DimensionsX << deepest;
+		int columnsY = grid.DimensionsY << deepest;
+
+		std::vector<int> firstX, lastX, firstY, lastY;
+		GetBoxFootprints(grid.DefaultX, deepestSize, columnsX, cellSize, map.Width, firstX, lastX);
+		GetBoxFootprints(grid.DefaultY, deepestSize, columnsY, cellSize, map.Height, firstY, lastY);
+
+		// height range of every row under every box column, empty ranges have lowest > highest
+		const float emptyLowest = std::numeric_limits<float>::max();
+		const float emptyHighest = -std::numeric_limits<float>::max();
+		std::vector<float> rowLowest(static_cast<size_t>(map.Height) * columnsX);
+		std::vector<float> rowHighest(rowLowest.size());
+		for (int y = 0; y < map.Height; ++y)
+		{
+			auto heightRow = map.Row(y);
+			float* lowestRow = rowLowest.data() + static_cast<size_t>(y) * columnsX;
+			float* highestRow = rowHighest.data() + static_cast<size_t>(y) * columnsX;
+			for (int i = 0; i < columnsX; ++i)
+			{
+				float lowest = emptyLowest;
+				float highest = emptyHighest;
+				for (int x = firstX[i]; x <= lastX[i]; ++x)
+				{
+					float height = GetBoxCountHeight(heightRow[x]);
+					lowest = std::min(lowest, height);
+					highest = std::max(highest, height);
+				}
+				lowestRow[i] = lowest;
+				highestRow[i] = highest;
+			}
+		}
+
+		// height range under every box column, scaled to box space
+		std::vector<float> columnLowest(static_cast<size_t>(columnsX) * columnsY, emptyLowest);
+		std::vector<float> columnHighest(columnLowest.size(), emptyHighest);
+		for (int j = 0; j < columnsY; ++j)
+		{
+			float* lowestColumn = columnLowest.data() + static_cast<size_t>(j) * columnsX;
+			float* highestColumn = columnHighest.data() + static_cast<size_t>(j) * columnsX;
+			for (int y = firstY[j]; y <= lastY[j]; ++y)
+			{
+				const float* lowestRow = rowLowest.data() + static_cast<size_t>(y) * columnsX;
+				const float* highestRow = rowHighest.data() + static_cast<size_t>(y) * columnsX;
+				for (int i = 0; i < columnsX; ++i)
+				{
+					lowestColumn[i] = std::min(lowestColumn[i], lowestRow[i]);
+					highestColumn[i] = std::max(highestColumn[i], highestRow[i]);
+				}
+			}
+		}
+		for (size_t c = 0; c < columnLowest.size(); ++c)
+		{
+			if (columnLowest[c] <= columnHighest[c])
+			{
+				columnLowest[c] *= heightScale;
+				columnHighest[c] *= heightScale;
+			}
+		}
+
+		// counts every level and combines 2x2 columns for the next coarser one, the footprint of a box is the union
+		// of the footprints of its children
+		float levelSize = deepestSize;
+		for (int level = deepest; level >= 0; --level)
+		{
+			int boxesZ = grid.DimensionsZ << level;
+			int collisions = 0;
+			for (size_t c = 0; c < columnLowest.size(); ++c)
+				collisions += CountColumnBoxes(grid.DefaultZ, levelSize, boxesZ, columnLowest[c], columnHighest[c]);
+			result.Collisions[levelCount - 1 - level] = collisions;
+
+			if (level == 0)
+				break;
+
+			int parentsX = columnsX / 2;
+			int parentsY = columnsY / 2;
+			for (int j = 0; j < parentsY; ++j)
+			{
+				for (int i = 0; i < parentsX; ++i)
+				{
+					size_t child = static_cast<size_t>(2 * j) * columnsX + 2 * i;
+					size_t childBelow = child + columnsX;
+					size_t parent = static_cast<size_t>(j) * parentsX + i;
+					columnLowest[parent] = std::min(std::min(columnLowest[child], columnLowest[child + 1]), std::min(columnLowest[childBelow], columnLowest[childBelow + 1]));
+					columnHighest[parent] = std::max(std::max(columnHighest[child], columnHighest[child + 1]), std::max(columnHighest[childBelow], columnHighest[childBelow + 1]));
+				}
+			}
+			columnsX = parentsX;
+			columnsY = parentsY;
+			columnLowest.resize(static_cast<size_t>(columnsX) * columnsY);
+			columnHighest.resize(columnLowest.size());
+			levelSize *= 2.f;
+		}
+		return result;
+	}
+
+	BoxCountResult CountHeightfieldBoxes(ConstHeightfieldView map, float cellSize, float heightScale, float boxSize, int depth)
+	{
+		return CountMapBoxes(map, cellSize, heightScale, boxSize, depth);
+	}
+
+	BoxCountResult CountHeightfieldBoxes(ConstQuantizedHeightfieldView map, float cellSize, float heightScale, float boxSize, int depth)
+	{
+		return CountMapBoxes(map, cellSize, heightScale, boxSize, depth);
+	}
+}
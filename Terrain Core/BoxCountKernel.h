@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Heightfield.h"
+
+#include <functional>
+#include <vector>
+
+namespace TerrainCore
+{
+	// axis aligned box given by its minimum corner and edge length
+	struct CountBox
+	{
+		float X;
+		float Y;
+		float Z;
+		float Size;
+	};
+
+	// bounds of the geometry that gets measured
+	struct BoxCountBounds
+	{
+		float MinX;
+		float MinY;
+		float MinZ;
+		float MaxX;
+		float MaxY;
+		float MaxZ;
+	};
+
+	// one point of the fractal dimension plot
+	struct BoxCountPoint
+	{
+		float LogSize;
+		float LogRatio;
+	};
+
+	// returns true if the box overlaps with the measured geometry
+	using BoxOverlapTest = std::function<bool(const CountBox&)>;
+
+	struct BoxCountResult
+	{
+		// collision count per depth, the first depth is stored last
+		std::vector<int> Collisions;
+		// amount of boxes on the first depth and their size
+		int TotalBoxes{ 0 };
+		float BoxSize{ 0.f };
+
+		// converts the collision counts to Log(Size)/Log(Ratio) pairs, starting at the first depth
+		std::vector<BoxCountPoint> GetLogPoints() const;
+	};
+
+	// Box counting algorithm, covers the bounds with boxes and splits every overlapping box into 8 smaller boxes
+	BoxCountResult CountBoxes(const BoxCountBounds& bounds, float boxSize, int depth, const BoxOverlapTest& overlapTest);
+
+	// Overlap test against the surface of a heightfield, samples are spaced cellSize apart and heights get multiplied by heightScale.
+	// A box overlaps if the height range of the samples under its footprint intersects the height range of the box.
+	class HeightfieldBoxOverlap
+	{
+	public:
+		HeightfieldBoxOverlap(ConstHeightfieldView map, float cellSize, float heightScale);
+
+		bool operator()(const CountBox& box) const;
+
+		// bounds of the heightfield surface
+		BoxCountBounds GetBounds() const;
+
+	private:
+		ConstHeightfieldView m_Map;
+		float m_CellSize;
+		float m_HeightScale;
+	};
+
+	// Same counts as CountBoxes with a HeightfieldBoxOverlap test, but derived from a min/max pyramid of the heights
+	// instead of testing every box. The height range under every box column of the deepest level is gathered once,
+	// every other level combines 2x2 columns of the level below, and the overlapping boxes of a column are counted
+	// directly from its height range. Depths whose boxes would be smaller than a cell are left out, Collisions then
+	// holds fewer depths than asked for, and a box size below the cell size counts nothing.
+	BoxCountResult CountHeightfieldBoxes(ConstHeightfieldView map, float cellSize, float heightScale, float boxSize, int depth);
+	// quantized maps are counted with their dequantized heights
+	BoxCountResult CountHeightfieldBoxes(ConstQuantizedHeightfieldView map, float cellSize, float heightScale, float boxSize, int depth);
+}
@@ -0,0 +1,231 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ChunkStreaming.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace TerrainCore
+{
+	TerrainChunkStreamer::TerrainChunkStreamer(const ChunkStreamingSettings& settings)
+		: m_Settings{ settings }
+	{
+		m_Settings.ChunkSize = std::max(m_Settings.ChunkSize, 2);
+		m_Settings.ViewRadius = std::max(m_Settings.ViewRadius, 0);
+		m_Settings.PrefetchChunks = std::max(m_Settings.PrefetchChunks, 0);
+		m_Settings.CacheCapacity = std::max(m_Settings.CacheCapacity, 1);
+		if (m_Settings.Noise.SamplingWidth <= 0)
+			m_Settings.Noise.SamplingWidth = m_Settings.ChunkSize;
+
+		m_Worker = std::thread([this]() { WorkerLoop(); });
+	}
+
+	TerrainChunkStreamer::~TerrainChunkStreamer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_WorkAvailable.notify_all();
+		m_Worker.join();
+	}
+
+	void TerrainChunkStreamer::UpdateViewers(const std::vector<ChunkViewer>& viewers)
+	{
+		// chunks every viewer needs from the closest ring outwards, followed by the chunks ahead of moving viewers
+		std::vector<ChunkCoord> wanted;
+		std::unordered_set<ChunkCoord, ChunkCoordHash> wantedSet;
+		auto addSquare = [&](ChunkCoord centre)
+		{
+			for (int ring = 0; ring <= m_Settings.ViewRadius; ++ring)
+			{
+				for (int y = -ring; y <= ring; ++y)
+				{
+					for (int x = -ring; x <= ring; ++x)
+					{
+						if (std::max(std::abs(x), std::abs(y)) != ring)
+							continue;
+						ChunkCoord coord{ centre.X + x, centre.Y + y };
+						if (wantedSet.insert(coord).second)
+							wanted.push_back(coord);
+					}
+				}
+			}
+		};
+
+		for (const auto& viewer : viewers)
+			addSquare(GetChunkAt(viewer.X, viewer.Y));
+
+		float chunkExtent = static_cast<float>(m_Settings.ChunkSize - 1);
+		for (const auto& viewer : viewers)
+		{
+			float speed = std::sqrt(viewer.VelocityX * viewer.VelocityX + viewer.VelocityY * viewer.VelocityY);
+			if (speed <= 0.f || m_Settings.PrefetchChunks == 0)
+				continue;
+			float distance = m_Settings.PrefetchChunks * chunkExtent / speed;
+			addSquare(GetChunkAt(viewer.X + viewer.VelocityX * distance, viewer.Y + viewer.VelocityY * distance));
+		}
+
+		// more chunks than fit in the cache would evict each other, the least important ones are left out
+		if (wanted.size() > static_cast<size_t>(m_Settings.CacheCapacity))
+		{
+			for (size_t i = m_Settings.CacheCapacity; i < wanted.size(); ++i)
+				wantedSet.erase(wanted[i]);
+			wanted.resize(m_Settings.CacheCapacity);
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		// resident chunks that are still needed move to the front of the use order, most important chunk first
+		for (auto coord = wanted.rbegin(); coord != wanted.rend(); ++coord)
+		{
+			auto entry = m_Cache.find(*coord);
+			if (entry != m_Cache.end())
+				TouchChunk(entry->second);
+		}
+
+		m_Pending.clear();
+		for (const auto& coord : wanted)
+		{
+			if (m_Cache.count(coord) == 0 && !(m_IsGenerating && m_GeneratingCoord == coord))
+				m_Pending.push_back(coord);
+		}
+		m_Wanted = std::move(wantedSet);
+
+		if (m_Pending.empty())
+			m_Idle.notify_all();
+		else
+			m_WorkAvailable.notify_one();
+	}
+
+	std::shared_ptr<const TerrainChunk> TerrainChunkStreamer::FindChunk(ChunkCoord coord)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto entry = m_Cache.find(coord);
+		if (entry == m_Cache.end())
+			return nullptr;
+		TouchChunk(entry->second);
+		return entry->second.Chunk;
+	}
+
+	bool TerrainChunkStreamer::IsChunkResident(ChunkCoord coord) const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Cache.count(coord) != 0;
+	}
+
+	std::shared_ptr<const TerrainChunk> TerrainChunkStreamer::GetChunk(ChunkCoord coord)
+	{
+		if (auto chunk = FindChunk(coord))
+			return chunk;
+
+		auto chunk = GenerateChunk(coord);
+
+		// the background thread might have finished the same chunk in the meantime
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto entry = m_Cache.find(coord);
+		if (entry != m_Cache.end())
+			return entry->second.Chunk;
+		InsertChunk(chunk);
+		return chunk;
+	}
+
+	std::vector<ChunkCoord> TerrainChunkStreamer::TakeReadyChunks()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		std::vector<ChunkCoord> ready;
+		ready.swap(m_Ready);
+		return ready;
+	}
+
+	void TerrainChunkStreamer::WaitUntilIdle()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Idle.wait(lock, [this]() { return m_Pending.empty() && !m_IsGenerating; });
+	}
+
+	ChunkCoord TerrainChunkStreamer::GetChunkAt(float x, float y) const
+	{
+		float chunkExtent = static_cast<float>(m_Settings.ChunkSize - 1);
+		return { static_cast<int>(std::floor(x / chunkExtent)), static_cast<int>(std::floor(y / chunkExtent)) };
+	}
+
+	int TerrainChunkStreamer::GetResidentChunkCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return static_cast<int>(m_Cache.size());
+	}
+
+	int TerrainChunkStreamer::GetPendingChunkCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return static_cast<int>(m_Pending.size()) + (m_IsGenerating ? 1 : 0);
+	}
+
+	std::shared_ptr<const TerrainChunk> TerrainChunkStreamer::GenerateChunk(ChunkCoord coord) const
+	{
+		auto chunk = std::make_shared<TerrainChunk>();
+		chunk->Coord = coord;
+		chunk->Heights.Resize(m_Settings.ChunkSize, m_Settings.ChunkSize);
+
+		// the chunk samples the world noise at its own origin
+		FractalNoiseSettings noise = m_Settings.Noise;
+		noise.OriginX = GetChunkOrigin(coord.X);
+		noise.OriginY = GetChunkOrigin(coord.Y);
+		GenerateFractalNoise(chunk->Heights.GetView(), noise);
+		return chunk;
+	}
+
+	void TerrainChunkStreamer::InsertChunk(const std::shared_ptr<const TerrainChunk>& chunk)
+	{
+		// chunks nobody asks for anymore get evicted before the ones the viewers need
+		bool isWanted = m_Wanted.count(chunk->Coord) != 0;
+		auto position = isWanted ? m_LruOrder.insert(m_LruOrder.begin(), chunk->Coord) : m_LruOrder.insert(m_LruOrder.end(), chunk->Coord);
+		m_Cache[chunk->Coord] = CacheEntry{ chunk, position };
+
+		while (m_Cache.size() > static_cast<size_t>(m_Settings.CacheCapacity))
+		{
+			m_Cache.erase(m_LruOrder.back());
+			m_LruOrder.pop_back();
+		}
+	}
+
+	void TerrainChunkStreamer::TouchChunk(CacheEntry& entry)
+	{
+		m_LruOrder.splice(m_LruOrder.begin(), m_LruOrder, entry.LruPosition);
+	}
+
+	void TerrainChunkStreamer::WorkerLoop()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		while (true)
+		{
+			m_WorkAvailable.wait(lock, [this]() { return m_Quit || !m_Pending.empty(); });
+			if (m_Quit)
+				return;
+
+			ChunkCoord coord = m_Pending.front();
+			m_Pending.pop_front();
+			if (m_Cache.count(coord) == 0)
+			{
+				m_IsGenerating = true;
+				m_GeneratingCoord = coord;
+
+				lock.unlock();
+				auto chunk = GenerateChunk(coord);
+				lock.lock();
+
+				m_IsGenerating = false;
+				if (m_Cache.count(coord) == 0)
+				{
+					InsertChunk(chunk);
+					m_Ready.push_back(coord);
+				}
+			}
+
+			if (m_Pending.empty())
+				m_Idle.notify_all();
+		}
+	}
+}
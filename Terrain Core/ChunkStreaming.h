@@ -0,0 +1,141 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "FractalNoise.h"
+#include "Heightfield.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace TerrainCore
+{
+	// position of a chunk in the chunk grid
+	struct ChunkCoord
+	{
+		int X{ 0 };
+		int Y{ 0 };
+
+		bool operator==(const ChunkCoord& other) const { return X == other.X && Y == other.Y; }
+		bool operator!=(const ChunkCoord& other) const { return !(*this == other); }
+	};
+
+	// a viewer in sample space, the velocity only gets used for its direction
+	struct ChunkViewer
+	{
+		float X{ 0.f };
+		float Y{ 0.f };
+		float VelocityX{ 0.f };
+		float VelocityY{ 0.f };
+	};
+
+	//variables that influence chunk streaming
+	struct ChunkStreamingSettings
+	{
+		// samples per chunk edge, neighboring chunks share their edge samples so they line up without seams
+		int ChunkSize{ 129 };
+		// chunks around every viewer that get generated, 1 keeps a 3x3 square resident
+		int ViewRadius{ 2 };
+		// how far ahead of a moving viewer chunks get generated
+		int PrefetchChunks{ 2 };
+		// maximum amount of resident chunks, the least recently used chunk gets evicted first
+		int CacheCapacity{ 64 };
+		// noise of the whole world, the sampling width defaults to the chunk size and the origin is set per chunk
+		FractalNoiseSettings Noise;
+	};
+
+	struct TerrainChunk
+	{
+		ChunkCoord Coord;
+		Heightfield Heights;
+	};
+
+	// Generates noise chunks around viewers on a background thread and keeps a bounded LRU cache of them. The chunks
+	// closest to a viewer get generated first, followed by the chunks ahead of moving viewers. Chunks handed out stay
+	// valid after eviction until the last reference is released.
+	class TerrainChunkStreamer
+	{
+	public:
+		explicit TerrainChunkStreamer(const ChunkStreamingSettings& settings);
+		// stops the background thread, a chunk that is being generated gets finished first
+		~TerrainChunkStreamer();
+
+		TerrainChunkStreamer(const TerrainChunkStreamer&) = delete;
+		TerrainChunkStreamer& operator=(const TerrainChunkStreamer&) = delete;
+
+		// replaces the requested chunks with the ones needed by the viewers, chunks that are no longer needed and not
+		// generated yet are dropped from the queue
+		void UpdateViewers(const std::vector<ChunkViewer>& viewers);
+
+		// returns the chunk if it is resident, nullptr otherwise. Counts as use for the eviction order
+		std::shared_ptr<const TerrainChunk> FindChunk(ChunkCoord coord);
+		bool IsChunkResident(ChunkCoord coord) const;
+		// returns the chunk, generates it on the calling thread if it isn't resident
+		std::shared_ptr<const TerrainChunk> GetChunk(ChunkCoord coord);
+
+		// chunks that finished generating since the last call
+		std::vector<ChunkCoord> TakeReadyChunks();
+
+		// blocks until every requested chunk is generated
+		void WaitUntilIdle();
+
+		// chunk that contains a sample position
+		ChunkCoord GetChunkAt(float x, float y) const;
+		// sample position of the first sample of a chunk
+		int GetChunkOrigin(int chunkIndex) const { return chunkIndex * (m_Settings.ChunkSize - 1); }
+
+		int GetResidentChunkCount() const;
+		int GetPendingChunkCount() const;
+		const ChunkStreamingSettings& GetSettings() const { return m_Settings; }
+
+	private:
+		struct ChunkCoordHash
+		{
+			size_t operator()(const ChunkCoord& coord) const
+			{
+				return std::hash<uint64_t>()((static_cast<uint64_t>(static_cast<uint32_t>(coord.X)) << 32) | static_cast<uint32_t>(coord.Y));
+			}
+		};
+
+		struct CacheEntry
+		{
+			std::shared_ptr<const TerrainChunk> Chunk;
+			std::list<ChunkCoord>::iterator LruPosition;
+		};
+
+		std::shared_ptr<const TerrainChunk> GenerateChunk(ChunkCoord coord) const;
+		void WorkerLoop();
+		// the following helpers expect m_Mutex to be locked
+		void InsertChunk(const std::shared_ptr<const TerrainChunk>& chunk);
+		void TouchChunk(CacheEntry& entry);
+
+		ChunkStreamingSettings m_Settings;
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_WorkAvailable;
+		std::condition_variable m_Idle;
+
+		// resident chunks and their use order, the most recently used chunk is at the front
+		std::unordered_map<ChunkCoord, CacheEntry, ChunkCoordHash> m_Cache;
+		std::list<ChunkCoord> m_LruOrder;
+
+		// chunks waiting for the background thread, the most important chunk is at the front
+		std::deque<ChunkCoord> m_Pending;
+		// chunks needed by the viewers of the last update, generated chunks outside of it are evicted first
+		std::unordered_set<ChunkCoord, ChunkCoordHash> m_Wanted;
+		bool m_IsGenerating{ false };
+		ChunkCoord m_GeneratingCoord;
+		std::vector<ChunkCoord> m_Ready;
+
+		bool m_Quit{ false };
+		std::thread m_Worker;
+	};
+}
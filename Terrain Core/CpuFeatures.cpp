@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CpuFeatures.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace TerrainCore
+{
+	static SimdLevel DetectCpuSimdLevel()
+	{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return SimdLevel::AVX512;
+		if (__builtin_cpu_supports("avx2"))
+			return SimdLevel::AVX2;
+		if (__builtin_cpu_supports("sse4.2"))
+			return SimdLevel::SSE42;
+		return SimdLevel::Scalar;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuid(info, 0);
+		int highestLeaf = info[0];
+
+		__cpuid(info, 1);
+		bool hasSSE42 = (info[2] & (1 << 20)) != 0;
+		bool hasOSXSave = (info[2] & (1 << 27)) != 0;
+		bool hasAVX = (info[2] & (1 << 28)) != 0;
+		if (!hasSSE42)
+			return SimdLevel::Scalar;
+		if (!hasOSXSave || !hasAVX || highestLeaf < 7)
+			return SimdLevel::SSE42;
+
+		// the operating system has to save the ymm and zmm registers
+		unsigned long long enabledState = _xgetbv(0);
+		bool saveYmm = (enabledState & 0x6) == 0x6;
+		bool saveZmm = (enabledState & 0xE6) == 0xE6;
+
+		__cpuidex(info, 7, 0);
+		bool hasAVX2 = (info[1] & (1 << 5)) != 0;
+		bool hasAVX512 = (info[1] & (1 << 16)) != 0;
+		if (hasAVX512 && saveZmm)
+			return SimdLevel::AVX512;
+		if (hasAVX2 && saveYmm)
+			return SimdLevel::AVX2;
+		return SimdLevel::SSE42;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	static SimdLevel ReadSimdLevelEnvironment()
+	{
+		const char* value = std::getenv("TERRAIN_SIMD");
+		if (!value)
+			return SimdLevel::AVX512;
+		if (std::strcmp(value, "scalar") == 0)
+			return SimdLevel::Scalar;
+		if (std::strcmp(value, "sse42") == 0)
+			return SimdLevel::SSE42;
+		if (std::strcmp(value, "avx2") == 0)
+			return SimdLevel::AVX2;
+		return SimdLevel::AVX512;
+	}
+
+	static std::atomic<int>& SimdLevelLimit()
+	{
+		static std::atomic<int> limit{ static_cast<int>(ReadSimdLevelEnvironment()) };
+		return limit;
+	}
+
+	SimdLevel GetCpuSimdLevel()
+	{
+		static const SimdLevel cpuLevel = DetectCpuSimdLevel();
+		return cpuLevel;
+	}
+
+	void SetSimdLevelLimit(SimdLevel level)
+	{
+		SimdLevelLimit().store(static_cast<int>(level));
+	}
+
+	SimdLevel GetSimdLevelLimit()
+	{
+		return static_cast<SimdLevel>(SimdLevelLimit().load());
+	}
+
+	const char* GetSimdLevelName(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SimdLevel::SSE42: return "sse42";
+		case SimdLevel::AVX2: return "avx2";
+		case SimdLevel::AVX512: return "avx512";
+		default: return "scalar";
+		}
+	}
+}
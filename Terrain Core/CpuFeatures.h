@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+namespace TerrainCore
+{
+	// instruction sets the batched kernels are compiled for, ordered from slowest to fastest
+	enum class SimdLevel
+	{
+		Scalar,
+		SSE42,
+		AVX2,
+		AVX512
+	};
+
+	// highest instruction set supported by the cpu and the operating system
+	SimdLevel GetCpuSimdLevel();
+
+	// caps the instruction set used by the batched kernels, useful to compare or debug kernels.
+	// the TERRAIN_SIMD environment variable (scalar, sse42, avx2, avx512) sets the initial limit
+	void SetSimdLevelLimit(SimdLevel level);
+	SimdLevel GetSimdLevelLimit();
+
+	const char* GetSimdLevelName(SimdLevel level);
+}
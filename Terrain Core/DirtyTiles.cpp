@@ -0,0 +1,90 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DirtyTiles.h"
+
+namespace TerrainCore
+{
+	void DirtyTileMask::Reset(int width, int height, int tileShift)
+	{
+		m_Width = std::max(width, 0);
+		m_Height = std::max(height, 0);
+		m_TileShift = tileShift;
+		int tileSize = GetTileSize();
+		int tileCountX = (m_Width + tileSize - 1) / tileSize;
+		int tileCountY = (m_Height + tileSize - 1) / tileSize;
+
+		// atomics can't be moved, so the flags only get reallocated when the tile count changes
+		if (static_cast<size_t>(tileCountX) * tileCountY != m_Tiles.size())
+			m_Tiles = std::vector<std::atomic<uint8_t>>(static_cast<size_t>(tileCountX) * tileCountY);
+		m_TileCountX = tileCountX;
+		m_TileCountY = tileCountY;
+		Clear();
+	}
+
+	void DirtyTileMask::MarkAll()
+	{
+		for (auto& tile : m_Tiles)
+			tile.store(1, std::memory_order_relaxed);
+	}
+
+	void DirtyTileMask::Clear()
+	{
+		for (auto& tile : m_Tiles)
+			tile.store(0, std::memory_order_relaxed);
+	}
+
+	int DirtyTileMask::GetDirtyTileCount() const
+	{
+		int count = 0;
+		for (const auto& tile : m_Tiles)
+			count += tile.load(std::memory_order_relaxed) != 0;
+		return count;
+	}
+
+	std::vector<DirtyRect> DirtyTileMask::GetDirtyRects() const
+	{
+		// rectangles in tiles first, the rectangles of the previous row that can still grow are kept by index
+		std::vector<DirtyRect> rects;
+		std::vector<int> previousRow;
+		std::vector<int> currentRow;
+		for (int tileY = 0; tileY < m_TileCountY; ++tileY)
+		{
+			currentRow.clear();
+			size_t previous = 0;
+			for (int tileX = 0; tileX < m_TileCountX; ++tileX)
+			{
+				if (!IsTileDirty(tileX, tileY))
+					continue;
+				int runStart = tileX;
+				while (tileX + 1 < m_TileCountX && IsTileDirty(tileX + 1, tileY))
+					++tileX;
+				int runWidth = tileX - runStart + 1;
+
+				// runs of both rows are ordered by x, so the candidate is found by walking along the previous row
+				while (previous < previousRow.size() && rects[previousRow[previous]].X < runStart)
+					++previous;
+				if (previous < previousRow.size() && rects[previousRow[previous]].X == runStart && rects[previousRow[previous]].Width == runWidth)
+				{
+					++rects[previousRow[previous]].Height;
+					currentRow.push_back(previousRow[previous]);
+					continue;
+				}
+				currentRow.push_back(static_cast<int>(rects.size()));
+				rects.push_back({ runStart, tileY, runWidth, 1 });
+			}
+			previousRow.swap(currentRow);
+		}
+
+		// tiles to samples, the last tiles of a row or column can reach beyond the map
+		int tileSize = GetTileSize();
+		for (auto& rect : rects)
+		{
+			rect.Width = std::min((rect.X + rect.Width) * tileSize, m_Width) - rect.X * tileSize;
+			rect.Height = std::min((rect.Y + rect.Height) * tileSize, m_Height) - rect.Y * tileSize;
+			rect.X *= tileSize;
+			rect.Y *= tileSize;
+		}
+		return rects;
+	}
+}
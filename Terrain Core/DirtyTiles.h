@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace TerrainCore
+{
+	// rectangle of samples within a map
+	struct DirtyRect
+	{
+		int X{ 0 };
+		int Y{ 0 };
+		int Width{ 0 };
+		int Height{ 0 };
+	};
+
+	// One flag per square tile of a map that remembers which parts of the map changed. Marking is thread safe so the
+	// tasks of the parallel erosion modes can mark the tiles they touch, a flag that is already set is only read.
+	class DirtyTileMask
+	{
+	public:
+		// tiles of 32x32 samples, a brush stroke of a raindrop marks at most 4 of them
+		static constexpr int DefaultTileShift = 5;
+
+		// clears every flag and covers a map of the size with tiles of 1 << tileShift samples
+		void Reset(int width, int height, int tileShift = DefaultTileShift);
+
+		// marks the tiles overlapping a rectangle of samples, the parts outside the map are ignored
+		void MarkRect(int x, int y, int width, int height)
+		{
+			int lastX = std::min(x + width - 1, m_Width - 1);
+			int lastY = std::min(y + height - 1, m_Height - 1);
+			x = std::max(x, 0);
+			y = std::max(y, 0);
+			if (x > lastX || y > lastY)
+				return;
+
+			for (int tileY = y >> m_TileShift; tileY <= lastY >> m_TileShift; ++tileY)
+			{
+				for (int tileX = x >> m_TileShift; tileX <= lastX >> m_TileShift; ++tileX)
+				{
+					auto& tile = m_Tiles[tileX + tileY * m_TileCountX];
+					if (!tile.load(std::memory_order_relaxed))
+						tile.store(1, std::memory_order_relaxed);
+				}
+			}
+		}
+		void MarkCell(int x, int y) { MarkRect(x, y, 1, 1); }
+		void MarkAll();
+		// clears every flag and keeps the size
+		void Clear();
+
+		bool IsEmpty() const { return GetDirtyTileCount() == 0; }
+		int GetDirtyTileCount() const;
+		bool IsTileDirty(int tileX, int tileY) const { return m_Tiles[tileX + tileY * m_TileCountX].load(std::memory_order_relaxed) != 0; }
+
+		int GetTileSize() const { return 1 << m_TileShift; }
+		int GetTileCountX() const { return m_TileCountX; }
+		int GetTileCountY() const { return m_TileCountY; }
+		int GetTileCount() const { return m_TileCountX * m_TileCountY; }
+
+		// Dirty tiles merged into few rectangles of samples clipped to the map, for uploads that pay per rectangle.
+		// Runs of dirty tiles within a row become one rectangle, runs that repeat in the next row get stacked onto it.
+		std::vector<DirtyRect> GetDirtyRects() const;
+
+	private:
+		int m_Width{ 0 };
+		int m_Height{ 0 };
+		int m_TileShift{ DefaultTileShift };
+		int m_TileCountX{ 0 };
+		int m_TileCountY{ 0 };
+		std::vector<std::atomic<uint8_t>> m_Tiles;
+	};
+}
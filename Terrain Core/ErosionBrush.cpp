@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ErosionBrush.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace TerrainCore
+{
+	void ErosionBrush::Prepare(int mapWidth, int mapHeight, int mapStride, int radius)
+	{
+		radius = std::max(radius, 1);
+		if (mapWidth == m_MapWidth && mapHeight == m_MapHeight && mapStride == m_MapStride && radius == m_Radius)
+			return;
+
+		m_MapWidth = mapWidth;
+		m_MapHeight = mapHeight;
+		m_MapStride = mapStride;
+		m_Radius = radius;
+
+		m_OffsetsX.clear();
+		m_OffsetsY.clear();
+		m_IndexOffsets.clear();
+		m_RawWeights.clear();
+		m_Weights.clear();
+
+		//Loops over the square grid the circle fits in
+		float weightSum = 0.f;
+		for (int y = -radius; y <= radius; y++)
+		{
+			for (int x = -radius; x <= radius; x++)
+			{
+				// calculates distance from center and sees if it is within the radius
+				float sqrDst = static_cast<float>(x * x + y * y);
+				if (sqrDst < radius * radius)
+				{
+					// calculates weight and adds the offset to the stencil
+					float weight = 1 - std::sqrt(sqrDst) / radius;
+					weightSum += weight;
+					m_OffsetsX.push_back(x);
+					m_OffsetsY.push_back(y);
+					m_IndexOffsets.push_back(x + y * mapStride);
+					m_RawWeights.push_back(weight);
+				}
+			}
+		}
+
+		// normalizes the weights of the full stencil
+		for (float weight : m_RawWeights)
+			m_Weights.push_back(weight / weightSum);
+	}
+}
@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace TerrainCore
+{
+	// Circular brush used to spread erosion over the cells around a raindrop. Interior cells share one precomputed
+	// stencil of index offsets and weights, cells within radius of the edge clip the stencil on the fly and renormalize
+	class ErosionBrush
+	{
+	public:
+		// builds the stencil, does nothing if the map layout and radius didn't change since the last call
+		void Prepare(int mapWidth, int mapHeight, int mapStride, int radius);
+
+		// calls visit(index, weight) for every map cell the brush covers around (centreX, centreY)
+		template<typename Visit>
+		void ForEachCell(int centreX, int centreY, Visit&& visit) const
+		{
+			int centreIndex = centreX + m_MapStride * centreY;
+
+			// interior cells use the full stencil
+			if (centreY > m_Radius && centreY < m_MapHeight - m_Radius && centreX > m_Radius && centreX < m_MapWidth - m_Radius)
+			{
+				for (std::size_t i = 0; i < m_IndexOffsets.size(); ++i)
+					visit(centreIndex + m_IndexOffsets[i], m_Weights[i]);
+				return;
+			}
+
+			// cells near the edge only use the entries within the map
+			float weightSum = 0.f;
+			for (std::size_t i = 0; i < m_IndexOffsets.size(); ++i)
+			{
+				if (IsInside(centreX + m_OffsetsX[i], centreY + m_OffsetsY[i]))
+					weightSum += m_RawWeights[i];
+			}
+			for (std::size_t i = 0; i < m_IndexOffsets.size(); ++i)
+			{
+				if (IsInside(centreX + m_OffsetsX[i], centreY + m_OffsetsY[i]))
+					visit(centreIndex + m_IndexOffsets[i], m_RawWeights[i] / weightSum);
+			}
+		}
+
+		int GetRadius() const { return m_Radius; }
+		// amount of cells the full stencil covers
+		int GetCellCount() const { return static_cast<int>(m_IndexOffsets.size()); }
+
+	private:
+		bool IsInside(int x, int y) const
+		{
+			return x >= 0 && x < m_MapWidth && y >= 0 && y < m_MapHeight;
+		}
+
+		int m_MapWidth{ -1 };
+		int m_MapHeight{ -1 };
+		int m_MapStride{ -1 };
+		int m_Radius{ -1 };
+
+		// stencil entries, ordered row by row
+		std::vector<int> m_OffsetsX;
+		std::vector<int> m_OffsetsY;
+		std::vector<int> m_IndexOffsets;
+		// unnormalized weights for the clipped path and normalized weights of the full stencil
+		std::vector<float> m_RawWeights;
+		std::vector<float> m_Weights;
+	};
+}
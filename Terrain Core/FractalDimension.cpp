@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FractalDimension.h"
+#include "Parallel.h"
+
+#include <cmath>
+
+namespace TerrainCore
+{
+	FractalDimensionFit FitFractalDimension(const std::vector<BoxCountPoint>& points)
+	{
+		// sums of the finite points, depths without collisions have a Log(Ratio) of -infinity
+		FractalDimensionFit fit;
+		double sumX = 0.0;
+		double sumY = 0.0;
+		double sumXX = 0.0;
+		double sumXY = 0.0;
+		double sumYY = 0.0;
+		for (const auto& point : points)
+		{
+			if (!std::isfinite(point.LogSize) || !std::isfinite(point.LogRatio))
+				continue;
+			sumX += point.LogSize;
+			sumY += point.LogRatio;
+			sumXX += static_cast<double>(point.LogSize) * point.LogSize;
+			sumXY += static_cast<double>(point.LogSize) * point.LogRatio;
+			sumYY += static_cast<double>(point.LogRatio) * point.LogRatio;
+			++fit.PointCount;
+		}
+		if (fit.PointCount < 2)
+			return fit;
+
+		double count = fit.PointCount;
+		double varianceX = sumXX - sumX * sumX / count;
+		double varianceY = sumYY - sumY * sumY / count;
+		double covariance = sumXY - sumX * sumY / count;
+		if (varianceX <= 0.0)
+			return fit;
+
+		double slope = covariance / varianceX;
+		fit.Slope = static_cast<float>(slope);
+		fit.Intercept = static_cast<float>((sumY - slope * sumX) / count);
+		fit.Dimension = fit.Slope + 3.f;
+		// every point on the line is a perfect fit, also when all ratios are equal
+		fit.RSquared = (varianceY > 0.0) ? static_cast<float>(covariance * covariance / (varianceX * varianceY)) : 1.f;
+		return fit;
+	}
+
+	template<typename ViewType>
+	static FractalDimensionResult MeasureMapFractalDimension(ViewType map, const FractalDimensionSettings& settings)
+	{
+		FractalDimensionResult result;
+		if (map.IsEmpty())
+			return result;
+
+		float mapExtent = map.Width * settings.CellSize;
+		float heightScale = (settings.HeightScale > 0.f) ? settings.HeightScale : mapExtent;
+		float boxSize = (settings.BoxSize > 0.f) ? settings.BoxSize : mapExtent / 4.f;
+
+		result.Counts = CountHeightfieldBoxes(map, settings.CellSize, heightScale, boxSize, settings.Depth);
+		result.Points = result.Counts.GetLogPoints();
+		result.Fit = FitFractalDimension(result.Points);
+		return result;
+	}
+
+	template<typename ViewType>
+	static std::vector<FractalDimensionResult> MeasureMapFractalDimensions(const std::vector<ViewType>& maps, const FractalDimensionSettings& settings, TaskControl* control)
+	{
+		std::vector<FractalDimensionResult> results(maps.size());
+		BeginWork(control, static_cast<int64_t>(maps.size()));
+		ParallelFor(0, static_cast<int>(maps.size()), 1, settings.ThreadCount, [&](int mapBegin, int mapEnd)
+		{
+			for (int i = mapBegin; i < mapEnd && !IsCancelled(control); ++i)
+			{
+				results[i] = MeasureMapFractalDimension(maps[i], settings);
+				AddProgress(control, 1);
+			}
+		});
+		return results;
+	}
+
+	FractalDimensionResult MeasureFractalDimension(ConstHeightfieldView map, const FractalDimensionSettings& settings)
+	{
+		return MeasureMapFractalDimension(map, settings);
+	}
+
+	FractalDimensionResult MeasureFractalDimension(ConstQuantizedHeightfieldView map, const FractalDimensionSettings& settings)
+	{
+		return MeasureMapFractalDimension(map, settings);
+	}
+
+	std::vector<FractalDimensionResult> MeasureFractalDimensions(const std::vector<ConstHeightfieldView>& maps, const FractalDimensionSettings& settings, TaskControl* control)
+	{
+		return MeasureMapFractalDimensions(maps, settings, control);
+	}
+
+	std::vector<FractalDimensionResult> MeasureFractalDimensions(const std::vector<ConstQuantizedHeightfieldView>& maps, const FractalDimensionSettings& settings, TaskControl* control)
+	{
+		return MeasureMapFractalDimensions(maps, settings, control);
+	}
+}
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "BoxCountKernel.h"
+#include "Heightfield.h"
+#include "TaskControl.h"
+
+#include <vector>
+
+namespace TerrainCore
+{
+	//variables that influence the fractal dimension measurement
+	struct FractalDimensionSettings
+	{
+		// distance between samples
+		float CellSize{ 1.f };
+		// heights get multiplied by this, 0 scales them to the width of the map so the surface is measured as a landscape
+		float HeightScale{ 0.f };
+		// edge length of the first depth boxes, 0 uses a quarter of the map width
+		float BoxSize{ 0.f };
+		int Depth{ 6 };
+		// threads used for a batch, 0 uses every core
+		int ThreadCount{ 0 };
+	};
+
+	// least squares line through the log points
+	struct FractalDimensionFit
+	{
+		// box counting dimension, the slope of Log(Ratio) over Log(Size) plus 3 since the total amount of boxes grows
+		// with the cube of 1 / size
+		float Dimension{ 0.f };
+		float Slope{ 0.f };
+		float Intercept{ 0.f };
+		// coefficient of determination of the fit, 1 is a perfect line
+		float RSquared{ 0.f };
+		// depths used by the fit, depths without collisions are skipped
+		int PointCount{ 0 };
+	};
+
+	struct FractalDimensionResult
+	{
+		BoxCountResult Counts;
+		std::vector<BoxCountPoint> Points;
+		FractalDimensionFit Fit;
+	};
+
+	// fits a line through the points, needs at least 2 points with a finite Log(Ratio)
+	FractalDimensionFit FitFractalDimension(const std::vector<BoxCountPoint>& points);
+
+	// box counts and fitted dimension of one heightfield
+	FractalDimensionResult MeasureFractalDimension(ConstHeightfieldView map, const FractalDimensionSettings& settings);
+	FractalDimensionResult MeasureFractalDimension(ConstQuantizedHeightfieldView map, const FractalDimensionSettings& settings);
+
+	// Measures every heightfield of a batch, the heightfields are spread over the threads. Results are in the same
+	// order as the heightfields. Progress is counted in heightfields, maps skipped after a cancel keep an empty result.
+	std::vector<FractalDimensionResult> MeasureFractalDimensions(const std::vector<ConstHeightfieldView>& maps, const FractalDimensionSettings& settings, TaskControl* control = nullptr);
+	std::vector<FractalDimensionResult> MeasureFractalDimensions(const std::vector<ConstQuantizedHeightfieldView>& maps, const FractalDimensionSettings& settings, TaskControl* control = nullptr);
+}
@@ -0,0 +1,335 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FractalNoise.h"
+#include "NoiseFunctions.h"
+#include "Parallel.h"
+#include "SimdKernels.h"
+#include "TerrainTrace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+namespace TerrainCore
+{
+	// rows per parallel task, small enough to balance the cores and large enough to reuse the row buffers
+	static const int FractalNoiseRowsPerTask = 8;
+
+	// row the noise gets accumulated in, float maps accumulate in place and other maps in a scratch row
+	static float* GetFractalNoiseRow(HeightfieldView map, int y, std::vector<float>&)
+	{
+		return map.Row(y);
+	}
+
+	template<typename ViewType>
+	static float* GetFractalNoiseRow(ViewType, int, std::vector<float>& scratchRow)
+	{
+		return scratchRow.data();
+	}
+
+	// slopes of the 0 1 heights per sample along x and y, only accumulated when they are needed
+	struct FractalNoiseSlopes
+	{
+		const float* X;
+		const float* Y;
+		float HeightScale;
+	};
+
+	static void StoreFractalNoiseRow(HeightfieldView, int, const float*, const FractalNoiseSlopes&)
+	{
+	}
+
+	static void StoreFractalNoiseRow(QuantizedHeightfieldView map, int y, const float* noiseHeights, const FractalNoiseSlopes&)
+	{
+		GetSimdKernels().QuantizeHeights(noiseHeights, map.Row(y), map.Width);
+	}
+
+	static void StoreFractalNoiseRow(HeightNormalView map, int y, const float* noiseHeights, const FractalNoiseSlopes& slopes)
+	{
+		HeightNormal* row = map.Row(y);
+		for (int x = 0; x < map.Width; ++x)
+		{
+			// normal of the surface (x, y, height * HeightScale)
+			float normalX = -slopes.X[x] * slopes.HeightScale;
+			float normalY = -slopes.Y[x] * slopes.HeightScale;
+			float scale = 1.f / std::sqrt(normalX * normalX + normalY * normalY + 1.f);
+			row[x] = { noiseHeights[x], normalX * scale, normalY * scale, scale };
+		}
+	}
+
+	// noise kernels of every basis, the perlin basis gets boosted a bit since it rarely reaches its extremes
+	struct FractalPerlinBasis
+	{
+		static constexpr float Amplitude = 1.2f;
+		static NoiseBatchFunction GetValues(const SimdKernelTable& kernels) { return kernels.PerlinNoise2D; }
+		static NoiseDerivativeBatchFunction GetDerivatives(const SimdKernelTable& kernels) { return kernels.PerlinNoise2DDerivatives; }
+	};
+
+	struct FractalSimplexBasis
+	{
+		static constexpr float Amplitude = 1.f;
+		static NoiseBatchFunction GetValues(const SimdKernelTable& kernels) { return kernels.SimplexNoise2D; }
+		static NoiseDerivativeBatchFunction GetDerivatives(const SimdKernelTable& kernels) { return kernels.SimplexNoise2DDerivatives; }
+	};
+
+	struct FractalValueBasis
+	{
+		static constexpr float Amplitude = 1.f;
+		static NoiseBatchFunction GetValues(const SimdKernelTable& kernels) { return kernels.ValueNoise2D; }
+		static NoiseDerivativeBatchFunction GetDerivatives(const SimdKernelTable& kernels) { return kernels.ValueNoise2DDerivatives; }
+	};
+
+	// shapes map the noise of an octave to the -1 1 range, Slope is the derivative of the shape by the noise
+	struct FractalFbmShape
+	{
+		static float Apply(float noise) { return noise; }
+		static float Slope(float) { return 1.f; }
+	};
+
+	struct FractalRidgedShape
+	{
+		static float Apply(float noise)
+		{
+			float ridge = 1.f - std::abs(noise);
+			return 2.f * ridge * ridge - 1.f;
+		}
+		static float Slope(float noise)
+		{
+			float ridge = 1.f - std::abs(noise);
+			return noise < 0.f ? 4.f * ridge : -4.f * ridge;
+		}
+	};
+
+	struct FractalBillowShape
+	{
+		static float Apply(float noise) { return 2.f * std::abs(noise) - 1.f; }
+		static float Slope(float noise) { return noise < 0.f ? -2.f : 2.f; }
+	};
+
+	// constants of one octave, computed once per map instead of once per sample
+	struct FractalOctave
+	{
+		// noise coordinates between two samples
+		float Step;
+		// amplitude of the octave including the amplitude of the basis
+		float Weight;
+	};
+
+	// everything the rows of one map share
+	struct FractalNoiseContext
+	{
+		const FractalNoiseSettings& Settings;
+		const int32_t* Permutation;
+		const SimdKernelTable& Kernels;
+		std::vector<FractalOctave> Octaves;
+		float HeightScale;
+	};
+
+	// Generates the rows [firstRow, lastRow), every sample only depends on its own coordinates. OctaveCount is the
+	// amount of octaves known at compile time, 0 reads it from the context
+	template<typename Basis, typename Shape, int OctaveCount, typename ViewType>
+	static void GenerateFractalNoiseRows(ViewType map, int firstRow, int lastRow, const FractalNoiseContext& context)
+	{
+		const FractalNoiseSettings& settings = context.Settings;
+		const FractalOctave* octaves = context.Octaves.data();
+		const int octaveCount = OctaveCount > 0 ? OctaveCount : static_cast<int>(context.Octaves.size());
+		int width = map.Width;
+		auto noiseBatch = Basis::GetValues(context.Kernels);
+		auto noiseDerivativesBatch = Basis::GetDerivatives(context.Kernels);
+
+		// derivatives come from the same noise evaluations, the values are the same as without them
+		constexpr bool storesNormals = std::is_same<ViewType, HeightNormalView>::value;
+		bool dampensSlopes = settings.SlopeDampening > 0.f;
+		bool needsDerivatives = storesNormals || dampensSlopes;
+		int derivativeWidth = needsDerivatives ? width : 0;
+
+		// a whole row gets evaluated per octave so the noise can run on all vector lanes
+		std::vector<float> sampleX(static_cast<size_t>(octaveCount) * width);
+		std::vector<float> sampleY(width);
+		std::vector<float> noiseValues(width);
+		std::vector<float> scratchRow(std::is_same<ViewType, HeightfieldView>::value ? 0 : width);
+		std::vector<float> derivativeX(derivativeWidth);
+		std::vector<float> derivativeY(derivativeWidth);
+		std::vector<float> dampingX(dampensSlopes ? width : 0);
+		std::vector<float> dampingY(dampensSlopes ? width : 0);
+		std::vector<float> slopeX(storesNormals ? width : 0);
+		std::vector<float> slopeY(storesNormals ? width : 0);
+
+		// The x coordinates are the same for every row and get computed once per octave. Columns advance by whole
+		// samples, so chunks sharing an edge get the same coordinates for it
+		std::vector<float> columns(width);
+		float column = static_cast<float>(settings.OriginX);
+		for (int j = 0; j < width; ++j)
+		{
+			columns[j] = column;
+			column += 1.f;
+		}
+		for (int k = 0; k < octaveCount; ++k)
+		{
+			float* octaveX = sampleX.data() + static_cast<size_t>(k) * width;
+			for (int j = 0; j < width; ++j)
+				octaveX[j] = settings.OffsetX + columns[j] * octaves[k].Step;
+		}
+
+		for (int i = firstRow; i < lastRow; ++i)
+		{
+			// noise heights get accumulated in the output row
+			float* noiseHeights = GetFractalNoiseRow(map, i, scratchRow);
+			std::fill(noiseHeights, noiseHeights + width, 0.f);
+			std::fill(dampingX.begin(), dampingX.end(), 0.f);
+			std::fill(dampingY.begin(), dampingY.end(), 0.f);
+			std::fill(slopeX.begin(), slopeX.end(), 0.f);
+			std::fill(slopeY.begin(), slopeY.end(), 0.f);
+
+			//FBM loop
+			float row = static_cast<float>(settings.OriginY + i);
+			for (int k = 0; k < octaveCount; ++k)
+			{
+				const FractalOctave octave = octaves[k];
+				const float* octaveX = sampleX.data() + static_cast<size_t>(k) * width;
+				std::fill(sampleY.begin(), sampleY.end(), settings.OffsetY + row * octave.Step);
+
+				if (!needsDerivatives)
+				{
+					noiseBatch(context.Permutation, octaveX, sampleY.data(), noiseValues.data(), width);
+
+					// NoiseHeight is increased
+					for (int j = 0; j < width; ++j)
+						noiseHeights[j] += Shape::Apply(noiseValues[j]) * octave.Weight;
+					continue;
+				}
+
+				noiseDerivativesBatch(context.Permutation, octaveX, sampleY.data(), noiseValues.data(), derivativeX.data(), derivativeY.data(), width);
+				for (int j = 0; j < width; ++j)
+				{
+					float shapeSlope = Shape::Slope(noiseValues[j]);
+					float octaveDerivativeX = derivativeX[j] * shapeSlope;
+					float octaveDerivativeY = derivativeY[j] * shapeSlope;
+
+					// octaves are damped by the slope of the octaves so far, steep areas get less detail
+					float weight = octave.Weight;
+					if (dampensSlopes)
+					{
+						dampingX[j] += octaveDerivativeX;
+						dampingY[j] += octaveDerivativeY;
+						weight /= 1.f + settings.SlopeDampening * (dampingX[j] * dampingX[j] + dampingY[j] * dampingY[j]);
+					}
+					noiseHeights[j] += Shape::Apply(noiseValues[j]) * weight;
+
+					// the damping is treated as constant within the octave, the step turns noise derivatives into slopes per sample
+					if (storesNormals)
+					{
+						slopeX[j] += octaveDerivativeX * weight * octave.Step;
+						slopeY[j] += octaveDerivativeY * weight * octave.Step;
+					}
+				}
+			}
+
+			//Moves noiseHeight from -1 1 to 0 1, clamped samples are flat
+			for (int j = 0; j < width; ++j)
+			{
+				float height = (noiseHeights[j] + 1.f) / 2.f;
+				noiseHeights[j] = std::clamp(height, 0.f, 1.f);
+				if (storesNormals)
+				{
+					bool isClamped = height != noiseHeights[j];
+					slopeX[j] = isClamped ? 0.f : slopeX[j] / 2.f;
+					slopeY[j] = isClamped ? 0.f : slopeY[j] / 2.f;
+				}
+			}
+			StoreFractalNoiseRow(map, i, noiseHeights, FractalNoiseSlopes{ slopeX.data(), slopeY.data(), context.HeightScale });
+		}
+	}
+
+	template<typename ViewType>
+	using FractalNoiseRowsFunction = void (*)(ViewType map, int firstRow, int lastRow, const FractalNoiseContext& context);
+
+	// common octave counts get an octave loop the compiler can unroll
+	template<typename Basis, typename Shape, typename ViewType>
+	static FractalNoiseRowsFunction<ViewType> SelectFractalNoiseOctaves(int octaves)
+	{
+		switch (octaves)
+		{
+		case 4: return GenerateFractalNoiseRows<Basis, Shape, 4, ViewType>;
+		case 6: return GenerateFractalNoiseRows<Basis, Shape, 6, ViewType>;
+		case 8: return GenerateFractalNoiseRows<Basis, Shape, 8, ViewType>;
+		default: return GenerateFractalNoiseRows<Basis, Shape, 0, ViewType>;
+		}
+	}
+
+	template<typename Basis, typename ViewType>
+	static FractalNoiseRowsFunction<ViewType> SelectFractalNoiseShape(const FractalNoiseSettings& settings)
+	{
+		switch (settings.Type)
+		{
+		case FractalNoiseType::Ridged: return SelectFractalNoiseOctaves<Basis, FractalRidgedShape, ViewType>(settings.Octaves);
+		case FractalNoiseType::Billow: return SelectFractalNoiseOctaves<Basis, FractalBillowShape, ViewType>(settings.Octaves);
+		default: return SelectFractalNoiseOctaves<Basis, FractalFbmShape, ViewType>(settings.Octaves);
+		}
+	}
+
+	// picks the row generator for the basis, shape and octave count of the settings
+	template<typename ViewType>
+	static FractalNoiseRowsFunction<ViewType> SelectFractalNoiseRows(const FractalNoiseSettings& settings)
+	{
+		switch (settings.Basis)
+		{
+		case NoiseBasis::Perlin: return SelectFractalNoiseShape<FractalPerlinBasis, ViewType>(settings);
+		case NoiseBasis::Value: return SelectFractalNoiseShape<FractalValueBasis, ViewType>(settings);
+		default: return SelectFractalNoiseShape<FractalSimplexBasis, ViewType>(settings);
+		}
+	}
+
+	// amplitude and frequency of every octave
+	static std::vector<FractalOctave> MakeFractalOctaves(const FractalNoiseSettings& settings, int width)
+	{
+		float samplingWidth = static_cast<float>(settings.SamplingWidth > 0 ? settings.SamplingWidth : width);
+		float basisAmplitude = settings.Basis == NoiseBasis::Perlin ? FractalPerlinBasis::Amplitude : 1.f;
+
+		std::vector<FractalOctave> octaves(std::max(settings.Octaves, 0));
+		float amplitude = 1.f;
+		float frequency = 1.f;
+		for (auto& octave : octaves)
+		{
+			octave.Step = settings.Scale * frequency / samplingWidth;
+			octave.Weight = amplitude * basisAmplitude;
+			amplitude *= settings.Persistance;
+			frequency *= settings.Lacunarity;
+		}
+		return octaves;
+	}
+
+	template<typename ViewType>
+	static void GenerateFractalNoiseMap(ViewType map, const FractalNoiseSettings& settings, float heightScale, TaskControl* control)
+	{
+		// the table of the seed and the octave constants are looked up once, the rows only read them
+		FractalNoiseContext context{ settings, GetNoisePermutation(settings.Seed).Values, GetSimdKernels(), MakeFractalOctaves(settings, map.Width), heightScale };
+		auto generateRows = SelectFractalNoiseRows<ViewType>(settings);
+
+		TraceScope evaluateScope("FractalNoise.Evaluate");
+		BeginWork(control, map.Height);
+		ParallelFor(0, map.Height, FractalNoiseRowsPerTask, settings.ThreadCount, [&](int firstRow, int lastRow) {
+			if (IsCancelled(control))
+				return;
+			generateRows(map, firstRow, lastRow, context);
+			AddProgress(control, lastRow - firstRow);
+		});
+	}
+
+	void GenerateFractalNoise(HeightfieldView map, const FractalNoiseSettings& settings, TaskControl* control)
+	{
+		GenerateFractalNoiseMap(map, settings, 0.f, control);
+	}
+
+	void GenerateFractalNoise(QuantizedHeightfieldView map, const FractalNoiseSettings& settings, TaskControl* control)
+	{
+		GenerateFractalNoiseMap(map, settings, 0.f, control);
+	}
+
+	void GenerateFractalNoiseWithNormals(HeightNormalView map, const FractalNoiseSettings& settings, float heightScale, TaskControl* control)
+	{
+		GenerateFractalNoiseMap(map, settings, heightScale, control);
+	}
+}
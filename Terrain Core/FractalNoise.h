@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Heightfield.h"
+#include "NoisePermutation.h"
+#include "TaskControl.h"
+
+namespace TerrainCore
+{
+	// noise function used for every octave
+	enum class NoiseBasis
+	{
+		Perlin,
+		Simplex,
+		Value
+	};
+
+	// how the octaves get shaped before they are summed up
+	enum class FractalNoiseType
+	{
+		// plain fractal brownian motion
+		Fbm,
+		// 1 - |noise| squared, sharp ridges where the noise crosses 0
+		Ridged,
+		// |noise|, round hills with creases in between
+		Billow
+	};
+
+	// Values used for Fractal brownian motion
+	struct FractalNoiseSettings
+	{
+		NoiseBasis Basis{ NoiseBasis::Simplex };
+		FractalNoiseType Type{ FractalNoiseType::Fbm };
+		float OffsetX{ 0.f };
+		float OffsetY{ 0.f };
+		float Scale{ 1.f };
+		int Octaves{ 1 };
+		float Persistance{ .5f };
+		float Lacunarity{ 2.f };
+		// picks the noise permutation, every seed gives a different reproducible terrain
+		uint32_t Seed{ DefaultNoiseSeed };
+		// Damps every octave by 1 / (1 + SlopeDampening * |d|^2), d being the summed noise derivatives of the octaves
+		// so far. Steep areas get less detail and flat areas keep theirs, 0 is plain fbm.
+		float SlopeDampening{ 0.f };
+		// Position of the first sample within a larger world and the amount of samples one unit of Scale spans, 0 uses
+		// the map width. Chunks of one world share the sampling width and use their own origin so their edges match.
+		int OriginX{ 0 };
+		int OriginY{ 0 };
+		int SamplingWidth{ 0 };
+		// threads used to generate the rows, 0 uses every core. the output does not depend on the thread count
+		int ThreadCount{ 0 };
+	};
+
+	// height and surface normal of a sample, packed so a map can be uploaded as one RGBA32F texture
+	struct HeightNormal
+	{
+		float Height;
+		float NormalX;
+		float NormalY;
+		float NormalZ;
+	};
+	using HeightNormalView = BasicHeightfieldView<HeightNormal>;
+	using HeightNormalField = BasicHeightfield<HeightNormal>;
+
+	// fills the whole map in place with fbm noise in the 0 1 range, progress is counted in rows
+	void GenerateFractalNoise(HeightfieldView map, const FractalNoiseSettings& settings, TaskControl* control = nullptr);
+	// same noise rounded to the nearest quantized height
+	void GenerateFractalNoise(QuantizedHeightfieldView map, const FractalNoiseSettings& settings, TaskControl* control = nullptr);
+	// Same noise with the normal of every sample, derived from the analytic derivatives of the noise in the same pass
+	// instead of a finite difference pass over the map. heightScale is the height of 1 in units of the sample spacing.
+	// With slope dampening the normals treat the damping of every octave as constant.
+	void GenerateFractalNoiseWithNormals(HeightNormalView map, const FractalNoiseSettings& settings, float heightScale, TaskControl* control = nullptr);
+}
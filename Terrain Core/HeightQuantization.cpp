@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HeightQuantization.h"
+#include "SimdKernels.h"
+
+#include <algorithm>
+
+namespace TerrainCore
+{
+	void QuantizeHeightfield(ConstHeightfieldView source, QuantizedHeightfieldView target)
+	{
+		int width = std::min(source.Width, target.Width);
+		int height = std::min(source.Height, target.Height);
+		auto quantize = GetSimdKernels().QuantizeHeights;
+		for (int y = 0; y < height; ++y)
+			quantize(source.Row(y), target.Row(y), width);
+	}
+
+	void DequantizeHeightfield(ConstQuantizedHeightfieldView source, HeightfieldView target)
+	{
+		int width = std::min(source.Width, target.Width);
+		int height = std::min(source.Height, target.Height);
+		for (int y = 0; y < height; ++y)
+		{
+			const uint16_t* sourceRow = source.Row(y);
+			float* targetRow = target.Row(y);
+			for (int x = 0; x < width; ++x)
+				targetRow[x] = DequantizeHeight(sourceRow[x]);
+		}
+	}
+}
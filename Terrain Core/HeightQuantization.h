@@ -0,0 +1,13 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Heightfield.h"
+
+namespace TerrainCore
+{
+	// Conversions between float and quantized maps of the same size, rows are converted with simd. Quantizing is
+	// within half a step of the float heights, dequantizing is exact so a round trip gives back the same quantized map.
+	void QuantizeHeightfield(ConstHeightfieldView source, QuantizedHeightfieldView target);
+	void DequantizeHeightfield(ConstQuantizedHeightfieldView source, HeightfieldView target);
+}
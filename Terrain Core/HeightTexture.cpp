@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HeightTexture.h"
+#include "SimdKernels.h"
+#include "TerrainTrace.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace TerrainCore
+{
+	int GetHeightTexelSize(HeightTextureFormat format)
+	{
+		return format == HeightTextureFormat::R16 ? static_cast<int>(sizeof(uint16_t)) : static_cast<int>(sizeof(float));
+	}
+
+	HeightTextureRegion ClipHeightTextureRegion(HeightTextureRegion region, int width, int height)
+	{
+		int right = std::min(region.X + region.Width, width);
+		int bottom = std::min(region.Y + region.Height, height);
+		region.X = std::max(region.X, 0);
+		region.Y = std::max(region.Y, 0);
+		region.Width = std::max(right - region.X, 0);
+		region.Height = std::max(bottom - region.Y, 0);
+		return region;
+	}
+
+	void ConvertHeightsToTexels(ConstHeightfieldView heights, HeightTextureRegion region, HeightTextureFormat format, void* texels, int pitch)
+	{
+		region = ClipHeightTextureRegion(region, heights.Width, heights.Height);
+		if (region.IsEmpty() || !texels)
+			return;
+
+		TraceScope convertScope("HeightTexture.Convert");
+
+		auto quantize = GetSimdKernels().QuantizeHeights;
+		uint8_t* texelRow = static_cast<uint8_t*>(texels);
+		for (int y = region.Y; y < region.Y + region.Height; ++y, texelRow += pitch)
+		{
+			const float* heightRow = heights.Row(y) + region.X;
+			if (format == HeightTextureFormat::R16)
+				quantize(heightRow, reinterpret_cast<uint16_t*>(texelRow), region.Width);
+			else
+				std::memcpy(texelRow, heightRow, static_cast<size_t>(region.Width) * sizeof(float));
+		}
+	}
+
+	void ConvertHeightsToTexels(ConstQuantizedHeightfieldView heights, HeightTextureRegion region, HeightTextureFormat format, void* texels, int pitch)
+	{
+		region = ClipHeightTextureRegion(region, heights.Width, heights.Height);
+		if (region.IsEmpty() || !texels)
+			return;
+
+		TraceScope convertScope("HeightTexture.Convert");
+
+		uint8_t* texelRow = static_cast<uint8_t*>(texels);
+		for (int y = region.Y; y < region.Y + region.Height; ++y, texelRow += pitch)
+		{
+			const uint16_t* heightRow = heights.Row(y) + region.X;
+			if (format == HeightTextureFormat::R16)
+				std::memcpy(texelRow, heightRow, static_cast<size_t>(region.Width) * sizeof(uint16_t));
+			else
+			{
+				float* floatRow = reinterpret_cast<float*>(texelRow);
+				for (int x = 0; x < region.Width; ++x)
+					floatRow[x] = DequantizeHeight(heightRow[x]);
+			}
+		}
+	}
+}
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Heightfield.h"
+
+#include <cstdint>
+
+namespace TerrainCore
+{
+	// single channel formats a heightmap can be uploaded as
+	enum class HeightTextureFormat
+	{
+		// 0 1 mapped to the full uint16 range
+		R16,
+		// heights as they are
+		R32F,
+	};
+
+	// rectangle of a heightmap in samples
+	struct HeightTextureRegion
+	{
+		int X{ 0 };
+		int Y{ 0 };
+		int Width{ 0 };
+		int Height{ 0 };
+
+		bool IsEmpty() const { return Width <= 0 || Height <= 0; }
+	};
+
+	// bytes per texel of a format
+	int GetHeightTexelSize(HeightTextureFormat format);
+
+	// part of the region that lies within a width x height map
+	HeightTextureRegion ClipHeightTextureRegion(HeightTextureRegion region, int width, int height);
+
+	// Converts a region of the heights into texels, texel rows start pitch bytes apart and the first texel is the top left
+	// sample of the region. Rows are converted with simd, only reads the heights so it can run on any thread.
+	void ConvertHeightsToTexels(ConstHeightfieldView heights, HeightTextureRegion region, HeightTextureFormat format, void* texels, int pitch);
+	// quantized heights are copied as they are for R16
+	void ConvertHeightsToTexels(ConstQuantizedHeightfieldView heights, HeightTextureRegion region, HeightTextureFormat format, void* texels, int pitch);
+}
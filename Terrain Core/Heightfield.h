@@ -0,0 +1,297 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace TerrainCore
+{
+	// Non owning view of a heightmap, rows start stride samples apart. Kernels work in place on views so the same
+	// memory can be shared between generation, erosion and analysis without copies
+	template<typename T>
+	struct BasicHeightfieldView
+	{
+		BasicHeightfieldView() = default;
+		BasicHeightfieldView(T* data, int width, int height)
+			: BasicHeightfieldView(data, width, height, width)
+		{
+		}
+		BasicHeightfieldView(T* data, int width, int height, int stride)
+			: Data{ data }
+			, Width{ width }
+			, Height{ height }
+			, Stride{ stride }
+		{
+		}
+
+		// a writable view can always be used as a read only view
+		template<typename U, typename = std::enable_if_t<std::is_same<const U, T>::value>>
+		BasicHeightfieldView(const BasicHeightfieldView<U>& other)
+			: BasicHeightfieldView(other.Data, other.Width, other.Height, other.Stride)
+		{
+		}
+
+		int GetSize() const { return Width * Height; }
+		bool IsEmpty() const { return !Data || Width <= 0 || Height <= 0; }
+
+		T* Row(int y) const { return Data + static_cast<ptrdiff_t>(Stride) * y; }
+		T& At(int x, int y) const { return Data[x + static_cast<ptrdiff_t>(Stride) * y]; }
+
+		// view of a rectangle within this view, shares the stride
+		BasicHeightfieldView SubView(int x, int y, int width, int height) const { return BasicHeightfieldView(&At(x, y), width, height, Stride); }
+
+		T* Data{ nullptr };
+		int Width{ 0 };
+		int Height{ 0 };
+		int Stride{ 0 };
+	};
+
+	using HeightfieldView = BasicHeightfieldView<float>;
+	using ConstHeightfieldView = BasicHeightfieldView<const float>;
+
+	// Heights in the 0 1 range stored as 16 bit fixed point. Storing a height rounds it to the nearest step, so a
+	// quantized map is within half a step (7.7e-6) of the float map it was made from. Heights outside 0 1 get clamped.
+	using QuantizedHeightfieldView = BasicHeightfieldView<uint16_t>;
+	using ConstQuantizedHeightfieldView = BasicHeightfieldView<const uint16_t>;
+
+	constexpr float QuantizedHeightMax = 65535.f;
+	// distance between two quantized heights
+	constexpr float QuantizedHeightStep = 1.f / QuantizedHeightMax;
+
+	// same rounding as the QuantizeHeights simd kernel
+	inline uint16_t QuantizeHeight(float height)
+	{
+		height = height > 0.f ? height : 0.f;
+		height = height < 1.f ? height : 1.f;
+		return static_cast<uint16_t>(static_cast<int32_t>(height * QuantizedHeightMax + .5f));
+	}
+
+	inline float DequantizeHeight(uint16_t value)
+	{
+		return static_cast<float>(value) / QuantizedHeightMax;
+	}
+
+	// helper that returns the lowest and highest sample of a view
+	inline std::pair<float, float> GetMinMax(ConstHeightfieldView view)
+	{
+		if (view.IsEmpty())
+			return { 0.f, 0.f };
+		float lowest = view.At(0, 0);
+		float highest = lowest;
+		for (int y = 0; y < view.Height; ++y)
+		{
+			auto range = std::minmax_element(view.Row(y), view.Row(y) + view.Width);
+			lowest = std::min(lowest, *range.first);
+			highest = std::max(highest, *range.second);
+		}
+		return { lowest, highest };
+	}
+
+	// lowest and highest height of a quantized view
+	inline std::pair<float, float> GetMinMax(ConstQuantizedHeightfieldView view)
+	{
+		if (view.IsEmpty())
+			return { 0.f, 0.f };
+		uint16_t lowest = view.At(0, 0);
+		uint16_t highest = lowest;
+		for (int y = 0; y < view.Height; ++y)
+		{
+			auto range = std::minmax_element(view.Row(y), view.Row(y) + view.Width);
+			lowest = std::min(lowest, *range.first);
+			highest = std::max(highest, *range.second);
+		}
+		return { DequantizeHeight(lowest), DequantizeHeight(highest) };
+	}
+
+	// Engine independent heightmap, samples are stored row by row (index = x + width * y)
+	template<typename T>
+	class BasicHeightfield
+	{
+	public:
+		BasicHeightfield() = default;
+		BasicHeightfield(int width, int height, T value = T())
+		{
+			Resize(width, height, value);
+		}
+		BasicHeightfield(int width, int height, const T* data)
+			: m_Width{ width }
+			, m_Height{ height }
+			, m_Data(data, data + static_cast<size_t>(width) * height)
+		{
+		}
+
+		// resizes the map and fills every sample with value
+		void Resize(int width, int height, T value = T())
+		{
+			m_Width = width;
+			m_Height = height;
+			m_Data.assign(static_cast<size_t>(width) * height, value);
+		}
+
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+		int GetSize() const { return m_Width * m_Height; }
+		bool IsEmpty() const { return m_Data.empty(); }
+
+		T* GetData() { return m_Data.data(); }
+		const T* GetData() const { return m_Data.data(); }
+
+		T& operator[](int index) { return m_Data[index]; }
+		T operator[](int index) const { return m_Data[index]; }
+
+		T& At(int x, int y) { return m_Data[x + m_Width * y]; }
+		T At(int x, int y) const { return m_Data[x + m_Width * y]; }
+
+		BasicHeightfieldView<T> GetView() { return BasicHeightfieldView<T>(m_Data.data(), m_Width, m_Height); }
+		BasicHeightfieldView<const T> GetView() const { return BasicHeightfieldView<const T>(m_Data.data(), m_Width, m_Height); }
+
+	private:
+		int m_Width{ 0 };
+		int m_Height{ 0 };
+		std::vector<T> m_Data;
+	};
+
+	using Heightfield = BasicHeightfield<float>;
+	// half the memory of a Heightfield, see QuantizedHeightfieldView for the precision
+	using QuantizedHeightfield = BasicHeightfield<uint16_t>;
+
+	// how the apron around a padded heightfield gets filled
+	enum class HeightfieldBorder
+	{
+		// ghost cells repeat the nearest sample of the map, slopes across the edge are flat
+		Clamp,
+		// ghost cells mirror the map at its edge without repeating the edge sample, slopes continue across the edge
+		Mirror,
+	};
+
+	// Heightmap surrounded by an apron of ghost cells. Stencils reading up to apron cells around a sample run over the
+	// whole map without bounds checks, and every row starts on a 64 byte boundary so simd loads of a row start on a
+	// cache line. Writes to the map don't reach the apron, FillApron refreshes it
+	template<typename T>
+	class BasicPaddedHeightfield
+	{
+	public:
+		static_assert(64 % sizeof(T) == 0, "samples have to tile a cache line");
+		// samples per 64 bytes, the stride is a multiple of it
+		static constexpr int RowAlignment = static_cast<int>(64 / sizeof(T));
+
+		BasicPaddedHeightfield() = default;
+		BasicPaddedHeightfield(int width, int height, int apron, T value = T())
+		{
+			Resize(width, height, apron, value);
+		}
+
+		// the alignment depends on the address of the buffer, so copies would need their own, moves keep the buffer
+		BasicPaddedHeightfield(const BasicPaddedHeightfield&) = delete;
+		BasicPaddedHeightfield& operator=(const BasicPaddedHeightfield&) = delete;
+		BasicPaddedHeightfield(BasicPaddedHeightfield&&) = default;
+		BasicPaddedHeightfield& operator=(BasicPaddedHeightfield&&) = default;
+
+		// resizes the map and fills every sample and ghost cell with value
+		void Resize(int width, int height, int apron, T value = T())
+		{
+			m_Width = std::max(width, 0);
+			m_Height = std::max(height, 0);
+			m_Apron = std::max(apron, 0);
+			m_Stride = (m_Width + 2 * m_Apron + RowAlignment - 1) / RowAlignment * RowAlignment;
+
+			// the first sample gets moved forward until it is aligned, the buffer has room for that on top
+			size_t firstSample = static_cast<size_t>(m_Apron) * m_Stride + m_Apron;
+			m_Data.assign(static_cast<size_t>(m_Height + 2 * m_Apron) * m_Stride + RowAlignment, value);
+			size_t misalignment = reinterpret_cast<uintptr_t>(m_Data.data() + firstSample) % 64 / sizeof(T);
+			m_Origin = firstSample + (RowAlignment - misalignment) % RowAlignment;
+		}
+
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+		int GetApron() const { return m_Apron; }
+		int GetStride() const { return m_Stride; }
+		bool IsEmpty() const { return m_Width == 0 || m_Height == 0; }
+
+		T& At(int x, int y) { return m_Data[m_Origin + x + static_cast<ptrdiff_t>(m_Stride) * y]; }
+		T At(int x, int y) const { return m_Data[m_Origin + x + static_cast<ptrdiff_t>(m_Stride) * y]; }
+
+		// the map without the apron
+		BasicHeightfieldView<T> GetView() { return BasicHeightfieldView<T>(m_Data.data() + m_Origin, m_Width, m_Height, m_Stride); }
+		BasicHeightfieldView<const T> GetView() const { return BasicHeightfieldView<const T>(m_Data.data() + m_Origin, m_Width, m_Height, m_Stride); }
+		// the map and its apron, the map starts at (apron, apron)
+		BasicHeightfieldView<T> GetPaddedView() { return BasicHeightfieldView<T>(&At(-m_Apron, -m_Apron), m_Width + 2 * m_Apron, m_Height + 2 * m_Apron, m_Stride); }
+		BasicHeightfieldView<const T> GetPaddedView() const { return BasicHeightfieldView<const T>(m_Data.data() + m_Origin - m_Apron - static_cast<ptrdiff_t>(m_Stride) * m_Apron, m_Width + 2 * m_Apron, m_Height + 2 * m_Apron, m_Stride); }
+
+		// copies a map of the same size in and out, the apron stays as it is
+		void CopyFrom(BasicHeightfieldView<const T> map)
+		{
+			for (int y = 0; y < m_Height; ++y)
+				std::copy(map.Row(y), map.Row(y) + m_Width, &At(0, y));
+		}
+		void CopyTo(BasicHeightfieldView<T> map) const
+		{
+			for (int y = 0; y < m_Height; ++y)
+				std::copy(&At(0, y), &At(0, y) + m_Width, map.Row(y));
+		}
+
+		// fills the apron from the samples of the map
+		void FillApron(HeightfieldBorder border)
+		{
+			if (IsEmpty())
+				return;
+
+			// columns of the map rows first, the rows above and below copy whole padded rows including their corners
+			for (int y = 0; y < m_Height; ++y)
+			{
+				T* row = &At(0, y);
+				for (int k = 1; k <= m_Apron; ++k)
+				{
+					row[-k] = row[GetBorderSource(-k, m_Width, border)];
+					row[m_Width - 1 + k] = row[GetBorderSource(m_Width - 1 + k, m_Width, border)];
+				}
+			}
+			for (int k = 1; k <= m_Apron; ++k)
+			{
+				const T* above = &At(-m_Apron, GetBorderSource(-k, m_Height, border));
+				std::copy(above, above + m_Width + 2 * m_Apron, &At(-m_Apron, -k));
+				const T* below = &At(-m_Apron, GetBorderSource(m_Height - 1 + k, m_Height, border));
+				std::copy(below, below + m_Width + 2 * m_Apron, &At(-m_Apron, m_Height - 1 + k));
+			}
+		}
+
+		// fills the apron with a fixed value, like a height no cell ever flows into
+		void FillApron(T value)
+		{
+			for (int y = -m_Apron; y < m_Height + m_Apron; ++y)
+			{
+				if (y < 0 || y >= m_Height)
+				{
+					std::fill(&At(-m_Apron, y), &At(-m_Apron, y) + m_Width + 2 * m_Apron, value);
+					continue;
+				}
+				std::fill(&At(-m_Apron, y), &At(0, y), value);
+				std::fill(&At(m_Width, y), &At(m_Width, y) + m_Apron, value);
+			}
+		}
+
+	private:
+		// sample of the map a ghost cell at index takes its value from, mirrors wider than the map clamp
+		static int GetBorderSource(int index, int size, HeightfieldBorder border)
+		{
+			if (border == HeightfieldBorder::Mirror)
+				index = index < 0 ? -index : (index >= size ? 2 * (size - 1) - index : index);
+			return std::min(std::max(index, 0), size - 1);
+		}
+
+		int m_Width{ 0 };
+		int m_Height{ 0 };
+		int m_Apron{ 0 };
+		int m_Stride{ 0 };
+		// index of the first sample of the map
+		size_t m_Origin{ 0 };
+		std::vector<T> m_Data;
+	};
+
+	using PaddedHeightfield = BasicPaddedHeightfield<float>;
+}
@@ -0,0 +1,635 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HydraulicErosionKernel.h"
+#include "Parallel.h"
+#include "SimdKernels.h"
+#include "TerrainTrace.h"
+#include "TimeBudget.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+namespace TerrainCore
+{
+	namespace
+	{
+		// drops every tile gets per round of the parallel mode
+		constexpr int HydraulicDropsPerTileRound = 32;
+		// drops the sequential mode simulates between cancellation checks
+		constexpr int HydraulicDropsPerCheck = 1024;
+		// drops the lockstep mode keeps in flight, the arrays of a batch stay in the l1 cache
+		constexpr int HydraulicLockstepDrops = 128;
+	}
+
+	static float LoadHydraulicHeight(const float* heights, int index)
+	{
+		return heights[index];
+	}
+
+	static float LoadHydraulicHeight(const uint16_t* heights, int index)
+	{
+		return DequantizeHeight(heights[index]);
+	}
+
+	static void AddHydraulicHeight(float* heights, int index, float delta, RandomStream&)
+	{
+		heights[index] += delta;
+	}
+
+	// rounds the new height up or down at random, weighted by the distance to both steps
+	static void AddHydraulicHeight(uint16_t* heights, int index, float delta, RandomStream& rounding)
+	{
+		float height = heights[index] + delta * QuantizedHeightMax + rounding.FRand();
+		heights[index] = static_cast<uint16_t>(std::min(std::max(height, 0.f), QuantizedHeightMax));
+	}
+
+	template<typename ViewType>
+	static HeightGradient CalcHydraulicHeightGradient(ViewType map, float posX, float posY)
+	{
+		// Get current position in grid
+		HeightGradient heightGradient;
+		int dimensions = map.Stride;
+		int coordX = (int)posX;
+		int coordY = (int)posY;
+
+		// get offset within grid
+		float x = posX - coordX;
+		float y = posY - coordY;
+
+		// get north western corner index
+		int nodeindexNW = coordX + dimensions * coordY;
+
+		// get corner gray values
+		float heightNW = LoadHydraulicHeight(map.Data, nodeindexNW);
+		float heightNE = LoadHydraulicHeight(map.Data, nodeindexNW + 1);
+		float heightSW = LoadHydraulicHeight(map.Data, nodeindexNW + dimensions);
+		float heightSE = LoadHydraulicHeight(map.Data, nodeindexNW + dimensions + 1);
+
+		// calculate gradient vars based on offset within grid
+		heightGradient.GradientX = (heightNE - heightNW) * (1 - y) + (heightSE - heightSW) * y;
+		heightGradient.GradientY = (heightSW - heightNW) * (1 - x) + (heightSE - heightNW) * x;
+		heightGradient.Height = heightNW * (1 - x) * (1 - y) + heightNE * x * (1 - y) + heightSW * (1 - x) * y + heightSE * x * y;
+
+		return heightGradient;
+	}
+
+	HeightGradient CalcHeightGradient(ConstHeightfieldView map, float posX, float posY)
+	{
+		return CalcHydraulicHeightGradient(map, posX, posY);
+	}
+
+	HeightGradient CalcHeightGradient(ConstQuantizedHeightfieldView map, float posX, float posY)
+	{
+		return CalcHydraulicHeightGradient(map, posX, posY);
+	}
+
+	int GetHydraulicTileSize(const HydraulicErosionSettings& settings)
+	{
+		// cells a drop can touch around its spawn cell, the brush covers radius - 1 cells and the bilinear reads and
+		// deposits one more
+		int reach = std::max(settings.MaxPath, 0) + std::max(settings.Radius, 1) + 2;
+		return 2 * reach + 1;
+	}
+
+	void HydraulicErosion::ErodeTerrain(HeightfieldView map, const HydraulicErosionSettings& settings, TaskControl* control)
+	{
+		ErodeMap(map, settings, control);
+	}
+
+	void HydraulicErosion::ErodeTerrain(QuantizedHeightfieldView map, const HydraulicErosionSettings& settings, TaskControl* control)
+	{
+		ErodeMap(map, settings, control);
+	}
+
+	template<typename ViewType>
+	void HydraulicErosion::ErodeMap(ViewType map, const HydraulicErosionSettings& settings, TaskControl* control)
+	{
+		// the progressive run shares the buffers and ends here
+		m_ProgressiveMap = {};
+		m_ProgressiveQuantizedMap = {};
+		m_DirtyTiles.Reset(map.Width, map.Height);
+		m_Stats = {};
+		if (map.Width < 2 || map.Height < 2)
+			return;
+
+		// the grid mode doesn't simulate drops
+		if (settings.Mode == HydraulicErosionMode::ShallowWater)
+		{
+			TraceScope waterScope("HydraulicErosion.ShallowWater");
+			BeginWork(control, settings.IterateAmount);
+			m_ShallowWaterErosion.ErodeTerrain(map, settings, m_DirtyTiles, control);
+			return;
+		}
+
+		// Initialize the brush
+		{
+			TraceScope brushScope("HydraulicErosion.BrushSetup");
+			m_ErosionBrush.Prepare(map.Width, map.Height, map.Stride, settings.Radius);
+		}
+
+		TraceScope dropScope("HydraulicErosion.Droplets");
+		BeginWork(control, settings.IterateAmount);
+		if (settings.Mode == HydraulicErosionMode::Parallel)
+			ErodeParallel(map, settings, control);
+		else if constexpr (std::is_same_v<ViewType, HeightfieldView>)
+		{
+			if (settings.Mode == HydraulicErosionMode::Lockstep)
+				ErodeLockstep(map, settings, control);
+			else
+				ErodeSequential(map, settings, control);
+		}
+		else
+			ErodeSequential(map, settings, control);
+	}
+
+	void HydraulicErosion::BeginProgressive(HeightfieldView map, const HydraulicErosionSettings& settings)
+	{
+		BeginProgressiveMap(map, settings);
+	}
+
+	void HydraulicErosion::BeginProgressive(QuantizedHeightfieldView map, const HydraulicErosionSettings& settings)
+	{
+		BeginProgressiveMap(map, settings);
+	}
+
+	template<typename ViewType>
+	void HydraulicErosion::BeginProgressiveMap(ViewType map, const HydraulicErosionSettings& settings)
+	{
+		m_ProgressiveMap = {};
+		m_ProgressiveQuantizedMap = {};
+		m_ProgressiveSettings = settings;
+		m_ProgressiveRandom.Seed(settings.Seed);
+		m_ProgressiveDone = 0;
+		m_DirtyTiles.Reset(map.Width, map.Height);
+		m_Stats = {};
+		if (map.Width < 2 || map.Height < 2)
+			return;
+
+		if constexpr (std::is_same_v<ViewType, HeightfieldView>)
+			m_ProgressiveMap = map;
+		else
+			m_ProgressiveQuantizedMap = map;
+		if (settings.Mode == HydraulicErosionMode::ShallowWater)
+			m_ShallowWaterErosion.Begin(map);
+		else
+		{
+			TraceScope brushScope("HydraulicErosion.BrushSetup");
+			m_ErosionBrush.Prepare(map.Width, map.Height, map.Stride, settings.Radius);
+		}
+	}
+
+	bool HydraulicErosion::AdvanceProgressive(double budgetMilliseconds)
+	{
+		if (IsProgressiveFinished())
+			return true;
+
+		int remaining = m_ProgressiveSettings.IterateAmount - m_ProgressiveDone;
+		if (m_ProgressiveSettings.Mode == HydraulicErosionMode::ShallowWater)
+		{
+			TraceScope waterScope("HydraulicErosion.ShallowWater");
+			RunWithinBudget(budgetMilliseconds, remaining, [this](int count)
+			{
+				for (int pass = 0; pass < count; ++pass)
+					m_ShallowWaterErosion.RunPass(m_ProgressiveSettings);
+				m_ProgressiveDone += count;
+				return count;
+			});
+
+			// the grids only reach the map when they get written
+			if (m_ProgressiveQuantizedMap.IsEmpty())
+				m_ShallowWaterErosion.WriteTerrain(m_ProgressiveMap, m_DirtyTiles);
+			else
+				m_ShallowWaterErosion.WriteTerrain(m_ProgressiveQuantizedMap, m_DirtyTiles);
+		}
+		else
+		{
+			TraceScope dropScope("HydraulicErosion.Droplets");
+			if (m_ProgressiveQuantizedMap.IsEmpty())
+				RunWithinBudget(budgetMilliseconds, remaining, [this](int count) { return RunProgressiveDrops(m_ProgressiveMap, count); });
+			else
+				RunWithinBudget(budgetMilliseconds, remaining, [this](int count) { return RunProgressiveDrops(m_ProgressiveQuantizedMap, count); });
+		}
+		return IsProgressiveFinished();
+	}
+
+	bool HydraulicErosion::IsProgressiveFinished() const
+	{
+		return (m_ProgressiveMap.IsEmpty() && m_ProgressiveQuantizedMap.IsEmpty()) || m_ProgressiveDone >= m_ProgressiveSettings.IterateAmount;
+	}
+
+	float HydraulicErosion::GetProgressiveProgress() const
+	{
+		if (IsProgressiveFinished())
+			return 1.f;
+		return static_cast<float>(m_ProgressiveDone) / static_cast<float>(m_ProgressiveSettings.IterateAmount);
+	}
+
+	template<typename ViewType>
+	int HydraulicErosion::RunProgressiveDrops(ViewType map, int count)
+	{
+		// same spawns and drop indices as the sequential mode
+		for (int a = 0; a < count; ++a, ++m_ProgressiveDone)
+		{
+			RainDrop drop;
+			drop.LocationX = m_ProgressiveRandom.FRandRange(0.f, map.Width - 2.f);
+			drop.LocationY = m_ProgressiveRandom.FRandRange(0.f, map.Height - 2.f);
+			SimulateDrop(map, m_ProgressiveSettings, drop, static_cast<uint32_t>(m_ProgressiveDone), m_DirtyTiles, m_Stats);
+		}
+		return count;
+	}
+
+	template<typename ViewType>
+	void HydraulicErosion::ErodeSequential(ViewType map, const HydraulicErosionSettings& settings, TaskControl* control)
+	{
+		RandomStream random(settings.Seed);
+		for (int a = 0; a < settings.IterateAmount; ++a)
+		{
+			if (a % HydraulicDropsPerCheck == 0 && a > 0)
+			{
+				AddProgress(control, HydraulicDropsPerCheck);
+				if (IsCancelled(control))
+					return;
+			}
+
+			// Create drop and spawn within grid
+			RainDrop drop;
+			drop.LocationX = random.FRandRange(0.f, map.Width - 2.f);
+			drop.LocationY = random.FRandRange(0.f, map.Height - 2.f);
+			SimulateDrop(map, settings, drop, static_cast<uint32_t>(a), m_DirtyTiles, m_Stats);
+		}
+		// drops since the last check
+		AddProgress(control, settings.IterateAmount - std::max(settings.IterateAmount - 1, 0) / HydraulicDropsPerCheck * HydraulicDropsPerCheck);
+	}
+
+	template<typename ViewType>
+	void HydraulicErosion::ErodeParallel(ViewType map, const HydraulicErosionSettings& settings, TaskControl* control)
+	{
+		int mapWidth = map.Width;
+		int mapHeight = map.Height;
+		int tileSize = GetHydraulicTileSize(settings);
+		int tilesX = std::max(mapWidth / tileSize, 1);
+		int tilesY = std::max(mapHeight / tileSize, 1);
+		if (tilesX < 2 && tilesY < 2)
+		{
+			ErodeSequential(map, settings, control);
+			return;
+		}
+
+		// tile of every column and row, the map gets split as evenly as possible so every tile is at least tileSize wide
+		m_TileOfColumn.resize(mapWidth);
+		for (int x = 0; x < mapWidth; ++x)
+			m_TileOfColumn[x] = static_cast<int>(static_cast<int64_t>(x) * tilesX / mapWidth);
+		m_TileOfRow.resize(mapHeight);
+		for (int y = 0; y < mapHeight; ++y)
+			m_TileOfRow[y] = static_cast<int>(static_cast<int64_t>(y) * tilesY / mapHeight);
+
+		// drops are simulated in rounds so the phases interleave over the whole run instead of eroding one quarter
+		// of the tiles after the other
+		int tileCount = tilesX * tilesY;
+		int dropsPerRound = tileCount * HydraulicDropsPerTileRound;
+		m_TileStats.assign(tileCount, HydraulicErosionStats{});
+
+		// spawns use the same random sequence as the sequential mode
+		RandomStream random(settings.Seed);
+		for (int roundBegin = 0; roundBegin < settings.IterateAmount && !IsCancelled(control); roundBegin += dropsPerRound)
+		{
+			int roundCount = std::min(dropsPerRound, settings.IterateAmount - roundBegin);
+			m_SpawnX.resize(roundCount);
+			m_SpawnY.resize(roundCount);
+			m_SpawnTile.resize(roundCount);
+			m_TileDropStart.assign(tileCount + 1, 0);
+			for (int a = 0; a < roundCount; ++a)
+			{
+				m_SpawnX[a] = random.FRandRange(0.f, mapWidth - 2.f);
+				m_SpawnY[a] = random.FRandRange(0.f, mapHeight - 2.f);
+				m_SpawnTile[a] = m_TileOfColumn[(int)m_SpawnX[a]] + tilesX * m_TileOfRow[(int)m_SpawnY[a]];
+				++m_TileDropStart[m_SpawnTile[a] + 1];
+			}
+
+			// counting sort by tile, drops keep their spawn order within a tile
+			for (int tile = 0; tile < tileCount; ++tile)
+				m_TileDropStart[tile + 1] += m_TileDropStart[tile];
+			m_TileDrops.resize(roundCount);
+			{
+				std::vector<int> tileCursor(m_TileDropStart.begin(), m_TileDropStart.end() - 1);
+				for (int a = 0; a < roundCount; ++a)
+					m_TileDrops[tileCursor[m_SpawnTile[a]]++] = a;
+			}
+
+			// checkerboard phases, tiles within a phase have a full tile between them
+			for (int phase = 0; phase < 4; ++phase)
+			{
+				int phaseX = phase & 1;
+				int phaseY = phase >> 1;
+				int phaseTilesX = (tilesX - phaseX + 1) / 2;
+				int phaseTilesY = (tilesY - phaseY + 1) / 2;
+				ParallelFor(0, phaseTilesX * phaseTilesY, 1, settings.ThreadCount, [&](int tileBegin, int tileEnd)
+				{
+					for (int phaseTile = tileBegin; phaseTile < tileEnd; ++phaseTile)
+					{
+						int tileX = phaseX + 2 * (phaseTile % phaseTilesX);
+						int tileY = phaseY + 2 * (phaseTile / phaseTilesX);
+						int tile = tileX + tilesX * tileY;
+						for (int slot = m_TileDropStart[tile]; slot < m_TileDropStart[tile + 1]; ++slot)
+						{
+							RainDrop drop;
+							drop.LocationX = m_SpawnX[m_TileDrops[slot]];
+							drop.LocationY = m_SpawnY[m_TileDrops[slot]];
+							SimulateDrop(map, settings, drop, static_cast<uint32_t>(roundBegin + m_TileDrops[slot]), m_DirtyTiles, m_TileStats[tile]);
+						}
+					}
+				});
+			}
+			AddProgress(control, roundCount);
+		}
+		for (const HydraulicErosionStats& tileStats : m_TileStats)
+			m_Stats.Add(tileStats);
+	}
+
+	void HydraulicErosion::ErodeLockstep(HeightfieldView map, const HydraulicErosionSettings& settings, TaskControl* control)
+	{
+		const SimdKernelTable& kernels = GetSimdKernels();
+		DropletStepSettings stepSettings;
+		stepSettings.Inertia = settings.Inertia;
+		stepSettings.Capacity = settings.Capacity;
+		stepSettings.Deposition = settings.Deposition;
+		stepSettings.Erosion = settings.Erosion;
+		stepSettings.Evaporation = settings.Evaporation;
+		stepSettings.Gravity = settings.Gravity;
+		stepSettings.MinSlope = settings.MinSlope;
+		stepSettings.MapWidth = map.Width;
+		stepSettings.MapHeight = map.Height;
+		stepSettings.MapStride = map.Stride;
+
+		// one array per drop variable, the ints also hold the steps taken and the box of the cells every drop changed
+		constexpr int batch = HydraulicLockstepDrops;
+		m_DropletFloats.resize(10 * batch);
+		m_DropletInts.resize(8 * batch);
+		float* floats = m_DropletFloats.data();
+		int32_t* ints = m_DropletInts.data();
+		DropletArrays drops;
+		drops.LocationX = floats;
+		drops.LocationY = floats + batch;
+		drops.DirectionX = floats + 2 * batch;
+		drops.DirectionY = floats + 3 * batch;
+		drops.Velocity = floats + 4 * batch;
+		drops.Water = floats + 5 * batch;
+		drops.Sediment = floats + 6 * batch;
+		drops.OffsetX = floats + 7 * batch;
+		drops.OffsetY = floats + 8 * batch;
+		drops.Amount = floats + 9 * batch;
+		drops.CellX = ints;
+		drops.CellY = ints + batch;
+		drops.Action = ints + 2 * batch;
+		int32_t* steps = ints + 3 * batch;
+		int32_t* changedMinX = ints + 4 * batch;
+		int32_t* changedMinY = ints + 5 * batch;
+		int32_t* changedMaxX = ints + 6 * batch;
+		int32_t* changedMaxY = ints + 7 * batch;
+
+		float* heights = map.Data;
+		int mapStride = map.Stride;
+		int reach = std::max(m_ErosionBrush.GetRadius(), 1);
+		RandomStream random(settings.Seed);
+		int spawned = settings.MaxPath > 0 ? 0 : settings.IterateAmount;
+		int active = 0;
+		while (!IsCancelled(control))
+		{
+			// retired drops were compacted out, new drops fill up the batch in spawn order
+			for (; active < batch && spawned < settings.IterateAmount; ++active, ++spawned)
+			{
+				drops.LocationX[active] = random.FRandRange(0.f, map.Width - 2.f);
+				drops.LocationY[active] = random.FRandRange(0.f, map.Height - 2.f);
+				drops.DirectionX[active] = 0.f;
+				drops.DirectionY[active] = 0.f;
+				drops.Velocity[active] = 1.f;
+				drops.Water[active] = 1.f;
+				drops.Sediment[active] = 0.f;
+				steps[active] = 0;
+				changedMinX[active] = map.Width;
+				changedMinY[active] = map.Height;
+				changedMaxX[active] = -1;
+				changedMaxY[active] = -1;
+			}
+			if (active == 0)
+				break;
+
+			kernels.DropletStep(heights, stepSettings, drops, active);
+
+			// the changes are applied in drop order, so drops sharing cells never lose each other's changes
+			for (int k = 0; k < active; ++k)
+			{
+				int cellX = drops.CellX[k];
+				int cellY = drops.CellY[k];
+				float amount = drops.Amount[k];
+				if (drops.Action[k] == DropletDeposit)
+				{
+					float offsetX = drops.OffsetX[k];
+					float offsetY = drops.OffsetY[k];
+					int mapIndex = cellX + mapStride * cellY;
+					heights[mapIndex] += amount * (1 - offsetX) * (1 - offsetY);
+					heights[mapIndex + 1] += amount * offsetX * (1 - offsetY);
+					heights[mapIndex + mapStride] += amount * (1 - offsetX) * offsetY;
+					heights[mapIndex + mapStride + 1] += amount * offsetX * offsetY;
+					m_Stats.Deposited += amount;
+				}
+				else if (drops.Action[k] == DropletErode)
+				{
+					float& sediment = drops.Sediment[k];
+					float eroded = 0.f;
+					m_ErosionBrush.ForEachCell(cellX, cellY, [&](int nodeIdx, float brushWeight)
+					{
+						float weightErode = amount * brushWeight;
+						float height = heights[nodeIdx];
+						auto deltaSediment = (height < weightErode) ? height : weightErode;
+						heights[nodeIdx] -= deltaSediment;
+						sediment += deltaSediment;
+						eroded += deltaSediment;
+					});
+					m_Stats.Eroded += eroded;
+				}
+				else
+					continue;
+
+				changedMinX[k] = std::min(changedMinX[k], cellX);
+				changedMinY[k] = std::min(changedMinY[k], cellY);
+				changedMaxX[k] = std::max(changedMaxX[k], cellX);
+				changedMaxY[k] = std::max(changedMaxY[k], cellY);
+			}
+
+			// drops that left the map or reached their max path make room, the others keep their order
+			int kept = 0;
+			for (int k = 0; k < active; ++k)
+			{
+				if (drops.Action[k] != DropletRetired && ++steps[k] < settings.MaxPath)
+				{
+					if (kept != k)
+					{
+						for (float* values : { drops.LocationX, drops.LocationY, drops.DirectionX, drops.DirectionY, drops.Velocity, drops.Water, drops.Sediment })
+							values[kept] = values[k];
+						for (int32_t* values : { steps, changedMinX, changedMinY, changedMaxX, changedMaxY })
+							values[kept] = values[k];
+					}
+					++kept;
+					continue;
+				}
+
+				// retired drops stopped without a direction or left the map
+				++m_Stats.Drops;
+				m_Stats.PathSteps += steps[k];
+				if (drops.Action[k] != DropletRetired)
+					++m_Stats.MaxPathDrops;
+				else if (drops.DirectionX[k] == 0.f && drops.DirectionY[k] == 0.f)
+					++m_Stats.StalledDrops;
+				else
+					++m_Stats.LeftMapDrops;
+
+				if (changedMaxX[k] >= 0)
+					m_DirtyTiles.MarkRect(changedMinX[k] - reach, changedMinY[k] - reach, changedMaxX[k] - changedMinX[k] + 2 * reach + 1, changedMaxY[k] - changedMinY[k] + 2 * reach + 1);
+			}
+			AddProgress(control, active - kept);
+			active = kept;
+		}
+		// drops that never started because of max path 0
+		if (settings.MaxPath <= 0)
+		{
+			m_Stats.Drops += settings.IterateAmount;
+			m_Stats.MaxPathDrops += settings.IterateAmount;
+			AddProgress(control, settings.IterateAmount);
+		}
+	}
+
+	template<typename ViewType>
+	void HydraulicErosion::SimulateDrop(ViewType map, const HydraulicErosionSettings& settings, RainDrop& drop, uint32_t dropIndex, DirtyTileMask& dirtyTiles, HydraulicErosionStats& stats) const
+	{
+		int mapWidth = map.Width;
+		int mapHeight = map.Height;
+		int mapStride = map.Stride;
+		auto heights = map.Data;
+		// only used by quantized maps, seeded per drop so the parallel mode rounds the same as the sequential mode
+		RandomStream rounding((static_cast<uint64_t>(settings.Seed) << 32) | dropIndex);
+		// cells the drop deposited on or eroded, the tiles get marked once the drop is done
+		int changedMinX = mapWidth;
+		int changedMinY = mapHeight;
+		int changedMaxX = -1;
+		int changedMaxY = -1;
+		// material moved by the drop, added to the stats once it is done
+		float eroded = 0.f;
+		float deposited = 0.f;
+
+		// loop over its max path
+		int i = 0;
+		for (; i < settings.MaxPath; ++i)
+		{
+			// get current location in grid
+			int currentX = (int)drop.LocationX;
+			int currentY = (int)drop.LocationY;
+			int mapIndex = currentX + mapStride * currentY;
+
+			// calculate offset within that cell
+			float currentOffsetX = drop.LocationX - currentX;
+			float currentOffsetY = drop.LocationY - currentY;
+
+			// get heightgradient
+			auto heightGradient = CalcHeightGradient(map, drop.LocationX, drop.LocationY);
+
+			// set direction based on heightgradient, current direction and inertia
+			drop.DirectionX = (drop.DirectionX * settings.Inertia - heightGradient.GradientX * (1 - settings.Inertia));
+			drop.DirectionY = (drop.DirectionY * settings.Inertia - heightGradient.GradientY * (1 - settings.Inertia));
+			float squareSum = drop.DirectionX * drop.DirectionX + drop.DirectionY * drop.DirectionY;
+			if (squareSum > 1e-8f)
+			{
+				float scale = 1.f / std::sqrt(squareSum);
+				drop.DirectionX *= scale;
+				drop.DirectionY *= scale;
+			}
+			else
+			{
+				drop.DirectionX = 0.f;
+				drop.DirectionY = 0.f;
+			}
+
+			// Change location based on direction
+			drop.LocationX += drop.DirectionX;
+			drop.LocationY += drop.DirectionY;
+
+			// escape if drop stopped or left map
+			if (drop.DirectionX == 0.f && drop.DirectionY == 0.f)
+			{
+				++stats.StalledDrops;
+				break;
+			}
+			if (drop.LocationX < 0.f || drop.LocationX >= mapWidth - 1 || drop.LocationY < 0.f || drop.LocationY >= mapHeight - 1)
+			{
+				++stats.LeftMapDrops;
+				break;
+			}
+
+			// get height in new cell
+			float newHeight = CalcHeightGradient(map, drop.LocationX, drop.LocationY).Height;
+
+			// calculate heightdifference
+			float heightDifference = newHeight - heightGradient.Height;
+
+			// calculate capacity
+			float capacity = std::max(-heightDifference, settings.MinSlope) * drop.Velocity * drop.Water * settings.Capacity;
+
+			if (drop.Sediment > capacity || heightDifference > 0.f)
+			{
+				// calculate sediment to drop based on heightdifference
+				auto sedimentTodrop = (heightDifference > 0.f) ? std::min(heightDifference, drop.Sediment) : (drop.Sediment - capacity) * settings.Deposition;
+				drop.Sediment -= sedimentTodrop;
+				deposited += sedimentTodrop;
+
+				// spread sediment drop over corners of cell
+				AddHydraulicHeight(heights, mapIndex, sedimentTodrop * (1 - currentOffsetX) * (1 - currentOffsetY), rounding);
+				AddHydraulicHeight(heights, mapIndex + 1, sedimentTodrop * currentOffsetX * (1 - currentOffsetY), rounding);
+				AddHydraulicHeight(heights, mapIndex + mapStride, sedimentTodrop * (1 - currentOffsetX) * currentOffsetY, rounding);
+				AddHydraulicHeight(heights, mapIndex + mapStride + 1, sedimentTodrop * currentOffsetX * currentOffsetY, rounding);
+			}
+			else
+			{
+				// calculate amount to erode
+				auto erode = std::min(settings.Erosion * (capacity - drop.Sediment), -heightDifference);
+
+				// loop over all cells of the brush
+				m_ErosionBrush.ForEachCell(currentX, currentY, [&](int nodeIdx, float brushWeight)
+				{
+					float weightErode = erode * brushWeight;
+
+					// calculate sediment to take from terrain and add sediment to drop
+					float height = LoadHydraulicHeight(heights, nodeIdx);
+					auto deltaSediment = (height < weightErode) ? height : weightErode;
+					AddHydraulicHeight(heights, nodeIdx, -deltaSediment, rounding);
+					drop.Sediment += deltaSediment;
+					eroded += deltaSediment;
+				});
+			}
+
+			// the brush reaches radius cells around the drop, the deposit one cell to the right and down
+			changedMinX = std::min(changedMinX, currentX);
+			changedMinY = std::min(changedMinY, currentY);
+			changedMaxX = std::max(changedMaxX, currentX);
+			changedMaxY = std::max(changedMaxY, currentY);
+
+			// decrease water capacity and change velocity
+			drop.Water *= (1 - settings.Evaporation);
+			drop.Velocity = std::sqrt(drop.Velocity * drop.Velocity + std::abs(heightDifference) * settings.Gravity);
+		}
+
+		++stats.Drops;
+		if (i >= settings.MaxPath)
+			++stats.MaxPathDrops;
+		stats.PathSteps += i;
+		stats.Eroded += eroded;
+		stats.Deposited += deposited;
+
+		if (changedMaxX >= 0)
+		{
+			int reach = std::max(m_ErosionBrush.GetRadius(), 1);
+			dirtyTiles.MarkRect(changedMinX - reach, changedMinY - reach, changedMaxX - changedMinX + 2 * reach + 1, changedMaxY - changedMinY + 2 * reach + 1);
+		}
+	}
+}
@@ -0,0 +1,201 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "DirtyTiles.h"
+#include "ErosionBrush.h"
+#include "Heightfield.h"
+#include "RandomStream.h"
+#include "ShallowWaterErosionKernel.h"
+#include "TaskControl.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace TerrainCore
+{
+	// how the raindrops get scheduled
+	enum class HydraulicErosionMode
+	{
+		// one drop after the other on the calling thread
+		Sequential,
+		// drops are bucketed by spawn tile and tiles that can't reach each other run at the same time
+		Parallel,
+		// Drops advance in batches one step at a time, sampling and the drop updates run with simd and the changes to
+		// the map get applied in drop order. Quantized maps use the sequential mode
+		Lockstep,
+		// Grid based pipe model instead of raindrops, water, sediment and outflow grids advance in fixed stencil passes
+		// on every core. The iterate amount counts passes
+		ShallowWater,
+	};
+
+	//variables that influence hydraulic erosion
+	struct HydraulicErosionSettings
+	{
+		float Inertia{ .05f };
+		float Capacity{ 4.f };
+		float MinCapacity{ .01f };
+		float Deposition{ .3f };
+		float Erosion{ .3f };
+		float Evaporation{ .01f };
+		int MaxPath{ 30 };
+		float Gravity{ 4.f };
+		int Radius{ 3 };
+		float MinSlope{ 0.01f };
+		int IterateAmount{ 7000 };
+		// seed used for the droplet spawn positions
+		uint32_t Seed{ 0 };
+		HydraulicErosionMode Mode{ HydraulicErosionMode::Sequential };
+		// threads used by the parallel and shallow water mode, 0 uses every core
+		int ThreadCount{ 0 };
+		// Shallow water mode only: water rained onto every cell per unit of time and the time every pass simulates.
+		// Steps longer than .5 / sqrt(gravity) get shortened, the water would swing between the cells
+		float Rain{ .01f };
+		float TimeStep{ .2f };
+	};
+
+	// Counters of the last run of the droplet modes, the shallow water mode leaves them at 0
+	struct HydraulicErosionStats
+	{
+		int64_t Drops{ 0 };
+		// drops that stopped on flat ground, left the map or ran for the max path
+		int64_t StalledDrops{ 0 };
+		int64_t LeftMapDrops{ 0 };
+		int64_t MaxPathDrops{ 0 };
+		// steps every drop moved and stayed on the map, summed over all drops
+		int64_t PathSteps{ 0 };
+		// material the drops took from the map and put back, quantized maps round the changes afterwards
+		double Eroded{ 0.0 };
+		double Deposited{ 0.0 };
+
+		double GetAveragePathLength() const { return Drops > 0 ? static_cast<double>(PathSteps) / static_cast<double>(Drops) : 0.0; }
+		void Add(const HydraulicErosionStats& other)
+		{
+			Drops += other.Drops;
+			StalledDrops += other.StalledDrops;
+			LeftMapDrops += other.LeftMapDrops;
+			MaxPathDrops += other.MaxPathDrops;
+			PathSteps += other.PathSteps;
+			Eroded += other.Eroded;
+			Deposited += other.Deposited;
+		}
+	};
+
+	//structure used for raindrops
+	struct RainDrop
+	{
+		float LocationX{ 0.f };
+		float LocationY{ 0.f };
+		float DirectionX{ 0.f };
+		float DirectionY{ 0.f };
+		float Velocity{ 1.f };
+		float Water{ 1.f };
+		float Sediment{ 0.f };
+	};
+
+	//structure used for heightgradient
+	struct HeightGradient
+	{
+		float Height;
+		float GradientX;
+		float GradientY;
+	};
+
+	// Helper function that gets the bilinear height and gradient at a position within the map
+	HeightGradient CalcHeightGradient(ConstHeightfieldView map, float posX, float posY);
+	HeightGradient CalcHeightGradient(ConstQuantizedHeightfieldView map, float posX, float posY);
+
+	// Size of the tiles used by the parallel mode. A drop never gets further than MaxPath cells from its spawn and its
+	// brush and bilinear reads reach a few cells beyond that, tiles are large enough that drops spawned two tiles apart
+	// never touch the same cells.
+	int GetHydraulicTileSize(const HydraulicErosionSettings& settings);
+
+	// Particle based hydraulic erosion, simulates raindrops that pick up and deposit sediment
+	class HydraulicErosion
+	{
+	public:
+		// erodes the map in place, progress is counted in drops
+		void ErodeTerrain(HeightfieldView map, const HydraulicErosionSettings& settings, TaskControl* control = nullptr);
+		// Erodes a quantized map in place. Changes smaller than a quantization step would get lost with plain rounding,
+		// so every change is rounded stochastically: the expected height matches the float path and the rounding error
+		// after n changes to a cell is about sqrt(n) / 2 steps. Heights saturate at 0 and 1.
+		void ErodeTerrain(QuantizedHeightfieldView map, const HydraulicErosionSettings& settings, TaskControl* control = nullptr);
+
+		// Progressive runs spread the iterate amount over many calls, for example one per frame. The map has to stay alive
+		// and untouched by others until the run finishes, ErodeTerrain ends it. Drops run one after another with the
+		// result of the sequential mode whatever the mode, the shallow water mode keeps its grids between the calls.
+		void BeginProgressive(HeightfieldView map, const HydraulicErosionSettings& settings);
+		void BeginProgressive(QuantizedHeightfieldView map, const HydraulicErosionSettings& settings);
+		// Continues the progressive run for about the budget in milliseconds and at least one drop or pass, the map
+		// shows the state of the run afterwards. Returns true once the iterate amount is done
+		bool AdvanceProgressive(double budgetMilliseconds);
+		bool IsProgressiveFinished() const;
+		// done drops or passes of the progressive run in the 0 1 range
+		float GetProgressiveProgress() const;
+
+		// Tiles of the map the last call changed, every drop marks the bounding box of the cells it deposited on or
+		// eroded. Progressive runs keep adding to them until they get cleared
+		const DirtyTileMask& GetDirtyTiles() const { return m_DirtyTiles; }
+		void ClearDirtyTiles() { m_DirtyTiles.Clear(); }
+
+		// counters of the last call, progressive runs keep adding to them since BeginProgressive
+		const HydraulicErosionStats& GetStats() const { return m_Stats; }
+
+	private:
+		template<typename ViewType>
+		void ErodeMap(ViewType map, const HydraulicErosionSettings& settings, TaskControl* control);
+
+		// moves a single drop over the map until it leaves the map or reaches its max path, the drop index seeds the
+		// rounding of quantized maps. Drops of the parallel mode share the dirty tiles, marking them is thread safe,
+		// and count into the stats of their tile
+		template<typename ViewType>
+		void SimulateDrop(ViewType map, const HydraulicErosionSettings& settings, RainDrop& drop, uint32_t dropIndex, DirtyTileMask& dirtyTiles, HydraulicErosionStats& stats) const;
+
+		template<typename ViewType>
+		void BeginProgressiveMap(ViewType map, const HydraulicErosionSettings& settings);
+		// runs the next drops of the progressive run, returns how many ran
+		template<typename ViewType>
+		int RunProgressiveDrops(ViewType map, int count);
+
+		template<typename ViewType>
+		void ErodeSequential(ViewType map, const HydraulicErosionSettings& settings, TaskControl* control);
+		// Spawns are bucketed per tile and the tiles run in four checkerboard phases, tiles of one phase are a full tile
+		// apart. Output only depends on the seed and map size, not on the thread count. Maps smaller than two tiles
+		// fall back to the sequential mode.
+		template<typename ViewType>
+		void ErodeParallel(ViewType map, const HydraulicErosionSettings& settings, TaskControl* control);
+		// Keeps a batch of drops in structure of arrays layout, retired drops are compacted out and new drops take their
+		// place in spawn order. Drops of a batch can share cells, the later drop sees the changes of the earlier one.
+		void ErodeLockstep(HeightfieldView map, const HydraulicErosionSettings& settings, TaskControl* control);
+
+		// brush stencil, kept between calls and only rebuilt when the map layout or radius changes
+		ErosionBrush m_ErosionBrush;
+		DirtyTileMask m_DirtyTiles;
+		HydraulicErosionStats m_Stats;
+
+		// scratch buffers of the parallel mode, kept between calls to avoid reallocating
+		std::vector<int> m_TileOfColumn;
+		std::vector<int> m_TileOfRow;
+		std::vector<float> m_SpawnX;
+		std::vector<float> m_SpawnY;
+		std::vector<int> m_SpawnTile;
+		std::vector<int> m_TileDropStart;
+		std::vector<int> m_TileDrops;
+		// counters of every tile, added up in tile order so the sums don't depend on the thread count
+		std::vector<HydraulicErosionStats> m_TileStats;
+
+		// grids of the shallow water mode
+		ShallowWaterErosion m_ShallowWaterErosion;
+
+		// drop arrays of the lockstep mode, kept between calls
+		std::vector<float> m_DropletFloats;
+		std::vector<int32_t> m_DropletInts;
+
+		// state of the progressive run, only one of the maps is set
+		HeightfieldView m_ProgressiveMap;
+		QuantizedHeightfieldView m_ProgressiveQuantizedMap;
+		HydraulicErosionSettings m_ProgressiveSettings;
+		RandomStream m_ProgressiveRandom;
+		int m_ProgressiveDone{ 0 };
+	};
+}
@@ -0,0 +1,235 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NoiseFunctions.h"
+#include "SimdKernels.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace TerrainCore
+{
+	static constexpr NoisePermutation DefaultNoisePermutation = MakeNoisePermutation(DefaultNoiseSeed);
+	static_assert(DefaultNoisePermutation.Values[0] == 151 && DefaultNoisePermutation.Values[511] == 180, "default seed has to give the classic permutation");
+
+	// simplex constants
+	static const float SimplexF2 = 0.5f * (std::sqrt(3.f) - 1.f);
+	static const float SimplexG2 = (3.f - std::sqrt(3.f)) / 6.f;
+
+	static float SimplexGrad(int32_t hash, float x, float y)
+	{
+		const int32_t h = hash & 0xF;
+		const float u = h < 8 ? x : y;
+		const float v = h < 8 ? y : x;
+		return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f * v : 2.0f * v);
+	}
+
+	float SimplexNoise2D(float x, float y)
+	{
+		return SimplexNoise2D(DefaultNoisePermutation, x, y);
+	}
+
+	float SimplexNoise2D(const NoisePermutation& noisePermutation, float x, float y)
+	{
+		const int32_t* permutation = noisePermutation.Values;
+		float n0, n1, n2;
+
+		auto skewFactor = (x + y) * SimplexF2;
+		int i = static_cast<int>(std::floor(x + skewFactor));
+		int j = static_cast<int>(std::floor(y + skewFactor));
+
+		auto unskewFactor = (i + j) * SimplexG2;
+		auto x0 = x - (i - unskewFactor);
+		auto y0 = y - (j - unskewFactor);
+
+		int i1, j1;
+		if (x0 > y0)
+		{
+			i1 = 1;
+			j1 = 0;
+		}
+		else
+		{
+			i1 = 0;
+			j1 = 1;
+		}
+
+		auto x1 = x0 - i1 + SimplexG2;
+		auto y1 = y0 - j1 + SimplexG2;
+		auto x2 = x0 - 1.f + 2.f * SimplexG2;
+		auto y2 = y0 - 1.f + 2.f * SimplexG2;
+
+		auto ii = i & 255;
+		auto jj = j & 255;
+
+		auto gi0 = permutation[ii + permutation[jj]];
+		auto gi1 = permutation[ii + i1 + permutation[jj + j1]];
+		auto gi2 = permutation[ii + 1 + permutation[jj + 1]];
+
+		auto t0 = 0.5f - x0 * x0 - y0 * y0;
+		if (t0 < 0.f)
+			n0 = 0.f;
+		else
+		{
+			t0 *= t0;
+			n0 = t0 * t0 * SimplexGrad(gi0, x0, y0);
+		}
+
+		auto t1 = 0.5f - x1 * x1 - y1 * y1;
+		if (t1 < 0.f)
+			n1 = 0.f;
+		else
+		{
+			t1 *= t1;
+			n1 = t1 * t1 * SimplexGrad(gi1, x1, y1);
+		}
+
+		float t2 = 0.5f - x2 * x2 - y2 * y2;
+		if (t2 < 0.f)
+			n2 = 0.f;
+		else
+		{
+			t2 *= t2;
+			n2 = t2 * t2 * SimplexGrad(gi2, x2, y2);
+		}
+
+		return 24.f * (n0 + n1 + n2);
+	}
+
+	// corners and major axes, in the -1 1 range without additional scaling
+	static float PerlinGrad(int32_t hash, float x, float y)
+	{
+		switch (hash & 7)
+		{
+		case 0: return x;
+		case 1: return x + y;
+		case 2: return y;
+		case 3: return -x + y;
+		case 4: return -x;
+		case 5: return -x - y;
+		case 6: return -y;
+		default: return x - y;
+		}
+	}
+
+	static float PerlinSmoothCurve(float x)
+	{
+		return x * x * x * (x * (x * 6.f - 15.f) + 10.f);
+	}
+
+	static float PerlinLerp(float a, float b, float alpha)
+	{
+		return a + alpha * (b - a);
+	}
+
+	float PerlinNoise2D(float x, float y)
+	{
+		return PerlinNoise2D(DefaultNoisePermutation, x, y);
+	}
+
+	float PerlinNoise2D(const NoisePermutation& noisePermutation, float x, float y)
+	{
+		const int32_t* permutation = noisePermutation.Values;
+
+		float xFloor = std::floor(x);
+		float yFloor = std::floor(y);
+		int xi = static_cast<int>(xFloor) & 255;
+		int yi = static_cast<int>(yFloor) & 255;
+
+		// offset within the cell and towards the next corner
+		float xOffset = x - xFloor;
+		float yOffset = y - yFloor;
+		float xm1 = xOffset - 1.f;
+		float ym1 = yOffset - 1.f;
+
+		int aa = permutation[xi] + yi;
+		int ab = aa + 1;
+		int ba = permutation[xi + 1] + yi;
+		int bb = ba + 1;
+
+		float u = PerlinSmoothCurve(xOffset);
+		float v = PerlinSmoothCurve(yOffset);
+
+		return PerlinLerp(
+			PerlinLerp(PerlinGrad(permutation[aa], xOffset, yOffset), PerlinGrad(permutation[ba], xm1, yOffset), u),
+			PerlinLerp(PerlinGrad(permutation[ab], xOffset, ym1), PerlinGrad(permutation[bb], xm1, ym1), u),
+			v);
+	}
+
+	// the scalar kernels are the reference, a single lane gives the same values as every batch
+	float ValueNoise2D(const NoisePermutation& permutation, float x, float y)
+	{
+		float value;
+		GetScalarKernels()->ValueNoise2D(permutation.Values, &x, &y, &value, 1);
+		return value;
+	}
+
+	NoiseDerivatives SimplexNoise2DDerivatives(const NoisePermutation& permutation, float x, float y)
+	{
+		NoiseDerivatives noise;
+		GetScalarKernels()->SimplexNoise2DDerivatives(permutation.Values, &x, &y, &noise.Value, &noise.DerivativeX, &noise.DerivativeY, 1);
+		return noise;
+	}
+
+	NoiseDerivatives PerlinNoise2DDerivatives(const NoisePermutation& permutation, float x, float y)
+	{
+		NoiseDerivatives noise;
+		GetScalarKernels()->PerlinNoise2DDerivatives(permutation.Values, &x, &y, &noise.Value, &noise.DerivativeX, &noise.DerivativeY, 1);
+		return noise;
+	}
+
+	NoiseDerivatives ValueNoise2DDerivatives(const NoisePermutation& permutation, float x, float y)
+	{
+		NoiseDerivatives noise;
+		GetScalarKernels()->ValueNoise2DDerivatives(permutation.Values, &x, &y, &noise.Value, &noise.DerivativeX, &noise.DerivativeY, 1);
+		return noise;
+	}
+
+	void SimplexNoise2DBatch(const NoisePermutation& permutation, const float* x, const float* y, float* result, int count)
+	{
+		GetSimdKernels().SimplexNoise2D(permutation.Values, x, y, result, count);
+	}
+
+	void PerlinNoise2DBatch(const NoisePermutation& permutation, const float* x, const float* y, float* result, int count)
+	{
+		GetSimdKernels().PerlinNoise2D(permutation.Values, x, y, result, count);
+	}
+
+	void ValueNoise2DBatch(const NoisePermutation& permutation, const float* x, const float* y, float* result, int count)
+	{
+		GetSimdKernels().ValueNoise2D(permutation.Values, x, y, result, count);
+	}
+
+	void SimplexNoise2DDerivativesBatch(const NoisePermutation& permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count)
+	{
+		GetSimdKernels().SimplexNoise2DDerivatives(permutation.Values, x, y, value, derivativeX, derivativeY, count);
+	}
+
+	void PerlinNoise2DDerivativesBatch(const NoisePermutation& permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count)
+	{
+		GetSimdKernels().PerlinNoise2DDerivatives(permutation.Values, x, y, value, derivativeX, derivativeY, count);
+	}
+
+	void ValueNoise2DDerivativesBatch(const NoisePermutation& permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count)
+	{
+		GetSimdKernels().ValueNoise2DDerivatives(permutation.Values, x, y, value, derivativeX, derivativeY, count);
+	}
+
+	const NoisePermutation& GetNoisePermutation(uint32_t seed)
+	{
+		if (seed == DefaultNoiseSeed)
+			return DefaultNoisePermutation;
+
+		// tables never move or get freed, references stay valid after the lock is released
+		static std::mutex cacheMutex;
+		static std::unordered_map<uint32_t, std::unique_ptr<NoisePermutation>> cache;
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto& permutation = cache[seed];
+		if (!permutation)
+			permutation = std::make_unique<NoisePermutation>(MakeNoisePermutation(seed));
+		return *permutation;
+	}
+}
@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "NoisePermutation.h"
+
+namespace TerrainCore
+{
+	// noise value with its partial derivatives along x and y
+	struct NoiseDerivatives
+	{
+		float Value;
+		float DerivativeX;
+		float DerivativeY;
+	};
+
+	// 2D simplex noise, returns a value in the -1 1 range. without a permutation the default seed is used
+	float SimplexNoise2D(float x, float y);
+	float SimplexNoise2D(const NoisePermutation& permutation, float x, float y);
+
+	// 2D perlin noise, same gradient set and smoothing curve as FMath::PerlinNoise2D
+	float PerlinNoise2D(float x, float y);
+	float PerlinNoise2D(const NoisePermutation& permutation, float x, float y);
+
+	// 2D value noise, random values on the integer lattice blended with the perlin smooth curve, in the -1 1 range
+	float ValueNoise2D(const NoisePermutation& permutation, float x, float y);
+
+	// Same noise values together with their analytic derivatives, computed in the same pass without extra noise
+	// evaluations
+	NoiseDerivatives SimplexNoise2DDerivatives(const NoisePermutation& permutation, float x, float y);
+	NoiseDerivatives PerlinNoise2DDerivatives(const NoisePermutation& permutation, float x, float y);
+	NoiseDerivatives ValueNoise2DDerivatives(const NoisePermutation& permutation, float x, float y);
+
+	// batched versions, evaluate count points with the fastest instruction set of the cpu and return the same values
+	void SimplexNoise2DBatch(const NoisePermutation& permutation, const float* x, const float* y, float* result, int count);
+	void PerlinNoise2DBatch(const NoisePermutation& permutation, const float* x, const float* y, float* result, int count);
+	void ValueNoise2DBatch(const NoisePermutation& permutation, const float* x, const float* y, float* result, int count);
+	void SimplexNoise2DDerivativesBatch(const NoisePermutation& permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count);
+	void PerlinNoise2DDerivativesBatch(const NoisePermutation& permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count);
+	void ValueNoise2DDerivativesBatch(const NoisePermutation& permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count);
+}
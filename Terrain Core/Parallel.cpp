@@ -0,0 +1,168 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TerrainCore
+{
+	namespace
+	{
+		// set on the pool threads so nested loops run inline
+		thread_local bool IsPoolWorker = false;
+
+		struct ParallelJob
+		{
+			const std::function<void(int)>* RunBlock;
+			int BlockCount;
+			int MaxHelpers;
+			int Helpers{ 0 };
+			std::atomic<int> NextBlock{ 0 };
+		};
+
+		void RunJobBlocks(ParallelJob& job)
+		{
+			for (int block = job.NextBlock++; block < job.BlockCount; block = job.NextBlock++)
+				(*job.RunBlock)(block);
+		}
+
+		// Persistent worker threads, the calling thread always helps with its own job
+		class WorkerPool
+		{
+		public:
+			WorkerPool()
+			{
+				int workerCount = GetHardwareThreadCount() - 1;
+				for (int i = 0; i < workerCount; ++i)
+					m_Workers.emplace_back([this]() { WorkerLoop(); });
+			}
+
+			~WorkerPool()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					m_Quit = true;
+				}
+				m_WakeUp.notify_all();
+				for (auto& worker : m_Workers)
+					worker.join();
+			}
+
+			int GetWorkerCount() const { return static_cast<int>(m_Workers.size()); }
+
+			// returns false if another thread is using the pool, the caller then runs the job on its own
+			bool Run(ParallelJob& job)
+			{
+				std::unique_lock<std::mutex> submitLock(m_SubmitMutex, std::try_to_lock);
+				if (!submitLock.owns_lock())
+					return false;
+
+				{
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					m_Job = &job;
+					++m_Generation;
+				}
+				m_WakeUp.notify_all();
+
+				RunJobBlocks(job);
+
+				// waits for the helpers before the job goes out of scope
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_Done.wait(lock, [this]() { return m_ActiveHelpers == 0; });
+				m_Job = nullptr;
+				return true;
+			}
+
+		private:
+			void WorkerLoop()
+			{
+				IsPoolWorker = true;
+				uint64_t seenGeneration = 0;
+
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				while (true)
+				{
+					m_WakeUp.wait(lock, [&]() { return m_Quit || (m_Job && m_Generation != seenGeneration); });
+					if (m_Quit)
+						return;
+
+					seenGeneration = m_Generation;
+					ParallelJob* job = m_Job;
+					if (job->Helpers >= job->MaxHelpers)
+						continue;
+					++job->Helpers;
+					++m_ActiveHelpers;
+
+					lock.unlock();
+					RunJobBlocks(*job);
+					lock.lock();
+
+					if (--m_ActiveHelpers == 0)
+						m_Done.notify_all();
+				}
+			}
+
+			std::vector<std::thread> m_Workers;
+			std::mutex m_SubmitMutex;
+			std::mutex m_Mutex;
+			std::condition_variable m_WakeUp;
+			std::condition_variable m_Done;
+			ParallelJob* m_Job{ nullptr };
+			uint64_t m_Generation{ 0 };
+			int m_ActiveHelpers{ 0 };
+			bool m_Quit{ false };
+		};
+
+		WorkerPool& GetWorkerPool()
+		{
+			static WorkerPool pool;
+			return pool;
+		}
+	}
+
+	int GetHardwareThreadCount()
+	{
+		static const int threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		return threadCount;
+	}
+
+	void ParallelFor(int begin, int end, int grainSize, int threadCount, const std::function<void(int, int)>& body)
+	{
+		if (end <= begin)
+			return;
+
+		grainSize = std::max(grainSize, 1);
+		int blockCount = (end - begin + grainSize - 1) / grainSize;
+		if (threadCount <= 0)
+			threadCount = GetHardwareThreadCount();
+
+		auto runBlock = [&](int block)
+		{
+			int blockBegin = begin + block * grainSize;
+			body(blockBegin, std::min(blockBegin + grainSize, end));
+		};
+
+		// small loops and nested loops run on the calling thread
+		if (threadCount == 1 || blockCount == 1 || IsPoolWorker || GetWorkerPool().GetWorkerCount() == 0)
+		{
+			for (int block = 0; block < blockCount; ++block)
+				runBlock(block);
+			return;
+		}
+
+		std::function<void(int)> runBlockFunction = runBlock;
+		ParallelJob job;
+		job.RunBlock = &runBlockFunction;
+		job.BlockCount = blockCount;
+		job.MaxHelpers = std::min(threadCount, blockCount) - 1;
+		if (!GetWorkerPool().Run(job))
+			RunJobBlocks(job);
+	}
+}
@@ -0,0 +1,16 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <functional>
+
+namespace TerrainCore
+{
+	// amount of threads used when a thread count of 0 is requested
+	int GetHardwareThreadCount();
+
+	// Splits [begin, end) into blocks of grainSize items and runs body(blockBegin, blockEnd) for every block on a shared
+	// pool of worker threads. threadCount 0 uses every core, 1 runs everything on the calling thread. Calls made from
+	// within a worker run on that worker, so nested loops can't deadlock the pool.
+	void ParallelFor(int begin, int end, int grainSize, int threadCount, const std::function<void(int, int)>& body);
+}
@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstdint>
+
+namespace TerrainCore
+{
+	// Small seedable random generator (PCG32), produces the same sequence on every platform and also works at compile time
+	class RandomStream
+	{
+	public:
+		constexpr explicit RandomStream(uint64_t seed = 0)
+		{
+			Seed(seed);
+		}
+
+		constexpr void Seed(uint64_t seed)
+		{
+			m_State = 0u;
+			Next();
+			m_State += seed;
+			Next();
+		}
+
+		constexpr uint32_t Next()
+		{
+			uint64_t oldState = m_State;
+			m_State = oldState * 6364136223846793005ULL + 1442695040888963407ULL;
+			uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+			uint32_t rotation = static_cast<uint32_t>(oldState >> 59u);
+			return (xorShifted >> rotation) | (xorShifted << ((32u - rotation) & 31u));
+		}
+
+		// returns a float in [0, 1)
+		constexpr float FRand()
+		{
+			return (Next() >> 8) * (1.f / 16777216.f);
+		}
+
+		// returns a float in [min, max)
+		constexpr float FRandRange(float min, float max)
+		{
+			return min + (max - min) * FRand();
+		}
+
+	private:
+		uint64_t m_State{ 0 };
+	};
+}
@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShallowWaterErosionKernel.h"
+#include "HeightQuantization.h"
+#include "HydraulicErosionKernel.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace TerrainCore
+{
+	namespace
+	{
+		// rows every task of a pass handles
+		constexpr int ShallowWaterRowsPerTask = 16;
+		// largest time step times the square root of the gravity that keeps the water from oscillating
+		constexpr float ShallowWaterMaxPipeScale = .5f;
+	}
+
+	void ShallowWaterErosion::ErodeTerrain(HeightfieldView map, const HydraulicErosionSettings& settings, DirtyTileMask& dirtyTiles, TaskControl* control)
+	{
+		Begin(map);
+		if (m_Width < 2 || m_Height < 2)
+			return;
+
+		for (int pass = 0; pass < settings.IterateAmount && !IsCancelled(control); ++pass)
+		{
+			RunPass(settings);
+			AddProgress(control, 1);
+		}
+		WriteTerrain(map, dirtyTiles);
+	}
+
+	void ShallowWaterErosion::ErodeTerrain(QuantizedHeightfieldView map, const HydraulicErosionSettings& settings, DirtyTileMask& dirtyTiles, TaskControl* control)
+	{
+		Begin(map);
+		if (m_Width < 2 || m_Height < 2)
+			return;
+
+		for (int pass = 0; pass < settings.IterateAmount && !IsCancelled(control); ++pass)
+		{
+			RunPass(settings);
+			AddProgress(control, 1);
+		}
+		WriteTerrain(map, dirtyTiles);
+	}
+
+	void ShallowWaterErosion::Begin(ConstHeightfieldView map)
+	{
+		m_Width = map.Width;
+		m_Height = map.Height;
+		if (m_Width < 2 || m_Height < 2)
+			return;
+
+		// every run starts on a dry map without sediment
+		for (auto* grid : { &m_Terrain[0], &m_Terrain[1], &m_Sediment[0], &m_Sediment[1], &m_Water, &m_OutflowLeft, &m_OutflowRight, &m_OutflowUp, &m_OutflowDown, &m_VelocityX, &m_VelocityY })
+			grid->Resize(m_Width, m_Height, 1, 0.f);
+		m_Terrain[0].CopyFrom(map);
+		m_Terrain[0].FillApron(HeightfieldBorder::Clamp);
+
+		// the water around the map stands higher than any surface, so no pipe ever carries water off the map
+		m_Water.FillApron(std::numeric_limits<float>::max());
+	}
+
+	void ShallowWaterErosion::Begin(ConstQuantizedHeightfieldView map)
+	{
+		// the float copy also holds the heights the written terrain gets compared with
+		m_DequantizedMap.Resize(map.Width, map.Height);
+		DequantizeHeightfield(map, m_DequantizedMap.GetView());
+		Begin(m_DequantizedMap.GetView());
+	}
+
+	void ShallowWaterErosion::WriteTerrain(HeightfieldView map, DirtyTileMask& dirtyTiles) const
+	{
+		// the sediment still carried by the water settles in its cell, so no material gets lost
+		for (int y = 0; y < m_Height; ++y)
+		{
+			const float* terrain = m_Terrain[0].GetView().Row(y);
+			const float* sediment = m_Sediment[0].GetView().Row(y);
+			float* row = map.Row(y);
+			for (int x = 0; x < m_Width; ++x)
+			{
+				float height = terrain[x] + sediment[x];
+				if (height != row[x])
+					dirtyTiles.MarkCell(x, y);
+				row[x] = height;
+			}
+		}
+	}
+
+	void ShallowWaterErosion::WriteTerrain(QuantizedHeightfieldView map, DirtyTileMask& dirtyTiles)
+	{
+		if (m_Width < 2 || m_Height < 2)
+			return;
+
+		WriteTerrain(m_DequantizedMap.GetView(), dirtyTiles);
+		QuantizeHeightfield(m_DequantizedMap.GetView(), map);
+	}
+
+	void ShallowWaterErosion::RunPass(const HydraulicErosionSettings& settings)
+	{
+		// the water starts to swing between neighbors once the pipes move more than the surface difference in a step
+		float timeStep = std::min(settings.TimeStep, ShallowWaterMaxPipeScale / std::sqrt(std::max(settings.Gravity, 1e-6f)));
+
+		// rates per pass, the deposition can't settle more than the water carries
+		ShallowWaterStepSettings stepSettings;
+		stepSettings.TimeStep = timeStep;
+		stepSettings.PipeScale = timeStep * settings.Gravity;
+		stepSettings.Rain = settings.Rain * timeStep;
+		stepSettings.Capacity = settings.Capacity;
+		stepSettings.ErosionRate = settings.Erosion * timeStep;
+		stepSettings.DepositionRate = std::min(settings.Deposition * timeStep, 1.f);
+		stepSettings.MinSlope = settings.MinSlope;
+		stepSettings.Evaporation = std::max(1.f - settings.Evaporation * timeStep, 0.f);
+		stepSettings.MapWidth = m_Width;
+		stepSettings.MapHeight = m_Height;
+
+		const SimdKernelTable& kernels = GetSimdKernels();
+		RunRows(kernels.ShallowWaterOutflow, stepSettings, settings.ThreadCount);
+		RunRows(kernels.ShallowWaterFlow, stepSettings, settings.ThreadCount);
+		RunRows(kernels.ShallowWaterErosion, stepSettings, settings.ThreadCount);
+		std::swap(m_Terrain[0], m_Terrain[1]);
+		m_Terrain[0].FillApron(HeightfieldBorder::Clamp);
+		RunRows(kernels.ShallowWaterTransport, stepSettings, settings.ThreadCount);
+		std::swap(m_Sediment[0], m_Sediment[1]);
+	}
+
+	void ShallowWaterErosion::RunRows(ShallowWaterRowFunction kernel, const ShallowWaterStepSettings& stepSettings, int threadCount)
+	{
+		ShallowWaterGrids grids = GetGrids();
+		ParallelFor(0, m_Height, ShallowWaterRowsPerTask, threadCount, [&](int rowBegin, int rowEnd)
+		{
+			for (int y = rowBegin; y < rowEnd; ++y)
+				kernel(grids, stepSettings, 0, y, m_Width);
+		});
+	}
+
+	ShallowWaterGrids ShallowWaterErosion::GetGrids()
+	{
+		ShallowWaterGrids grids;
+		grids.Terrain = m_Terrain[0].GetPaddedView().Data;
+		grids.TerrainResult = m_Terrain[1].GetPaddedView().Data;
+		grids.Water = m_Water.GetPaddedView().Data;
+		grids.Sediment = m_Sediment[0].GetPaddedView().Data;
+		grids.SedimentResult = m_Sediment[1].GetPaddedView().Data;
+		grids.OutflowLeft = m_OutflowLeft.GetPaddedView().Data;
+		grids.OutflowRight = m_OutflowRight.GetPaddedView().Data;
+		grids.OutflowUp = m_OutflowUp.GetPaddedView().Data;
+		grids.OutflowDown = m_OutflowDown.GetPaddedView().Data;
+		grids.VelocityX = m_VelocityX.GetPaddedView().Data;
+		grids.VelocityY = m_VelocityY.GetPaddedView().Data;
+		grids.Stride = m_Terrain[0].GetStride();
+		return grids;
+	}
+}
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "DirtyTiles.h"
+#include "Heightfield.h"
+#include "SimdKernels.h"
+#include "TaskControl.h"
+
+namespace TerrainCore
+{
+	struct HydraulicErosionSettings;
+
+	// Grid based hydraulic erosion with the virtual pipe model. Water, suspended sediment and the outflow through the
+	// pipes to the 4 neighbors are kept per cell next to the terrain, every pass runs the same fixed stencils over all
+	// cells: rain and outflow, water and velocity, erosion and deposition, sediment transport and evaporation.
+	// Every pass splits its rows over the cores and no cell reads what its neighbors write in the same pass, so the
+	// result doesn't depend on the thread count.
+	class ShallowWaterErosion
+	{
+	public:
+		// Runs the iterate amount of passes on a dry map, the sediment still suspended at the end settles where it is.
+		// Marks the tiles of the cells whose height changed, progress is counted in passes
+		void ErodeTerrain(HeightfieldView map, const HydraulicErosionSettings& settings, DirtyTileMask& dirtyTiles, TaskControl* control = nullptr);
+		// runs on a float copy of the map that gets rounded back once at the end
+		void ErodeTerrain(QuantizedHeightfieldView map, const HydraulicErosionSettings& settings, DirtyTileMask& dirtyTiles, TaskControl* control = nullptr);
+
+		// Steps of ErodeTerrain for runs spread over several calls: Begin starts on a dry copy of the map, every pass
+		// advances the grids and WriteTerrain can show the state in between
+		void Begin(ConstHeightfieldView map);
+		void Begin(ConstQuantizedHeightfieldView map);
+		void RunPass(const HydraulicErosionSettings& settings);
+		// writes the terrain with the suspended sediment settled to the map, marks the tiles of the cells that changed
+		void WriteTerrain(HeightfieldView map, DirtyTileMask& dirtyTiles) const;
+		void WriteTerrain(QuantizedHeightfieldView map, DirtyTileMask& dirtyTiles);
+
+	private:
+		// Runs a row kernel over every row of the map, split over the cores
+		void RunRows(ShallowWaterRowFunction kernel, const ShallowWaterStepSettings& stepSettings, int threadCount);
+		ShallowWaterGrids GetGrids();
+
+		int m_Width{ 0 };
+		int m_Height{ 0 };
+		// Grids padded with one cell on every side that share the stride, sediment and outflow stay 0 outside of the
+		// map. The terrain apron repeats the edge heights, so the slope at the edge only looks along it. The stencils
+		// reading the neighbors of the terrain or the sediment write into the second buffer
+		PaddedHeightfield m_Terrain[2];
+		PaddedHeightfield m_Sediment[2];
+		PaddedHeightfield m_Water;
+		PaddedHeightfield m_OutflowLeft;
+		PaddedHeightfield m_OutflowRight;
+		PaddedHeightfield m_OutflowUp;
+		PaddedHeightfield m_OutflowDown;
+		PaddedHeightfield m_VelocityX;
+		PaddedHeightfield m_VelocityY;
+
+		// float copy of a quantized map
+		Heightfield m_DequantizedMap;
+	};
+}
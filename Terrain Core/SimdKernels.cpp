@@ -0,0 +1,22 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SimdKernels.h"
+
+namespace TerrainCore
+{
+	const SimdKernelTable& GetSimdKernels()
+	{
+		// kernels ordered from fastest to slowest, missing instruction sets are nullptr
+		static const SimdKernelTable* const kernelTables[] = { GetAVX512Kernels(), GetAVX2Kernels(), GetSSE42Kernels() };
+
+		int cpuLevel = static_cast<int>(GetCpuSimdLevel());
+		int levelLimit = static_cast<int>(GetSimdLevelLimit());
+		for (const SimdKernelTable* table : kernelTables)
+		{
+			if (table && static_cast<int>(table->Level) <= cpuLevel && static_cast<int>(table->Level) <= levelLimit)
+				return *table;
+		}
+		return *GetScalarKernels();
+	}
+}
@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CpuFeatures.h"
+
+#include <cstdint>
+
+namespace TerrainCore
+{
+	// evaluates noise for count points, permutation has to hold 512 entries
+	using NoiseBatchFunction = void (*)(const int32_t* permutation, const float* x, const float* y, float* result, int count);
+	// same noise values together with their partial derivatives along x and y
+	using NoiseDerivativeBatchFunction = void (*)(const int32_t* permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count);
+
+	// Thermal erosion row passes. Rows are padded so every cell has 4 neighbors at -1, +1, -stride and +stride, the
+	// first pass stores how much material every cell loses and in which direction, the second adds up what every cell
+	// keeps and receives from its neighbors
+	using ThermalOutflowFunction = void (*)(const float* heights, int stride, float maxAngle, float* outflow, int32_t* direction, int count);
+	using ThermalApplyFunction = void (*)(const float* heights, const float* outflow, const int32_t* direction, int stride, float* result, int count);
+
+	// what a raindrop does to the map after a lockstep step
+	enum DropletAction : int32_t
+	{
+		// the drop stopped or left the map and changes nothing
+		DropletRetired = 0,
+		// Amount gets spread over the 4 corners of the cell
+		DropletDeposit = 1,
+		// Amount gets taken from the cells of the erosion brush around the cell
+		DropletErode = 2,
+	};
+
+	// Raindrops of the lockstep hydraulic erosion in structure of arrays layout, every array holds one entry per drop.
+	// The step reads the state arrays and writes back the moved drops together with the change to the map.
+	struct DropletArrays
+	{
+		float* LocationX;
+		float* LocationY;
+		float* DirectionX;
+		float* DirectionY;
+		float* Velocity;
+		float* Water;
+		float* Sediment;
+		// cell the drop was in at the start of the step and its offset within it
+		int32_t* CellX;
+		int32_t* CellY;
+		float* OffsetX;
+		float* OffsetY;
+		int32_t* Action;
+		float* Amount;
+	};
+
+	// variables of the hydraulic erosion a droplet step needs
+	struct DropletStepSettings
+	{
+		float Inertia;
+		float Capacity;
+		float Deposition;
+		float Erosion;
+		float Evaporation;
+		float Gravity;
+		float MinSlope;
+		int MapWidth;
+		int MapHeight;
+		int MapStride;
+	};
+
+	// Moves count drops one step along the gradient of a float map without writing to it, the same math as a step of
+	// the scalar drop. Deposited sediment already leaves the drop, eroded sediment gets added while the caller applies
+	// the brush.
+	using DropletStepFunction = void (*)(const float* heights, const DropletStepSettings& settings, const DropletArrays& drops, int count);
+
+	// Grids of the shallow water erosion, padded with one cell on every side so every cell has 4 neighbors at -1, +1,
+	// -stride and +stride. The passes read the neighbors of a grid only when they write another one
+	struct ShallowWaterGrids
+	{
+		float* Terrain;
+		float* TerrainResult;
+		float* Water;
+		float* Sediment;
+		float* SedimentResult;
+		// outflow through the pipes to the left, right, upper and lower neighbor
+		float* OutflowLeft;
+		float* OutflowRight;
+		float* OutflowUp;
+		float* OutflowDown;
+		float* VelocityX;
+		float* VelocityY;
+		int Stride;
+	};
+
+	// variables of the hydraulic erosion a shallow water pass needs, rates are already scaled by the time step
+	struct ShallowWaterStepSettings
+	{
+		float TimeStep;
+		float PipeScale;
+		float Rain;
+		float Capacity;
+		float ErosionRate;
+		float DepositionRate;
+		float MinSlope;
+		float Evaporation;
+		int MapWidth;
+		int MapHeight;
+	};
+
+	// Shallow water row passes over count cells starting at map cell (x, y): outflow through the pipes, water and
+	// velocity, erosion and deposition into TerrainResult, sediment transport into SedimentResult with evaporation
+	using ShallowWaterRowFunction = void (*)(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int x, int y, int count);
+
+	// maps heights from 0 1 to the full uint16 range, rounded to the nearest step. Heights outside 0 1 are clamped
+	using QuantizeHeightsFunction = void (*)(const float* heights, uint16_t* result, int count);
+
+	// directions stored by the thermal outflow pass, in the order the neighbors are checked
+	enum ThermalDirection : int32_t
+	{
+		ThermalSouth = 0,
+		ThermalWest = 1,
+		ThermalEast = 2,
+		ThermalNorth = 3,
+		ThermalNone = 4,
+	};
+
+	// batched kernels compiled for one instruction set
+	struct SimdKernelTable
+	{
+		SimdLevel Level;
+		// amount of points evaluated per instruction
+		int Width;
+		NoiseBatchFunction SimplexNoise2D;
+		NoiseBatchFunction PerlinNoise2D;
+		NoiseBatchFunction ValueNoise2D;
+		NoiseDerivativeBatchFunction SimplexNoise2DDerivatives;
+		NoiseDerivativeBatchFunction PerlinNoise2DDerivatives;
+		NoiseDerivativeBatchFunction ValueNoise2DDerivatives;
+		ThermalOutflowFunction ThermalOutflow;
+		ThermalApplyFunction ThermalApply;
+		DropletStepFunction DropletStep;
+		ShallowWaterRowFunction ShallowWaterOutflow;
+		ShallowWaterRowFunction ShallowWaterFlow;
+		ShallowWaterRowFunction ShallowWaterErosion;
+		ShallowWaterRowFunction ShallowWaterTransport;
+		QuantizeHeightsFunction QuantizeHeights;
+	};
+
+	// kernels of every instruction set, returns nullptr when the file was not compiled with that instruction set enabled
+	const SimdKernelTable* GetScalarKernels();
+	const SimdKernelTable* GetSSE42Kernels();
+	const SimdKernelTable* GetAVX2Kernels();
+	const SimdKernelTable* GetAVX512Kernels();
+
+	// fastest kernels supported by the cpu within the simd level limit
+	const SimdKernelTable& GetSimdKernels();
+}
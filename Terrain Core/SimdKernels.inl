@@ -0,0 +1,814 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Batched kernels written against the lane wrappers of SimdLanes.h, every SimdKernels*.cpp file instantiates them for
+// its own instruction set. The math mirrors the scalar functions operation by operation so every lane width returns
+// the same values.
+
+#include "SimdKernels.h"
+
+#include <cmath>
+#include <cstdint>
+
+namespace TerrainCore
+{
+	namespace
+	{
+		// simplex constants, computed the same way as the scalar noise
+		const float KernelSimplexF2 = 0.5f * (LaneSqrt(3.f) - 1.f);
+		const float KernelSimplexG2 = (3.f - LaneSqrt(3.f)) / 6.f;
+
+		template<typename L>
+		typename L::Float SimplexGradLanes(typename L::Int hash, typename L::Float x, typename L::Float y)
+		{
+			auto h = L::AndInt(hash, L::SetInt(15));
+			auto lowHash = L::EqualInt(L::AndInt(h, L::SetInt(8)), L::SetInt(0));
+			auto u = L::Select(lowHash, x, y);
+			auto v = L::Select(lowHash, y, x);
+
+			// bit 0 flips the sign of u, bit 1 flips the sign of 2v
+			u = L::Xor(u, L::template ShiftLeft<31>(h));
+			v = L::Xor(L::Mul(L::Set(2.f), v), L::template ShiftLeft<30>(L::AndInt(h, L::SetInt(2))));
+			return L::Add(u, v);
+		}
+
+		// simplex contribution of one corner, falls off to 0 without branching
+		template<typename L>
+		typename L::Float SimplexCornerLanes(typename L::Int hash, typename L::Float x, typename L::Float y)
+		{
+			auto t = L::Sub(L::Sub(L::Set(0.5f), L::Mul(x, x)), L::Mul(y, y));
+			t = L::Max(t, L::Set(0.f));
+			t = L::Mul(t, t);
+			return L::Mul(L::Mul(t, t), SimplexGradLanes<L>(hash, x, y));
+		}
+
+		template<typename L>
+		typename L::Float SimplexNoiseLanes(const int32_t* permutation, typename L::Float x, typename L::Float y)
+		{
+			auto skewFactor = L::Mul(L::Add(x, y), L::Set(KernelSimplexF2));
+			auto i = L::ToInt(L::Floor(L::Add(x, skewFactor)));
+			auto j = L::ToInt(L::Floor(L::Add(y, skewFactor)));
+
+			auto unskewFactor = L::Mul(L::ToFloat(L::AddInt(i, j)), L::Set(KernelSimplexG2));
+			auto x0 = L::Sub(x, L::Sub(L::ToFloat(i), unskewFactor));
+			auto y0 = L::Sub(y, L::Sub(L::ToFloat(j), unskewFactor));
+
+			// middle corner of the simplex
+			auto lowerTriangle = L::Greater(x0, y0);
+			auto i1 = L::SelectInt(lowerTriangle, L::SetInt(1), L::SetInt(0));
+			auto j1 = L::SelectInt(lowerTriangle, L::SetInt(0), L::SetInt(1));
+
+			auto x1 = L::Add(L::Sub(x0, L::ToFloat(i1)), L::Set(KernelSimplexG2));
+			auto y1 = L::Add(L::Sub(y0, L::ToFloat(j1)), L::Set(KernelSimplexG2));
+			auto x2 = L::Add(L::Sub(x0, L::Set(1.f)), L::Set(2.f * KernelSimplexG2));
+			auto y2 = L::Add(L::Sub(y0, L::Set(1.f)), L::Set(2.f * KernelSimplexG2));
+
+			auto ii = L::AndInt(i, L::SetInt(255));
+			auto jj = L::AndInt(j, L::SetInt(255));
+			auto one = L::SetInt(1);
+
+			auto gi0 = L::Gather(permutation, L::AddInt(ii, L::Gather(permutation, jj)));
+			auto gi1 = L::Gather(permutation, L::AddInt(L::AddInt(ii, i1), L::Gather(permutation, L::AddInt(jj, j1))));
+			auto gi2 = L::Gather(permutation, L::AddInt(L::AddInt(ii, one), L::Gather(permutation, L::AddInt(jj, one))));
+
+			auto n0 = SimplexCornerLanes<L>(gi0, x0, y0);
+			auto n1 = SimplexCornerLanes<L>(gi1, x1, y1);
+			auto n2 = SimplexCornerLanes<L>(gi2, x2, y2);
+			return L::Mul(L::Set(24.f), L::Add(L::Add(n0, n1), n2));
+		}
+
+		// corners and major axes, hashes 4 to 7 are the negated versions of 0 to 3
+		template<typename L>
+		typename L::Float PerlinGradLanes(typename L::Int hash, typename L::Float x, typename L::Float y)
+		{
+			auto h = L::AndInt(hash, L::SetInt(7));
+			auto axis = L::AndInt(h, L::SetInt(3));
+			auto gradient = L::Select(L::EqualInt(axis, L::SetInt(2)), y, L::Sub(y, x));
+			gradient = L::Select(L::EqualInt(axis, L::SetInt(1)), L::Add(x, y), gradient);
+			gradient = L::Select(L::EqualInt(axis, L::SetInt(0)), x, gradient);
+			return L::Xor(gradient, L::template ShiftLeft<29>(L::AndInt(h, L::SetInt(4))));
+		}
+
+		template<typename L>
+		typename L::Float PerlinSmoothCurveLanes(typename L::Float x)
+		{
+			auto polynomial = L::Add(L::Mul(x, L::Sub(L::Mul(x, L::Set(6.f)), L::Set(15.f))), L::Set(10.f));
+			return L::Mul(L::Mul(L::Mul(x, x), x), polynomial);
+		}
+
+		template<typename L>
+		typename L::Float PerlinLerpLanes(typename L::Float a, typename L::Float b, typename L::Float alpha)
+		{
+			return L::Add(a, L::Mul(alpha, L::Sub(b, a)));
+		}
+
+		template<typename L>
+		typename L::Float PerlinNoiseLanes(const int32_t* permutation, typename L::Float x, typename L::Float y)
+		{
+			auto xFloor = L::Floor(x);
+			auto yFloor = L::Floor(y);
+			auto xi = L::AndInt(L::ToInt(xFloor), L::SetInt(255));
+			auto yi = L::AndInt(L::ToInt(yFloor), L::SetInt(255));
+
+			// offset within the cell and towards the next corner
+			auto xOffset = L::Sub(x, xFloor);
+			auto yOffset = L::Sub(y, yFloor);
+			auto xm1 = L::Sub(xOffset, L::Set(1.f));
+			auto ym1 = L::Sub(yOffset, L::Set(1.f));
+
+			auto one = L::SetInt(1);
+			auto aa = L::AddInt(L::Gather(permutation, xi), yi);
+			auto ab = L::AddInt(aa, one);
+			auto ba = L::AddInt(L::Gather(permutation, L::AddInt(xi, one)), yi);
+			auto bb = L::AddInt(ba, one);
+
+			auto u = PerlinSmoothCurveLanes<L>(xOffset);
+			auto v = PerlinSmoothCurveLanes<L>(yOffset);
+
+			auto bottom = PerlinLerpLanes<L>(PerlinGradLanes<L>(L::Gather(permutation, aa), xOffset, yOffset), PerlinGradLanes<L>(L::Gather(permutation, ba), xm1, yOffset), u);
+			auto top = PerlinLerpLanes<L>(PerlinGradLanes<L>(L::Gather(permutation, ab), xOffset, ym1), PerlinGradLanes<L>(L::Gather(permutation, bb), xm1, ym1), u);
+			return PerlinLerpLanes<L>(bottom, top, v);
+		}
+
+		// noise value and its partial derivatives along x and y
+		template<typename L>
+		struct NoiseDerivativeLanes
+		{
+			typename L::Float Value;
+			typename L::Float DerivativeX;
+			typename L::Float DerivativeY;
+		};
+
+		// Simplex corner with its derivatives. The gradient function is linear, so its derivatives are the gradient
+		// evaluated at (1, 0) and (0, 1). The value is computed with the same operations as SimplexCornerLanes.
+		template<typename L>
+		void SimplexCornerDerivativeLanes(typename L::Int hash, typename L::Float x, typename L::Float y, NoiseDerivativeLanes<L>& sum)
+		{
+			auto t = L::Sub(L::Sub(L::Set(0.5f), L::Mul(x, x)), L::Mul(y, y));
+			t = L::Max(t, L::Set(0.f));
+			auto t2 = L::Mul(t, t);
+			auto t4 = L::Mul(t2, t2);
+			auto gradient = SimplexGradLanes<L>(hash, x, y);
+			auto gradientX = SimplexGradLanes<L>(hash, L::Set(1.f), L::Set(0.f));
+			auto gradientY = SimplexGradLanes<L>(hash, L::Set(0.f), L::Set(1.f));
+
+			// d(t^4 g) = t^4 dg - 8 t^3 g (x, y)
+			auto falloff = L::Mul(L::Mul(L::Set(8.f), L::Mul(t2, t)), gradient);
+			sum.Value = L::Add(sum.Value, L::Mul(t4, gradient));
+			sum.DerivativeX = L::Add(sum.DerivativeX, L::Sub(L::Mul(t4, gradientX), L::Mul(falloff, x)));
+			sum.DerivativeY = L::Add(sum.DerivativeY, L::Sub(L::Mul(t4, gradientY), L::Mul(falloff, y)));
+		}
+
+		template<typename L>
+		NoiseDerivativeLanes<L> SimplexNoiseDerivativeLanes(const int32_t* permutation, typename L::Float x, typename L::Float y)
+		{
+			auto skewFactor = L::Mul(L::Add(x, y), L::Set(KernelSimplexF2));
+			auto i = L::ToInt(L::Floor(L::Add(x, skewFactor)));
+			auto j = L::ToInt(L::Floor(L::Add(y, skewFactor)));
+
+			auto unskewFactor = L::Mul(L::ToFloat(L::AddInt(i, j)), L::Set(KernelSimplexG2));
+			auto x0 = L::Sub(x, L::Sub(L::ToFloat(i), unskewFactor));
+			auto y0 = L::Sub(y, L::Sub(L::ToFloat(j), unskewFactor));
+
+			auto lowerTriangle = L::Greater(x0, y0);
+			auto i1 = L::SelectInt(lowerTriangle, L::SetInt(1), L::SetInt(0));
+			auto j1 = L::SelectInt(lowerTriangle, L::SetInt(0), L::SetInt(1));
+
+			auto x1 = L::Add(L::Sub(x0, L::ToFloat(i1)), L::Set(KernelSimplexG2));
+			auto y1 = L::Add(L::Sub(y0, L::ToFloat(j1)), L::Set(KernelSimplexG2));
+			auto x2 = L::Add(L::Sub(x0, L::Set(1.f)), L::Set(2.f * KernelSimplexG2));
+			auto y2 = L::Add(L::Sub(y0, L::Set(1.f)), L::Set(2.f * KernelSimplexG2));
+
+			auto ii = L::AndInt(i, L::SetInt(255));
+			auto jj = L::AndInt(j, L::SetInt(255));
+			auto one = L::SetInt(1);
+
+			auto gi0 = L::Gather(permutation, L::AddInt(ii, L::Gather(permutation, jj)));
+			auto gi1 = L::Gather(permutation, L::AddInt(L::AddInt(ii, i1), L::Gather(permutation, L::AddInt(jj, j1))));
+			auto gi2 = L::Gather(permutation, L::AddInt(L::AddInt(ii, one), L::Gather(permutation, L::AddInt(jj, one))));
+
+			// the corner offsets move one to one with the input, so their derivatives are the input derivatives
+			NoiseDerivativeLanes<L> noise{ L::Set(0.f), L::Set(0.f), L::Set(0.f) };
+			SimplexCornerDerivativeLanes<L>(gi0, x0, y0, noise);
+			SimplexCornerDerivativeLanes<L>(gi1, x1, y1, noise);
+			SimplexCornerDerivativeLanes<L>(gi2, x2, y2, noise);
+			noise.Value = L::Mul(L::Set(24.f), noise.Value);
+			noise.DerivativeX = L::Mul(L::Set(24.f), noise.DerivativeX);
+			noise.DerivativeY = L::Mul(L::Set(24.f), noise.DerivativeY);
+			return noise;
+		}
+
+		// derivative of the smooth curve, 30 x^2 (x - 1)^2
+		template<typename L>
+		typename L::Float PerlinSmoothCurveDerivativeLanes(typename L::Float x)
+		{
+			auto polynomial = L::Add(L::Mul(x, L::Sub(L::Mul(x, L::Set(30.f)), L::Set(60.f))), L::Set(30.f));
+			return L::Mul(L::Mul(x, x), polynomial);
+		}
+
+		template<typename L>
+		NoiseDerivativeLanes<L> PerlinNoiseDerivativeLanes(const int32_t* permutation, typename L::Float x, typename L::Float y)
+		{
+			auto xFloor = L::Floor(x);
+			auto yFloor = L::Floor(y);
+			auto xi = L::AndInt(L::ToInt(xFloor), L::SetInt(255));
+			auto yi = L::AndInt(L::ToInt(yFloor), L::SetInt(255));
+
+			auto xOffset = L::Sub(x, xFloor);
+			auto yOffset = L::Sub(y, yFloor);
+			auto xm1 = L::Sub(xOffset, L::Set(1.f));
+			auto ym1 = L::Sub(yOffset, L::Set(1.f));
+
+			auto one = L::SetInt(1);
+			auto aa = L::AddInt(L::Gather(permutation, xi), yi);
+			auto ab = L::AddInt(aa, one);
+			auto ba = L::AddInt(L::Gather(permutation, L::AddInt(xi, one)), yi);
+			auto bb = L::AddInt(ba, one);
+
+			auto u = PerlinSmoothCurveLanes<L>(xOffset);
+			auto v = PerlinSmoothCurveLanes<L>(yOffset);
+			auto du = PerlinSmoothCurveDerivativeLanes<L>(xOffset);
+			auto dv = PerlinSmoothCurveDerivativeLanes<L>(yOffset);
+
+			// corner gradients are linear, their derivatives are the gradients at (1, 0) and (0, 1)
+			auto hashAA = L::Gather(permutation, aa);
+			auto hashBA = L::Gather(permutation, ba);
+			auto hashAB = L::Gather(permutation, ab);
+			auto hashBB = L::Gather(permutation, bb);
+			auto unitX = L::Set(1.f);
+			auto unitY = L::Set(0.f);
+
+			auto cornerAA = PerlinGradLanes<L>(hashAA, xOffset, yOffset);
+			auto cornerBA = PerlinGradLanes<L>(hashBA, xm1, yOffset);
+			auto cornerAB = PerlinGradLanes<L>(hashAB, xOffset, ym1);
+			auto cornerBB = PerlinGradLanes<L>(hashBB, xm1, ym1);
+			auto bottom = PerlinLerpLanes<L>(cornerAA, cornerBA, u);
+			auto top = PerlinLerpLanes<L>(cornerAB, cornerBB, u);
+
+			auto bottomX = L::Add(PerlinLerpLanes<L>(PerlinGradLanes<L>(hashAA, unitX, unitY), PerlinGradLanes<L>(hashBA, unitX, unitY), u), L::Mul(du, L::Sub(cornerBA, cornerAA)));
+			auto topX = L::Add(PerlinLerpLanes<L>(PerlinGradLanes<L>(hashAB, unitX, unitY), PerlinGradLanes<L>(hashBB, unitX, unitY), u), L::Mul(du, L::Sub(cornerBB, cornerAB)));
+			auto bottomY = PerlinLerpLanes<L>(PerlinGradLanes<L>(hashAA, unitY, unitX), PerlinGradLanes<L>(hashBA, unitY, unitX), u);
+			auto topY = PerlinLerpLanes<L>(PerlinGradLanes<L>(hashAB, unitY, unitX), PerlinGradLanes<L>(hashBB, unitY, unitX), u);
+
+			NoiseDerivativeLanes<L> noise;
+			noise.Value = PerlinLerpLanes<L>(bottom, top, v);
+			noise.DerivativeX = PerlinLerpLanes<L>(bottomX, topX, v);
+			noise.DerivativeY = L::Add(PerlinLerpLanes<L>(bottomY, topY, v), L::Mul(dv, L::Sub(top, bottom)));
+			return noise;
+		}
+
+		// lattice value of a hash in the -1 1 range
+		template<typename L>
+		typename L::Float ValueLatticeLanes(const int32_t* permutation, typename L::Int index)
+		{
+			return L::Sub(L::Mul(L::ToFloat(L::Gather(permutation, index)), L::Set(2.f / 255.f)), L::Set(1.f));
+		}
+
+		// value noise, random lattice values blended with the perlin smooth curve
+		template<typename L>
+		typename L::Float ValueNoiseLanes(const int32_t* permutation, typename L::Float x, typename L::Float y)
+		{
+			auto xFloor = L::Floor(x);
+			auto yFloor = L::Floor(y);
+			auto xi = L::AndInt(L::ToInt(xFloor), L::SetInt(255));
+			auto yi = L::AndInt(L::ToInt(yFloor), L::SetInt(255));
+
+			auto one = L::SetInt(1);
+			auto aa = L::AddInt(L::Gather(permutation, xi), yi);
+			auto ab = L::AddInt(aa, one);
+			auto ba = L::AddInt(L::Gather(permutation, L::AddInt(xi, one)), yi);
+			auto bb = L::AddInt(ba, one);
+
+			auto u = PerlinSmoothCurveLanes<L>(L::Sub(x, xFloor));
+			auto v = PerlinSmoothCurveLanes<L>(L::Sub(y, yFloor));
+
+			auto bottom = PerlinLerpLanes<L>(ValueLatticeLanes<L>(permutation, aa), ValueLatticeLanes<L>(permutation, ba), u);
+			auto top = PerlinLerpLanes<L>(ValueLatticeLanes<L>(permutation, ab), ValueLatticeLanes<L>(permutation, bb), u);
+			return PerlinLerpLanes<L>(bottom, top, v);
+		}
+
+		template<typename L>
+		NoiseDerivativeLanes<L> ValueNoiseDerivativeLanes(const int32_t* permutation, typename L::Float x, typename L::Float y)
+		{
+			auto xFloor = L::Floor(x);
+			auto yFloor = L::Floor(y);
+			auto xi = L::AndInt(L::ToInt(xFloor), L::SetInt(255));
+			auto yi = L::AndInt(L::ToInt(yFloor), L::SetInt(255));
+
+			auto one = L::SetInt(1);
+			auto aa = L::AddInt(L::Gather(permutation, xi), yi);
+			auto ab = L::AddInt(aa, one);
+			auto ba = L::AddInt(L::Gather(permutation, L::AddInt(xi, one)), yi);
+			auto bb = L::AddInt(ba, one);
+
+			auto xOffset = L::Sub(x, xFloor);
+			auto yOffset = L::Sub(y, yFloor);
+			auto u = PerlinSmoothCurveLanes<L>(xOffset);
+			auto v = PerlinSmoothCurveLanes<L>(yOffset);
+
+			auto cornerAA = ValueLatticeLanes<L>(permutation, aa);
+			auto cornerBA = ValueLatticeLanes<L>(permutation, ba);
+			auto cornerAB = ValueLatticeLanes<L>(permutation, ab);
+			auto cornerBB = ValueLatticeLanes<L>(permutation, bb);
+			auto bottom = PerlinLerpLanes<L>(cornerAA, cornerBA, u);
+			auto top = PerlinLerpLanes<L>(cornerAB, cornerBB, u);
+
+			// the lattice values are constant, only the blend weights change
+			NoiseDerivativeLanes<L> noise;
+			noise.Value = PerlinLerpLanes<L>(bottom, top, v);
+			noise.DerivativeX = L::Mul(PerlinSmoothCurveDerivativeLanes<L>(xOffset), PerlinLerpLanes<L>(L::Sub(cornerBA, cornerAA), L::Sub(cornerBB, cornerAB), v));
+			noise.DerivativeY = L::Mul(PerlinSmoothCurveDerivativeLanes<L>(yOffset), L::Sub(top, bottom));
+			return noise;
+		}
+
+		// runs a lane kernel over count points, the remainder is evaluated in a zero padded block
+		template<typename L, typename LaneKernel>
+		void RunNoiseBatch(LaneKernel laneKernel, const int32_t* permutation, const float* x, const float* y, float* result, int count)
+		{
+			int i = 0;
+			for (; i + L::Width <= count; i += L::Width)
+				L::Store(result + i, laneKernel(permutation, L::Load(x + i), L::Load(y + i)));
+
+			int remaining = count - i;
+			if (remaining <= 0)
+				return;
+
+			float paddedX[L::Width] = {};
+			float paddedY[L::Width] = {};
+			float paddedResult[L::Width];
+			for (int k = 0; k < remaining; ++k)
+			{
+				paddedX[k] = x[i + k];
+				paddedY[k] = y[i + k];
+			}
+			L::Store(paddedResult, laneKernel(permutation, L::Load(paddedX), L::Load(paddedY)));
+			for (int k = 0; k < remaining; ++k)
+				result[i + k] = paddedResult[k];
+		}
+
+		// same as RunNoiseBatch for kernels that also return the derivatives
+		template<typename L, typename LaneKernel>
+		void RunNoiseDerivativeBatch(LaneKernel laneKernel, const int32_t* permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count)
+		{
+			int i = 0;
+			for (; i + L::Width <= count; i += L::Width)
+			{
+				auto noise = laneKernel(permutation, L::Load(x + i), L::Load(y + i));
+				L::Store(value + i, noise.Value);
+				L::Store(derivativeX + i, noise.DerivativeX);
+				L::Store(derivativeY + i, noise.DerivativeY);
+			}
+
+			int remaining = count - i;
+			if (remaining <= 0)
+				return;
+
+			float paddedX[L::Width] = {};
+			float paddedY[L::Width] = {};
+			float paddedValue[L::Width];
+			float paddedDerivativeX[L::Width];
+			float paddedDerivativeY[L::Width];
+			for (int k = 0; k < remaining; ++k)
+			{
+				paddedX[k] = x[i + k];
+				paddedY[k] = y[i + k];
+			}
+			auto noise = laneKernel(permutation, L::Load(paddedX), L::Load(paddedY));
+			L::Store(paddedValue, noise.Value);
+			L::Store(paddedDerivativeX, noise.DerivativeX);
+			L::Store(paddedDerivativeY, noise.DerivativeY);
+			for (int k = 0; k < remaining; ++k)
+			{
+				value[i + k] = paddedValue[k];
+				derivativeX[i + k] = paddedDerivativeX[k];
+				derivativeY[i + k] = paddedDerivativeY[k];
+			}
+		}
+
+		template<typename L>
+		void SimplexNoiseBatch(const int32_t* permutation, const float* x, const float* y, float* result, int count)
+		{
+			RunNoiseBatch<L>(SimplexNoiseLanes<L>, permutation, x, y, result, count);
+		}
+
+		template<typename L>
+		void PerlinNoiseBatch(const int32_t* permutation, const float* x, const float* y, float* result, int count)
+		{
+			RunNoiseBatch<L>(PerlinNoiseLanes<L>, permutation, x, y, result, count);
+		}
+
+		template<typename L>
+		void ValueNoiseBatch(const int32_t* permutation, const float* x, const float* y, float* result, int count)
+		{
+			RunNoiseBatch<L>(ValueNoiseLanes<L>, permutation, x, y, result, count);
+		}
+
+		template<typename L>
+		void SimplexNoiseDerivativeBatch(const int32_t* permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count)
+		{
+			RunNoiseDerivativeBatch<L>(SimplexNoiseDerivativeLanes<L>, permutation, x, y, value, derivativeX, derivativeY, count);
+		}
+
+		template<typename L>
+		void PerlinNoiseDerivativeBatch(const int32_t* permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count)
+		{
+			RunNoiseDerivativeBatch<L>(PerlinNoiseDerivativeLanes<L>, permutation, x, y, value, derivativeX, derivativeY, count);
+		}
+
+		template<typename L>
+		void ValueNoiseDerivativeBatch(const int32_t* permutation, const float* x, const float* y, float* value, float* derivativeX, float* derivativeY, int count)
+		{
+			RunNoiseDerivativeBatch<L>(ValueNoiseDerivativeLanes<L>, permutation, x, y, value, derivativeX, derivativeY, count);
+		}
+
+		// share of the height difference a cell passes to its lowest neighbor, same as the sorted thermal erosion
+		constexpr float KernelThermalTransferRate = 0.1f;
+
+		// lowest of the 4 neighbors that is lower than the cell itself, ties go to the neighbor checked first
+		template<typename L>
+		void ThermalOutflowLanes(const float* heights, int stride, typename L::Float maxAngle, float* outflow, int32_t* direction)
+		{
+			auto height = L::Load(heights);
+			auto lowest = height;
+			auto lowestDirection = L::SetInt(ThermalNone);
+
+			const float* neighbors[4] = { heights + stride, heights - 1, heights + 1, heights - stride };
+			for (int32_t neighborDirection = ThermalSouth; neighborDirection <= ThermalNorth; ++neighborDirection)
+			{
+				auto neighbor = L::Load(neighbors[neighborDirection]);
+				auto isLower = L::Greater(lowest, neighbor);
+				lowest = L::Select(isLower, neighbor, lowest);
+				lowestDirection = L::SelectInt(isLower, L::SetInt(neighborDirection), lowestDirection);
+			}
+
+			auto heightDif = L::Sub(height, lowest);
+			auto isSteep = L::Greater(heightDif, maxAngle);
+			L::Store(outflow, L::Select(isSteep, L::Mul(heightDif, L::Set(KernelThermalTransferRate)), L::Set(0.f)));
+			L::StoreInt(direction, lowestDirection);
+		}
+
+		// material a cell receives from one neighbor, only if that neighbor's lowest neighbor is this cell
+		template<typename L>
+		typename L::Float ThermalInflowLanes(const float* outflow, const int32_t* direction, int32_t towardsCell)
+		{
+			auto isTarget = L::EqualInt(L::LoadInt(direction), L::SetInt(towardsCell));
+			return L::Select(isTarget, L::Load(outflow), L::Set(0.f));
+		}
+
+		template<typename L>
+		void ThermalApplyLanes(const float* heights, const float* outflow, const int32_t* direction, int stride, float* result)
+		{
+			auto height = L::Sub(L::Load(heights), L::Load(outflow));
+			height = L::Add(height, ThermalInflowLanes<L>(outflow + stride, direction + stride, ThermalNorth));
+			height = L::Add(height, ThermalInflowLanes<L>(outflow - 1, direction - 1, ThermalEast));
+			height = L::Add(height, ThermalInflowLanes<L>(outflow + 1, direction + 1, ThermalWest));
+			height = L::Add(height, ThermalInflowLanes<L>(outflow - stride, direction - stride, ThermalSouth));
+			L::Store(result, L::Min(L::Max(height, L::Set(0.f)), L::Set(1.f)));
+		}
+
+		// the remainder of a row runs one cell at a time with the same math
+		template<typename L>
+		void ThermalOutflowBatch(const float* heights, int stride, float maxAngle, float* outflow, int32_t* direction, int count)
+		{
+			int i = 0;
+			for (; i + L::Width <= count; i += L::Width)
+				ThermalOutflowLanes<L>(heights + i, stride, L::Set(maxAngle), outflow + i, direction + i);
+			for (; i < count; ++i)
+				ThermalOutflowLanes<ScalarLanes>(heights + i, stride, maxAngle, outflow + i, direction + i);
+		}
+
+		template<typename L>
+		void ThermalApplyBatch(const float* heights, const float* outflow, const int32_t* direction, int stride, float* result, int count)
+		{
+			int i = 0;
+			for (; i + L::Width <= count; i += L::Width)
+				ThermalApplyLanes<L>(heights + i, outflow + i, direction + i, stride, result + i);
+			for (; i < count; ++i)
+				ThermalApplyLanes<ScalarLanes>(heights + i, outflow + i, direction + i, stride, result + i);
+		}
+
+		// bilinear height of the map at a position, the gradient is only needed where the drop starts its step
+		template<typename L>
+		typename L::Float DropletHeightLanes(const float* heights, typename L::Int stride, typename L::Float x, typename L::Float y, typename L::Float* gradientX, typename L::Float* gradientY)
+		{
+			auto cellX = L::ToInt(x);
+			auto cellY = L::ToInt(y);
+			auto offsetX = L::Sub(x, L::ToFloat(cellX));
+			auto offsetY = L::Sub(y, L::ToFloat(cellY));
+			auto indexNW = L::AddInt(cellX, L::MulInt(stride, cellY));
+			auto heightNW = L::GatherFloat(heights, indexNW);
+			auto heightNE = L::GatherFloat(heights, L::AddInt(indexNW, L::SetInt(1)));
+			auto heightSW = L::GatherFloat(heights, L::AddInt(indexNW, stride));
+			auto heightSE = L::GatherFloat(heights, L::AddInt(L::AddInt(indexNW, stride), L::SetInt(1)));
+
+			auto one = L::Set(1.f);
+			auto inverseX = L::Sub(one, offsetX);
+			auto inverseY = L::Sub(one, offsetY);
+			if (gradientX)
+			{
+				// the y gradient uses the north western corner twice, like the scalar gradient
+				*gradientX = L::Add(L::Mul(L::Sub(heightNE, heightNW), inverseY), L::Mul(L::Sub(heightSE, heightSW), offsetY));
+				*gradientY = L::Add(L::Mul(L::Sub(heightSW, heightNW), inverseX), L::Mul(L::Sub(heightSE, heightNW), offsetX));
+			}
+			auto height = L::Mul(L::Mul(heightNW, inverseX), inverseY);
+			height = L::Add(height, L::Mul(L::Mul(heightNE, offsetX), inverseY));
+			height = L::Add(height, L::Mul(L::Mul(heightSW, inverseX), offsetY));
+			return L::Add(height, L::Mul(L::Mul(heightSE, offsetX), offsetY));
+		}
+
+		template<typename L>
+		void DropletStepLanes(const float* heights, const DropletStepSettings& settings, const DropletArrays& drops, int i)
+		{
+			auto stride = L::SetInt(settings.MapStride);
+			auto locationX = L::Load(drops.LocationX + i);
+			auto locationY = L::Load(drops.LocationY + i);
+			auto cellX = L::ToInt(locationX);
+			auto cellY = L::ToInt(locationY);
+			L::StoreInt(drops.CellX + i, cellX);
+			L::StoreInt(drops.CellY + i, cellY);
+			L::Store(drops.OffsetX + i, L::Sub(locationX, L::ToFloat(cellX)));
+			L::Store(drops.OffsetY + i, L::Sub(locationY, L::ToFloat(cellY)));
+
+			typename L::Float gradientX;
+			typename L::Float gradientY;
+			auto height = DropletHeightLanes<L>(heights, stride, locationX, locationY, &gradientX, &gradientY);
+
+			// new direction from the gradient and the old direction, normalized unless it vanished
+			auto inertia = L::Set(settings.Inertia);
+			auto pull = L::Set(1.f - settings.Inertia);
+			auto directionX = L::Sub(L::Mul(L::Load(drops.DirectionX + i), inertia), L::Mul(gradientX, pull));
+			auto directionY = L::Sub(L::Mul(L::Load(drops.DirectionY + i), inertia), L::Mul(gradientY, pull));
+			auto squareSum = L::Add(L::Mul(directionX, directionX), L::Mul(directionY, directionY));
+			auto isMoving = L::Greater(squareSum, L::Set(1e-8f));
+			auto scale = L::Div(L::Set(1.f), L::Sqrt(squareSum));
+			directionX = L::Select(isMoving, L::Mul(directionX, scale), L::Set(0.f));
+			directionY = L::Select(isMoving, L::Mul(directionY, scale), L::Set(0.f));
+			locationX = L::Add(locationX, directionX);
+			locationY = L::Add(locationY, directionY);
+
+			auto zero = L::Set(0.f);
+			auto isAlive = L::And(isMoving, L::And(L::GreaterEqual(locationX, zero), L::GreaterEqual(locationY, zero)));
+			isAlive = L::And(isAlive, L::And(L::Greater(L::Set(settings.MapWidth - 1.f), locationX), L::Greater(L::Set(settings.MapHeight - 1.f), locationY)));
+
+			// retired drops sample the corner of the map instead of reading outside of it
+			auto newHeight = DropletHeightLanes<L>(heights, stride, L::Select(isAlive, locationX, zero), L::Select(isAlive, locationY, zero), nullptr, nullptr);
+			auto heightDifference = L::Sub(newHeight, height);
+			auto velocity = L::Load(drops.Velocity + i);
+			auto water = L::Load(drops.Water + i);
+			auto sediment = L::Load(drops.Sediment + i);
+			auto capacity = L::Mul(L::Mul(L::Mul(L::Max(L::Sub(zero, heightDifference), L::Set(settings.MinSlope)), velocity), water), L::Set(settings.Capacity));
+
+			// drops deposit when they carry more than they can or flow uphill, otherwise they erode
+			auto isUphill = L::Greater(heightDifference, zero);
+			auto depositMask = L::Or(L::Greater(sediment, capacity), isUphill);
+			auto sedimentToDrop = L::Select(isUphill, L::Min(heightDifference, sediment), L::Mul(L::Sub(sediment, capacity), L::Set(settings.Deposition)));
+			auto erode = L::Min(L::Mul(L::Set(settings.Erosion), L::Sub(capacity, sediment)), L::Sub(zero, heightDifference));
+
+			L::Store(drops.LocationX + i, locationX);
+			L::Store(drops.LocationY + i, locationY);
+			L::Store(drops.DirectionX + i, directionX);
+			L::Store(drops.DirectionY + i, directionY);
+			L::Store(drops.Sediment + i, L::Select(depositMask, L::Sub(sediment, sedimentToDrop), sediment));
+			L::Store(drops.Amount + i, L::Select(depositMask, sedimentToDrop, erode));
+			L::StoreInt(drops.Action + i, L::SelectInt(isAlive, L::SelectInt(depositMask, L::SetInt(DropletDeposit), L::SetInt(DropletErode)), L::SetInt(DropletRetired)));
+
+			// water evaporates and the drop speeds up with the height it lost or gained
+			auto absoluteDifference = L::Max(heightDifference, L::Sub(zero, heightDifference));
+			L::Store(drops.Water + i, L::Mul(water, L::Set(1.f - settings.Evaporation)));
+			L::Store(drops.Velocity + i, L::Sqrt(L::Add(L::Mul(velocity, velocity), L::Mul(absoluteDifference, L::Set(settings.Gravity)))));
+		}
+
+		template<typename L>
+		void DropletStepBatch(const float* heights, const DropletStepSettings& settings, const DropletArrays& drops, int count)
+		{
+			int i = 0;
+			for (; i + L::Width <= count; i += L::Width)
+				DropletStepLanes<L>(heights, settings, drops, i);
+			for (; i < count; ++i)
+				DropletStepLanes<ScalarLanes>(heights, settings, drops, i);
+		}
+
+		// offset of every lane to the first cell of a row
+		alignas(64) const float KernelLaneOffsets[16] = { 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f };
+		// water depth below which a cell counts as dry and its water doesn't move
+		constexpr float KernelShallowWaterMinDepth = 1e-5f;
+
+		// padded index of a map cell
+		inline int ShallowWaterIndex(const ShallowWaterGrids& grids, int x, int y)
+		{
+			return (y + 1) * grids.Stride + x + 1;
+		}
+
+		template<typename L>
+		void ShallowWaterOutflowLanes(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int i)
+		{
+			const float* terrain = grids.Terrain;
+			const float* water = grids.Water;
+			int stride = grids.Stride;
+			auto pipeScale = L::Set(settings.PipeScale);
+			auto zero = L::Set(0.f);
+
+			// the pipes accelerate with the difference of the water surfaces and never carry water back
+			auto surface = L::Add(L::Load(terrain + i), L::Load(water + i));
+			auto pipeOutflow = [&](const float* outflow, int neighbor)
+			{
+				auto difference = L::Sub(L::Sub(surface, L::Load(terrain + i + neighbor)), L::Load(water + i + neighbor));
+				return L::Max(L::Add(L::Load(outflow + i), L::Mul(pipeScale, difference)), zero);
+			};
+			auto outflowLeft = pipeOutflow(grids.OutflowLeft, -1);
+			auto outflowRight = pipeOutflow(grids.OutflowRight, 1);
+			auto outflowUp = pipeOutflow(grids.OutflowUp, -stride);
+			auto outflowDown = pipeOutflow(grids.OutflowDown, stride);
+
+			// a cell can't send more water than it has after the rain
+			auto volume = L::Mul(L::Add(L::Add(L::Add(outflowLeft, outflowRight), outflowUp), outflowDown), L::Set(settings.TimeStep));
+			auto available = L::Add(L::Load(water + i), L::Set(settings.Rain));
+			auto scale = L::Min(L::Div(available, L::Max(volume, L::Set(1e-20f))), L::Set(1.f));
+			L::Store(grids.OutflowLeft + i, L::Mul(outflowLeft, scale));
+			L::Store(grids.OutflowRight + i, L::Mul(outflowRight, scale));
+			L::Store(grids.OutflowUp + i, L::Mul(outflowUp, scale));
+			L::Store(grids.OutflowDown + i, L::Mul(outflowDown, scale));
+		}
+
+		template<typename L>
+		void ShallowWaterFlowLanes(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int i)
+		{
+			int stride = grids.Stride;
+			auto fromLeft = L::Load(grids.OutflowRight + i - 1);
+			auto fromRight = L::Load(grids.OutflowLeft + i + 1);
+			auto fromUp = L::Load(grids.OutflowDown + i - stride);
+			auto fromDown = L::Load(grids.OutflowUp + i + stride);
+			auto outflowLeft = L::Load(grids.OutflowLeft + i);
+			auto outflowRight = L::Load(grids.OutflowRight + i);
+			auto outflowUp = L::Load(grids.OutflowUp + i);
+			auto outflowDown = L::Load(grids.OutflowDown + i);
+			auto inflow = L::Add(L::Add(L::Add(fromLeft, fromRight), fromUp), fromDown);
+			auto outflow = L::Add(L::Add(L::Add(outflowLeft, outflowRight), outflowUp), outflowDown);
+
+			auto before = L::Add(L::Load(grids.Water + i), L::Set(settings.Rain));
+			auto after = L::Max(L::Add(before, L::Mul(L::Set(settings.TimeStep), L::Sub(inflow, outflow))), L::Set(0.f));
+			L::Store(grids.Water + i, after);
+
+			// velocity from the water passing through the cell and the mean depth during the pass
+			auto half = L::Set(.5f);
+			auto depth = L::Mul(L::Add(before, after), half);
+			auto flowX = L::Mul(L::Sub(L::Add(L::Sub(fromLeft, outflowLeft), outflowRight), fromRight), half);
+			auto flowY = L::Mul(L::Sub(L::Add(L::Sub(fromUp, outflowUp), outflowDown), fromDown), half);
+			auto minDepth = L::Set(KernelShallowWaterMinDepth);
+			auto inverseDepth = L::Select(L::Greater(depth, minDepth), L::Div(L::Set(1.f), L::Max(depth, minDepth)), L::Set(0.f));
+			L::Store(grids.VelocityX + i, L::Mul(flowX, inverseDepth));
+			L::Store(grids.VelocityY + i, L::Mul(flowY, inverseDepth));
+		}
+
+		template<typename L>
+		void ShallowWaterErosionLanes(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int i)
+		{
+			// sine of the slope, flat ground still counts with the min slope like the raindrops do
+			const float* terrain = grids.Terrain;
+			int stride = grids.Stride;
+			auto half = L::Set(.5f);
+			auto slopeX = L::Mul(L::Sub(L::Load(terrain + i + 1), L::Load(terrain + i - 1)), half);
+			auto slopeY = L::Mul(L::Sub(L::Load(terrain + i + stride), L::Load(terrain + i - stride)), half);
+			auto squareSlope = L::Add(L::Mul(slopeX, slopeX), L::Mul(slopeY, slopeY));
+			auto tilt = L::Max(L::Sqrt(L::Div(squareSlope, L::Add(L::Set(1.f), squareSlope))), L::Set(settings.MinSlope));
+
+			// the capacity grows with slope, speed and water like the capacity of a raindrop
+			auto velocityX = L::Load(grids.VelocityX + i);
+			auto velocityY = L::Load(grids.VelocityY + i);
+			auto speed = L::Sqrt(L::Add(L::Mul(velocityX, velocityX), L::Mul(velocityY, velocityY)));
+			auto capacity = L::Mul(L::Mul(L::Mul(tilt, speed), L::Load(grids.Water + i)), L::Set(settings.Capacity));
+
+			// water below its capacity takes material from the ground, above it the material settles
+			auto height = L::Load(terrain + i);
+			auto sediment = L::Load(grids.Sediment + i);
+			auto difference = L::Sub(capacity, sediment);
+			auto eroded = L::Select(L::Greater(difference, L::Set(0.f)), L::Min(L::Mul(L::Set(settings.ErosionRate), difference), height), L::Mul(L::Set(settings.DepositionRate), difference));
+			L::Store(grids.TerrainResult + i, L::Sub(height, eroded));
+			L::Store(grids.Sediment + i, L::Add(sediment, eroded));
+		}
+
+		template<typename L>
+		void ShallowWaterTransportLanes(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int x, int y, int i)
+		{
+			// every cell fetches the sediment from where its water was a time step ago
+			// at most a cell away, faster water in thin films would skip the cells in between
+			auto timeStep = L::Set(settings.TimeStep);
+			auto zero = L::Set(0.f);
+			auto one = L::Set(1.f);
+			auto minusOne = L::Set(-1.f);
+			auto distanceX = L::Min(L::Max(L::Mul(L::Load(grids.VelocityX + i), timeStep), minusOne), one);
+			auto distanceY = L::Min(L::Max(L::Mul(L::Load(grids.VelocityY + i), timeStep), minusOne), one);
+			auto cellX = L::Add(L::Set(static_cast<float>(x)), L::Load(KernelLaneOffsets));
+			auto sourceX = L::Min(L::Max(L::Sub(cellX, distanceX), zero), L::Set(settings.MapWidth - 1.f));
+			auto sourceY = L::Min(L::Max(L::Sub(L::Set(static_cast<float>(y)), distanceY), zero), L::Set(settings.MapHeight - 1.f));
+			auto cornerX = L::Min(L::Floor(sourceX), L::Set(settings.MapWidth - 2.f));
+			auto cornerY = L::Min(L::Floor(sourceY), L::Set(settings.MapHeight - 2.f));
+			auto offsetX = L::Sub(sourceX, cornerX);
+			auto offsetY = L::Sub(sourceY, cornerY);
+
+			auto stride = L::SetInt(grids.Stride);
+			auto oneInt = L::SetInt(1);
+			auto index = L::AddInt(L::MulInt(L::AddInt(L::ToInt(cornerY), oneInt), stride), L::AddInt(L::ToInt(cornerX), oneInt));
+			auto topLeft = L::GatherFloat(grids.Sediment, index);
+			auto topRight = L::GatherFloat(grids.Sediment, L::AddInt(index, oneInt));
+			auto bottomLeft = L::GatherFloat(grids.Sediment, L::AddInt(index, stride));
+			auto bottomRight = L::GatherFloat(grids.Sediment, L::AddInt(L::AddInt(index, stride), oneInt));
+			auto inverseX = L::Sub(one, offsetX);
+			auto top = L::Add(L::Mul(topLeft, inverseX), L::Mul(topRight, offsetX));
+			auto bottom = L::Add(L::Mul(bottomLeft, inverseX), L::Mul(bottomRight, offsetX));
+			L::Store(grids.SedimentResult + i, L::Add(L::Mul(top, L::Sub(one, offsetY)), L::Mul(bottom, offsetY)));
+
+			L::Store(grids.Water + i, L::Mul(L::Load(grids.Water + i), L::Set(settings.Evaporation)));
+		}
+
+		// the remainder of a row runs one cell at a time with the same math
+		template<typename L>
+		void ShallowWaterOutflowBatch(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int x, int y, int count)
+		{
+			int i = ShallowWaterIndex(grids, x, y);
+			int last = i + count;
+			for (; i + L::Width <= last; i += L::Width)
+				ShallowWaterOutflowLanes<L>(grids, settings, i);
+			for (; i < last; ++i)
+				ShallowWaterOutflowLanes<ScalarLanes>(grids, settings, i);
+		}
+
+		template<typename L>
+		void ShallowWaterFlowBatch(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int x, int y, int count)
+		{
+			int i = ShallowWaterIndex(grids, x, y);
+			int last = i + count;
+			for (; i + L::Width <= last; i += L::Width)
+				ShallowWaterFlowLanes<L>(grids, settings, i);
+			for (; i < last; ++i)
+				ShallowWaterFlowLanes<ScalarLanes>(grids, settings, i);
+		}
+
+		template<typename L>
+		void ShallowWaterErosionBatch(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int x, int y, int count)
+		{
+			int i = ShallowWaterIndex(grids, x, y);
+			int last = i + count;
+			for (; i + L::Width <= last; i += L::Width)
+				ShallowWaterErosionLanes<L>(grids, settings, i);
+			for (; i < last; ++i)
+				ShallowWaterErosionLanes<ScalarLanes>(grids, settings, i);
+		}
+
+		template<typename L>
+		void ShallowWaterTransportBatch(const ShallowWaterGrids& grids, const ShallowWaterStepSettings& settings, int x, int y, int count)
+		{
+			int i = ShallowWaterIndex(grids, x, y);
+			int lastX = x + count;
+			for (; x + L::Width <= lastX; x += L::Width, i += L::Width)
+				ShallowWaterTransportLanes<L>(grids, settings, x, y, i);
+			for (; x < lastX; ++x, ++i)
+				ShallowWaterTransportLanes<ScalarLanes>(grids, settings, x, y, i);
+		}
+
+		// largest value of a quantized height
+		constexpr float KernelQuantizedHeightMax = 65535.f;
+
+		template<typename L>
+		void QuantizeHeightsLanes(const float* heights, uint16_t* result)
+		{
+			auto height = L::Min(L::Max(L::Load(heights), L::Set(0.f)), L::Set(1.f));
+			auto scaled = L::Add(L::Mul(height, L::Set(KernelQuantizedHeightMax)), L::Set(.5f));
+			L::StoreUInt16(result, L::ToInt(scaled));
+		}
+
+		template<typename L>
+		void QuantizeHeightsBatch(const float* heights, uint16_t* result, int count)
+		{
+			int i = 0;
+			for (; i + L::Width <= count; i += L::Width)
+				QuantizeHeightsLanes<L>(heights + i, result + i);
+			for (; i < count; ++i)
+				QuantizeHeightsLanes<ScalarLanes>(heights + i, result + i);
+		}
+
+		template<typename L>
+		SimdKernelTable MakeSimdKernelTable(SimdLevel level)
+		{
+			SimdKernelTable table;
+			table.Level = level;
+			table.Width = L::Width;
+			table.SimplexNoise2D = SimplexNoiseBatch<L>;
+			table.PerlinNoise2D = PerlinNoiseBatch<L>;
+			table.ValueNoise2D = ValueNoiseBatch<L>;
+			table.SimplexNoise2DDerivatives = SimplexNoiseDerivativeBatch<L>;
+			table.PerlinNoise2DDerivatives = PerlinNoiseDerivativeBatch<L>;
+			table.ValueNoise2DDerivatives = ValueNoiseDerivativeBatch<L>;
+			table.ThermalOutflow = ThermalOutflowBatch<L>;
+			table.ThermalApply = ThermalApplyBatch<L>;
+			table.DropletStep = DropletStepBatch<L>;
+			table.ShallowWaterOutflow = ShallowWaterOutflowBatch<L>;
+			table.ShallowWaterFlow = ShallowWaterFlowBatch<L>;
+			table.ShallowWaterErosion = ShallowWaterErosionBatch<L>;
+			table.ShallowWaterTransport = ShallowWaterTransportBatch<L>;
+			table.QuantizeHeights = QuantizeHeightsBatch<L>;
+			return table;
+		}
+	}
+}
@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// AVX2 kernels, the build enables the instruction set for this file only
+
+#include "SimdKernels.h"
+#include "SimdLanes.h"
+
+#if defined(__AVX2__)
+#include "SimdKernels.inl"
+#endif
+
+namespace TerrainCore
+{
+	const SimdKernelTable* GetAVX2Kernels()
+	{
+#if defined(__AVX2__)
+		static const SimdKernelTable table = MakeSimdKernelTable<AVX2Lanes>(SimdLevel::AVX2);
+		return &table;
+#else
+		return nullptr;
+#endif
+	}
+}
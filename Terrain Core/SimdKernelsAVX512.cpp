@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// AVX-512 kernels, the build enables the instruction set for this file only
+
+#include "SimdKernels.h"
+#include "SimdLanes.h"
+
+#if defined(__AVX512F__)
+#include "SimdKernels.inl"
+#endif
+
+namespace TerrainCore
+{
+	const SimdKernelTable* GetAVX512Kernels()
+	{
+#if defined(__AVX512F__)
+		static const SimdKernelTable table = MakeSimdKernelTable<AVX512Lanes>(SimdLevel::AVX512);
+		return &table;
+#else
+		return nullptr;
+#endif
+	}
+}
@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// SSE4.2 kernels, the build enables the instruction set for this file only
+
+#include "SimdKernels.h"
+#include "SimdLanes.h"
+
+#if defined(__SSE4_2__) || (defined(_MSC_VER) && defined(_M_X64))
+#include "SimdKernels.inl"
+#endif
+
+namespace TerrainCore
+{
+	const SimdKernelTable* GetSSE42Kernels()
+	{
+#if defined(__SSE4_2__) || (defined(_MSC_VER) && defined(_M_X64))
+		static const SimdKernelTable table = MakeSimdKernelTable<SSE42Lanes>(SimdLevel::SSE42);
+		return &table;
+#else
+		return nullptr;
+#endif
+	}
+}
@@ -0,0 +1,17 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Scalar kernels, used when no vector instruction set is available
+
+#include "SimdKernels.h"
+#include "SimdLanes.h"
+
+#include "SimdKernels.inl"
+
+namespace TerrainCore
+{
+	const SimdKernelTable* GetScalarKernels()
+	{
+		static const SimdKernelTable table = MakeSimdKernelTable<ScalarLanes>(SimdLevel::Scalar);
+		return &table;
+	}
+}
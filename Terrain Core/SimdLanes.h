@@ -0,0 +1,244 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Thin wrappers around the vector registers of every instruction set, the batched kernels are written once against
+// this interface. A wrapper only exists when the translation unit is compiled with its instruction set enabled.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE4_2__) || defined(__AVX2__) || defined(__AVX512F__) || (defined(_MSC_VER) && defined(_M_X64))
+#include <immintrin.h>
+#endif
+
+namespace TerrainCore
+{
+	// Internal linkage, every file includes the wrappers with the flags of its own instruction set. Shared inline
+	// members would let the linker pick the copy of a wider instruction set for the fallback kernels
+	namespace
+	{
+		// The std math overloads are inline functions every file shares, the linker keeps one copy and it can be the one
+		// compiled for a wider instruction set than the caller supports. The builtins are expanded in place or call the
+		// c library
+#if defined(__GNUC__) || defined(__clang__)
+		inline float LaneSqrt(float value) { return __builtin_sqrtf(value); }
+		inline float LaneFloor(float value) { return __builtin_floorf(value); }
+		inline void LaneCopy(void* destination, const void* source, size_t size) { __builtin_memcpy(destination, source, size); }
+#else
+		inline float LaneSqrt(float value) { return sqrtf(value); }
+		inline float LaneFloor(float value) { return floorf(value); }
+		inline void LaneCopy(void* destination, const void* source, size_t size) { memcpy(destination, source, size); }
+#endif
+
+		// one lane, used as fallback on every platform
+		struct ScalarLanes
+		{
+			static constexpr int Width = 1;
+			using Float = float;
+			using Int = int32_t;
+			using Mask = bool;
+
+			static Float Load(const float* source) { return *source; }
+			static void Store(float* destination, Float value) { *destination = value; }
+			static Float Set(float value) { return value; }
+			static Int SetInt(int32_t value) { return value; }
+			static Int LoadInt(const int32_t* source) { return *source; }
+			static void StoreInt(int32_t* destination, Int value) { *destination = value; }
+			// stores the low 16 bits of every lane, the lanes have to be within 0 65535
+			static void StoreUInt16(uint16_t* destination, Int value) { *destination = static_cast<uint16_t>(value); }
+
+			static Float Add(Float a, Float b) { return a + b; }
+			static Float Sub(Float a, Float b) { return a - b; }
+			static Float Mul(Float a, Float b) { return a * b; }
+			static Float Max(Float a, Float b) { return a > b ? a : b; }
+			static Float Min(Float a, Float b) { return a < b ? a : b; }
+			static Float Div(Float a, Float b) { return a / b; }
+			static Float Sqrt(Float value) { return LaneSqrt(value); }
+			static Float Floor(Float value) { return LaneFloor(value); }
+			static Float Xor(Float value, Int bits)
+			{
+				uint32_t valueBits;
+				LaneCopy(&valueBits, &value, sizeof(valueBits));
+				valueBits ^= static_cast<uint32_t>(bits);
+				LaneCopy(&value, &valueBits, sizeof(valueBits));
+				return value;
+			}
+
+			static Int ToInt(Float value) { return static_cast<int32_t>(value); }
+			static Float ToFloat(Int value) { return static_cast<float>(value); }
+			static Int AddInt(Int a, Int b) { return a + b; }
+			static Int AndInt(Int a, Int b) { return a & b; }
+			static Int MulInt(Int a, Int b) { return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+			template<int Count>
+			static Int ShiftLeft(Int value) { return static_cast<int32_t>(static_cast<uint32_t>(value) << Count); }
+			static Int Gather(const int32_t* table, Int index) { return table[index]; }
+			static Float GatherFloat(const float* table, Int index) { return table[index]; }
+
+			static Mask Greater(Float a, Float b) { return a > b; }
+			static Mask GreaterEqual(Float a, Float b) { return a >= b; }
+			static Mask And(Mask a, Mask b) { return a && b; }
+			static Mask Or(Mask a, Mask b) { return a || b; }
+			static Mask EqualInt(Int a, Int b) { return a == b; }
+			static Float Select(Mask mask, Float a, Float b) { return mask ? a : b; }
+			static Int SelectInt(Mask mask, Int a, Int b) { return mask ? a : b; }
+		};
+
+#if defined(__SSE4_2__) || (defined(_MSC_VER) && defined(_M_X64))
+		// 4 lanes, floor and blend need SSE4.1, gathers are emulated
+		struct SSE42Lanes
+		{
+			static constexpr int Width = 4;
+			using Float = __m128;
+			using Int = __m128i;
+			using Mask = __m128;
+
+			static Float Load(const float* source) { return _mm_loadu_ps(source); }
+			static void Store(float* destination, Float value) { _mm_storeu_ps(destination, value); }
+			static Float Set(float value) { return _mm_set1_ps(value); }
+			static Int SetInt(int32_t value) { return _mm_set1_epi32(value); }
+			static Int LoadInt(const int32_t* source) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)); }
+			static void StoreInt(int32_t* destination, Int value) { _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), value); }
+			static void StoreUInt16(uint16_t* destination, Int value) { _mm_storel_epi64(reinterpret_cast<__m128i*>(destination), _mm_packus_epi32(value, value)); }
+
+			static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+			static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+			static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+			static Float Sqrt(Float value) { return _mm_sqrt_ps(value); }
+			static Float Floor(Float value) { return _mm_floor_ps(value); }
+			static Float Xor(Float value, Int bits) { return _mm_xor_ps(value, _mm_castsi128_ps(bits)); }
+
+			static Int ToInt(Float value) { return _mm_cvttps_epi32(value); }
+			static Float ToFloat(Int value) { return _mm_cvtepi32_ps(value); }
+			static Int AddInt(Int a, Int b) { return _mm_add_epi32(a, b); }
+			static Int AndInt(Int a, Int b) { return _mm_and_si128(a, b); }
+			static Int MulInt(Int a, Int b) { return _mm_mullo_epi32(a, b); }
+			template<int Count>
+			static Int ShiftLeft(Int value) { return _mm_slli_epi32(value, Count); }
+			static Int Gather(const int32_t* table, Int index)
+			{
+				alignas(16) int32_t indices[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(indices), index);
+				return _mm_setr_epi32(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]);
+			}
+			static Float GatherFloat(const float* table, Int index)
+			{
+				alignas(16) int32_t indices[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(indices), index);
+				return _mm_setr_ps(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]);
+			}
+
+			static Mask Greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+			static Mask GreaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+			static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+			static Mask Or(Mask a, Mask b) { return _mm_or_ps(a, b); }
+			static Mask EqualInt(Int a, Int b) { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b)); }
+			static Float Select(Mask mask, Float a, Float b) { return _mm_blendv_ps(b, a, mask); }
+			static Int SelectInt(Mask mask, Int a, Int b) { return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b), _mm_castsi128_ps(a), mask)); }
+		};
+#endif
+
+#if defined(__AVX2__)
+		// 8 lanes with hardware gathers
+		struct AVX2Lanes
+		{
+			static constexpr int Width = 8;
+			using Float = __m256;
+			using Int = __m256i;
+			using Mask = __m256;
+
+			static Float Load(const float* source) { return _mm256_loadu_ps(source); }
+			static void Store(float* destination, Float value) { _mm256_storeu_ps(destination, value); }
+			static Float Set(float value) { return _mm256_set1_ps(value); }
+			static Int SetInt(int32_t value) { return _mm256_set1_epi32(value); }
+			static Int LoadInt(const int32_t* source) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)); }
+			static void StoreInt(int32_t* destination, Int value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), value); }
+			static void StoreUInt16(uint16_t* destination, Int value)
+			{
+				// the pack works per 128 bit half, the permute moves both packed halves next to each other
+				__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(value, value), 0x08);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm256_castsi256_si128(packed));
+			}
+
+			static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+			static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+			static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+			static Float Sqrt(Float value) { return _mm256_sqrt_ps(value); }
+			static Float Floor(Float value) { return _mm256_floor_ps(value); }
+			static Float Xor(Float value, Int bits) { return _mm256_xor_ps(value, _mm256_castsi256_ps(bits)); }
+
+			static Int ToInt(Float value) { return _mm256_cvttps_epi32(value); }
+			static Float ToFloat(Int value) { return _mm256_cvtepi32_ps(value); }
+			static Int AddInt(Int a, Int b) { return _mm256_add_epi32(a, b); }
+			static Int AndInt(Int a, Int b) { return _mm256_and_si256(a, b); }
+			static Int MulInt(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+			template<int Count>
+			static Int ShiftLeft(Int value) { return _mm256_slli_epi32(value, Count); }
+			static Int Gather(const int32_t* table, Int index) { return _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), index, 4); }
+			static Float GatherFloat(const float* table, Int index) { return _mm256_i32gather_ps(table, index, 4); }
+
+			static Mask Greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+			static Mask GreaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+			static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+			static Mask Or(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+			static Mask EqualInt(Int a, Int b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+			static Float Select(Mask mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+			static Int SelectInt(Mask mask, Int a, Int b) { return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), mask)); }
+		};
+#endif
+
+#if defined(__AVX512F__)
+		// 16 lanes with mask registers, only uses AVX-512F instructions
+		struct AVX512Lanes
+		{
+			static constexpr int Width = 16;
+			using Float = __m512;
+			using Int = __m512i;
+			using Mask = __mmask16;
+
+			static Float Load(const float* source) { return _mm512_loadu_ps(source); }
+			static void Store(float* destination, Float value) { _mm512_storeu_ps(destination, value); }
+			static Float Set(float value) { return _mm512_set1_ps(value); }
+			static Int SetInt(int32_t value) { return _mm512_set1_epi32(value); }
+			static Int LoadInt(const int32_t* source) { return _mm512_loadu_si512(source); }
+			static void StoreInt(int32_t* destination, Int value) { _mm512_storeu_si512(destination, value); }
+			static void StoreUInt16(uint16_t* destination, Int value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), _mm512_cvtepi32_epi16(value)); }
+
+			static Float Add(Float a, Float b) { return _mm512_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+			static Float Max(Float a, Float b) { return _mm512_max_ps(a, b); }
+			static Float Min(Float a, Float b) { return _mm512_min_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm512_div_ps(a, b); }
+			static Float Sqrt(Float value) { return _mm512_sqrt_ps(value); }
+			static Float Floor(Float value) { return _mm512_roundscale_ps(value, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+			static Float Xor(Float value, Int bits) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(value), bits)); }
+
+			static Int ToInt(Float value) { return _mm512_cvttps_epi32(value); }
+			static Float ToFloat(Int value) { return _mm512_cvtepi32_ps(value); }
+			static Int AddInt(Int a, Int b) { return _mm512_add_epi32(a, b); }
+			static Int AndInt(Int a, Int b) { return _mm512_and_si512(a, b); }
+			static Int MulInt(Int a, Int b) { return _mm512_mullo_epi32(a, b); }
+			template<int Count>
+			static Int ShiftLeft(Int value) { return _mm512_slli_epi32(value, Count); }
+			static Int Gather(const int32_t* table, Int index) { return _mm512_i32gather_epi32(index, table, 4); }
+			static Float GatherFloat(const float* table, Int index) { return _mm512_i32gather_ps(index, table, 4); }
+
+			static Mask Greater(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+			static Mask GreaterEqual(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+			static Mask And(Mask a, Mask b) { return static_cast<Mask>(a & b); }
+			static Mask Or(Mask a, Mask b) { return static_cast<Mask>(a | b); }
+			static Mask EqualInt(Int a, Int b) { return _mm512_cmpeq_epi32_mask(a, b); }
+			static Float Select(Mask mask, Float a, Float b) { return _mm512_mask_blend_ps(mask, b, a); }
+			static Int SelectInt(Mask mask, Int a, Int b) { return _mm512_mask_blend_epi32(mask, b, a); }
+		};
+#endif
+	}
+}
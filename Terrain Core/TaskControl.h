@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace TerrainCore
+{
+	// Shared between a running kernel and the code that started it. The kernel reports finished work and stops early
+	// once the task gets cancelled, a cancelled kernel leaves its output partially processed.
+	class TaskControl
+	{
+	public:
+		// gets called with the progress in the 0 1 range whenever it grows by a percent, possibly from worker threads
+		using ProgressCallback = std::function<void(float)>;
+
+		TaskControl() = default;
+		explicit TaskControl(ProgressCallback onProgress)
+			: m_OnProgress{ std::move(onProgress) }
+		{
+		}
+
+		void Cancel() { m_Cancelled = true; }
+		bool IsCancelled() const { return m_Cancelled; }
+
+		// starts a new stage with the given amount of work units
+		void BeginWork(int64_t totalWork)
+		{
+			m_DoneWork = 0;
+			m_TotalWork = totalWork > 0 ? totalWork : 1;
+			m_ReportedPercent = -1;
+			AddProgress(0);
+		}
+
+		// adds finished work units, thread safe
+		void AddProgress(int64_t work)
+		{
+			int64_t doneWork = m_DoneWork += work;
+			int percent = static_cast<int>(doneWork * 100 / m_TotalWork);
+			int reportedPercent = m_ReportedPercent;
+			while (percent > reportedPercent)
+			{
+				if (m_ReportedPercent.compare_exchange_weak(reportedPercent, percent))
+				{
+					if (m_OnProgress)
+						m_OnProgress(percent / 100.f);
+					break;
+				}
+			}
+		}
+
+		float GetProgress() const { return static_cast<float>(m_DoneWork) / static_cast<float>(m_TotalWork); }
+
+	private:
+		std::atomic<bool> m_Cancelled{ false };
+		std::atomic<int64_t> m_TotalWork{ 1 };
+		std::atomic<int64_t> m_DoneWork{ 0 };
+		std::atomic<int> m_ReportedPercent{ -1 };
+		ProgressCallback m_OnProgress;
+	};
+
+	// helpers for kernels that take an optional control
+	inline bool IsCancelled(const TaskControl* control)
+	{
+		return control && control->IsCancelled();
+	}
+
+	inline void BeginWork(TaskControl* control, int64_t totalWork)
+	{
+		if (control)
+			control->BeginWork(totalWork);
+	}
+
+	inline void AddProgress(TaskControl* control, int64_t work)
+	{
+		if (control)
+			control->AddProgress(work);
+	}
+}
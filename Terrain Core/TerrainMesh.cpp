@@ -0,0 +1,238 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainMesh.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace TerrainCore
+{
+	TerrainMeshBuilder::TerrainMeshBuilder(const TerrainMeshSettings& settings)
+		: m_Settings{ settings }
+	{
+		// every detail level has to split a section into whole quads
+		int sectionSize = 1;
+		while (sectionSize < m_Settings.SectionSize)
+			sectionSize *= 2;
+		m_Settings.SectionSize = std::max(sectionSize, 2);
+
+		int lodCount = 1;
+		while (lodCount < m_Settings.LodCount && (1 << lodCount) <= m_Settings.SectionSize)
+			++lodCount;
+		m_Settings.LodCount = lodCount;
+		m_Settings.LodDistance = std::max(m_Settings.LodDistance, 1.f);
+		m_Settings.CellSize = std::max(m_Settings.CellSize, 1e-6f);
+	}
+
+	void TerrainMeshBuilder::Resize(int width, int height)
+	{
+		if (width == m_Width && height == m_Height)
+			return;
+
+		m_Width = width;
+		m_Height = height;
+		auto countSections = [this](int samples) { return samples > 1 ? (samples - 2) / m_Settings.SectionSize + 1 : 0; };
+		m_SectionCountX = countSections(width);
+		m_SectionCountY = countSections(height);
+
+		m_Sections.assign(static_cast<size_t>(m_SectionCountX) * m_SectionCountY, TerrainMeshSection());
+		for (int y = 0; y < m_SectionCountY; ++y)
+		{
+			for (int x = 0; x < m_SectionCountX; ++x)
+			{
+				auto& section = m_Sections[x + y * m_SectionCountX];
+				section.X = x;
+				section.Y = y;
+			}
+		}
+		m_Dirty.assign(m_Sections.size(), 1);
+	}
+
+	void TerrainMeshBuilder::MarkDirty(int x, int y, int width, int height)
+	{
+		if (m_Sections.empty() || width <= 0 || height <= 0)
+			return;
+
+		// a section reads one sample beyond its edges for the normals, sections sharing an edge sample both use it
+		int firstX = std::max((x - 2) / m_Settings.SectionSize, 0);
+		int firstY = std::max((y - 2) / m_Settings.SectionSize, 0);
+		int lastX = std::min((x + width) / m_Settings.SectionSize, m_SectionCountX - 1);
+		int lastY = std::min((y + height) / m_Settings.SectionSize, m_SectionCountY - 1);
+		for (int sectionY = firstY; sectionY <= lastY; ++sectionY)
+		{
+			for (int sectionX = firstX; sectionX <= lastX; ++sectionX)
+				m_Dirty[sectionX + sectionY * m_SectionCountX] = 1;
+		}
+	}
+
+	void TerrainMeshBuilder::MarkAllDirty()
+	{
+		std::fill(m_Dirty.begin(), m_Dirty.end(), 1);
+	}
+
+	bool TerrainMeshBuilder::HasDirtySections() const
+	{
+		return std::find(m_Dirty.begin(), m_Dirty.end(), 1) != m_Dirty.end();
+	}
+
+	void TerrainMeshBuilder::UpdateLods(const std::vector<MeshViewer>& viewers)
+	{
+		for (size_t i = 0; i < m_Sections.size(); ++i)
+		{
+			auto& section = m_Sections[i];
+			float minX = static_cast<float>(GetSectionStart(section.X));
+			float minY = static_cast<float>(GetSectionStart(section.Y));
+			float maxX = static_cast<float>(GetSectionEnd(section.X, m_Width));
+			float maxY = static_cast<float>(GetSectionEnd(section.Y, m_Height));
+
+			// distance to the closest point of the section, 0 for viewers above it
+			int lod = viewers.empty() ? 0 : m_Settings.LodCount - 1;
+			for (const auto& viewer : viewers)
+			{
+				float distanceX = std::max({ minX - viewer.X, 0.f, viewer.X - maxX });
+				float distanceY = std::max({ minY - viewer.Y, 0.f, viewer.Y - maxY });
+				lod = std::min(lod, GetLodForDistance(std::sqrt(distanceX * distanceX + distanceY * distanceY)));
+			}
+
+			if (lod != section.Lod)
+			{
+				section.Lod = lod;
+				m_Dirty[i] = 1;
+			}
+		}
+	}
+
+	std::vector<int> TerrainMeshBuilder::BuildDirtySections(ConstHeightfieldView heights, TaskControl* control)
+	{
+		Resize(heights.Width, heights.Height);
+
+		std::vector<int> dirtySections;
+		for (int i = 0; i < GetSectionCount(); ++i)
+		{
+			if (m_Dirty[i])
+				dirtySections.push_back(i);
+		}
+
+		// sections only write their own buffers and dirty flag
+		BeginWork(control, static_cast<int64_t>(dirtySections.size()));
+		ParallelFor(0, static_cast<int>(dirtySections.size()), 1, m_Settings.ThreadCount, [&](int first, int last) {
+			for (int i = first; i < last; ++i)
+			{
+				if (IsCancelled(control))
+					return;
+				int index = dirtySections[i];
+				BuildSection(m_Sections[index], heights);
+				m_Dirty[index] = 0;
+				AddProgress(control, 1);
+			}
+		});
+
+		dirtySections.erase(std::remove_if(dirtySections.begin(), dirtySections.end(), [this](int index) { return m_Dirty[index] != 0; }), dirtySections.end());
+		return dirtySections;
+	}
+
+	int TerrainMeshBuilder::GetSectionEnd(int section, int samples) const
+	{
+		return std::min(GetSectionStart(section) + m_Settings.SectionSize, samples - 1);
+	}
+
+	int TerrainMeshBuilder::GetLodForDistance(float distance) const
+	{
+		int lod = 0;
+		float range = m_Settings.LodDistance;
+		while (lod < m_Settings.LodCount - 1 && distance >= range)
+		{
+			++lod;
+			range *= 2.f;
+		}
+		return lod;
+	}
+
+	void TerrainMeshBuilder::BuildSection(TerrainMeshSection& section, ConstHeightfieldView heights) const
+	{
+		// samples used along both axes, sections at the end of the map can be smaller and always end on the last sample
+		int step = 1 << section.Lod;
+		auto collectSamples = [step](int first, int last)
+		{
+			std::vector<int> samples;
+			for (int sample = first; sample < last; sample += step)
+				samples.push_back(sample);
+			samples.push_back(last);
+			return samples;
+		};
+		std::vector<int> columns = collectSamples(GetSectionStart(section.X), GetSectionEnd(section.X, heights.Width));
+		std::vector<int> rows = collectSamples(GetSectionStart(section.Y), GetSectionEnd(section.Y, heights.Height));
+		int columnCount = static_cast<int>(columns.size());
+		int rowCount = static_cast<int>(rows.size());
+
+		// edge vertices in a loop around the section, along +x, +y, -x and -y
+		std::vector<int32_t> edge;
+		for (int i = 0; i < columnCount - 1; ++i)
+			edge.push_back(i);
+		for (int i = 0; i < rowCount - 1; ++i)
+			edge.push_back(columnCount - 1 + i * columnCount);
+		for (int i = columnCount - 1; i > 0; --i)
+			edge.push_back(i + (rowCount - 1) * columnCount);
+		for (int i = rowCount - 1; i > 0; --i)
+			edge.push_back(i * columnCount);
+
+		section.Vertices.resize(static_cast<size_t>(columnCount) * rowCount + edge.size());
+		section.Indices.clear();
+		section.Indices.reserve(static_cast<size_t>(columnCount - 1) * (rowCount - 1) * 6 + edge.size() * 6);
+
+		// normals use the full detail heights, so neighboring sections of different detail shade the same
+		float inverseU = heights.Width > 1 ? 1.f / (heights.Width - 1) : 0.f;
+		float inverseV = heights.Height > 1 ? 1.f / (heights.Height - 1) : 0.f;
+		float slopeScale = m_Settings.HeightScale / m_Settings.CellSize;
+		for (int row = 0; row < rowCount; ++row)
+		{
+			int y = rows[row];
+			int up = std::max(y - 1, 0);
+			int down = std::min(y + 1, heights.Height - 1);
+			for (int column = 0; column < columnCount; ++column)
+			{
+				int x = columns[column];
+				int left = std::max(x - 1, 0);
+				int right = std::min(x + 1, heights.Width - 1);
+				float slopeX = (heights.At(right, y) - heights.At(left, y)) / static_cast<float>(std::max(right - left, 1)) * slopeScale;
+				float slopeY = (heights.At(x, down) - heights.At(x, up)) / static_cast<float>(std::max(down - up, 1)) * slopeScale;
+				float normalScale = 1.f / std::sqrt(slopeX * slopeX + slopeY * slopeY + 1.f);
+
+				auto& vertex = section.Vertices[column + row * columnCount];
+				vertex.X = x * m_Settings.CellSize;
+				vertex.Y = y * m_Settings.CellSize;
+				vertex.Z = heights.At(x, y) * m_Settings.HeightScale;
+				vertex.NormalX = -slopeX * normalScale;
+				vertex.NormalY = -slopeY * normalScale;
+				vertex.NormalZ = normalScale;
+				vertex.U = x * inverseU;
+				vertex.V = y * inverseV;
+			}
+		}
+
+		for (int row = 0; row + 1 < rowCount; ++row)
+		{
+			for (int column = 0; column + 1 < columnCount; ++column)
+			{
+				int32_t i = column + row * columnCount;
+				section.Indices.insert(section.Indices.end(), { i, i + 1, i + columnCount, i + 1, i + columnCount + 1, i + columnCount });
+			}
+		}
+
+		// skirts hang down from the edge, the cracks to sections of other detail levels get covered by them
+		int32_t skirtStart = columnCount * rowCount;
+		int32_t edgeCount = static_cast<int32_t>(edge.size());
+		for (int32_t i = 0; i < edgeCount; ++i)
+		{
+			auto& skirt = section.Vertices[skirtStart + i];
+			skirt = section.Vertices[edge[i]];
+			skirt.Z -= m_Settings.SkirtDepth;
+
+			int32_t next = (i + 1) % edgeCount;
+			section.Indices.insert(section.Indices.end(), { edge[i], skirtStart + i, edge[next], edge[next], skirtStart + i, skirtStart + next });
+		}
+		++section.Revision;
+	}
+}
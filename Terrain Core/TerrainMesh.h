@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Heightfield.h"
+#include "TaskControl.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace TerrainCore
+{
+	//variables that influence the terrain mesh
+	struct TerrainMeshSettings
+	{
+		// quads per section edge at full detail, rounded up to a power of 2
+		int SectionSize{ 64 };
+		// amount of detail levels, every level halves the vertices per section edge
+		int LodCount{ 4 };
+		// distance in samples up to which sections keep full detail, the range of every further level doubles
+		float LodDistance{ 128.f };
+		// units between two samples and units of a height of 1
+		float CellSize{ 1.f };
+		float HeightScale{ 1.f };
+		// how far the skirts reach below the section edges, they hide the cracks between sections of different detail
+		float SkirtDepth{ 1.f };
+		// threads used to build the sections, 0 uses every core
+		int ThreadCount{ 0 };
+	};
+
+	// position of a viewer in sample space
+	struct MeshViewer
+	{
+		float X{ 0.f };
+		float Y{ 0.f };
+	};
+
+	struct TerrainMeshVertex
+	{
+		float X;
+		float Y;
+		float Z;
+		float NormalX;
+		float NormalY;
+		float NormalZ;
+		float U;
+		float V;
+	};
+
+	// Vertices and triangles of one section. The grid comes first, followed by one skirt vertex below every edge vertex.
+	// Triangles are clockwise seen from above
+	struct TerrainMeshSection
+	{
+		// position in the section grid
+		int X{ 0 };
+		int Y{ 0 };
+		int Lod{ 0 };
+		std::vector<TerrainMeshVertex> Vertices;
+		std::vector<int32_t> Indices;
+		// grows with every rebuild
+		uint32_t Revision{ 0 };
+	};
+
+	// Splits a heightmap into square mesh sections with a detail level per section. Sections only get rebuilt when
+	// their heights or their detail level changed, dirty sections are built in parallel.
+	class TerrainMeshBuilder
+	{
+	public:
+		explicit TerrainMeshBuilder(const TerrainMeshSettings& settings);
+
+		// sets the size of the map the sections cover, every section becomes dirty when the size changes
+		void Resize(int width, int height);
+
+		// marks the sections using samples of a rectangle for a rebuild, normals also read the neighboring samples
+		void MarkDirty(int x, int y, int width, int height);
+		void MarkAllDirty();
+		bool HasDirtySections() const;
+
+		// picks the detail level of every section by its distance to the closest viewer, sections whose level changed
+		// become dirty. Without viewers every section gets full detail
+		void UpdateLods(const std::vector<MeshViewer>& viewers);
+
+		// Rebuilds the dirty sections from the heights and returns their indices, the builder gets resized first if the
+		// heights have another size. Sections skipped because of a cancellation stay dirty
+		std::vector<int> BuildDirtySections(ConstHeightfieldView heights, TaskControl* control = nullptr);
+
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+		int GetSectionCount() const { return static_cast<int>(m_Sections.size()); }
+		int GetSectionCountX() const { return m_SectionCountX; }
+		int GetSectionCountY() const { return m_SectionCountY; }
+		const TerrainMeshSection& GetSection(int index) const { return m_Sections[index]; }
+		const TerrainMeshSettings& GetSettings() const { return m_Settings; }
+
+	private:
+		// first and last sample of a section along one axis, neighboring sections share their edge samples
+		int GetSectionStart(int section) const { return section * m_Settings.SectionSize; }
+		int GetSectionEnd(int section, int samples) const;
+		int GetLodForDistance(float distance) const;
+		void BuildSection(TerrainMeshSection& section, ConstHeightfieldView heights) const;
+
+		TerrainMeshSettings m_Settings;
+		int m_Width{ 0 };
+		int m_Height{ 0 };
+		int m_SectionCountX{ 0 };
+		int m_SectionCountY{ 0 };
+		std::vector<TerrainMeshSection> m_Sections;
+		// one flag per section, written by the build tasks of their own section only
+		std::vector<uint8_t> m_Dirty;
+	};
+}
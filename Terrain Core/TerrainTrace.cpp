@@ -0,0 +1,127 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainTrace.h"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+
+namespace TerrainCore
+{
+	namespace
+	{
+		using TraceClock = std::chrono::steady_clock;
+
+		std::atomic<void (*)(const char*)> TraceBeginHook{ nullptr };
+		std::atomic<void (*)()> TraceEndHook{ nullptr };
+
+		// events of the running recording, scopes of all threads end up here
+		std::atomic<bool> TraceIsRecording{ false };
+		std::mutex TraceMutex;
+		std::vector<TraceEvent> TraceEvents;
+		TraceClock::time_point TraceRecordingStart;
+
+		std::atomic<int> TraceThreadCount{ 0 };
+
+		int GetTraceThread()
+		{
+			thread_local int thread = TraceThreadCount.fetch_add(1, std::memory_order_relaxed);
+			return thread;
+		}
+
+		double ToTraceMicroseconds(TraceClock::duration duration)
+		{
+			return std::chrono::duration<double, std::micro>(duration).count();
+		}
+	}
+
+	void SetTraceHooks(const TraceHooks& hooks)
+	{
+		// a scope that already began keeps the end hook it saw
+		bool isComplete = hooks.BeginScope && hooks.EndScope;
+		TraceEndHook.store(isComplete ? hooks.EndScope : nullptr, std::memory_order_relaxed);
+		TraceBeginHook.store(isComplete ? hooks.BeginScope : nullptr, std::memory_order_release);
+	}
+
+	void StartTraceRecording()
+	{
+		std::lock_guard<std::mutex> lock(TraceMutex);
+		TraceEvents.clear();
+		TraceRecordingStart = TraceClock::now();
+		TraceIsRecording.store(true, std::memory_order_release);
+	}
+
+	std::vector<TraceEvent> StopTraceRecording()
+	{
+		std::lock_guard<std::mutex> lock(TraceMutex);
+		TraceIsRecording.store(false, std::memory_order_relaxed);
+		std::vector<TraceEvent> events;
+		events.swap(TraceEvents);
+		return events;
+	}
+
+	bool IsTraceRecording()
+	{
+		return TraceIsRecording.load(std::memory_order_relaxed);
+	}
+
+	bool WriteTraceCsv(const std::string& path, const std::vector<TraceEvent>& events)
+	{
+		FILE* file = std::fopen(path.c_str(), "w");
+		if (!file)
+			return false;
+
+		std::fprintf(file, "name,thread,start_us,duration_us\n");
+		for (const TraceEvent& event : events)
+			std::fprintf(file, "%s,%d,%.3f,%.3f\n", event.Name, event.Thread, event.Start, event.Duration);
+		return std::fclose(file) == 0;
+	}
+
+	bool WriteTraceJson(const std::string& path, const std::vector<TraceEvent>& events)
+	{
+		FILE* file = std::fopen(path.c_str(), "w");
+		if (!file)
+			return false;
+
+		// complete events, the names are identifiers that need no escaping
+		std::fprintf(file, "{\"traceEvents\": [");
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			const TraceEvent& event = events[i];
+			std::fprintf(file, "%s\n\t{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", i > 0 ? "," : "", event.Name, event.Thread, event.Start, event.Duration);
+		}
+		std::fprintf(file, "\n]}\n");
+		return std::fclose(file) == 0;
+	}
+
+	TraceScope::TraceScope(const char* name)
+		: m_Name(name)
+	{
+		if (auto beginScope = TraceBeginHook.load(std::memory_order_acquire))
+		{
+			m_EndScope = TraceEndHook.load(std::memory_order_relaxed);
+			beginScope(name);
+		}
+		m_IsRecorded = IsTraceRecording();
+		if (m_IsRecorded)
+			m_Start = TraceClock::now();
+	}
+
+	TraceScope::~TraceScope()
+	{
+		if (m_EndScope)
+			m_EndScope();
+		if (!m_IsRecorded)
+			return;
+
+		TraceClock::time_point end = TraceClock::now();
+		int thread = GetTraceThread();
+		std::lock_guard<std::mutex> lock(TraceMutex);
+
+		// scopes that began before the recording got restarted belong to the last one
+		if (!IsTraceRecording() || m_Start < TraceRecordingStart)
+			return;
+		TraceEvents.push_back({ m_Name, thread, ToTraceMicroseconds(m_Start - TraceRecordingStart), ToTraceMicroseconds(end - m_Start) });
+	}
+}
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace TerrainCore
+{
+	// a finished trace scope, times in microseconds since the recording started
+	struct TraceEvent
+	{
+		const char* Name{ nullptr };
+		// small number per thread, in the order the threads recorded their first scope
+		int Thread{ 0 };
+		double Start{ 0.0 };
+		double Duration{ 0.0 };
+	};
+
+	// Functions that forward the scopes to an external profiler, the engine plugs in its cpu profiler so the phases show
+	// up in Unreal Insights. Both are called on the thread of the scope
+	struct TraceHooks
+	{
+		void (*BeginScope)(const char* name){ nullptr };
+		void (*EndScope)(){ nullptr };
+	};
+	// empty hooks turn forwarding off
+	void SetTraceHooks(const TraceHooks& hooks);
+
+	// Keeps every scope that ends while recording, for runs without a profiler. Starting drops the events of the last
+	// recording, stopping hands them over in the order the scopes ended
+	void StartTraceRecording();
+	std::vector<TraceEvent> StopTraceRecording();
+	bool IsTraceRecording();
+
+	// one line per event with name, thread, start and duration
+	bool WriteTraceCsv(const std::string& path, const std::vector<TraceEvent>& events);
+	// chrome trace event format, opens in chrome://tracing and Perfetto
+	bool WriteTraceJson(const std::string& path, const std::vector<TraceEvent>& events);
+
+	// Marks a phase of a run from construction to destruction. The name has to outlive the scope, phases are named
+	// after the class and the phase like "ThermalErosion.Sort". Without hooks and recording a scope only costs two
+	// atomic loads, so scopes mark phases and not single drops or cells
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char* name);
+		~TraceScope();
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		const char* m_Name;
+		void (*m_EndScope)(){ nullptr };
+		bool m_IsRecorded{ false };
+		std::chrono::steady_clock::time_point m_Start;
+	};
+}
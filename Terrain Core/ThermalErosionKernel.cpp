@@ -0,0 +1,492 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ThermalErosionKernel.h"
+#include "HeightQuantization.h"
+#include "Parallel.h"
+#include "SimdKernels.h"
+#include "TerrainTrace.h"
+#include "TimeBudget.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace TerrainCore
+{
+	namespace
+	{
+		// rows every task of the dense passes handles
+		constexpr int ThermalRowsPerTask = 16;
+		// active cells every task of the sparse passes handles
+		constexpr int ThermalCellsPerTask = 4096;
+		// the active set mode runs a dense pass while more than 1 / ThermalDenseFraction of the cells are active
+		constexpr size_t ThermalDenseFraction = 16;
+		// mark of the padding cells, never used as iteration mark
+		constexpr uint32_t ThermalApronMark = std::numeric_limits<uint32_t>::max();
+
+		// index of a map cell in the padded buffers
+		size_t PaddedCellIndex(int paddedStride, int x, int y)
+		{
+			return static_cast<size_t>(y + 1) * paddedStride + x + 1;
+		}
+	}
+
+	void ThermalErosion::ErodeTerrain(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control)
+	{
+		// the progressive run shares the buffers and ends here
+		m_ProgressiveMap = {};
+		m_ProgressiveQuantizedMap = {};
+		m_IterationsRun = 0;
+		m_DirtyTiles.Reset(map.Width, map.Height);
+		m_Stats = {};
+		if (map.IsEmpty())
+			return;
+
+		BeginWork(control, settings.IterateAmount);
+		RunIterations(map, settings, control);
+	}
+
+	void ThermalErosion::ErodeTerrain(QuantizedHeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control)
+	{
+		m_ProgressiveMap = {};
+		m_ProgressiveQuantizedMap = {};
+		m_IterationsRun = 0;
+		m_DirtyTiles.Reset(map.Width, map.Height);
+		if (map.IsEmpty())
+			return;
+
+		// Rounding after every iteration would add up over the iterations, so the map only gets rounded once. The tiles
+		// marked on the float copy can be a few more than the ones whose steps changed
+		m_DequantizedMap.Resize(map.Width, map.Height);
+		DequantizeHeightfield(map, m_DequantizedMap.GetView());
+		ErodeTerrain(m_DequantizedMap.GetView(), settings, control);
+		QuantizeHeightfield(m_DequantizedMap.GetView(), map);
+	}
+
+	void ThermalErosion::BeginProgressive(HeightfieldView map, const ThermalErosionSettings& settings)
+	{
+		m_ProgressiveMap = map;
+		m_ProgressiveQuantizedMap = {};
+		m_ProgressiveSettings = settings;
+		m_ProgressiveDone = 0;
+		m_IterationsRun = 0;
+		m_DirtyTiles.Reset(map.Width, map.Height);
+		m_Stats = {};
+	}
+
+	void ThermalErosion::BeginProgressive(QuantizedHeightfieldView map, const ThermalErosionSettings& settings)
+	{
+		m_ProgressiveMap = {};
+		m_ProgressiveQuantizedMap = {};
+		m_ProgressiveSettings = settings;
+		m_ProgressiveDone = 0;
+		m_IterationsRun = 0;
+		m_DirtyTiles.Reset(map.Width, map.Height);
+		m_Stats = {};
+		if (map.IsEmpty())
+			return;
+
+		// rounding after every call would add up like rounding after every iteration
+		m_DequantizedMap.Resize(map.Width, map.Height);
+		DequantizeHeightfield(map, m_DequantizedMap.GetView());
+		m_ProgressiveMap = m_DequantizedMap.GetView();
+		m_ProgressiveQuantizedMap = map;
+	}
+
+	bool ThermalErosion::AdvanceProgressive(double budgetMilliseconds)
+	{
+		if (IsProgressiveFinished())
+			return true;
+
+		// every chunk pays for copying the map into the buffers of the mode and back
+		int remaining = m_ProgressiveSettings.IterateAmount - m_ProgressiveDone;
+		int iterationsRun = RunWithinBudget(budgetMilliseconds, remaining, [this](int count)
+		{
+			ThermalErosionSettings settings = m_ProgressiveSettings;
+			settings.IterateAmount = count;
+			RunIterations(m_ProgressiveMap, settings, nullptr);
+			m_ProgressiveDone += m_IterationsRun;
+
+			// the active set mode stops early once nothing moves anymore
+			if (m_IterationsRun < count)
+				m_ProgressiveDone = m_ProgressiveSettings.IterateAmount;
+			return m_IterationsRun;
+		});
+		m_IterationsRun = iterationsRun;
+
+		if (!m_ProgressiveQuantizedMap.IsEmpty())
+			QuantizeHeightfield(m_ProgressiveMap, m_ProgressiveQuantizedMap);
+		return IsProgressiveFinished();
+	}
+
+	bool ThermalErosion::IsProgressiveFinished() const
+	{
+		return m_ProgressiveMap.IsEmpty() || m_ProgressiveDone >= m_ProgressiveSettings.IterateAmount;
+	}
+
+	float ThermalErosion::GetProgressiveProgress() const
+	{
+		if (IsProgressiveFinished())
+			return 1.f;
+		return static_cast<float>(m_ProgressiveDone) / static_cast<float>(m_ProgressiveSettings.IterateAmount);
+	}
+
+	void ThermalErosion::RunIterations(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control)
+	{
+		if (settings.Mode == ThermalErosionMode::Jacobi)
+			ErodeJacobi(map, settings, control);
+		else if (settings.Mode == ThermalErosionMode::ActiveSet)
+			ErodeActiveSet(map, settings, control);
+		else
+			ErodeSorted(map, settings, control);
+	}
+
+	void ThermalErosion::ErodeSorted(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control)
+	{
+		m_HeightmapData.Resize(map.Width, map.Height, 1);
+		m_HeightmapData.FillApron(std::numeric_limits<float>::max());
+		const float* heights = m_HeightmapData.GetPaddedView().Data;
+		int paddedStride = m_HeightmapData.GetStride();
+
+		for (m_IterationsRun = 0; m_IterationsRun < settings.IterateAmount && !IsCancelled(control); ++m_IterationsRun)
+		{
+			{
+				TraceScope sortScope("ThermalErosion.Sort");
+
+				// updates heightmapdata variable
+				m_HeightmapData.CopyFrom(map);
+
+				// sorts terrain by height
+				SortTerrainByHeight();
+			}
+
+			// loops through sorted terrain
+			TraceScope transferScope("ThermalErosion.Transfer");
+			int senders = 0;
+			for (int adjustedIdx : m_SortedTerrain)
+			{
+				// gets lowest neighbor of current cell
+				int lowestNeighbor = GetLowestNeighbor(adjustedIdx);
+
+				// escapes if lowestneighbor doesn't exist
+				if (lowestNeighbor == -1)
+					continue;
+
+				// calculates deltaheight
+				float heightDif = heights[adjustedIdx] - heights[lowestNeighbor];
+
+				// if the height difference is bigger than the max angle it erodes terrain
+				if (heightDif > settings.MaxAngle)
+				{
+					// padded indices to map cells
+					int sourceX = adjustedIdx % paddedStride - 1;
+					int sourceY = adjustedIdx / paddedStride - 1;
+					int targetX = lowestNeighbor % paddedStride - 1;
+					int targetY = lowestNeighbor / paddedStride - 1;
+
+					float sedimentToMove = heightDif * 0.1f;
+					float& source = map.At(sourceX, sourceY);
+					float& target = map.At(targetX, targetY);
+					source = std::max(source - sedimentToMove, 0.f);
+					target = std::min(target + sedimentToMove, 1.f);
+					m_DirtyTiles.MarkCell(sourceX, sourceY);
+					m_DirtyTiles.MarkCell(targetX, targetY);
+					++senders;
+					m_Stats.MovedMass += sedimentToMove;
+				}
+			}
+			m_Stats.SendingCellsPerIteration.push_back(senders);
+			AddProgress(control, 1);
+		}
+	}
+
+	void ThermalErosion::ErodeJacobi(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control)
+	{
+		PreparePaddedBuffers(map);
+
+		int current = 0;
+		for (m_IterationsRun = 0; m_IterationsRun < settings.IterateAmount && !IsCancelled(control); ++m_IterationsRun)
+		{
+			RunDensePass(map.Width, map.Height, current, settings);
+			current = 1 - current;
+			AddProgress(control, 1);
+		}
+
+		CopyPaddedToMap(map, current);
+	}
+
+	void ThermalErosion::ErodeActiveSet(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control)
+	{
+		int mapWidth = map.Width;
+		int mapHeight = map.Height;
+		size_t cellCount = map.GetSize();
+		PreparePaddedBuffers(map);
+		int paddedStride = m_Outflow.GetStride();
+
+		// the apron keeps its own mark so it never becomes active
+		m_CellMark.Resize(mapWidth, mapHeight, 1, 0u);
+		m_CellMark.FillApron(ThermalApronMark);
+		uint32_t* cellMark = m_CellMark.GetPaddedView().Data;
+		uint32_t mark = 0;
+
+		const SimdKernelTable& kernels = GetSimdKernels();
+		const int neighborOffsets[4] = { paddedStride, -1, 1, -paddedStride };
+		float* outflow = m_Outflow.GetPaddedView().Data;
+		int32_t* direction = m_OutflowDirection.GetPaddedView().Data;
+
+		// a cell that sends material and its target change this iteration
+		auto addChangedCells = [&](int idx)
+		{
+			const int changedByTransfer[2] = { idx, idx + neighborOffsets[direction[idx]] };
+			for (int changedIdx : changedByTransfer)
+			{
+				if (cellMark[changedIdx] == mark)
+					continue;
+				cellMark[changedIdx] = mark;
+				m_ChangedCells.push_back(changedIdx);
+			}
+		};
+
+		// every cell is active in the first iteration, while large parts of the map are active the dense jacobi pass
+		// is cheaper than the worklist
+		bool isDense = true;
+		m_ActiveCells.clear();
+		int current = 0;
+		m_IterationsRun = 0;
+		while (m_IterationsRun < settings.IterateAmount && (isDense || !m_ActiveCells.empty()) && !IsCancelled(control))
+		{
+			++m_IterationsRun;
+			AddProgress(control, 1);
+			float* heights = m_PaddedHeights[current].GetPaddedView().Data;
+			double movedMass = 0.0;
+			bool isNextDense = false;
+			++mark;
+			m_ChangedCells.clear();
+
+			if (isDense)
+			{
+				movedMass = RunDensePass(mapWidth, mapHeight, current, settings);
+				current = 1 - current;
+				size_t senderCount = m_Stats.SendingCellsPerIteration.back();
+
+				// the worklist is only built once it gets small enough
+				isNextDense = senderCount * ThermalDenseFraction >= cellCount;
+				if (!isNextDense)
+				{
+					for (int y = 0; y < mapHeight; ++y)
+					{
+						int rowStart = static_cast<int>(PaddedCellIndex(paddedStride, 0, y));
+						for (int x = 0; x < mapWidth; ++x)
+						{
+							if (outflow[rowStart + x] > 0.f)
+								addChangedCells(rowStart + x);
+						}
+					}
+				}
+			}
+			else
+			{
+				// Cells outside the active set didn't change and neither did their neighbors, so their outflow is still
+				// the 0 computed when they were last active
+				TraceScope outflowScope("ThermalErosion.Outflow");
+				int activeCount = static_cast<int>(m_ActiveCells.size());
+				ParallelFor(0, activeCount, ThermalCellsPerTask, settings.ThreadCount, [&](int cellBegin, int cellEnd)
+				{
+					for (int k = cellBegin; k < cellEnd; ++k)
+					{
+						int idx = m_ActiveCells[k];
+						kernels.ThermalOutflow(heights + idx, paddedStride, settings.MaxAngle, outflow + idx, direction + idx, 1);
+					}
+				});
+
+				int senders = 0;
+				for (int idx : m_ActiveCells)
+				{
+					if (outflow[idx] > 0.f)
+					{
+						movedMass += outflow[idx];
+						addChangedCells(idx);
+						++senders;
+					}
+				}
+				m_Stats.SendingCellsPerIteration.push_back(senders);
+				m_Stats.MovedMass += movedMass;
+
+				// new heights are computed from the old ones before any of them gets written
+				TraceScope transferScope("ThermalErosion.Transfer");
+				int changedCount = static_cast<int>(m_ChangedCells.size());
+				m_ChangedHeights.resize(changedCount);
+				ParallelFor(0, changedCount, ThermalCellsPerTask, settings.ThreadCount, [&](int cellBegin, int cellEnd)
+				{
+					for (int k = cellBegin; k < cellEnd; ++k)
+					{
+						int idx = m_ChangedCells[k];
+						kernels.ThermalApply(heights + idx, outflow + idx, direction + idx, paddedStride, &m_ChangedHeights[k], 1);
+					}
+				});
+				for (int k = 0; k < changedCount; ++k)
+					heights[m_ChangedCells[k]] = m_ChangedHeights[k];
+
+				isNextDense = m_ChangedCells.size() * ThermalDenseFraction >= cellCount;
+			}
+
+			// converged
+			if (movedMass <= settings.Tolerance)
+				break;
+
+			// the next iteration only looks at the changed cells and their neighbors
+			isDense = isNextDense;
+			m_ActiveCells.clear();
+			if (isDense)
+				continue;
+
+			++mark;
+			for (int changedIdx : m_ChangedCells)
+			{
+				const int cellsToActivate[5] = { changedIdx, changedIdx + neighborOffsets[0], changedIdx + neighborOffsets[1], changedIdx + neighborOffsets[2], changedIdx + neighborOffsets[3] };
+				for (int idx : cellsToActivate)
+				{
+					if (cellMark[idx] == mark || cellMark[idx] == ThermalApronMark)
+						continue;
+					cellMark[idx] = mark;
+					m_ActiveCells.push_back(idx);
+				}
+			}
+			if (m_ActiveCells.size() * ThermalDenseFraction >= cellCount)
+				isDense = true;
+		}
+
+		// iterations skipped after converging count as done
+		if (!IsCancelled(control))
+			AddProgress(control, settings.IterateAmount - m_IterationsRun);
+		CopyPaddedToMap(map, current);
+	}
+
+	void ThermalErosion::PreparePaddedBuffers(ConstHeightfieldView map)
+	{
+		// the padding of the heights is never lower than a cell and the padding of the outflow never sends anything
+		for (auto& heights : m_PaddedHeights)
+			heights.Resize(map.Width, map.Height, 1, std::numeric_limits<float>::max());
+		m_Outflow.Resize(map.Width, map.Height, 1, 0.f);
+		m_OutflowDirection.Resize(map.Width, map.Height, 1, ThermalNone);
+		m_PaddedHeights[0].CopyFrom(map);
+	}
+
+	double ThermalErosion::RunDensePass(int mapWidth, int mapHeight, int current, const ThermalErosionSettings& settings)
+	{
+		const SimdKernelTable& kernels = GetSimdKernels();
+		int paddedStride = m_Outflow.GetStride();
+		const float* heights = m_PaddedHeights[current].GetPaddedView().Data;
+		float* result = m_PaddedHeights[1 - current].GetPaddedView().Data;
+		float* outflow = m_Outflow.GetPaddedView().Data;
+		int32_t* direction = m_OutflowDirection.GetPaddedView().Data;
+
+		// every cell decides how much it loses before any cell adds up what it receives
+		m_RowSenders.resize(mapHeight);
+		m_RowOutflow.resize(mapHeight);
+		{
+			TraceScope outflowScope("ThermalErosion.Outflow");
+			ParallelFor(0, mapHeight, ThermalRowsPerTask, settings.ThreadCount, [&](int rowBegin, int rowEnd)
+			{
+				for (int y = rowBegin; y < rowEnd; ++y)
+				{
+					size_t idx = PaddedCellIndex(paddedStride, 0, y);
+					kernels.ThermalOutflow(heights + idx, paddedStride, settings.MaxAngle, outflow + idx, direction + idx, mapWidth);
+
+					// cells that don't send material have an outflow of 0, so the sums don't need a branch
+					float rowOutflow = 0.f;
+					int rowSenders = 0;
+					for (int x = 0; x < mapWidth; ++x)
+					{
+						rowOutflow += outflow[idx + x];
+						rowSenders += outflow[idx + x] > 0.f;
+					}
+					m_RowOutflow[y] = rowOutflow;
+					m_RowSenders[y] = rowSenders;
+				}
+			});
+		}
+
+		TraceScope transferScope("ThermalErosion.Transfer");
+		ParallelFor(0, mapHeight, ThermalRowsPerTask, settings.ThreadCount, [&](int rowBegin, int rowEnd)
+		{
+			for (int y = rowBegin; y < rowEnd; ++y)
+			{
+				size_t idx = PaddedCellIndex(paddedStride, 0, y);
+				kernels.ThermalApply(heights + idx, outflow + idx, direction + idx, paddedStride, result + idx, mapWidth);
+			}
+		});
+
+		double movedMass = 0.0;
+		int senders = 0;
+		for (int y = 0; y < mapHeight; ++y)
+		{
+			movedMass += m_RowOutflow[y];
+			senders += m_RowSenders[y];
+		}
+		m_Stats.SendingCellsPerIteration.push_back(senders);
+		m_Stats.MovedMass += movedMass;
+		return movedMass;
+	}
+
+	void ThermalErosion::CopyPaddedToMap(HeightfieldView map, int current)
+	{
+		for (int y = 0; y < map.Height; ++y)
+		{
+			const float* row = m_PaddedHeights[current].GetView().Row(y);
+			float* mapRow = map.Row(y);
+
+			// a tile only needs one changed cell, the rest of it is skipped
+			int tileSize = m_DirtyTiles.GetTileSize();
+			for (int tileX = 0; tileX * tileSize < map.Width; ++tileX)
+			{
+				if (m_DirtyTiles.IsTileDirty(tileX, y / tileSize))
+					continue;
+				int first = tileX * tileSize;
+				int last = std::min(first + tileSize, map.Width);
+				if (!std::equal(row + first, row + last, mapRow + first))
+					m_DirtyTiles.MarkCell(first, y);
+			}
+			std::copy(row, row + map.Width, mapRow);
+		}
+	}
+
+	int ThermalErosion::GetLowestNeighbor(int currentIndex) const
+	{
+		// sets default idx
+		int idx = -1;
+		const float* heights = m_HeightmapData.GetPaddedView().Data;
+		int paddedStride = m_HeightmapData.GetStride();
+		float lowestPoint = heights[currentIndex];
+
+		// south, west, east and north neighbor, the apron is never lower
+		const int indexesToCheck[4] = { currentIndex + paddedStride, currentIndex - 1, currentIndex + 1, currentIndex - paddedStride };
+		for (int currIdx : indexesToCheck)
+		{
+			if (heights[currIdx] < lowestPoint)
+			{
+				idx = currIdx;
+				lowestPoint = heights[currIdx];
+			}
+		}
+
+		return idx;
+	}
+
+	void ThermalErosion::SortTerrainByHeight()
+	{
+		// cells in row order, so equally high cells start out in the same order as in a packed map
+		int paddedStride = m_HeightmapData.GetStride();
+		m_SortedTerrain.clear();
+		for (int y = 0; y < m_HeightmapData.GetHeight(); ++y)
+		{
+			for (int x = 0; x < m_HeightmapData.GetWidth(); ++x)
+				m_SortedTerrain.push_back(static_cast<int>(PaddedCellIndex(paddedStride, x, y)));
+		}
+
+		const float* heights = m_HeightmapData.GetPaddedView().Data;
+		std::sort(m_SortedTerrain.begin(), m_SortedTerrain.end(), [heights](int a, int b) {
+			return heights[a] < heights[b];
+		});
+	}
+}
@@ -0,0 +1,137 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "DirtyTiles.h"
+#include "Heightfield.h"
+#include "TaskControl.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace TerrainCore
+{
+	// how the cells of an iteration get updated
+	enum class ThermalErosionMode
+	{
+		// cells are visited from low to high and move material right away, the original behaviour
+		Sorted,
+		// every cell reads the heights of the previous iteration and the transfers are applied all at once, rows run
+		// with simd on every core
+		Jacobi,
+		// same result as jacobi but only revisits cells that changed or have a neighbor that changed, stops once
+		// nothing moves anymore
+		ActiveSet,
+	};
+
+	//variables that influence thermal erosion
+	struct ThermalErosionSettings
+	{
+		float MaxAngle{ .1f };
+		int IterateAmount{ 500 };
+		ThermalErosionMode Mode{ ThermalErosionMode::Sorted };
+		// threads used by the jacobi and active set mode, 0 uses every core
+		int ThreadCount{ 0 };
+		// the active set mode stops once an iteration moves this much material or less in total
+		float Tolerance{ 0.f };
+	};
+
+	// counters of the last thermal run
+	struct ThermalErosionStats
+	{
+		// Cells that sent material to a neighbor in every iteration, each of them and its target changed. Iterations of
+		// the active set mode only count their active cells
+		std::vector<int> SendingCellsPerIteration;
+		// material moved between cells over all iterations
+		double MovedMass{ 0.0 };
+	};
+
+	// Thermal erosion, moves material from cells that are steeper than the max angle to their lowest neighbor
+	class ThermalErosion
+	{
+	public:
+		// erodes the map in place, progress is counted in iterations. A cancelled run still leaves a consistent map with
+		// the iterations finished so far
+		void ErodeTerrain(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control = nullptr);
+		// Erodes a quantized map, the iterations run on a float copy that gets rounded back once at the end. The
+		// result is within half a step of eroding the dequantized map.
+		void ErodeTerrain(QuantizedHeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control = nullptr);
+
+		// Progressive runs spread the iterate amount over many calls, for example one per frame. The map has to stay alive
+		// and untouched by others until the run finishes, ErodeTerrain ends it. Quantized maps are eroded on a float
+		// copy that gets rounded into the map after every call.
+		void BeginProgressive(HeightfieldView map, const ThermalErosionSettings& settings);
+		void BeginProgressive(QuantizedHeightfieldView map, const ThermalErosionSettings& settings);
+		// Continues the progressive run for about the budget in milliseconds and at least one iteration. Returns true
+		// once the iterate amount is done or the active set mode found nothing left to move
+		bool AdvanceProgressive(double budgetMilliseconds);
+		bool IsProgressiveFinished() const;
+		// done iterations of the progressive run in the 0 1 range
+		float GetProgressiveProgress() const;
+
+		// iterations the last call ran, the active set mode can stop before the iterate amount
+		int GetIterationsRun() const { return m_IterationsRun; }
+		// Tiles of the map the last call changed, only cells whose height differs at the end count. Progressive runs
+		// keep adding to them until they get cleared
+		const DirtyTileMask& GetDirtyTiles() const { return m_DirtyTiles; }
+		void ClearDirtyTiles() { m_DirtyTiles.Clear(); }
+
+		// counters of the last call, progressive runs keep adding to them since BeginProgressive
+		const ThermalErosionStats& GetStats() const { return m_Stats; }
+
+	private:
+		// runs the iterations of the mode without resetting the dirty tiles
+		void RunIterations(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control);
+		void ErodeSorted(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control);
+		// Double buffered version, every iteration computes the outflow of all cells from one buffer and writes the
+		// new heights to the other. Cells outside the map are never lower so material stays on the map.
+		void ErodeJacobi(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control);
+		// Keeps a worklist of the cells that changed last iteration and their neighbors, only those can start or stop
+		// sending material. Runs the dense jacobi pass while the worklist covers a large part of the map.
+		void ErodeActiveSet(HeightfieldView map, const ThermalErosionSettings& settings, TaskControl* control);
+
+		// helpers of the jacobi and active set mode
+		void PreparePaddedBuffers(ConstHeightfieldView map);
+		// runs a jacobi iteration and counts it, returns the material it moved
+		double RunDensePass(int mapWidth, int mapHeight, int current, const ThermalErosionSettings& settings);
+		// writes the heights back and marks the tiles of the cells whose height changed
+		void CopyPaddedToMap(HeightfieldView map, int current);
+
+		// helper function that gets lowest neighbor in the snapshot, -1 if no neighbor is lower
+		int GetLowestNeighbor(int currentIndex) const;
+		// helper function that fills the visiting order sorted by height
+		void SortTerrainByHeight();
+
+		// Heights at the start of the current iteration and the visiting order, indices into the padded snapshot. The
+		// apron is higher than any cell, so the edge cells never pick a neighbor outside the map or in another row
+		PaddedHeightfield m_HeightmapData;
+		// float copy of a quantized map
+		Heightfield m_DequantizedMap;
+		std::vector<int> m_SortedTerrain;
+
+		// buffers of the jacobi mode, padded with one cell on every side so the row kernels don't need edge cases. All
+		// of them share the stride, a cell has the same index into every padded view
+		PaddedHeightfield m_PaddedHeights[2];
+		PaddedHeightfield m_Outflow;
+		BasicPaddedHeightfield<int32_t> m_OutflowDirection;
+		// sending cells and outflow of every row of a dense pass, added up in row order
+		std::vector<int> m_RowSenders;
+		std::vector<float> m_RowOutflow;
+
+		// worklists of the active set mode, indices into the padded buffers
+		std::vector<int> m_ActiveCells;
+		std::vector<int> m_ChangedCells;
+		std::vector<float> m_ChangedHeights;
+		BasicPaddedHeightfield<uint32_t> m_CellMark;
+
+		DirtyTileMask m_DirtyTiles;
+		ThermalErosionStats m_Stats;
+		int m_IterationsRun{ 0 };
+
+		// state of the progressive run, the float map is the dequantized copy when a quantized map gets eroded
+		HeightfieldView m_ProgressiveMap;
+		QuantizedHeightfieldView m_ProgressiveQuantizedMap;
+		ThermalErosionSettings m_ProgressiveSettings;
+		int m_ProgressiveDone{ 0 };
+	};
+}
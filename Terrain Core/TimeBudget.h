@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+namespace TerrainCore
+{
+	// Runs work units in chunks until the budget in milliseconds is used up or no units remain, returns the units run.
+	// The first chunk is a single unit, the later ones are sized from the time the units took so far, so kernels that
+	// pay a setup cost per call don't get called for every unit. runChunk(count) returns the units it finished, fewer than
+	// asked for ends the loop. At least one unit runs even with an empty budget, so the work always moves on
+	template<typename ChunkFunction>
+	int RunWithinBudget(double budgetMilliseconds, int remainingUnits, ChunkFunction&& runChunk)
+	{
+		using Clock = std::chrono::steady_clock;
+		auto start = Clock::now();
+		int done = 0;
+		int chunk = 1;
+		while (chunk > 0 && remainingUnits > 0)
+		{
+			chunk = std::min(chunk, remainingUnits);
+			int finished = runChunk(chunk);
+			done += finished;
+			remainingUnits -= finished;
+			if (finished < chunk)
+				break;
+
+			// chunks grow at most fourfold, a few fast units at the start don't decide the size of a long chunk
+			double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			double fitting = elapsed > 0. ? (budgetMilliseconds - elapsed) * done / elapsed : remainingUnits;
+			chunk = static_cast<int>(std::min(fitting, done * 4.));
+		}
+		return done;
+	}
+}
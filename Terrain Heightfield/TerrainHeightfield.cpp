@@ -0,0 +1,380 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainHeightfield.h"
+#include "../Terrain Core/HeightQuantization.h"
+#include "../Terrain Core/TerrainTrace.h"
+#include "Engine/Texture2D.h"
+#include "Components/PrimitiveComponent.h"
+#include "Materials/MaterialInstanceDynamic.h"
+
+// core format of a texture format
+static TerrainCore::HeightTextureFormat ToCoreFormat(EHeightTextureFormat format)
+{
+	return format == EHeightTextureFormat::R32F ? TerrainCore::HeightTextureFormat::R32F : TerrainCore::HeightTextureFormat::R16;
+}
+
+// single channel texture without mips or srgb, R16 is sampled as red channel
+static UTexture2D* CreateHeightTexture(int32 width, int32 height, EHeightTextureFormat format)
+{
+	auto texture = UTexture2D::CreateTransient(width, height, format == EHeightTextureFormat::R32F ? PF_R32_FLOAT : PF_G16);
+	texture->SRGB = false;
+	texture->Filter = TF_Bilinear;
+	return texture;
+}
+
+// applies the texture to the "Texture" parameter of the mesh material
+static void ApplyHeightTexture(UTexture2D* texture, UPrimitiveComponent* mesh)
+{
+	UMaterialInstanceDynamic* DynamicMaterial = mesh->CreateDynamicMaterialInstance(0, mesh->GetMaterial(0));
+	DynamicMaterial->SetTextureParameterValue("Texture", texture);
+	mesh->SetMaterial(0, DynamicMaterial);
+}
+
+// Work that converts a copy of a heightmap region, the heights can change while the worker converts. The region is
+// given in the heightmap and stays the region of the texels.
+template<typename ViewType>
+static TUniqueFunction<FHeightTexels(TerrainCore::TaskControl&)> MakeTextureRegionWork(ViewType heightmap, TerrainCore::HeightTextureRegion region, EHeightTextureFormat format)
+{
+	using SampleType = std::remove_const_t<std::remove_pointer_t<decltype(heightmap.Data)>>;
+	TerrainCore::BasicHeightfield<SampleType> snapshot(region.Width, region.Height);
+	auto regionView = heightmap.SubView(region.X, region.Y, region.Width, region.Height);
+	for (int row = 0; row < region.Height; ++row)
+		FMemory::Memcpy(&snapshot.At(0, row), regionView.Row(row), region.Width * sizeof(SampleType));
+
+	return [snapshot = MoveTemp(snapshot), region, format](TerrainCore::TaskControl&)
+	{
+		FHeightTexels texels = UTerrainHeightfield::ConvertHeightmap(snapshot.GetView(), { 0, 0, region.Width, region.Height }, format);
+		texels.Region = region;
+		return texels;
+	};
+}
+
+int32 FHeightTexels::GetPitch() const
+{
+	return Region.Width * TerrainCore::GetHeightTexelSize(ToCoreFormat(Format));
+}
+
+UTerrainHeightfield* UTerrainHeightfield::CreateTerrainHeightfield(UObject* Outer, int32 width, int32 height, EHeightfieldStorage storage)
+{
+	auto heightfield = NewObject<UTerrainHeightfield>(Outer ? Outer : GetTransientPackage());
+	heightfield->m_Storage = storage;
+	heightfield->Resize(width, height);
+	return heightfield;
+}
+
+void UTerrainHeightfield::Resize(int32 width, int32 height)
+{
+	m_Width = FMath::Max(width, 0);
+	m_Height = FMath::Max(height, 0);
+	++m_HeightsRevision;
+	m_Heights.Reset();
+	m_QuantizedHeights.Reset();
+	if (IsQuantized())
+		m_QuantizedHeights.SetNumZeroed(m_Width * m_Height);
+	else
+		m_Heights.SetNumZeroed(m_Width * m_Height);
+}
+
+float UTerrainHeightfield::GetHeightAt(int32 x, int32 y) const
+{
+	if (x < 0 || x >= m_Width || y < 0 || y >= m_Height)
+		return 0.f;
+	if (IsQuantized())
+		return TerrainCore::DequantizeHeight(m_QuantizedHeights[x + m_Width * y]);
+	return m_Heights[x + m_Width * y];
+}
+
+void UTerrainHeightfield::SetHeights(int32 width, int32 height, const TArray<float>& heights)
+{
+	if (width * height != heights.Num())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SetHeights: %d heights don't match a %dx%d heightfield"), heights.Num(), width, height);
+		return;
+	}
+	if (IsQuantized())
+	{
+		Resize(width, height);
+		TerrainCore::QuantizeHeightfield(TerrainCore::ConstHeightfieldView(heights.GetData(), width, height), GetQuantizedView());
+		return;
+	}
+	m_Width = width;
+	m_Height = height;
+	m_Heights = heights;
+	++m_HeightsRevision;
+}
+
+TArray<float> UTerrainHeightfield::GetHeights() const
+{
+	if (!IsQuantized())
+		return m_Heights;
+
+	TArray<float> heights;
+	heights.SetNumUninitialized(m_Width * m_Height);
+	TerrainCore::DequantizeHeightfield(GetQuantizedView(), TerrainCore::HeightfieldView(heights.GetData(), m_Width, m_Height));
+	return heights;
+}
+
+void UTerrainHeightfield::SetStorage(EHeightfieldStorage storage)
+{
+	if (storage == m_Storage)
+		return;
+
+	// the heights get converted into the other array, the old one is freed afterwards
+	if (storage == EHeightfieldStorage::UInt16)
+	{
+		m_QuantizedHeights.SetNumUninitialized(m_Width * m_Height);
+		TerrainCore::QuantizeHeightfield(GetView(), TerrainCore::QuantizedHeightfieldView(m_QuantizedHeights.GetData(), m_Width, m_Height));
+		m_Heights.Empty();
+	}
+	else
+	{
+		m_Heights.SetNumUninitialized(m_Width * m_Height);
+		TerrainCore::DequantizeHeightfield(GetQuantizedView(), TerrainCore::HeightfieldView(m_Heights.GetData(), m_Width, m_Height));
+		m_QuantizedHeights.Empty();
+	}
+	m_Storage = storage;
+	++m_HeightsRevision;
+}
+
+void UTerrainHeightfield::VisualizeOnMesh(UPrimitiveComponent* mesh)
+{
+	if (mesh && UpdateTexture())
+		ApplyHeightTexture(m_Texture, mesh);
+}
+
+UTexture2D* UTerrainHeightfield::UpdateTexture()
+{
+	UpdateTextureRegion(0, 0, m_Width, m_Height);
+	return m_Texture;
+}
+
+void UTerrainHeightfield::UpdateTextureRegion(int32 x, int32 y, int32 width, int32 height)
+{
+	if (!PrepareTexture())
+		return;
+	++m_HeightsRevision;
+	UploadTexels(ConvertRegion({ x, y, width, height }, m_TextureFormat));
+}
+
+void UTerrainHeightfield::UpdateTextureRegionAsync(int32 x, int32 y, int32 width, int32 height)
+{
+	UpdateTextureRegionsAsync({ FHeightfieldRegion(x, y, width, height) });
+}
+
+void UTerrainHeightfield::UpdateTextureRegions(const TArray<FHeightfieldRegion>& regions)
+{
+	if (!PrepareTexture())
+		return;
+	++m_HeightsRevision;
+	for (const FHeightfieldRegion& region : regions)
+		UploadTexels(ConvertRegion({ region.X, region.Y, region.Width, region.Height }, m_TextureFormat));
+}
+
+void UTerrainHeightfield::UpdateTextureRegionsAsync(const TArray<FHeightfieldRegion>& regions)
+{
+	if (!PrepareTexture())
+		return;
+
+	// the worker converts a copy of every region so the heights can change meanwhile
+	TArray<TUniqueFunction<FHeightTexels(TerrainCore::TaskControl&)>> regionWork;
+	for (const FHeightfieldRegion& heightfieldRegion : regions)
+	{
+		auto region = TerrainCore::ClipHeightTextureRegion({ heightfieldRegion.X, heightfieldRegion.Y, heightfieldRegion.Width, heightfieldRegion.Height }, m_Width, m_Height);
+		if (!region.IsEmpty())
+			regionWork.Add(IsQuantized() ? MakeTextureRegionWork(GetQuantizedView(), region, m_TextureFormat) : MakeTextureRegionWork(GetView(), region, m_TextureFormat));
+	}
+	if (regionWork.Num() == 0)
+		return;
+
+	auto control = RestartTerrainTask(m_AsyncTextureUpdate, nullptr);
+	auto work = [regionWork = MoveTemp(regionWork)](TerrainCore::TaskControl& taskControl) mutable
+	{
+		TArray<FHeightTexels> texels;
+		for (auto& convert : regionWork)
+			texels.Add(convert(taskControl));
+		return texels;
+	};
+
+	// The heightfield can change while converting. A new size or format recreates the texture with all heights, so
+	// the texels are dropped. Heights that were set or uploaded since the copy may be newer than the texels, those
+	// regions get converted again from the current heights
+	TWeakObjectPtr<UTerrainHeightfield> weakThis = this;
+	int32 width = m_Width;
+	int32 height = m_Height;
+	uint32 revision = m_HeightsRevision;
+	LaunchTerrainTask<TArray<FHeightTexels>>(control, MoveTemp(work), [weakThis, width, height, revision](TTerrainTaskResult<TArray<FHeightTexels>> texels)
+	{
+		if (!texels || !weakThis.IsValid() || weakThis->m_Width != width || weakThis->m_Height != height || !weakThis->PrepareTexture())
+			return;
+		bool bHeightsChanged = weakThis->m_HeightsRevision != revision;
+		for (FHeightTexels& regionTexels : *texels)
+		{
+			if (weakThis->m_TextureFormat != regionTexels.Format)
+				continue;
+			if (bHeightsChanged)
+				weakThis->UploadTexels(weakThis->ConvertRegion(regionTexels.Region, regionTexels.Format));
+			else
+				weakThis->UploadTexels(MoveTemp(regionTexels));
+		}
+	});
+}
+
+void UTerrainHeightfield::NotifyRegionsChanged(const TArray<FHeightfieldRegion>& regions, bool bAsyncTextureUpdate)
+{
+	if (regions.Num() == 0)
+		return;
+
+	// async texture updates still converting copied the heights before this change
+	++m_HeightsRevision;
+	// heightfields that were never shown don't get a texture
+	if (m_Texture)
+	{
+		if (bAsyncTextureUpdate)
+			UpdateTextureRegionsAsync(regions);
+		else
+			UpdateTextureRegions(regions);
+	}
+	m_OnRegionsChanged.Broadcast(regions);
+}
+
+bool UTerrainHeightfield::PrepareTexture()
+{
+	if (m_Width <= 0 || m_Height <= 0)
+		return false;
+
+	EPixelFormat pixelFormat = m_TextureFormat == EHeightTextureFormat::R32F ? PF_R32_FLOAT : PF_G16;
+	if (!m_Texture || m_Texture->GetSizeX() != m_Width || m_Texture->GetSizeY() != m_Height || m_Texture->GetPixelFormat() != pixelFormat)
+	{
+		// a new texture gets all heights, callers only upload their region
+		TerrainCore::TraceScope uploadScope("TerrainHeightfield.Upload");
+		m_Texture = CreateHeightTexture(m_Width, m_Height, m_TextureFormat);
+		FByteBulkData& imageData = m_Texture->PlatformData->Mips[0].BulkData;
+		FHeightTexels texels = ConvertRegion({ 0, 0, m_Width, m_Height }, m_TextureFormat);
+		FMemory::Memcpy(imageData.Lock(LOCK_READ_WRITE), texels.Data.GetData(), texels.Data.Num());
+		imageData.Unlock();
+		m_Texture->UpdateResource();
+	}
+	return true;
+}
+
+FHeightTexels UTerrainHeightfield::ConvertRegion(TerrainCore::HeightTextureRegion region, EHeightTextureFormat format) const
+{
+	if (IsQuantized())
+		return ConvertHeightmap(GetQuantizedView(), region, format);
+	return ConvertHeightmap(GetView(), region, format);
+}
+
+void UTerrainHeightfield::UploadTexels(FHeightTexels texels)
+{
+	if (texels.Region.IsEmpty())
+		return;
+
+	// region and texels stay alive until the render thread copied them
+	TerrainCore::TraceScope uploadScope("TerrainHeightfield.Upload");
+	auto region = new FUpdateTextureRegion2D(texels.Region.X, texels.Region.Y, 0, 0, texels.Region.Width, texels.Region.Height);
+	auto data = new TArray<uint8>(MoveTemp(texels.Data));
+	int32 texelSize = TerrainCore::GetHeightTexelSize(ToCoreFormat(texels.Format));
+	m_Texture->UpdateTextureRegions(0, 1, region, region->Width * texelSize, texelSize, data->GetData(), [data](uint8*, const FUpdateTextureRegion2D* uploadedRegion)
+	{
+		delete data;
+		delete uploadedRegion;
+	});
+}
+
+TerrainCore::HeightfieldView UTerrainHeightfield::GetView()
+{
+	if (IsQuantized())
+		return TerrainCore::HeightfieldView();
+	return TerrainCore::HeightfieldView(m_Heights.GetData(), m_Width, m_Height);
+}
+
+TerrainCore::ConstHeightfieldView UTerrainHeightfield::GetView() const
+{
+	if (IsQuantized())
+		return TerrainCore::ConstHeightfieldView();
+	return TerrainCore::ConstHeightfieldView(m_Heights.GetData(), m_Width, m_Height);
+}
+
+TerrainCore::QuantizedHeightfieldView UTerrainHeightfield::GetQuantizedView()
+{
+	if (!IsQuantized())
+		return TerrainCore::QuantizedHeightfieldView();
+	return TerrainCore::QuantizedHeightfieldView(m_QuantizedHeights.GetData(), m_Width, m_Height);
+}
+
+TerrainCore::ConstQuantizedHeightfieldView UTerrainHeightfield::GetQuantizedView() const
+{
+	if (!IsQuantized())
+		return TerrainCore::ConstQuantizedHeightfieldView();
+	return TerrainCore::ConstQuantizedHeightfieldView(m_QuantizedHeights.GetData(), m_Width, m_Height);
+}
+
+void UTerrainHeightfield::CopyHeightsTo(TerrainCore::Heightfield& target) const
+{
+	target.Resize(m_Width, m_Height);
+	if (IsQuantized())
+		TerrainCore::DequantizeHeightfield(GetQuantizedView(), target.GetView());
+	else if (!m_Heights.IsEmpty())
+		FMemory::Memcpy(target.GetData(), m_Heights.GetData(), m_Heights.Num() * sizeof(float));
+}
+
+void UTerrainHeightfield::VisualizeHeightmap(TerrainCore::ConstHeightfieldView heightmap, UPrimitiveComponent* mesh)
+{
+	if (!mesh || heightmap.IsEmpty())
+		return;
+
+	//Heightmap gets converted straight into the mip of a single channel texture
+	TerrainCore::TraceScope uploadScope("TerrainHeightfield.Upload");
+	auto CustomTexture = CreateHeightTexture(heightmap.Width, heightmap.Height, EHeightTextureFormat::R16);
+	FByteBulkData& ImageData = CustomTexture->PlatformData->Mips[0].BulkData;
+	int32 pitch = heightmap.Width * TerrainCore::GetHeightTexelSize(TerrainCore::HeightTextureFormat::R16);
+	TerrainCore::ConvertHeightsToTexels(heightmap, { 0, 0, heightmap.Width, heightmap.Height }, TerrainCore::HeightTextureFormat::R16, ImageData.Lock(LOCK_READ_WRITE), pitch);
+	ImageData.Unlock();
+	CustomTexture->UpdateResource();
+
+	ApplyHeightTexture(CustomTexture, mesh);
+}
+
+void UTerrainHeightfield::VisualizeTexels(const FHeightTexels& texels, UPrimitiveComponent* mesh)
+{
+	if (!mesh || texels.Region.IsEmpty())
+		return;
+
+	TerrainCore::TraceScope uploadScope("TerrainHeightfield.Upload");
+	auto CustomTexture = CreateHeightTexture(texels.Region.Width, texels.Region.Height, texels.Format);
+	FByteBulkData& ImageData = CustomTexture->PlatformData->Mips[0].BulkData;
+	FMemory::Memcpy(ImageData.Lock(LOCK_READ_WRITE), texels.Data.GetData(), texels.Data.Num());
+	ImageData.Unlock();
+	CustomTexture->UpdateResource();
+
+	ApplyHeightTexture(CustomTexture, mesh);
+}
+
+FHeightTexels UTerrainHeightfield::ConvertHeightmap(TerrainCore::ConstHeightfieldView heightmap, TerrainCore::HeightTextureRegion region, EHeightTextureFormat format)
+{
+	FHeightTexels texels;
+	texels.Region = TerrainCore::ClipHeightTextureRegion(region, heightmap.Width, heightmap.Height);
+	texels.Format = format;
+	texels.Data.SetNumUninitialized(texels.GetPitch() * texels.Region.Height);
+	TerrainCore::ConvertHeightsToTexels(heightmap, texels.Region, ToCoreFormat(format), texels.Data.GetData(), texels.GetPitch());
+	return texels;
+}
+
+FHeightTexels UTerrainHeightfield::ConvertHeightmap(TerrainCore::ConstQuantizedHeightfieldView heightmap, TerrainCore::HeightTextureRegion region, EHeightTextureFormat format)
+{
+	FHeightTexels texels;
+	texels.Region = TerrainCore::ClipHeightTextureRegion(region, heightmap.Width, heightmap.Height);
+	texels.Format = format;
+	texels.Data.SetNumUninitialized(texels.GetPitch() * texels.Region.Height);
+	TerrainCore::ConvertHeightsToTexels(heightmap, texels.Region, ToCoreFormat(format), texels.Data.GetData(), texels.GetPitch());
+	return texels;
+}
+
+TArray<FHeightfieldRegion> UTerrainHeightfield::MakeRegions(const TerrainCore::DirtyTileMask& dirtyTiles)
+{
+	TArray<FHeightfieldRegion> regions;
+	for (const auto& rect : dirtyTiles.GetDirtyRects())
+		regions.Emplace(rect.X, rect.Y, rect.Width, rect.Height);
+	return regions;
+}
@@ -0,0 +1,205 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "../Terrain Core/DirtyTiles.h"
+#include "../Terrain Core/Heightfield.h"
+#include "../Terrain Core/HeightTexture.h"
+#include "../Terrain Async/TerrainAsyncTask.h"
+#include "TerrainHeightfield.generated.h"
+
+class UPrimitiveComponent;
+class UTexture2D;
+
+//single channel format of the heightfield texture
+UENUM(BlueprintType)
+enum class EHeightTextureFormat : uint8
+{
+	// 0 1 mapped to 16 bit, steps of 1/65535
+	R16,
+	// full float precision, twice the memory of R16
+	R32F,
+};
+
+//how the heights of a heightfield are kept in memory
+UENUM(BlueprintType)
+enum class EHeightfieldStorage : uint8
+{
+	// full float precision
+	Float,
+	// 0 1 mapped to 16 bit, half the memory and within half a step of 1/65535 of the float heights
+	UInt16,
+};
+
+//rectangle of samples whose heights changed
+USTRUCT(BlueprintType)
+struct FHeightfieldRegion
+{
+	GENERATED_BODY()
+
+	FHeightfieldRegion() = default;
+	FHeightfieldRegion(int32 x, int32 y, int32 width, int32 height) : X(x), Y(y), Width(width), Height(height) {}
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 X = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 Y = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 Width = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 Height = 0;
+};
+
+// broadcast with the regions whose heights changed
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnHeightfieldRegionsChanged, const TArray<FHeightfieldRegion>&);
+
+// texels of a heightmap region ready for upload, can be converted on any thread
+struct FHeightTexels
+{
+	TerrainCore::HeightTextureRegion Region;
+	EHeightTextureFormat Format{ EHeightTextureFormat::R16 };
+	TArray<uint8> Data;
+
+	int32 GetPitch() const;
+};
+
+// Heightmap shared by the noise, erosion and box count components, every stage works on the same memory in place
+UCLASS(BlueprintType)
+class PROCEDURALTERRAIN_API UTerrainHeightfield : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// function used in blueprint to create an empty heightfield
+	UFUNCTION(BlueprintCallable, Category = "Heightfield", meta = (DefaultToSelf = "Outer"))
+	static UTerrainHeightfield* CreateTerrainHeightfield(UObject* Outer, int32 width, int32 height, EHeightfieldStorage storage = EHeightfieldStorage::Float);
+
+	// resizes the heightfield and sets every sample to 0
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void Resize(int32 width, int32 height);
+
+	UFUNCTION(BlueprintPure, Category = "Heightfield")
+	int32 GetWidth() const { return m_Width; }
+	UFUNCTION(BlueprintPure, Category = "Heightfield")
+	int32 GetHeight() const { return m_Height; }
+
+	UFUNCTION(BlueprintPure, Category = "Heightfield")
+	float GetHeightAt(int32 x, int32 y) const;
+
+	// copies heights from or to blueprint arrays, the C++ code uses the views instead. Quantized heightfields round
+	// the heights when setting and return dequantized copies.
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void SetHeights(int32 width, int32 height, const TArray<float>& heights);
+	UFUNCTION(BlueprintPure, Category = "Heightfield")
+	TArray<float> GetHeights() const;
+
+	// converts the heights to the storage, going to UInt16 rounds every height to the nearest step
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void SetStorage(EHeightfieldStorage storage);
+	UFUNCTION(BlueprintPure, Category = "Heightfield")
+	EHeightfieldStorage GetStorage() const { return m_Storage; }
+	UFUNCTION(BlueprintPure, Category = "Heightfield")
+	bool IsQuantized() const { return m_Storage == EHeightfieldStorage::UInt16; }
+
+	// shows the heightfield texture on the mesh material, the texture gets updated first
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void VisualizeOnMesh(UPrimitiveComponent* mesh);
+
+	// Uploads all heights to the single channel texture of the heightfield, the texture gets created or recreated when
+	// the size or format changed
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	UTexture2D* UpdateTexture();
+
+	// uploads the heights of a rectangle, only the texels within it get converted and sent to the gpu
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void UpdateTextureRegion(int32 x, int32 y, int32 width, int32 height);
+
+	// Same as UpdateTextureRegion but the conversion runs on the thread pool, the heights of the region get copied
+	// first. A newer async update cancels the one still converting. Regions whose heights changed while converting get
+	// converted again from the current heights, a resize or a new format drops the texels.
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void UpdateTextureRegionAsync(int32 x, int32 y, int32 width, int32 height);
+
+	// uploads the heights of every region, the regions are converted in one go
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void UpdateTextureRegions(const TArray<FHeightfieldRegion>& regions);
+	// same as UpdateTextureRegions with the conversion on the thread pool, one task converts every region
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void UpdateTextureRegionsAsync(const TArray<FHeightfieldRegion>& regions);
+
+	// Called after the heights of the regions changed, e.g. with the dirty regions of an erosion. An existing texture
+	// only gets the regions uploaded and the listeners of OnRegionsChanged rebuild only what uses them.
+	UFUNCTION(BlueprintCallable, Category = "Heightfield")
+	void NotifyRegionsChanged(const TArray<FHeightfieldRegion>& regions, bool bAsyncTextureUpdate = false);
+	FOnHeightfieldRegionsChanged& OnRegionsChanged() { return m_OnRegionsChanged; }
+
+	UFUNCTION(BlueprintPure, Category = "Heightfield")
+	UTexture2D* GetTexture() const { return m_Texture; }
+
+	// views used by the terrain core to work on the heights in place, only the views of the current storage are
+	// valid, the others are empty
+	TerrainCore::HeightfieldView GetView();
+	TerrainCore::ConstHeightfieldView GetView() const;
+	TerrainCore::QuantizedHeightfieldView GetQuantizedView();
+	TerrainCore::ConstQuantizedHeightfieldView GetQuantizedView() const;
+
+	// copies the heights into a float map, works with either storage
+	void CopyHeightsTo(TerrainCore::Heightfield& target) const;
+
+	// start of the heights in the current storage, changes when the heights get reallocated or the storage switches
+	const void* GetStorageData() const { return IsQuantized() ? static_cast<const void*>(m_QuantizedHeights.GetData()) : m_Heights.GetData(); }
+
+	// helper that creates a single channel R16 texture of a heightmap and applies it to the "Texture" parameter of the mesh
+	// material, the height is in the red channel
+	static void VisualizeHeightmap(TerrainCore::ConstHeightfieldView heightmap, UPrimitiveComponent* mesh);
+	// same as VisualizeHeightmap for texels converted beforehand
+	static void VisualizeTexels(const FHeightTexels& texels, UPrimitiveComponent* mesh);
+
+	// converts a region of the heights, thread safe as long as nothing writes to the heights meanwhile
+	static FHeightTexels ConvertHeightmap(TerrainCore::ConstHeightfieldView heightmap, TerrainCore::HeightTextureRegion region, EHeightTextureFormat format);
+	static FHeightTexels ConvertHeightmap(TerrainCore::ConstQuantizedHeightfieldView heightmap, TerrainCore::HeightTextureRegion region, EHeightTextureFormat format);
+
+	// merged rectangles of the dirty tiles of an erosion
+	static TArray<FHeightfieldRegion> MakeRegions(const TerrainCore::DirtyTileMask& dirtyTiles);
+
+protected:
+	UPROPERTY(VisibleAnywhere, Category = "Heightfield")
+	int32 m_Width{ 0 };
+	UPROPERTY(VisibleAnywhere, Category = "Heightfield")
+	int32 m_Height{ 0 };
+	UPROPERTY()
+	TArray<float> m_Heights;
+	// heights of UInt16 storage, only one of the arrays is in use
+	UPROPERTY()
+	TArray<uint16> m_QuantizedHeights;
+	UPROPERTY(VisibleAnywhere, Category = "Heightfield")
+	EHeightfieldStorage m_Storage{ EHeightfieldStorage::Float };
+
+	// format used by UpdateTexture, changing it recreates the texture on the next update
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Heightfield")
+	EHeightTextureFormat m_TextureFormat{ EHeightTextureFormat::R16 };
+
+private:
+	// creates the texture if it doesn't match the heightfield, returns false if there is nothing to upload
+	bool PrepareTexture();
+	// converts a region of the heights of either storage
+	FHeightTexels ConvertRegion(TerrainCore::HeightTextureRegion region, EHeightTextureFormat format) const;
+	// sends converted texels to the texture, the texels are freed by the render thread
+	void UploadTexels(FHeightTexels texels);
+
+	UPROPERTY(Transient)
+	UTexture2D* m_Texture{ nullptr };
+
+	// async texture update that is converting
+	FTerrainTaskControlPtr m_AsyncTextureUpdate;
+	// Grows whenever the heights were set, resized, reported as changed or uploaded, async texture updates compare it
+	// with the revision of their copy so they never upload heights older than the texture has
+	uint32 m_HeightsRevision{ 0 };
+
+	FOnHeightfieldRegionsChanged m_OnRegionsChanged;
+};
@@ -0,0 +1,183 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainLodMesh.h"
+#include "GameFramework/Actor.h"
+
+// Sets default values for this component's properties
+UTerrainLodMesh::UTerrainLodMesh()
+{
+	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
+	// off to improve performance if you don't need them.
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+
+// Called when the game starts
+void UTerrainLodMesh::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (!m_pProceduralMeshComponent)
+		m_pProceduralMeshComponent = GetOwner()->FindComponentByClass<UProceduralMeshComponent>();
+	BindHeightfield();
+}
+
+void UTerrainLodMesh::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UnbindHeightfield();
+	Super::EndPlay(EndPlayReason);
+}
+
+
+// Called every frame
+void UTerrainLodMesh::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	UpdateSections();
+}
+
+void UTerrainLodMesh::SetHeightfield(UTerrainHeightfield* heightfield)
+{
+	m_Heightfield = heightfield;
+	BindHeightfield();
+	if (m_Builder)
+		m_Builder->MarkAllDirty();
+}
+
+void UTerrainLodMesh::MarkRegionDirty(int32 x, int32 y, int32 width, int32 height)
+{
+	if (m_Builder)
+		m_Builder->MarkDirty(x, y, width, height);
+}
+
+void UTerrainLodMesh::RebuildMesh()
+{
+	m_Builder.reset();
+	m_UploadedVertexCounts.Reset();
+	if (m_pProceduralMeshComponent)
+		m_pProceduralMeshComponent->ClearAllMeshSections();
+	UpdateSections();
+}
+
+int32 UTerrainLodMesh::GetSectionCount() const
+{
+	return m_Builder ? m_Builder->GetSectionCount() : 0;
+}
+
+void UTerrainLodMesh::UpdateSections()
+{
+	// the heightfield property can be set from blueprint without SetHeightfield
+	if (m_BoundHeightfield.Get() != m_Heightfield)
+		BindHeightfield();
+	if (!m_Heightfield || !m_pProceduralMeshComponent || m_Heightfield->GetWidth() < 2 || m_Heightfield->GetHeight() < 2)
+		return;
+
+	if (!m_Builder)
+	{
+		TerrainCore::TerrainMeshSettings settings;
+		settings.SectionSize = m_SectionSize;
+		settings.LodCount = m_LodCount;
+		settings.LodDistance = m_LodDistance / m_CellSize;
+		settings.CellSize = m_CellSize;
+		settings.HeightScale = m_HeightScale;
+		settings.SkirtDepth = m_SkirtDepth;
+		m_Builder = std::make_unique<TerrainCore::TerrainMeshBuilder>(settings);
+	}
+
+	// viewer positions in sample space
+	std::vector<TerrainCore::MeshViewer> viewers;
+	auto addViewer = [this, &viewers](const AActor* actor)
+	{
+		if (!actor)
+			return;
+		FVector location = m_pProceduralMeshComponent->GetComponentTransform().InverseTransformPosition(actor->GetActorLocation());
+		viewers.push_back({ static_cast<float>(location.X / m_CellSize), static_cast<float>(location.Y / m_CellSize) });
+	};
+	for (const AActor* viewer : m_Viewers)
+		addViewer(viewer);
+	if (m_Viewers.Num() == 0)
+		addViewer(GetOwner());
+
+	// A new map size moves every section, an index can end up on a section of another shape with the same vertex
+	// count and sections past the new count would stay visible. The mesh starts over instead
+	if (m_Builder->GetWidth() != m_Heightfield->GetWidth() || m_Builder->GetHeight() != m_Heightfield->GetHeight())
+	{
+		m_UploadedVertexCounts.Reset();
+		m_pProceduralMeshComponent->ClearAllMeshSections();
+		m_Builder->Resize(m_Heightfield->GetWidth(), m_Heightfield->GetHeight());
+	}
+	m_Builder->UpdateLods(viewers);
+	if (!m_Builder->HasDirtySections())
+		return;
+
+	// quantized heights get dequantized for the build, float heights are read in place
+	TerrainCore::Heightfield dequantized;
+	TerrainCore::ConstHeightfieldView heights = m_Heightfield->GetView();
+	if (m_Heightfield->IsQuantized())
+	{
+		m_Heightfield->CopyHeightsTo(dequantized);
+		heights = dequantized.GetView();
+	}
+	UploadSections(m_Builder->BuildDirtySections(heights));
+}
+
+void UTerrainLodMesh::UploadSections(const std::vector<int>& sections)
+{
+	m_UploadedVertexCounts.SetNumZeroed(m_Builder->GetSectionCount());
+
+	TArray<FVector> vertices;
+	TArray<int32> triangles;
+	TArray<FVector> normals;
+	TArray<FVector2D> uvs;
+	for (int index : sections)
+	{
+		const auto& section = m_Builder->GetSection(index);
+		int32 vertexCount = static_cast<int32>(section.Vertices.size());
+		vertices.SetNumUninitialized(vertexCount);
+		normals.SetNumUninitialized(vertexCount);
+		uvs.SetNumUninitialized(vertexCount);
+		for (int32 i = 0; i < vertexCount; ++i)
+		{
+			const auto& vertex = section.Vertices[i];
+			vertices[i] = FVector(vertex.X, vertex.Y, vertex.Z);
+			normals[i] = FVector(vertex.NormalX, vertex.NormalY, vertex.NormalZ);
+			uvs[i] = FVector2D(vertex.U, vertex.V);
+		}
+
+		// the same vertex count means the same detail level and triangles, only the vertices get sent again
+		if (m_UploadedVertexCounts[index] == vertexCount)
+		{
+			m_pProceduralMeshComponent->UpdateMeshSection(index, vertices, normals, uvs, TArray<FColor>(), TArray<FProcMeshTangent>());
+			continue;
+		}
+
+		triangles = TArray<int32>(section.Indices.data(), static_cast<int32>(section.Indices.size()));
+		m_pProceduralMeshComponent->CreateMeshSection(index, vertices, triangles, normals, uvs, TArray<FColor>(), TArray<FProcMeshTangent>(), m_bCreateCollision);
+		m_UploadedVertexCounts[index] = vertexCount;
+	}
+}
+
+void UTerrainLodMesh::BindHeightfield()
+{
+	UnbindHeightfield();
+	if (!m_Heightfield)
+		return;
+	m_RegionsChangedHandle = m_Heightfield->OnRegionsChanged().AddUObject(this, &UTerrainLodMesh::OnHeightfieldRegionsChanged);
+	m_BoundHeightfield = m_Heightfield;
+}
+
+void UTerrainLodMesh::UnbindHeightfield()
+{
+	if (m_BoundHeightfield.IsValid())
+		m_BoundHeightfield->OnRegionsChanged().Remove(m_RegionsChangedHandle);
+	m_BoundHeightfield.Reset();
+	m_RegionsChangedHandle.Reset();
+}
+
+void UTerrainLodMesh::OnHeightfieldRegionsChanged(const TArray<FHeightfieldRegion>& regions)
+{
+	for (const FHeightfieldRegion& region : regions)
+		MarkRegionDirty(region.X, region.Y, region.Width, region.Height);
+}
@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "ProceduralMeshComponent.h"
+#include "../Terrain Core/TerrainMesh.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
+#include <memory>
+#include "TerrainLodMesh.generated.h"
+
+// Shows a heightfield as chunked mesh sections on a procedural mesh. Sections far from the viewers get less detail and
+// only sections whose heights or detail changed get rebuilt, the sections are built on every core
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class PROCEDURALTERRAIN_API UTerrainLodMesh : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:	
+	// Sets default values for this component's properties
+	UTerrainLodMesh();
+
+protected:
+	// Called when the game starts
+	virtual void BeginPlay() override;
+	// stops listening to the heightfield
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// mesh the sections get created on, the procedural mesh of the owner is used when empty
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Procedural Mesh")
+	UProceduralMeshComponent* m_pProceduralMeshComponent;
+	// heightfield that gets shown
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Procedural Mesh")
+	UTerrainHeightfield* m_Heightfield{ nullptr };
+	// actors the detail levels are picked for, the owner is used when empty
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Procedural Mesh")
+	TArray<AActor*> m_Viewers;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Procedural Mesh")
+	bool m_bCreateCollision{ false };
+
+	// world units between two samples and of a height of 1
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Mesh settings", meta = (ClampMin = "0.001"))
+	float m_CellSize{ 100.f };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Mesh settings")
+	float m_HeightScale{ 10000.f };
+	// quads per section edge at full detail, rounded up to a power of 2
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Mesh settings", meta = (ClampMin = "2"))
+	int m_SectionSize{ 64 };
+	// every detail level halves the vertices per section edge
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Mesh settings", meta = (ClampMin = "1"))
+	int m_LodCount{ 4 };
+	// world distance up to which sections keep full detail, the range of every further level doubles
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Mesh settings", meta = (ClampMin = "0"))
+	float m_LodDistance{ 12800.f };
+	// how far the skirts reach below the section edges, they hide the cracks between sections of different detail
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Mesh settings", meta = (ClampMin = "0"))
+	float m_SkirtDepth{ 200.f };
+
+public:	
+	// Called every frame
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// shows another heightfield, every section gets rebuilt. Regions passed to NotifyRegionsChanged of the heightfield
+	// mark their sections dirty
+	UFUNCTION(BlueprintCallable, Category = "Terrain Mesh")
+	void SetHeightfield(UTerrainHeightfield* heightfield);
+
+	// rebuilds the sections using heights of a rectangle on the next tick, called after the heights changed
+	UFUNCTION(BlueprintCallable, Category = "Terrain Mesh")
+	void MarkRegionDirty(int32 x, int32 y, int32 width, int32 height);
+
+	// recreates every section with the current settings right away
+	UFUNCTION(BlueprintCallable, Category = "Terrain Mesh")
+	void RebuildMesh();
+
+	UFUNCTION(BlueprintPure, Category = "Terrain Mesh")
+	int32 GetSectionCount() const;
+
+private:
+	// picks the detail levels for the viewers and rebuilds the sections that changed
+	void UpdateSections();
+	// sends built sections to the procedural mesh
+	void UploadSections(const std::vector<int>& sections);
+	// listens to the changed regions of the shown heightfield
+	void BindHeightfield();
+	void UnbindHeightfield();
+	void OnHeightfieldRegionsChanged(const TArray<FHeightfieldRegion>& regions);
+
+	// engine independent sections, created on the first update with the settings of that moment. Only RebuildMesh
+	// recreates it, settings changed afterwards apply from the next RebuildMesh on
+	std::unique_ptr<TerrainCore::TerrainMeshBuilder> m_Builder;
+	// vertex count of every section on the mesh, sections keeping their count only get their vertices updated. Reset
+	// together with the mesh when the map size changes
+	TArray<int32> m_UploadedVertexCounts;
+
+	// heightfield the region listener is bound to, can differ from m_Heightfield after it got set from blueprint
+	TWeakObjectPtr<UTerrainHeightfield> m_BoundHeightfield;
+	FDelegateHandle m_RegionsChangedHandle;
+};
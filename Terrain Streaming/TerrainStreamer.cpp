@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainStreamer.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
+#include "GameFramework/Actor.h"
+
+// the engine enums are ordered for the editor, the core enums get mapped by name
+static TerrainCore::NoiseBasis ToNoiseBasis(ETerrainNoiseBasis basis)
+{
+	switch (basis)
+	{
+	case ETerrainNoiseBasis::Perlin: return TerrainCore::NoiseBasis::Perlin;
+	case ETerrainNoiseBasis::Value: return TerrainCore::NoiseBasis::Value;
+	default: return TerrainCore::NoiseBasis::Simplex;
+	}
+}
+
+static TerrainCore::FractalNoiseType ToFractalNoiseType(ETerrainFractalType type)
+{
+	switch (type)
+	{
+	case ETerrainFractalType::Ridged: return TerrainCore::FractalNoiseType::Ridged;
+	case ETerrainFractalType::Billow: return TerrainCore::FractalNoiseType::Billow;
+	default: return TerrainCore::FractalNoiseType::Fbm;
+	}
+}
+
+// Sets default values for this component's properties
+UTerrainStreamer::UTerrainStreamer()
+{
+	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
+	// off to improve performance if you don't need them.
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+
+// Called when the game starts
+void UTerrainStreamer::BeginPlay()
+{
+	Super::BeginPlay();
+
+	RestartStreaming();
+}
+
+void UTerrainStreamer::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	m_Streamer.reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+
+// Called every frame
+void UTerrainStreamer::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (!m_Streamer)
+		return;
+
+	// viewer positions and velocities in sample space
+	std::vector<TerrainCore::ChunkViewer> viewers;
+	auto addViewer = [this, &viewers](const AActor* actor)
+	{
+		if (!actor)
+			return;
+		FVector location = actor->GetActorLocation() - GetOwner()->GetActorLocation();
+		FVector velocity = actor->GetVelocity();
+		TerrainCore::ChunkViewer viewer;
+		viewer.X = location.X / m_CellSize;
+		viewer.Y = location.Y / m_CellSize;
+		viewer.VelocityX = velocity.X / m_CellSize;
+		viewer.VelocityY = velocity.Y / m_CellSize;
+		viewers.push_back(viewer);
+	};
+	for (const AActor* viewer : m_Viewers)
+		addViewer(viewer);
+	if (m_Viewers.Num() == 0)
+		addViewer(GetOwner());
+	m_Streamer->UpdateViewers(viewers);
+
+	// chunks finished on the background thread get announced on the game thread
+	for (const auto& coord : m_Streamer->TakeReadyChunks())
+		OnChunkReady.Broadcast(coord.X, coord.Y);
+}
+
+void UTerrainStreamer::RestartStreaming()
+{
+	// the old streamer finishes its current chunk before the new one starts
+	m_Streamer.reset();
+
+	TerrainCore::ChunkStreamingSettings settings;
+	settings.ChunkSize = m_ChunkSize;
+	settings.ViewRadius = m_ViewRadius;
+	settings.PrefetchChunks = m_PrefetchChunks;
+	settings.CacheCapacity = m_CacheCapacity;
+	settings.Noise.Basis = ToNoiseBasis(m_Basis);
+	settings.Noise.Type = ToFractalNoiseType(m_FractalType);
+	settings.Noise.OffsetX = m_Offset.X;
+	settings.Noise.OffsetY = m_Offset.Y;
+	settings.Noise.Scale = m_Scale;
+	settings.Noise.Octaves = m_Octaves;
+	settings.Noise.Persistance = m_Persistance;
+	settings.Noise.Lacunarity = m_Lacunarity;
+	settings.Noise.Seed = static_cast<uint32>(m_Seed);
+	m_Streamer = std::make_unique<TerrainCore::TerrainChunkStreamer>(settings);
+}
+
+bool UTerrainStreamer::GetChunkHeights(int32 chunkX, int32 chunkY, TArray<float>& heights)
+{
+	auto chunk = m_Streamer ? m_Streamer->FindChunk({ chunkX, chunkY }) : nullptr;
+	if (!chunk)
+		return false;
+
+	heights = TArray<float>(chunk->Heights.GetData(), static_cast<int32>(chunk->Heights.GetSize()));
+	return true;
+}
+
+void UTerrainStreamer::LoadChunkInto(int32 chunkX, int32 chunkY, UTerrainHeightfield* heightfield)
+{
+	if (!m_Streamer || !heightfield)
+		return;
+
+	auto chunk = m_Streamer->GetChunk({ chunkX, chunkY });
+	int32 size = chunk->Heights.GetWidth();
+	heightfield->SetHeights(size, size, TArray<float>(chunk->Heights.GetData(), static_cast<int32>(chunk->Heights.GetSize())));
+}
+
+bool UTerrainStreamer::IsChunkResident(int32 chunkX, int32 chunkY) const
+{
+	return m_Streamer && m_Streamer->IsChunkResident({ chunkX, chunkY });
+}
+
+void UTerrainStreamer::GetChunkAtLocation(FVector location, int32& chunkX, int32& chunkY) const
+{
+	chunkX = 0;
+	chunkY = 0;
+	if (!m_Streamer)
+		return;
+
+	FVector localLocation = location - GetOwner()->GetActorLocation();
+	auto coord = m_Streamer->GetChunkAt(localLocation.X / m_CellSize, localLocation.Y / m_CellSize);
+	chunkX = coord.X;
+	chunkY = coord.Y;
+}
+
+int32 UTerrainStreamer::GetResidentChunkCount() const
+{
+	return m_Streamer ? m_Streamer->GetResidentChunkCount() : 0;
+}
@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "../Terrain Core/ChunkStreaming.h"
+#include <memory>
+#include "TerrainStreamer.generated.h"
+
+//noise function used for the streamed world
+UENUM(BlueprintType)
+enum class ETerrainNoiseBasis : uint8
+{
+	Simplex,
+	Perlin,
+	Value,
+};
+
+// shape of the octaves of the streamed world
+UENUM(BlueprintType)
+enum class ETerrainFractalType : uint8
+{
+	Fbm,
+	Ridged,
+	Billow,
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnTerrainChunkReady, int32, ChunkX, int32, ChunkY);
+
+class UTerrainHeightfield;
+
+// Streams noise chunks around the viewers, chunks get generated on a background thread and the least recently used
+// chunks get evicted once the cache is full, so memory stays flat while the viewers roam
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class PROCEDURALTERRAIN_API UTerrainStreamer : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:	
+	// Sets default values for this component's properties
+	UTerrainStreamer();
+
+protected:
+	// Called when the game starts
+	virtual void BeginPlay() override;
+	// stops the background generation
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// actors chunks get streamed around, the owner is used when empty
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Streaming settings")
+	TArray<AActor*> m_Viewers;
+	// world units between two samples
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Streaming settings", meta = (ClampMin = "0.001"))
+	float m_CellSize{ 100.f };
+	// samples per chunk edge, neighboring chunks share their edge samples
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Streaming settings", meta = (ClampMin = "2"))
+	int m_ChunkSize{ 129 };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Streaming settings", meta = (ClampMin = "0"))
+	int m_ViewRadius{ 2 };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Streaming settings", meta = (ClampMin = "0"))
+	int m_PrefetchChunks{ 2 };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Streaming settings", meta = (ClampMin = "1"))
+	int m_CacheCapacity{ 64 };
+
+	//Values used for Fractal brownian motion
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings")
+	ETerrainNoiseBasis m_Basis{ ETerrainNoiseBasis::Simplex };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings")
+	ETerrainFractalType m_FractalType{ ETerrainFractalType::Fbm };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings")
+	FVector2D m_Offset{ 0.f, 0.f };
+	// noise scale of one chunk
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings")
+	float m_Scale{ 1.f };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings")
+	int m_Octaves{ 6 };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings")
+	float m_Persistance{ .5f };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings")
+	float m_Lacunarity{ 2.f };
+	// seed of the noise permutation, every seed gives its own world and 0 the classic one
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise settings", meta = (ClampMin = "0"))
+	int m_Seed{ 0 };
+
+public:	
+	// Called every frame
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// called on the game thread for every chunk that finished generating
+	UPROPERTY(BlueprintAssignable, Category = "Streaming")
+	FOnTerrainChunkReady OnChunkReady;
+
+	// restarts streaming with the current settings, resident chunks get dropped
+	UFUNCTION(BlueprintCallable, Category = "Streaming")
+	void RestartStreaming();
+
+	// copies the heights of a resident chunk, returns false if the chunk isn't generated yet
+	UFUNCTION(BlueprintCallable, Category = "Streaming")
+	bool GetChunkHeights(int32 chunkX, int32 chunkY, TArray<float>& heights);
+
+	// copies a chunk into a shared heightfield, generates it right away if it isn't resident
+	UFUNCTION(BlueprintCallable, Category = "Streaming")
+	void LoadChunkInto(int32 chunkX, int32 chunkY, UTerrainHeightfield* heightfield);
+
+	UFUNCTION(BlueprintPure, Category = "Streaming")
+	bool IsChunkResident(int32 chunkX, int32 chunkY) const;
+
+	// chunk that contains a world location
+	UFUNCTION(BlueprintPure, Category = "Streaming")
+	void GetChunkAtLocation(FVector location, int32& chunkX, int32& chunkY) const;
+
+	UFUNCTION(BlueprintPure, Category = "Streaming")
+	int32 GetResidentChunkCount() const;
+
+private:
+	// engine independent streaming, owns the background thread
+	std::unique_ptr<TerrainCore::TerrainChunkStreamer> m_Streamer;
+};
@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainTraceLibrary.h"
+#include "../Terrain Core/TerrainTrace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+#if CPUPROFILERTRACE_ENABLED
+// the phases of the terrain core become cpu events in Unreal Insights, on whatever thread they run
+static void BeginTerrainTraceScope(const char* name)
+{
+	FCpuProfilerTrace::OutputBeginDynamicEvent(name);
+}
+
+static void EndTerrainTraceScope()
+{
+	FCpuProfilerTrace::OutputEndEvent();
+}
+
+// hooks get installed once the module is loaded
+static struct FTerrainTraceHooksRegistration
+{
+	FTerrainTraceHooksRegistration()
+	{
+		TerrainCore::SetTraceHooks({ &BeginTerrainTraceScope, &EndTerrainTraceScope });
+	}
+} GTerrainTraceHooksRegistration;
+#endif
+
+void UTerrainTraceLibrary::StartTerrainTraceRecording()
+{
+	TerrainCore::StartTraceRecording();
+}
+
+bool UTerrainTraceLibrary::StopTerrainTraceRecording(const FString& path)
+{
+	std::vector<TerrainCore::TraceEvent> events = TerrainCore::StopTraceRecording();
+	if (path.IsEmpty())
+		return true;
+
+	std::string filePath = TCHAR_TO_UTF8(*path);
+	if (path.EndsWith(TEXT(".json")))
+		return TerrainCore::WriteTraceJson(filePath, events);
+	return TerrainCore::WriteTraceCsv(filePath, events);
+}
+
+bool UTerrainTraceLibrary::IsTerrainTraceRecording()
+{
+	return TerrainCore::IsTraceRecording();
+}
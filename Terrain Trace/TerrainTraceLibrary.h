@@ -0,0 +1,28 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "TerrainTraceLibrary.generated.h"
+
+// Blueprint access to the phase markers of the terrain core. The markers always show up in Unreal Insights as cpu
+// events, recording also keeps them for a csv or json dump like the batch tool writes
+UCLASS()
+class PROCEDURALTERRAIN_API UTerrainTraceLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	// starts a new recording of the phases of every generation, erosion and texture upload
+	UFUNCTION(BlueprintCallable, Category = "Terrain Trace")
+	static void StartTerrainTraceRecording();
+
+	// Stops the recording and writes its phases to the file, files ending in .json get the chrome trace format and the
+	// others csv. An empty path drops the recording, returns false if the file couldn't be written
+	UFUNCTION(BlueprintCallable, Category = "Terrain Trace")
+	static bool StopTerrainTraceRecording(const FString& path);
+
+	UFUNCTION(BlueprintPure, Category = "Terrain Trace")
+	static bool IsTerrainTraceRecording();
+};
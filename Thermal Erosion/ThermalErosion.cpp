@@ -2,6 +2,7 @@
 
 
 #include "ThermalErosion.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
 #include "GameFramework/Actor.h"
 
 // Sets default values for this component's properties
@@ -22,107 +23,201 @@ void UThermalErosion::BeginPlay()
 	
 }
 
+void UThermalErosion::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CancelAsyncErosion();
+	m_ProgressiveHeightfield.Reset();
+	Super::EndPlay(EndPlayReason);
+}
+
 
 // Called every frame
 void UThermalErosion::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	// ...
+	if (!m_ProgressiveHeightfield.IsValid())
+		return;
+
+	// the core keeps a view of the heights, it must not run on heights that moved or changed their size
+	UTerrainHeightfield* heightfield = m_ProgressiveHeightfield.Get();
+	if (heightfield->GetStorageData() != m_ProgressiveData || FIntPoint(heightfield->GetWidth(), heightfield->GetHeight()) != m_ProgressiveSize)
+	{
+		m_ProgressiveHeightfield.Reset();
+		return;
+	}
+
+	bool bFinished = m_ThermalErosion.AdvanceProgressive(m_FrameBudget);
+	m_TimeSincePublish += DeltaTime;
+	if (bFinished || m_TimeSincePublish >= m_PublishInterval)
+		PublishProgressiveErosion();
+	if (bFinished)
+	{
+		m_ProgressiveHeightfield.Reset();
+		OnProgressiveErosionFinished.Broadcast();
+	}
 }
 
-TArray<float> UThermalErosion::ErodeTerrain(TArray<float> HeightmapData)
+TArray<float> UThermalErosion::ErodeTerrain(const TArray<float>& HeightmapData)
 {
 	// calculate width/height of map
 	int heightmapDimension = FMath::Sqrt(static_cast<float>(HeightmapData.Num()));
+	return ErodeTerrainWithSize(HeightmapData, heightmapDimension, heightmapDimension);
+}
 
-	// Used to calculate computational time
-	auto startTime = FPlatformTime::Cycles();
-
-	for (int a = 0; a < m_IterateAmount; ++a)
+TArray<float> UThermalErosion::ErodeTerrainWithSize(const TArray<float>& HeightmapData, int32 width, int32 height)
+{
+	if (width <= 0 || height <= 0 || static_cast<int64>(width) * height != HeightmapData.Num())
 	{
-		// updates heightmapdata variable
-		m_HeightmapData = HeightmapData;
-
-		// sorts terrain by height
-		auto sortedTerrain = terrainByHeight();
-
-		// loops through sorted terrain
-		for (int i = 0; i < sortedTerrain.Num(); ++i)
-		{
-			// gets index of current cell and gets lowest neighbor
-			int adjustedIdx = sortedTerrain[i];
-			int lowestNeighbor = getLowestNeighbor(adjustedIdx, heightmapDimension);
-
-			// escapes if lowestneighbor doesn't exist
-			if (lowestNeighbor == -1)
-				continue;
-
-			// calculates deltaheight
-			float heightDif = m_HeightmapData[adjustedIdx] - m_HeightmapData[lowestNeighbor];
-
-			// if the height difference is bigger than the max angle it erodes terrain
-			if (heightDif > m_MaxAngle)
-			{
-				float sedimentToMove = heightDif * 0.1f;
-				HeightmapData[adjustedIdx] -= sedimentToMove;
-				if (HeightmapData[adjustedIdx] < 0.f)
-					HeightmapData[adjustedIdx] = 0.f;
-				HeightmapData[lowestNeighbor] += sedimentToMove;
-				if (HeightmapData[lowestNeighbor] > 1.f)
-					HeightmapData[lowestNeighbor] = 1.f;
-			}
-		}
+		UE_LOG(LogTemp, Warning, TEXT("Thermal erosion got %d heights for a %d x %d map"), HeightmapData.Num(), width, height);
+		return HeightmapData;
 	}
-	// computational time gets measured and logged
-	auto compTime = FPlatformTime::Cycles() - startTime;
-	UE_LOG(LogTemp, Warning, TEXT("CompTime simplex noise: %f"), FPlatformTime::ToMilliseconds(compTime));
 
-	return HeightmapData;
+	// the result is the only copy, erosion runs in place on it
+	TArray<float> erodedHeightmap = HeightmapData;
+	Erode(TerrainCore::HeightfieldView(erodedHeightmap.GetData(), width, height));
+	return erodedHeightmap;
+}
+
+void UThermalErosion::ErodeHeightfield(UTerrainHeightfield* heightfield)
+{
+	if (!heightfield)
+		return;
+	if (heightfield->IsQuantized())
+		Erode(heightfield->GetQuantizedView());
+	else
+		Erode(heightfield->GetView());
+
+	heightfield->NotifyRegionsChanged(m_DirtyRegions);
+}
+
+TFuture<TTerrainTaskResult<TArray<float>>> UThermalErosion::ErodeTerrainAsync(TArray<float> HeightmapData, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished, FTerrainTaskControlPtr control)
+{
+	int heightmapDimension = FMath::Sqrt(static_cast<float>(HeightmapData.Num()));
+	return ErodeTerrainAsync(MoveTemp(HeightmapData), heightmapDimension, heightmapDimension, MoveTemp(onFinished), control);
 }
 
-int UThermalErosion::getLowestNeighbor(int currentIndex, int heightMapDimension)
+TFuture<TTerrainTaskResult<TArray<float>>> UThermalErosion::ErodeTerrainAsync(TArray<float> HeightmapData, int32 width, int32 height, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished, FTerrainTaskControlPtr control)
 {
-	// sets default idx
-	int idx = -1;
-	float LowestPoint = m_HeightmapData[currentIndex];
-	int idxToCheck = currentIndex + heightMapDimension - 1;
+	// a heightmap of another size comes back unchanged like in ErodeTerrainWithSize
+	if (width <= 0 || height <= 0 || static_cast<int64>(width) * height != HeightmapData.Num())
+		width = height = 0;
+
+	control = RestartTerrainTask(m_AsyncErosion, control);
+	auto settings = MakeSettings();
 
-	// initializes list with all neighboring indexes
-	TArray<int> indexesToCheck;
-	indexesToCheck.Add(idxToCheck + 1);
-	idxToCheck -= heightMapDimension;
-	indexesToCheck.Add(idxToCheck);
-	indexesToCheck.Add(idxToCheck + 2);
-	idxToCheck -= heightMapDimension;
-	indexesToCheck.Add(idxToCheck + 1);
-	for (auto currIdx : indexesToCheck)
+	// the worker owns the heights, the erosion happens in place on them
+	auto work = [settings, width, height, heights = MoveTemp(HeightmapData)](TerrainCore::TaskControl& taskControl) mutable
 	{
-		if (currIdx < 0 || currIdx >= m_HeightmapData.Num())
-			continue;
-		if (m_HeightmapData[currIdx] < LowestPoint)
-		{
-			idx = currIdx;
-			LowestPoint = m_HeightmapData[currIdx];
-		}
-	}
+		auto startTime = FPlatformTime::Cycles();
+		TerrainCore::ThermalErosion erosion;
+		erosion.ErodeTerrain(TerrainCore::HeightfieldView(heights.GetData(), width, height), settings, &taskControl);
+
+		auto compTime = FPlatformTime::Cycles() - startTime;
+		UE_LOG(LogTemp, Warning, TEXT("CompTime async Thermal erosion: %f, iterations: %d"), FPlatformTime::ToMilliseconds(compTime), erosion.GetIterationsRun());
+		return MoveTemp(heights);
+	};
+	return LaunchTerrainTask<TArray<float>>(control, MoveTemp(work), MoveTemp(onFinished));
+}
 
-	return idx;
+void UThermalErosion::CancelAsyncErosion()
+{
+	if (m_AsyncErosion)
+		m_AsyncErosion->Cancel();
 }
 
-bool UThermalErosion::HeightComparison(const int32& a, const int32& b) const {
-	return m_HeightmapData[a] < m_HeightmapData[b];
+float UThermalErosion::GetAsyncErosionProgress() const
+{
+	return m_AsyncErosion ? m_AsyncErosion->GetProgress() : 0.f;
+}
+
+FThermalErosionStats UThermalErosion::GetErosionStats() const
+{
+	const TerrainCore::ThermalErosionStats& coreStats = m_ThermalErosion.GetStats();
+	FThermalErosionStats stats;
+	stats.IterationsRun = static_cast<int32>(coreStats.SendingCellsPerIteration.size());
+	stats.SendingCellsPerIteration = TArray<int32>(coreStats.SendingCellsPerIteration.data(), static_cast<int32>(coreStats.SendingCellsPerIteration.size()));
+	stats.MovedMass = static_cast<float>(coreStats.MovedMass);
+	return stats;
+}
+
+void UThermalErosion::StartProgressiveErosion(UTerrainHeightfield* heightfield)
+{
+	StopProgressiveErosion();
+	if (!heightfield)
+		return;
+
+	auto settings = MakeSettings();
+	if (heightfield->IsQuantized())
+		m_ThermalErosion.BeginProgressive(heightfield->GetQuantizedView(), settings);
+	else
+		m_ThermalErosion.BeginProgressive(heightfield->GetView(), settings);
+	m_ProgressiveHeightfield = heightfield;
+	m_ProgressiveData = heightfield->GetStorageData();
+	m_ProgressiveSize = FIntPoint(heightfield->GetWidth(), heightfield->GetHeight());
+	m_TimeSincePublish = 0.f;
+}
+
+void UThermalErosion::StopProgressiveErosion()
+{
+	if (!m_ProgressiveHeightfield.IsValid())
+		return;
+
+	PublishProgressiveErosion();
+	m_ProgressiveHeightfield.Reset();
+}
+
+float UThermalErosion::GetProgressiveErosionProgress() const
+{
+	return m_ThermalErosion.GetProgressiveProgress();
 }
 
-TArray<int> UThermalErosion::terrainByHeight()
+void UThermalErosion::PublishProgressiveErosion()
 {
-	TArray<int> heightmapIndex;
-	heightmapIndex.Reserve(m_HeightmapData.Num());
-	for (size_t i = 0; i < m_HeightmapData.Num(); i++)
-		heightmapIndex.Add(i);
-	heightmapIndex.Sort([this](const int32& A, const int32& B) {
-		return HeightComparison(A, B);
-	});
-	return heightmapIndex;
+	m_TimeSincePublish = 0.f;
+	TArray<FHeightfieldRegion> regions = UTerrainHeightfield::MakeRegions(m_ThermalErosion.GetDirtyTiles());
+	m_ThermalErosion.ClearDirtyTiles();
+	if (regions.Num() > 0)
+		m_ProgressiveHeightfield->NotifyRegionsChanged(regions);
 }
 
+TerrainCore::ThermalErosionSettings UThermalErosion::MakeSettings() const
+{
+	// settings get forwarded to the terrain core
+	TerrainCore::ThermalErosionSettings settings;
+	settings.MaxAngle = m_MaxAngle;
+	settings.IterateAmount = m_IterateAmount;
+	switch (m_Mode)
+	{
+	case EThermalErosionMode::Jacobi:
+		settings.Mode = TerrainCore::ThermalErosionMode::Jacobi;
+		break;
+	case EThermalErosionMode::ActiveSet:
+		settings.Mode = TerrainCore::ThermalErosionMode::ActiveSet;
+		break;
+	default:
+		settings.Mode = TerrainCore::ThermalErosionMode::Sorted;
+		break;
+	}
+	settings.ThreadCount = m_ThreadCount;
+	settings.Tolerance = m_Tolerance;
+	return settings;
+}
+
+template<typename ViewType>
+void UThermalErosion::Erode(ViewType map)
+{
+	// the progressive erosion shares the core erosion
+	StopProgressiveErosion();
+	auto settings = MakeSettings();
+
+	// Used to calculate computational time
+	auto startTime = FPlatformTime::Cycles();
+	m_ThermalErosion.ErodeTerrain(map, settings);
+	m_DirtyRegions = UTerrainHeightfield::MakeRegions(m_ThermalErosion.GetDirtyTiles());
+
+	// computational time gets measured and logged
+	auto compTime = FPlatformTime::Cycles() - startTime;
+	UE_LOG(LogTemp, Warning, TEXT("CompTime Thermal erosion: %f"), FPlatformTime::ToMilliseconds(compTime));
+	UE_LOG(LogTemp, Warning, TEXT("Thermal erosion iterations: %d"), m_ThermalErosion.GetIterationsRun());
+}
@@ -4,8 +4,42 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "../Terrain Core/ThermalErosionKernel.h"
+#include "../Terrain Async/TerrainAsyncTask.h"
+#include "../Terrain Heightfield/TerrainHeightfield.h"
 #include "ThermalErosion.generated.h"
 
+//how the cells of an iteration get updated
+UENUM(BlueprintType)
+enum class EThermalErosionMode : uint8
+{
+	// cells are visited from low to high and move material right away
+	Sorted,
+	// all cells move material at once, runs with simd on every core
+	Jacobi,
+	// same as jacobi but only revisits cells near the last changes and stops once nothing moves
+	ActiveSet,
+};
+
+//counters of a thermal erosion run
+USTRUCT(BlueprintType)
+struct FThermalErosionStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 IterationsRun = 0;
+
+	// cells that sent material to a neighbor in every iteration, the active set mode only counts its active cells
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<int32> SendingCellsPerIteration;
+
+	// material moved between cells over all iterations
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float MovedMass = 0.f;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnThermalErosionFinished);
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class PROCEDURALTERRAIN_API UThermalErosion : public UActorComponent
@@ -19,24 +53,109 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	// cancels the async erosion that is still running and drops the progressive one
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings")
 	float m_MaxAngle{ .1f };
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings")
 	int m_IterateAmount{ 500 };
-	TArray<float> m_HeightmapData;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings")
+	EThermalErosionMode m_Mode{ EThermalErosionMode::Sorted };
+	// threads used by the jacobi and active set mode, 0 uses every core
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings", meta = (ClampMin = "0"))
+	int m_ThreadCount{ 0 };
+	// the active set mode stops once an iteration moves this much material or less
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion settings", meta = (ClampMin = "0"))
+	float m_Tolerance{ 0.f };
+	// milliseconds every tick of a progressive erosion may spend, at least one iteration runs per tick
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Progressive erosion", meta = (ClampMin = "0"))
+	float m_FrameBudget{ 4.f };
+	// seconds between updates of the heightfield while a progressive erosion runs, 0 updates it every tick
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Progressive erosion", meta = (ClampMin = "0"))
+	float m_PublishInterval{ .25f };
 public:	
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
-	// function used in blueprint to erode terrain
+	// function used in blueprint to erode terrain, the heightmap has to be square
 	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
-	TArray<float> ErodeTerrain(TArray<float> HeightmapData);
-
-	// helper function that gets lowest neighbor
-	int getLowestNeighbor(int currentIndex, int heightMapDimention);
-	// helper function that provides terrain sorted by height
-	TArray<int> terrainByHeight();
-	// helper function used by the sort function
-	bool HeightComparison(const int32& A, const int32& B) const;
+	TArray<float> ErodeTerrain(const TArray<float>& HeightmapData);
+
+	// ErodeTerrain for heightmaps of width x height samples stored row by row, a heightmap of another size is returned unchanged
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	TArray<float> ErodeTerrainWithSize(const TArray<float>& HeightmapData, int32 width, int32 height);
+
+	// function used in blueprint to erode a shared heightfield in place
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	void ErodeHeightfield(UTerrainHeightfield* heightfield);
+
+	// Regions the last ErodeTerrain or ErodeHeightfield changed, merged from tiles of 32x32 samples. ErodeHeightfield
+	// already passes them to NotifyRegionsChanged of the heightfield
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	TArray<FHeightfieldRegion> GetDirtyRegions() const { return m_DirtyRegions; }
+
+	// counters of the last ErodeTerrain or ErodeHeightfield, or of the running or last progressive erosion
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	FThermalErosionStats GetErosionStats() const;
+
+	// ErodeTerrain on a background thread with the settings at the time of the call. onFinished gets the eroded heights
+	// on the game thread, or null if the run got cancelled. Starting a new run cancels the one that is still running.
+	TFuture<TTerrainTaskResult<TArray<float>>> ErodeTerrainAsync(TArray<float> HeightmapData, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished = nullptr, FTerrainTaskControlPtr control = nullptr);
+	TFuture<TTerrainTaskResult<TArray<float>>> ErodeTerrainAsync(TArray<float> HeightmapData, int32 width, int32 height, TFunction<void(TTerrainTaskResult<TArray<float>>)> onFinished = nullptr, FTerrainTaskControlPtr control = nullptr);
+
+	// cancels the running async erosion, its eroded heights get discarded
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	void CancelAsyncErosion();
+
+	// progress of the last async erosion in the 0 1 range
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	float GetAsyncErosionProgress() const;
+
+	// Erodes the heightfield over the next ticks instead of all at once with the settings at the time of the call,
+	// every tick spends about the frame budget on it. The heightfield gets the changed regions every publish interval
+	// and at the end. A new run, ErodeTerrain, ErodeHeightfield or resizing the heightfield ends the running one
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	void StartProgressiveErosion(UTerrainHeightfield* heightfield);
+
+	// stops the progressive erosion, the heightfield keeps and gets the changes made so far
+	UFUNCTION(BlueprintCallable, Category = "Procedural Mesh")
+	void StopProgressiveErosion();
+
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	bool IsProgressiveErosionRunning() const { return m_ProgressiveHeightfield.IsValid(); }
+
+	// progress of the running or last progressive erosion in the 0 1 range
+	UFUNCTION(BlueprintPure, Category = "Procedural Mesh")
+	float GetProgressiveErosionProgress() const;
+
+	// called on the game thread once a progressive erosion finished all of its work
+	UPROPERTY(BlueprintAssignable, Category = "Procedural Mesh")
+	FOnThermalErosionFinished OnProgressiveErosionFinished;
+
+private:
+	// snapshot of the erosion settings for the terrain core
+	TerrainCore::ThermalErosionSettings MakeSettings() const;
+
+	// erodes a float or quantized map in place and logs the computational time
+	template<typename ViewType>
+	void Erode(ViewType map);
+
+	// engine independent erosion, keeps its buffers between calls
+	TerrainCore::ThermalErosion m_ThermalErosion;
+
+	// async erosion that is running, async runs use their own erosion instance
+	FTerrainTaskControlPtr m_AsyncErosion;
+
+	// changed regions of the last synchronous erosion
+	TArray<FHeightfieldRegion> m_DirtyRegions;
+
+	// hands the regions the progressive erosion changed since the last time to the heightfield
+	void PublishProgressiveErosion();
+
+	// heightfield of the running progressive erosion, its heights have to stay where they were at the start
+	TWeakObjectPtr<UTerrainHeightfield> m_ProgressiveHeightfield;
+	const void* m_ProgressiveData{ nullptr };
+	FIntPoint m_ProgressiveSize{ 0, 0 };
+	float m_TimeSincePublish{ 0.f };
 };